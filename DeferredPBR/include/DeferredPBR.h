@@ -3,6 +3,14 @@
 #include <VulkanApplicationBase.h>
 #include <VulkanGLTFModel.h>
 #include <VulkanRenderPass.h>
+#include <VulkanProfiler.h>
+#include <VulkanRenderGraph.h>
+#include <LightCluster.h>
+#include <VulkanShadowMap.h>
+#include <ShadowCascade.h>
+#include <ShadowAtlas.h>
+#include <VulkanStorageImage.h>
+#include <FrameBenchmark.h>
 
 #include <GloalVars.h>
 
@@ -24,11 +32,15 @@ public:
 
 protected:
     void ViewChanged() override;
+    void GetEnabledFeatures() override;
+    void GetEnabledExtensions() override;
 
 private:
 
     void UpdateUniformBuffers();
     void SetupDescriptorSets();
+    // declares the passes of a frame, rebuilt whenever a resource it imports is recreated
+    void SetupRenderGraph();
 
     void BakingIrradianceCubeMap();
     void BakingPreFilteringCubeMap();
@@ -36,22 +48,97 @@ private:
 
     // SSAO
     void PrepareSSAOGenData();
+    void SetupSSAOComputeTargets();
+    void StartSSAOComparison();
+
+    // temporal accumulation
+    void SetupShadowHistory();
+    void RecordShadowTemporal(VkCommandBuffer commandBuffer);
+    float HistoryWeight(bool historyValid) const;
+
+    // clustered lighting
+    void PrepareLightBuffers();
+    void UpdateLightBuffers();
+    // schedules the atlas tiles of the command buffer being recorded, once per frame
+    void UpdateShadowAtlas();
+    // the atlas tiles of the shadowed lights into the light and tile buffers
+    void WriteShadowAtlasTiles();
+    void GenerateBenchmarkLights(uint32_t lightCount);
+    void ValidateLightClusters();
+    void StartLightScalingBenchmark();
+
+    // cascaded shadow maps
+    void SetupCascadeShadowMap();
+    void UpdateShadowCascades();
+    void StartShadowCascadeBenchmark();
+
+    // spot and point light shadow atlas
+    void SetupShadowAtlas();
+
+    // frustum culling, times the batch test against one box at a time
+    void RunCullingBenchmark();
+    // times the build, refit and queries of a hierarchy over the culling benchmark boxes
+    void RunBVHBenchmark();
+    // flattened transform updates against walking the parent chain of every node, on a deep random tree
+    void RunTransformBenchmark();
+    // closest primitive under uv of the scene view, uv is 0 at its top left corner
+    void PickScene(const glm::vec2& uv);
+
+    // GPU driven rendering
+    void PrepareIndirectDrawBuffers();
+    void UpdateDrawCulling();
+    // the setting is on and the device draws several indirect commands per call
+    bool GpuDrivenRendering() const;
+    // GPU driven rendering with the camera's records also culled against the depth pyramid of the early draws
+    bool OcclusionCulling() const;
+    // rebuilds the depth pyramid at the size of the mrt depth
+    void SetupDepthPyramid();
+    // batches [firstBatch, firstBatch + batchCount) of a view, 0 the camera, 1 + i cascade i and
+    // LATE_CAMERA_VIEW the camera's records the late culling phase found
+    void DrawIndirectView(VkCommandBuffer commandBuffer, uint32_t view, uint32_t firstBatch, uint32_t batchCount,
+                          uint32_t renderFlags, VkPipelineLayout pipelineLayout);
+    // the camera's material batches of the views with one of the indirect mrt or G-buffer fill pipelines
+    void DrawSceneIndirect(VkCommandBuffer commandBuffer, VkPipeline pipeline, const std::vector<uint32_t>& views);
+    // the camera's primitives culled and drawn on the CPU, in scene or sorted draw list order
+    void DrawScene(VkCommandBuffer commandBuffer, VkPipeline pipeline);
+
+    // post processing
+    void SetupPostProcessTargets();
+    void PreparePostProcessBuffers();
+
+    // dynamic resolution
+    void UpdateRenderScale();
+    // size the scene is rendered at, the top left part of the targets
+    VkExtent2D RenderExtent() const;
+    // rendered fraction of the targets in each dimension
+    glm::vec2 RenderScale() const;
+    // part of a target of the given size covered by the rendered region, e.g. of a reduced resolution one
+    VkExtent2D RenderRegion(uint32_t width, uint32_t height) const;
+    void SetViewport(VkCommandBuffer commandBuffer, VkExtent2D extent) const;
+    // sub-pixel offset of the projection in normalized device coordinates, zero without temporal upscaling
+    glm::vec2 ProjectionJitter() const;
 
     void PrepareMrtPipeline();
     void PrepareSSAOPipeline();
     void PrepareSSAOBlurPipeline();
+    void PrepareSSAOComputePipelines();
     void PrepareShadowMapPipeline();
     void PrepareDirectionalShadowPipeline();
+    void PrepareShadowTemporalPipeline();
+    void PrepareLightCullingPipeline();
+    void PrepareDrawCullingPipeline();
+    void PrepareDepthPyramidPipeline();
     void PrepareLightingPipeline();
     void PrepareSkyboxPipeline();
-    void PreparePostprocessPipeline();
+    void PreparePostProcessPipelines();
 
     void SetupMrtRenderPass();
     void SetupSSAORenderPass();
     void SetupShadowRenderPass();
     void SetupLightingRenderPass();
-    void SetupSkyboxRenderPass();
-    void SetupPostprocessRenderPass();
+    void SetupDeferredRenderPass();
+    // creates the lighting render pass owning the scene color and, on the merged path, the deferred render pass
+    void SetupShadingRenderPasses();
 
     std::unique_ptr<vks::geometry::VulkanGLTFModel> gltfModel;
     std::unique_ptr<vks::geometry::VulkanGLTFModel> skybox;
@@ -63,6 +150,10 @@ private:
             float farPlane;
             glm::mat4 projection;
             glm::mat4 view;
+            // camera of the last rendered frame, for the G_Velocity motion vectors
+            glm::mat4 previousViewProjection;
+            // xy: projection jitter of this frame, zw: of the last frame, removed from the motion vectors
+            glm::vec4 jitter;
         } values;
     } mrtUBO;
 
@@ -72,10 +163,14 @@ private:
         struct Values{
             glm::mat4 view;
             glm::mat3 invViewT;
+            // camera projection onto the rendered region of the targets
             glm::mat4 projection;
+            glm::mat4 invProjection;
             std::array<glm::vec4, GlobalVars::SSAO_KERNEL_SIZE> kernel;
             float ssaoRadius;
             float ssaoBias;
+            // advances every frame while ssao is accumulated over time, 0 otherwise
+            int32_t temporalFrame;
         }values;
     } ssaoCreateUbo;
 
@@ -89,6 +184,43 @@ private:
         }values;
     } ssaoUbo;
 
+    // reduced resolution compute ssao, one set of targets per frame in flight
+    struct SsaoComputeTargets
+    {
+        // transient images of the render graph, only valid within a frame
+        // positive linear view space depth
+        vks::RenderGraphImage* depth = nullptr;
+        // view space normal
+        vks::RenderGraphImage* normal = nullptr;
+        // raw ssao, later the result of the vertical blur
+        vks::RenderGraphImage* occlusion = nullptr;
+        // result of the horizontal blur
+        vks::RenderGraphImage* blurred = nullptr;
+        // r: accumulated occlusion, g: its depth, the targets of the previous frame hold the history of this one
+        std::unique_ptr<vks::VulkanStorageImage> history;
+    };
+    std::vector<SsaoComputeTargets> ssaoComputeTargets;
+    // the previous frame wrote the history of the compute path
+    bool ssaoHistoryValid = false;
+    // quality tier changed, the targets and the ssao pipeline are rebuilt before the next frame
+    bool ssaoDirty = false;
+
+    // renders the fragment path and every compute tier of the same frame and compares their G_Occlusion
+    struct SsaoComparison
+    {
+        // step 0 is the full resolution fragment path, the reference of the compute tiers that follow
+        vks::FrameBenchmark run;
+        // restored when the comparison finishes
+        bool enabled = true;
+        bool compute = true;
+        int quality = 0;
+        bool paused = false;
+        // the next recorded frame copies G_Occlusion into readbackBuffer
+        bool readbackRequested = false;
+        vks::Buffer readbackBuffer;
+        std::vector<uint8_t> reference;
+    } ssaoComparison;
+
     struct ShadowUBO
     {
         vks::Buffer buffer;
@@ -98,22 +230,300 @@ private:
             float farPlane;
             glm::mat4 projection;
             glm::mat4 view;
-            glm::mat4 lightSpace;
-            glm::vec3 lightPosition;
+            std::array<glm::mat4, GlobalVars::MAX_SHADOW_CASCADE_COUNT> cascadeViewProjection;
+            // view space far distance of each cascade
+            glm::vec4 cascadeSplits;
+            // xyz: direction the light travels, w: cascade count
+            glm::vec4 lightDirection;
+            // x: filter radius in texels, y: penumbra texels per unit of light space depth, z: max radius in texels,
+            // w: disk rotation of this frame while the shadows are accumulated over time
+            glm::vec4 filterParams;
+            // inverse camera view projection, reconstructs world positions from depth at uvs of the targets
+            glm::mat4 invViewProjection;
         }values;
     } shadowUbo;
 
+    // directional light cascades, layers of cascadeShadowMap
+    std::unique_ptr<vks::VulkanShadowMap> cascadeShadowMap = nullptr;
+    std::vector<vks::ShadowCascade> shadowCascades;
+    std::array<math::Frustum, GlobalVars::MAX_SHADOW_CASCADE_COUNT> shadowCascadeFrustums;
+    // cascade count or resolution changed, the shadow map is recreated before the next frame
+    bool shadowMapDirty = false;
+    // filter quality tier changed, the resolve pipeline is rebuilt before the next frame
+    bool shadowFilterDirty = false;
+
+    // accumulated G_Shadow per frame in flight, r: shadow, g: its depth, read by the lighting pass
+    std::vector<std::unique_ptr<vks::VulkanStorageImage>> shadowHistory;
+    bool shadowHistoryValid = false;
+    // advances after every rendered frame, varies the samples of the accumulated effects
+    uint32_t temporalFrameIndex = 0;
+    // camera of the frame rendered last, with its projection jitter
+    glm::mat4 previousViewProjection{1.0f};
+    glm::vec2 previousJitter{0.0f};
+
+    // frustum of the G-buffer passes, the camera without the projection jitter
+    math::Frustum cameraFrustum;
+    struct SceneDrawStats
+    {
+        uint32_t drawCount = 0;
+        uint32_t culledCount = 0;
+        // CPU path, index 0 in scene order and 1 sorted, kept from the last frame drawn in each order
+        uint32_t bindCount[2] = {};
+        // smoothed time to cull, sort and record the draws
+        float recordTime[2] = {};
+        // GPU driven path, draws of the late occlusion culling phase
+        uint32_t lateDrawCount = 0;
+        // GPU time of the G-buffer draws, index 0 without and 1 with occlusion culling including the pyramid and
+        // the late phase, kept from the last frame in each mode
+        float mrtTime[2] = {};
+    } sceneDrawStats;
+
+    struct CullingBenchmark
+    {
+        uint32_t boxCount = 0;
+        // CPU time of a test of all boxes
+        float scalarTime = 0.0f;
+        float batchTime = 0.0f;
+        uint32_t visibleCount = 0;
+        // boxes the two tests disagree on
+        uint32_t mismatchCount = 0;
+    } cullingBenchmark;
+
+    struct BVHBenchmark
+    {
+        uint32_t boxCount = 0;
+        uint32_t nodeCount = 0;
+        uint32_t depth = 0;
+        // CPU times, the queries per query
+        float buildTime = 0.0f;
+        float refitTime = 0.0f;
+        uint32_t refitBoxCount = 0;
+        float frustumTime = 0.0f;
+        // the batch test of every box, for comparison
+        float linearFrustumTime = 0.0f;
+        float sphereTime = 0.0f;
+        float rayTime = 0.0f;
+        uint32_t rayHitCount = 0;
+        // boxes the hierarchy and the batch test disagree on
+        uint32_t mismatchCount = 0;
+    } bvhBenchmark;
+
+    struct TransformBenchmark
+    {
+        uint32_t nodeCount = 0;
+        uint32_t depth = 0;
+        // CPU times, the updates averaged over the runs
+        float walkTime = 0.0f;
+        float fullTime = 0.0f;
+        float dirtyTime = 0.0f;
+        // world matrices recomputed after a single node changed
+        uint32_t dirtyUpdateCount = 0;
+        // largest difference of a world matrix entry between the parent walk and the flattened update
+        float maxError = 0.0f;
+    } transformBenchmark;
+
+    // result of the last click into the scene view
+    struct ScenePick
+    {
+        bool hit = false;
+        vks::geometry::VulkanGLTFModel::RayHit rayHit;
+        float time = 0.0f;
+    } scenePick;
+
+    struct ShadowStats
+    {
+        std::array<uint32_t, GlobalVars::MAX_SHADOW_CASCADE_COUNT> drawCount{};
+        std::array<uint32_t, GlobalVars::MAX_SHADOW_CASCADE_COUNT> culledCount{};
+        // static caster draws served by the cache instead of being issued
+        std::array<uint32_t, GlobalVars::MAX_SHADOW_CASCADE_COUNT> skippedCount{};
+    } shadowStats;
+
+    // GPU driven rendering, drawCulling.comp culls the model's draw records for the camera and every cascade
+    struct DrawCullingUBO
+    {
+        vks::Buffer buffer;
+        struct Values
+        {
+            // world space planes of the camera, then of each cascade
+            alignas(16) glm::vec4 frustumPlanes[(1 + GlobalVars::MAX_SHADOW_CASCADE_COUNT) * 6];
+            // x: record count, y: view count, z: batch count, w: 1 with occlusion culling
+            alignas(16) glm::uvec4 counts;
+            // camera without the projection jitter
+            alignas(16) glm::mat4 viewProjection;
+            // xy: rendered size of the depth, z: level count of the depth pyramid
+            alignas(16) glm::uvec4 pyramid;
+        } values;
+    } drawCullingUbo;
+    // the commands and counts of the late camera draws follow the ones of the camera and the cascades
+    static constexpr uint32_t LATE_CAMERA_VIEW = 1 + GlobalVars::MAX_SHADOW_CASCADE_COUNT;
+    // record count indirect commands per view, the camera's first
+    vks::Buffer indirectCommandBuffer;
+    // draw count of every batch per view, host visible for the statistics
+    vks::Buffer indirectCountBuffer;
+    // one per record, 1 for the records the camera drew in the last frame, the early phase draws them
+    vks::Buffer drawVisibilityBuffer;
+    // mirrors OcclusionStats in drawCulling.comp, triangles of the camera's records in the last frame
+    struct OcclusionStats
+    {
+        uint32_t triangleCount;
+        uint32_t frustumCulledTriangles;
+        uint32_t occludedTriangles;
+        // drawn by the late phase, hidden in the last frame or newly in view
+        uint32_t lateTriangles;
+    };
+    vks::Buffer occlusionStatsBuffer;
+    // farthest depth of the early camera draws, level 0 at half the depth resolution, see depthPyramid.comp
+    std::unique_ptr<vks::VulkanStorageImage> depthPyramid = nullptr;
+    // work groups of the pyramid dispatch that finished their tile
+    vks::Buffer depthPyramidCounterBuffer;
+    // multiDrawIndirect and drawIndirectFirstInstance are available
+    bool gpuDrivenSupported = false;
+    // the depth pyramid shader indexes its array of level images
+    bool occlusionCullingSupported = false;
+    // VK_KHR_draw_indirect_count is enabled, the draws stop at the count of their batch
+    bool drawIndirectCountSupported = false;
+    PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR = nullptr;
+
+    // spot and point light shadows, tiles are allocated and scheduled by shadowAtlas
+    std::unique_ptr<vks::VulkanShadowMap> shadowAtlasMap = nullptr;
+    vks::ShadowAtlas shadowAtlas;
+    // host visible copy of shadowAtlas.GetTiles()
+    vks::Buffer shadowTileBuffer;
+    // world space lights passed to shadowAtlas this frame
+    std::vector<vks::ShadowAtlasLight> shadowAtlasLights;
+    uint32_t shadowAtlasDrawCount = 0;
+    // primitives in range of the light being rendered, and the ones of those inside the current tile
+    std::vector<uint8_t> shadowCasterVisibility;
+    std::vector<uint8_t> tileCasterVisibility;
+    // geometry shader and multiViewport are available, point lights render their six faces in one pass
+    bool singlePassPointShadowsSupported = false;
+
+    struct PointShadowStats
+    {
+        uint32_t lightCount = 0;
+        // index count of the cube passes, an upper bound of their vertex shader invocations
+        uint32_t vertexCount = 0;
+        // the same lights rendered as six culled passes, one per face, only counted while the performance view is open
+        uint32_t sixPassVertexCount = 0;
+    } pointShadowStats;
+
+    // static casters of each cascade, a layer is valid as long as its light matrix does not change
+    struct ShadowCache
+    {
+        std::array<glm::mat4, GlobalVars::MAX_SHADOW_CASCADE_COUNT> viewProjection;
+        std::array<bool, GlobalVars::MAX_SHADOW_CASCADE_COUNT> valid{};
+        std::array<uint32_t, GlobalVars::MAX_SHADOW_CASCADE_COUNT> staticDrawCount{};
+    } shadowCache;
+
+    struct ShadowCascadeBenchmark
+    {
+        // one cascade is the single shadow map reference, then every cascade count at the same resolution
+        vks::FrameBenchmark run;
+        // restored when the benchmark finishes
+        int cascadeCount = 0;
+    } shadowCascadeBenchmark;
+
     struct LightingUBO
     {
         vks::Buffer buffer;
         struct Values
         {
-            alignas(16) vks::geometry::Light lights[GlobalVars::LIGHT_COUNT];
             alignas(16) glm::vec4 viewPos;
             alignas(16) glm::mat4 viewMat;
+            // xyz: cluster grid size, w: light count
+            alignas(16) glm::uvec4 clusterGrid;
+            // x: near, y: far, z: slice scale, w: slice bias
+            alignas(16) glm::vec4 clusterDepth;
+            // inverse camera view projection, reconstructs world positions from depth at uvs of the targets
+            alignas(16) glm::mat4 invViewProjection;
+            // xy: fraction of the targets the scene is rendered into
+            alignas(16) glm::vec4 renderScale;
         } values;
     } lightingUbo;
 
+    struct LightCullingUBO
+    {
+        vks::Buffer buffer;
+        struct Values
+        {
+            alignas(16) glm::mat4 invProjection;
+            alignas(16) glm::uvec4 clusterGrid;
+            alignas(16) glm::vec4 clusterDepth;
+        } values;
+    } lightCullingUbo;
+
+    // clustered lighting storage buffers
+    vks::Buffer lightBuffer;
+    vks::Buffer clusterLightCountBuffer;
+    vks::Buffer clusterLightIndexBuffer;
+    vks::LightClusterGrid lightClusterGrid;
+    // view space lights uploaded this frame
+    std::vector<vks::ClusterLight> clusterLights;
+    // world space lights spawned for the light scaling benchmark
+    std::vector<vks::geometry::Light> benchmarkLights;
+
+    struct LightClusterStats
+    {
+        uint32_t lightCount = 0;
+        uint32_t maxLightsPerCluster = 0;
+        float averageLightsPerCluster = 0.0f;
+        float cpuBinningTime = 0.0f;
+        uint32_t validationMismatches = 0;
+        bool validated = false;
+        bool validateRequested = false;
+    } lightClusterStats;
+
+    struct LightScalingBenchmark
+    {
+        vks::FrameBenchmark run;
+        std::vector<uint32_t> lightCounts = {16, 64, 256, 1024, 4096, 8192};
+    } lightScalingBenchmark;
+
+    // exposure, bloom, tonemapping and color grading of the HDR scene color, one set of targets per frame in flight
+    struct PostProcessTargets
+    {
+        // transient images of the render graph, only valid within a frame
+        // half resolution and smaller, the first one holds the thresholded scene
+        std::array<vks::RenderGraphImage*, GlobalVars::BLOOM_LEVEL_COUNT> bloomDown{};
+        // bloomUp[i] has the size of bloomDown[i], bloomUp[0] is added to the scene
+        std::array<vks::RenderGraphImage*, GlobalVars::BLOOM_LEVEL_COUNT - 1> bloomUp{};
+        // sharpened temporal upscale, the scene color of the post process pass while upscaling
+        vks::RenderGraphImage* upscaled = nullptr;
+        // scene color accumulated at the output resolution, the targets of the previous frame hold the history of this one
+        std::unique_ptr<vks::VulkanStorageImage> upscaleHistory;
+        // tonemapped and graded, shown on UI after the frame
+        std::unique_ptr<vks::VulkanStorageImage> result;
+        VkDescriptorSet resultDescriptorSet = VK_NULL_HANDLE;
+    };
+    std::vector<PostProcessTargets> postProcessTargets;
+    // luminance histogram, cleared by the exposure pass after it is read
+    vks::Buffer luminanceHistogramBuffer;
+    // adapted average luminance and the exposure derived from it, kept across frames and read back for the UI
+    vks::Buffer exposureBuffer;
+
+    std::unique_ptr<vks::GpuProfiler> gpuProfiler = nullptr;
+
+    // the scene renders into the top left part of the targets, they keep the viewport size as the maximum
+    struct DynamicResolution
+    {
+        // fraction of the viewport size in each dimension
+        float scale = 1.0f;
+        // the smoothed GPU time needs a few frames to follow a change
+        uint32_t framesSinceChange = 0;
+    } dynamicResolution;
+
+    std::unique_ptr<vks::VulkanRenderGraph> renderGraph = nullptr;
+    // passes whose execution decides whether the next frame has a history
+    vks::RenderGraphPass ssaoTemporalPass = 0;
+    vks::RenderGraphPass shadowTemporalPass = 0;
+    vks::RenderGraphPass temporalUpscalePass = 0;
+    // the previous frame wrote the upscale history
+    bool upscaleHistoryValid = false;
+    // the UI windows showing the graph outputs were open in the last GUI frame
+    bool sceneViewVisible = true;
+    bool gBufferViewVisible = true;
+    bool performanceViewVisible = false;
+
     struct SkyboxUBO
     {
         vks::Buffer buffer;
@@ -125,23 +535,43 @@ private:
     } skyboxUbo;
 
     std::unique_ptr<vks::VulkanRenderPass> mrtRenderPass = nullptr;
+    // the attachments of mrtFrameBuffer loaded instead of cleared, for the late occlusion culling draws
+    std::unique_ptr<vks::VulkanRenderPass> mrtLoadRenderPass = nullptr;
     std::unique_ptr<vks::VulkanRenderPass> shadowRenderPass = nullptr;
     std::unique_ptr<vks::VulkanRenderPass> ssaoRenderPass = nullptr;
+    // lighting and the skybox into the HDR scene color, the merged path shares its scene color
     std::unique_ptr<vks::VulkanRenderPass> lightingRenderPass = nullptr;
-    std::unique_ptr<vks::VulkanRenderPass> skyboxRenderPass = nullptr;
-    std::unique_ptr<vks::VulkanRenderPass> postprocessRenderPass = nullptr;
+    // G-buffer fill and lighting with the skybox as subpasses of one render pass, GraphicSettings::subpassDeferred
+    std::unique_ptr<vks::VulkanRenderPass> deferredRenderPass = nullptr;
 
     std::unique_ptr<vks::VulkanFrameBuffer> mrtFrameBuffer = nullptr;
+    std::unique_ptr<vks::VulkanFrameBuffer> mrtLoadFrameBuffer = nullptr;
     std::unique_ptr<vks::VulkanFrameBuffer> shadowFrameBuffer = nullptr;
     std::unique_ptr<vks::VulkanFrameBuffer> ssaoFrameBuffer = nullptr;
     std::unique_ptr<vks::VulkanFrameBuffer> lightingFrameBuffer = nullptr;
-    std::unique_ptr<vks::VulkanFrameBuffer> skyboxFrameBuffer = nullptr;
-    std::unique_ptr<vks::VulkanFrameBuffer> postprocessFrameBuffer = nullptr;
+    std::unique_ptr<vks::VulkanFrameBuffer> deferredFrameBuffer = nullptr;
+    // the merged deferred path was toggled, render passes, descriptors and pipelines are rebuilt before the next frame
+    bool deferredPathDirty = false;
 
     VkDescriptorSetLayout mrtDescriptorSetLayout_Vertex = VK_NULL_HANDLE;
     VkDescriptorSetLayout mrtDescriptorSetLayout_Fragment = VK_NULL_HANDLE;
     VkPipelineLayout mrtPipelineLayout = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> mrtDescriptorSets_Vertex;
+    // the mrt sets and the draw data of the indirect draws
+    VkPipelineLayout mrtIndirectPipelineLayout = VK_NULL_HANDLE;
+
+    // records of the indirect draws and the objects and joint matrices of every draw,
+    // read by the mrt and shadow map vertex shaders
+    VkDescriptorSetLayout drawDataDescriptorSetLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> drawDataDescriptorSets;
+
+    VkDescriptorSetLayout drawCullingDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout drawCullingPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> drawCullingDescriptorSets;
+
+    VkDescriptorSetLayout depthPyramidDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout depthPyramidPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> depthPyramidDescriptorSets;
 
     VkDescriptorSetLayout ssaoDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout ssaoPipelineLayout = VK_NULL_HANDLE;
@@ -151,14 +581,49 @@ private:
     VkPipelineLayout ssaoBlurPipelineLayout = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> ssaoBlurDescriptorSets;
 
+    VkDescriptorSetLayout ssaoDownsampleDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout ssaoDownsamplePipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> ssaoDownsampleDescriptorSets;
+
+    VkDescriptorSetLayout ssaoComputeDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout ssaoComputePipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> ssaoComputeDescriptorSets;
+
+    // two sets per frame, horizontal then vertical pass
+    VkDescriptorSetLayout ssaoBilateralBlurDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout ssaoBilateralBlurPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> ssaoBilateralBlurDescriptorSets;
+
+    VkDescriptorSetLayout ssaoTemporalDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout ssaoTemporalPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> ssaoTemporalDescriptorSets;
+
+    VkDescriptorSetLayout ssaoUpsampleDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout ssaoUpsamplePipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> ssaoUpsampleDescriptorSets;
+
     VkDescriptorSetLayout shadowMapDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout shadowMapPipelineLayout = VK_NULL_HANDLE;
+    VkPipelineLayout shadowMapIndirectPipelineLayout = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> shadowMapDescriptorSets;
 
+    VkDescriptorSetLayout shadowAtlasDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout shadowAtlasPipelineLayout = VK_NULL_HANDLE;
+    VkPipelineLayout shadowAtlasCubePipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> shadowAtlasDescriptorSets;
+
     VkDescriptorSetLayout directionalShadowDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout directionalShadowPipelineLayout = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> directionalShadowDescriptorSets;
 
+    VkDescriptorSetLayout shadowTemporalDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout shadowTemporalPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> shadowTemporalDescriptorSets;
+
+    VkDescriptorSetLayout lightCullingDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout lightCullingPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> lightCullingDescriptorSets;
+
     VkDescriptorSetLayout lightingDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout lightingPipelineLayout = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> lightingDescriptorSets;
@@ -167,9 +632,31 @@ private:
     VkPipelineLayout skyboxPipelineLayout = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> skyboxDescriptorSets;
 
-    VkDescriptorSetLayout postprocessDescriptorSetLayout = VK_NULL_HANDLE;
-    VkPipelineLayout postprocessPipelineLayout = VK_NULL_HANDLE;
-    std::vector<VkDescriptorSet> postprocessDescriptorSets;
+    // histogram and exposure passes share the layout
+    VkDescriptorSetLayout autoExposureDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout autoExposurePipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> autoExposureDescriptorSets;
+
+    // downsample and upsample passes share the layout, 2 * BLOOM_LEVEL_COUNT - 1 sets per frame, the downsamples first
+    VkDescriptorSetLayout bloomDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout bloomPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> bloomDescriptorSets;
+
+    // jittered scene color accumulated into the upscale history, one set per frame
+    VkDescriptorSetLayout temporalUpscaleDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout temporalUpscalePipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> temporalUpscaleDescriptorSets;
+    VkDescriptorSetLayout sharpenDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout sharpenPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> sharpenDescriptorSets;
+
+    // four sets per frame, the scene color or the upscaled one, each with bloom and without it,
+    // the sets without bloom bind the scene source in place of the bloom
+    VkDescriptorSetLayout postProcessDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout postProcessPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> postProcessDescriptorSets;
+    // a single sampled image, the sets the UI draws the post process results with
+    VkDescriptorSetLayout postProcessResultDescriptorSetLayout = VK_NULL_HANDLE;
 
     // irradiance cube map
     std::unique_ptr<vks::TextureCubeMap> irradianceCubeMap = nullptr;
@@ -184,12 +671,38 @@ private:
     struct Pipelines {
         VkPipeline offscreen = VK_NULL_HANDLE;
         VkPipeline offscreenWireframe = VK_NULL_HANDLE;
+        // first subpass of deferredRenderPass, shades the fragments matching the depth of the prepass
+        VkPipeline gBufferFill = VK_NULL_HANDLE;
+        VkPipeline gBufferFillWireframe = VK_NULL_HANDLE;
+        // the same passes drawing the commands of drawCulling
+        VkPipeline offscreenIndirect = VK_NULL_HANDLE;
+        VkPipeline offscreenIndirectWireframe = VK_NULL_HANDLE;
+        VkPipeline gBufferFillIndirect = VK_NULL_HANDLE;
+        VkPipeline gBufferFillIndirectWireframe = VK_NULL_HANDLE;
         VkPipeline shadowMap = VK_NULL_HANDLE;
+        VkPipeline shadowMapIndirect = VK_NULL_HANDLE;
+        VkPipeline shadowAtlas = VK_NULL_HANDLE;
+        VkPipeline shadowAtlasCube = VK_NULL_HANDLE;
         VkPipeline directionalShadow = VK_NULL_HANDLE;
+        VkPipeline shadowTemporal = VK_NULL_HANDLE;
         VkPipeline ssao = VK_NULL_HANDLE;
         VkPipeline ssaoBlur = VK_NULL_HANDLE;
+        VkPipeline ssaoDownsample = VK_NULL_HANDLE;
+        VkPipeline ssaoCompute = VK_NULL_HANDLE;
+        VkPipeline ssaoTemporal = VK_NULL_HANDLE;
+        VkPipeline ssaoBilateralBlur = VK_NULL_HANDLE;
+        VkPipeline ssaoUpsample = VK_NULL_HANDLE;
+        VkPipeline lightCulling = VK_NULL_HANDLE;
+        VkPipeline drawCulling = VK_NULL_HANDLE;
+        VkPipeline depthPyramid = VK_NULL_HANDLE;
         VkPipeline lighting = VK_NULL_HANDLE;
         VkPipeline skybox = VK_NULL_HANDLE;
-        VkPipeline postprocess = VK_NULL_HANDLE;
+        VkPipeline luminanceHistogram = VK_NULL_HANDLE;
+        VkPipeline exposure = VK_NULL_HANDLE;
+        VkPipeline bloomDownsample = VK_NULL_HANDLE;
+        VkPipeline bloomUpsample = VK_NULL_HANDLE;
+        VkPipeline temporalUpscale = VK_NULL_HANDLE;
+        VkPipeline sharpen = VK_NULL_HANDLE;
+        VkPipeline postProcess = VK_NULL_HANDLE;
     } pipelines;
 };
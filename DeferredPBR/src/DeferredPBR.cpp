@@ -11,6 +11,10 @@
 
 #include <MathUtils.h>
 #include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include <GloalVars.h>
 
@@ -22,6 +26,198 @@
 #undef max
 #endif
 
+namespace
+{
+    // directional shadow filter of each quality tier, from low to ultra
+    struct ShadowFilterTier
+    {
+        const char* name;
+        uint32_t sampleCount;
+        VkBool32 blockerSearch;
+        // kernel radius in texels, the smallest one with the blocker search
+        float radius;
+        // taps per frame while the shadows are accumulated over time
+        uint32_t temporalSampleCount;
+    };
+
+    constexpr ShadowFilterTier shadowFilterTiers[] =
+    {
+        {"low", 4, VK_FALSE, 1.0f, 2},
+        {"medium", 8, VK_FALSE, 1.5f, 4},
+        {"high", 16, VK_FALSE, 2.0f, 4},
+        {"ultra", 16, VK_TRUE, 1.0f, 8},
+    };
+
+    const ShadowFilterTier& GetShadowFilterTier(int quality)
+    {
+        return shadowFilterTiers[std::clamp(quality, 0, static_cast<int>(IM_ARRAYSIZE(shadowFilterTiers)) - 1)];
+    }
+
+    // compute ssao of each quality tier, from low to high
+    struct SsaoQualityTier
+    {
+        const char* name;
+        // the viewport is divided by this in both dimensions
+        uint32_t downsample;
+        uint32_t kernelSize;
+        // samples per frame while ssao is accumulated over time
+        uint32_t temporalKernelSize;
+    };
+
+    constexpr SsaoQualityTier ssaoQualityTiers[] =
+    {
+        {"low", 4, 16, 4},
+        {"medium", 2, 32, 8},
+        {"high", 2, 64, 8},
+    };
+
+    const SsaoQualityTier& GetSsaoQualityTier(int quality)
+    {
+        return ssaoQualityTiers[std::clamp(quality, 0, static_cast<int>(IM_ARRAYSIZE(ssaoQualityTiers)) - 1)];
+    }
+
+    // temporal upscaling of each quality mode, native renders at the dynamic resolution without accumulation
+    struct UpscaleQualityTier
+    {
+        const char* name;
+        // fraction of the dynamic resolution in each dimension
+        float scale;
+    };
+
+    constexpr UpscaleQualityTier upscaleQualityTiers[] =
+    {
+        {"native", 1.0f},
+        {"quality", 0.67f},
+        {"balanced", 0.58f},
+        {"performance", 0.5f},
+    };
+
+    const UpscaleQualityTier& GetUpscaleQualityTier(int quality)
+    {
+        return upscaleQualityTiers[std::clamp(quality, 0, static_cast<int>(IM_ARRAYSIZE(upscaleQualityTiers)) - 1)];
+    }
+
+    // subpasses of the merged deferred render pass
+    enum DeferredSubpass : uint32_t
+    {
+        DeferredSubpassGBuffer,
+        // lighting, then the skybox where no geometry was drawn
+        DeferredSubpassLighting,
+    };
+
+    // push constants of the post process shaders, see autoExposure.glsl, bloom.glsl, temporalUpscale.comp,
+    // sharpen.comp and postprocess.comp
+    struct AutoExposurePushConstants
+    {
+        float minLogLuminance;
+        float logLuminanceRange;
+        float adaptation;
+        float keyValue;
+        glm::uvec2 renderSize;
+    };
+
+    struct BloomPushConstants
+    {
+        float threshold;
+        float knee;
+        float radius;
+        int32_t prefilter;
+        glm::vec2 renderScale;
+    };
+
+    struct PostProcessPushConstants
+    {
+        glm::vec4 colorFilter;
+        float exposure;
+        int32_t autoExposure;
+        float bloomIntensity;
+        float contrast;
+        float saturation;
+        alignas(8) glm::vec2 sceneScale;
+        glm::vec2 bloomScale;
+    };
+
+    struct TemporalUpscalePushConstants
+    {
+        glm::vec2 jitter;
+        glm::uvec2 renderSize;
+        float historyWeight;
+    };
+
+    struct SharpenPushConstants
+    {
+        float sharpness;
+    };
+
+    // push constants of ssaoTemporal.comp and shadowTemporal.comp
+    struct TemporalPushConstants
+    {
+        float historyWeight;
+        alignas(8) glm::vec2 renderScale;
+    };
+
+    // push constants of depthPyramid.comp
+    struct DepthPyramidPushConstants
+    {
+        glm::uvec2 renderSize;
+        uint32_t levelCount;
+        uint32_t groupCount;
+    };
+
+    // phases of drawCulling.comp, the late one only runs with occlusion culling
+    enum DrawCullingPhase : uint32_t
+    {
+        DrawCullingPhaseEarly,
+        DrawCullingPhaseLate,
+    };
+
+    // clip space of the camera onto the rendered region of the screen space targets, whose uvs span the whole target,
+    // the matrices of the screen space passes reconstruct and project positions at uvs of the targets through it
+    glm::mat4 RenderRegionTransform(const glm::vec2& renderScale)
+    {
+        return glm::translate(glm::mat4(1.0f), glm::vec3(renderScale - 1.0f, 0.0f)) *
+               glm::scale(glm::mat4(1.0f), glm::vec3(renderScale, 1.0f));
+    }
+
+    // log2 luminance range of the histogram, from moonlight to direct sun on the exposed scale of the scene
+    constexpr float HISTOGRAM_MIN_LOG_LUMINANCE = -10.0f;
+    constexpr float HISTOGRAM_LOG_LUMINANCE_RANGE = 12.0f;
+    // middle grey, the auto exposure maps the average luminance to it
+    constexpr float EXPOSURE_KEY_VALUE = 0.18f;
+
+    // random boxes of the culling benchmark and the runs the times are averaged over
+    constexpr uint32_t CULLING_BENCHMARK_BOX_COUNT = 100000;
+    constexpr uint32_t CULLING_BENCHMARK_RUNS = 16;
+    // rays cast through the benchmark boxes, and every n-th box moves before the refit
+    constexpr uint32_t BVH_BENCHMARK_RAY_COUNT = 4096;
+    constexpr uint32_t BVH_BENCHMARK_REFIT_STRIDE = 8;
+    // nodes of the transform benchmark, each one below one of the last few nodes, a tree over a thousand levels deep
+    constexpr uint32_t TRANSFORM_BENCHMARK_NODE_COUNT = 10000;
+    constexpr uint32_t TRANSFORM_BENCHMARK_MAX_PARENT_DISTANCE = 16;
+
+    // fixed seed, boxes of up to a twentieth of the scene spread over twice its bounds, so the culling tests see
+    // a mix of visible and culled boxes
+    void GenerateBenchmarkBoxes(const glm::vec3& sceneCenter, const glm::vec3& sceneSize,
+                                std::vector<glm::vec3>& boxMin, std::vector<glm::vec3>& boxMax, math::AABBArray& boxes)
+    {
+        std::default_random_engine generator(1337);
+        std::uniform_real_distribution<float> randomFloats(0.0f, 1.0f);
+        boxMin.resize(CULLING_BENCHMARK_BOX_COUNT);
+        boxMax.resize(CULLING_BENCHMARK_BOX_COUNT);
+        boxes.Resize(CULLING_BENCHMARK_BOX_COUNT);
+        for (uint32_t i = 0; i < CULLING_BENCHMARK_BOX_COUNT; i++)
+        {
+            const glm::vec3 center = sceneCenter + sceneSize * (glm::vec3(randomFloats(generator), randomFloats(generator),
+                                                                          randomFloats(generator)) * 2.0f - 1.0f);
+            const glm::vec3 extent = sceneSize * 0.05f * glm::vec3(randomFloats(generator), randomFloats(generator),
+                                                                   randomFloats(generator));
+            boxMin[i] = center - extent;
+            boxMax[i] = center + extent;
+            boxes.Set(i, boxMin[i], boxMax[i]);
+        }
+    }
+}
+
 DeferredPBR::~DeferredPBR()
 {
     // Clean up used Vulkan resources
@@ -31,30 +227,51 @@ DeferredPBR::~DeferredPBR()
 
     // render pass
     mrtRenderPass.reset();
+    mrtLoadRenderPass.reset();
     shadowRenderPass.reset();
     ssaoRenderPass.reset();
     lightingRenderPass.reset();
-    skyboxRenderPass.reset();
-    postprocessRenderPass.reset();
+    deferredRenderPass.reset();
 
     // frame buffer
+    mrtLoadFrameBuffer.reset();
     mrtFrameBuffer.reset();
     shadowFrameBuffer.reset();
     ssaoFrameBuffer.reset();
     lightingFrameBuffer.reset();
-    skyboxFrameBuffer.reset();
-    postprocessFrameBuffer.reset();
+    deferredFrameBuffer.reset();
+
+    cascadeShadowMap.reset();
+    shadowAtlasMap.reset();
+    depthPyramid.reset();
+
+    // owns the transient images
+    renderGraph.reset();
 
     if (pipelines.offscreen != VK_NULL_HANDLE)
         vkDestroyPipeline(device, pipelines.offscreen, nullptr);
     if (pipelines.offscreenWireframe != VK_NULL_HANDLE)
         vkDestroyPipeline(device, pipelines.offscreenWireframe, nullptr);
+    if (pipelines.gBufferFill != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.gBufferFill, nullptr);
+    if (pipelines.gBufferFillWireframe != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.gBufferFillWireframe, nullptr);
+    for (VkPipeline pipeline : {pipelines.offscreenIndirect, pipelines.offscreenIndirectWireframe,
+                                pipelines.gBufferFillIndirect, pipelines.gBufferFillIndirectWireframe})
+    {
+        if (pipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(device, pipeline, nullptr);
+    }
 
     // mrt
     if (mrtPipelineLayout != VK_NULL_HANDLE)
         vkDestroyPipelineLayout(device, mrtPipelineLayout, nullptr);
+    if (mrtIndirectPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, mrtIndirectPipelineLayout, nullptr);
     if (mrtDescriptorSetLayout_Vertex != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, mrtDescriptorSetLayout_Vertex, nullptr);
+    if (drawDataDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, drawDataDescriptorSetLayout, nullptr);
 
     // ssao
     if(pipelines.ssao != VK_NULL_HANDLE)
@@ -72,14 +289,63 @@ DeferredPBR::~DeferredPBR()
     if(ssaoBlurDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, ssaoBlurDescriptorSetLayout, nullptr);
 
+    // compute ssao
+    if(pipelines.ssaoDownsample != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.ssaoDownsample, nullptr);
+    if(ssaoDownsamplePipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, ssaoDownsamplePipelineLayout, nullptr);
+    if(ssaoDownsampleDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoDownsampleDescriptorSetLayout, nullptr);
+    if(pipelines.ssaoCompute != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.ssaoCompute, nullptr);
+    if(ssaoComputePipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, ssaoComputePipelineLayout, nullptr);
+    if(ssaoComputeDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoComputeDescriptorSetLayout, nullptr);
+    if(pipelines.ssaoTemporal != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.ssaoTemporal, nullptr);
+    if(ssaoTemporalPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, ssaoTemporalPipelineLayout, nullptr);
+    if(ssaoTemporalDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoTemporalDescriptorSetLayout, nullptr);
+    if(pipelines.ssaoBilateralBlur != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.ssaoBilateralBlur, nullptr);
+    if(ssaoBilateralBlurPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, ssaoBilateralBlurPipelineLayout, nullptr);
+    if(ssaoBilateralBlurDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoBilateralBlurDescriptorSetLayout, nullptr);
+    if(pipelines.ssaoUpsample != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.ssaoUpsample, nullptr);
+    if(ssaoUpsamplePipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, ssaoUpsamplePipelineLayout, nullptr);
+    if(ssaoUpsampleDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoUpsampleDescriptorSetLayout, nullptr);
+    ssaoComputeTargets.clear();
+
     // shadow map
     if(pipelines.shadowMap != VK_NULL_HANDLE)
         vkDestroyPipeline(device, pipelines.shadowMap, nullptr);
     if(shadowMapPipelineLayout != VK_NULL_HANDLE)
         vkDestroyPipelineLayout(device, shadowMapPipelineLayout, nullptr);
+    if(pipelines.shadowMapIndirect != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.shadowMapIndirect, nullptr);
+    if(shadowMapIndirectPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, shadowMapIndirectPipelineLayout, nullptr);
     if(shadowMapDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, shadowMapDescriptorSetLayout, nullptr);
 
+    // shadow atlas
+    if(pipelines.shadowAtlas != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.shadowAtlas, nullptr);
+    if(shadowAtlasPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, shadowAtlasPipelineLayout, nullptr);
+    if(pipelines.shadowAtlasCube != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.shadowAtlasCube, nullptr);
+    if(shadowAtlasCubePipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, shadowAtlasCubePipelineLayout, nullptr);
+    if(shadowAtlasDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, shadowAtlasDescriptorSetLayout, nullptr);
+
     // shadow gen
     if(pipelines.directionalShadow != VK_NULL_HANDLE)
         vkDestroyPipeline(device, pipelines.directionalShadow, nullptr);
@@ -87,7 +353,40 @@ DeferredPBR::~DeferredPBR()
         vkDestroyPipelineLayout(device, directionalShadowPipelineLayout, nullptr);
     if(directionalShadowDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, directionalShadowDescriptorSetLayout, nullptr);
+
+    // shadow accumulation
+    if(pipelines.shadowTemporal != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.shadowTemporal, nullptr);
+    if(shadowTemporalPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, shadowTemporalPipelineLayout, nullptr);
+    if(shadowTemporalDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, shadowTemporalDescriptorSetLayout, nullptr);
+    shadowHistory.clear();
     
+    // light culling
+    if (pipelines.lightCulling != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.lightCulling, nullptr);
+    if (lightCullingPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, lightCullingPipelineLayout, nullptr);
+    if (lightCullingDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, lightCullingDescriptorSetLayout, nullptr);
+
+    // draw culling
+    if (pipelines.drawCulling != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.drawCulling, nullptr);
+    if (drawCullingPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, drawCullingPipelineLayout, nullptr);
+    if (drawCullingDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, drawCullingDescriptorSetLayout, nullptr);
+
+    // depth pyramid
+    if (pipelines.depthPyramid != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipelines.depthPyramid, nullptr);
+    if (depthPyramidPipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, depthPyramidPipelineLayout, nullptr);
+    if (depthPyramidDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, depthPyramidDescriptorSetLayout, nullptr);
+
     // lighting
     if (pipelines.lighting != VK_NULL_HANDLE)
         vkDestroyPipeline(device, pipelines.lighting, nullptr);
@@ -104,20 +403,52 @@ DeferredPBR::~DeferredPBR()
     if (skyboxDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, skyboxDescriptorSetLayout, nullptr);
 
-    // postprocess
-    if (pipelines.postprocess != VK_NULL_HANDLE)
-        vkDestroyPipeline(device, pipelines.postprocess, nullptr);
-    if (postprocessPipelineLayout != VK_NULL_HANDLE)
-        vkDestroyPipelineLayout(device, postprocessPipelineLayout, nullptr);
-    if (postprocessDescriptorSetLayout != VK_NULL_HANDLE)
-        vkDestroyDescriptorSetLayout(device, postprocessDescriptorSetLayout, nullptr);
+    // post processing
+    for (VkPipeline pipeline : {pipelines.luminanceHistogram, pipelines.exposure, pipelines.bloomDownsample,
+                                pipelines.bloomUpsample, pipelines.temporalUpscale, pipelines.sharpen,
+                                pipelines.postProcess})
+    {
+        if (pipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    for (VkPipelineLayout pipelineLayout : {autoExposurePipelineLayout, bloomPipelineLayout, temporalUpscalePipelineLayout,
+                                            sharpenPipelineLayout, postProcessPipelineLayout})
+    {
+        if (pipelineLayout != VK_NULL_HANDLE)
+            vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    }
+    for (VkDescriptorSetLayout descriptorSetLayout : {autoExposureDescriptorSetLayout, bloomDescriptorSetLayout,
+                                                      temporalUpscaleDescriptorSetLayout, sharpenDescriptorSetLayout,
+                                                      postProcessDescriptorSetLayout, postProcessResultDescriptorSetLayout})
+    {
+        if (descriptorSetLayout != VK_NULL_HANDLE)
+            vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    }
+    postProcessTargets.clear();
 
     mrtUBO.buffer.Destroy();
     ssaoCreateUbo.buffer.Destroy();
     shadowUbo.buffer.Destroy();
     lightingUbo.buffer.Destroy();
+    lightCullingUbo.buffer.Destroy();
+    drawCullingUbo.buffer.Destroy();
     skyboxUbo.buffer.Destroy();
 
+    lightBuffer.Destroy();
+    clusterLightCountBuffer.Destroy();
+    clusterLightIndexBuffer.Destroy();
+    shadowTileBuffer.Destroy();
+    luminanceHistogramBuffer.Destroy();
+    exposureBuffer.Destroy();
+    ssaoComparison.readbackBuffer.Destroy();
+    indirectCommandBuffer.Destroy();
+    indirectCountBuffer.Destroy();
+    drawVisibilityBuffer.Destroy();
+    occlusionStatsBuffer.Destroy();
+    depthPyramidCounterBuffer.Destroy();
+
+    gpuProfiler.reset();
+
     if (irradianceCubeMap != nullptr)
         irradianceCubeMap->Destroy();
 
@@ -161,71 +492,110 @@ void DeferredPBR::InitFondation()
 
 void DeferredPBR::SetupMrtRenderPass()
 {
+    // the loading render pass uses the attachments of the frame buffer replaced here
+    mrtLoadRenderPass.reset();
+    mrtLoadFrameBuffer.reset();
+
     mrtRenderPass = std::make_unique<vks::VulkanRenderPass>("mrtRenderPass", vulkanDevice.get());
     const uint32_t imageWidth = swapChain->imageExtent.width;
     const uint32_t imageHeight = swapChain->imageExtent.height;
 
-    // Four attachments (3 color, 1 depth)
-    vks::AttachmentCreateInfo attachmentInfo = {};
-    attachmentInfo.width = imageWidth;
-    attachmentInfo.height = imageHeight;
-    attachmentInfo.layerCount = 1;
-    attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    // Color attachments
-    // Attachment 0: (World space) Positions
-    attachmentInfo.binding = mrtRenderPass->AttachmentCount();
-    attachmentInfo.name = "G_WorldPosition";
-    attachmentInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    mrtRenderPass->AddAttachment(attachmentInfo);
-
-    // Attachment 1: (World space) Normals
-    attachmentInfo.binding = mrtRenderPass->AttachmentCount();
-    attachmentInfo.name = "G_WorldNormal";
-    attachmentInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    mrtRenderPass->AddAttachment(attachmentInfo);
-
-    // Attachment 2: Albedo (color)
-    attachmentInfo.binding = mrtRenderPass->AttachmentCount();
-    attachmentInfo.name = "G_Color";
-    attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    mrtRenderPass->AddAttachment(attachmentInfo);
-
-    // Attachment 3: Roughness
-    attachmentInfo.binding = mrtRenderPass->AttachmentCount();
-    attachmentInfo.name = "G_Roughness";
-    attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    mrtRenderPass->AddAttachment(attachmentInfo);
-
-    // Attachment 4: Emissive
-    attachmentInfo.binding = mrtRenderPass->AttachmentCount();
-    attachmentInfo.name = "G_Emissive";
-    attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    mrtRenderPass->AddAttachment(attachmentInfo);
-
-    // Attachment 5: Occlusion
-    attachmentInfo.binding = mrtRenderPass->AttachmentCount();
-    attachmentInfo.name = "G_Occlusion";
-    attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-    mrtRenderPass->AddAttachment(attachmentInfo);
-
-    attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    
-    // Attachment 6: G_Depth
-    attachmentInfo.binding = mrtRenderPass->AttachmentCount();
-    attachmentInfo.name = "G_Depth";
-    attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    mrtRenderPass->AddAttachment(attachmentInfo);
+    // Six attachments (5 color, 1 depth), world space positions are reconstructed from depth.
+    // The merged deferred path only keeps the ones read before lighting, the others live in deferredRenderPass.
+    // The loading render pass has the same attachments and subpasses, its frame buffers take the images of
+    // sharedFrameBuffer
+    const bool subpassDeferred = graphicSettings->subpassDeferred;
+    auto addAttachments = [&](vks::VulkanRenderPass& renderPass, const vks::VulkanFrameBuffer* sharedFrameBuffer)
+    {
+        vks::AttachmentCreateInfo attachmentInfo = {};
+        attachmentInfo.width = imageWidth;
+        attachmentInfo.height = imageHeight;
+        attachmentInfo.layerCount = 1;
+        // the G-buffer is rewritten every frame before it is read, one image serves all frames in flight
+        attachmentInfo.sharedAcrossFrames = sharedFrameBuffer == nullptr;
+        attachmentInfo.sharedFrameBuffer = sharedFrameBuffer;
+        attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        // Color attachments
+        // Attachment 0: (World space) Normals, octahedral encoded
+        attachmentInfo.binding = renderPass.AttachmentCount();
+        attachmentInfo.name = "G_Normal";
+        attachmentInfo.format = VK_FORMAT_R16G16_SNORM;
+        renderPass.AddAttachment(attachmentInfo);
+
+        if (!subpassDeferred)
+        {
+            // Attachment 1: Albedo (color)
+            attachmentInfo.binding = renderPass.AttachmentCount();
+            attachmentInfo.name = "G_Color";
+            attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            renderPass.AddAttachment(attachmentInfo);
+
+            // Attachment 2: Material, r = ao, g = roughness, b = metallic
+            attachmentInfo.binding = renderPass.AttachmentCount();
+            attachmentInfo.name = "G_Material";
+            attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            renderPass.AddAttachment(attachmentInfo);
+
+            // Attachment 3: Emissive
+            attachmentInfo.binding = renderPass.AttachmentCount();
+            attachmentInfo.name = "G_Emissive";
+            attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            renderPass.AddAttachment(attachmentInfo);
+        }
 
-    // Attachment 7: Depth
-    attachmentInfo.name = "Depth";
-    attachmentInfo.binding = mrtRenderPass->AttachmentCount();
-    attachmentInfo.format = depthFormat;
-    attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    mrtRenderPass->AddAttachment(attachmentInfo);
+        // Attachment 4: Velocity, uv motion since the last frame for the temporal accumulation
+        attachmentInfo.binding = renderPass.AttachmentCount();
+        attachmentInfo.name = "G_Velocity";
+        attachmentInfo.format = VK_FORMAT_R16G16_SFLOAT;
+        renderPass.AddAttachment(attachmentInfo);
+
+        // Attachment 5: Depth, sampled for positions and the background test
+        attachmentInfo.name = "Depth";
+        attachmentInfo.binding = renderPass.AttachmentCount();
+        attachmentInfo.format = depthFormat;
+        attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        renderPass.AddAttachment(attachmentInfo);
+    };
 
     // create render pass
-    mrtRenderPass->Init(true);
+    auto initRenderPass = [subpassDeferred](vks::VulkanRenderPass& renderPass)
+    {
+        if (subpassDeferred)
+        {
+            // depth, normal and velocity prepass for the screen space passes, the fragment outputs of mrt.frag keep
+            // their locations and the ones the G-buffer fill subpass writes are discarded
+            // attachments 0: normals, 1: velocity, 2: depth
+            std::vector<uint32_t> subPassColorAttachmentIndices = {
+                0, VK_ATTACHMENT_UNUSED, VK_ATTACHMENT_UNUSED, VK_ATTACHMENT_UNUSED, 1, 2};
+            renderPass.AddSubPass("prepass", VK_PIPELINE_BIND_POINT_GRAPHICS, subPassColorAttachmentIndices, {});
+            renderPass.AddSubPassDependency(
+                {
+                    {
+                        VK_SUBPASS_EXTERNAL, 0,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                        VK_ACCESS_MEMORY_READ_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_DEPENDENCY_BY_REGION_BIT,
+                    },
+                    {
+                        0, VK_SUBPASS_EXTERNAL,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_ACCESS_MEMORY_READ_BIT,
+                        VK_DEPENDENCY_BY_REGION_BIT,
+                    }
+                });
+            renderPass.Init();
+        }
+        else
+            renderPass.Init(true);
+    };
+    addAttachments(*mrtRenderPass, nullptr);
+    initRenderPass(*mrtRenderPass);
 
     // frame buffer
     mrtFrameBuffer = std::make_unique<vks::VulkanFrameBuffer>(vulkanDevice.get(), imageWidth, imageHeight, maxFrameInFlight);
@@ -237,6 +607,19 @@ void DeferredPBR::SetupMrtRenderPass()
     
     // show on UI
     mrtFrameBuffer->CrateDescriptorSet();
+
+    // the late occlusion culling draws add to the G-buffer of the early ones, compatible with the mrt pipelines
+    mrtLoadRenderPass = std::make_unique<vks::VulkanRenderPass>("mrtLoadRenderPass", vulkanDevice.get());
+    addAttachments(*mrtLoadRenderPass, mrtFrameBuffer.get());
+    for (vks::VulkanAttachmentDescription* attachment : mrtLoadRenderPass->attachmentDescriptions)
+    {
+        attachment->description.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachment->description.initialLayout = attachment->description.finalLayout;
+    }
+    initRenderPass(*mrtLoadRenderPass);
+    mrtLoadFrameBuffer = std::make_unique<vks::VulkanFrameBuffer>(vulkanDevice.get(), imageWidth, imageHeight,
+                                                                  maxFrameInFlight);
+    mrtLoadFrameBuffer->Init(mrtLoadRenderPass.get(), samplerCreateInfo);
 }
 
 void DeferredPBR::SetupSSAORenderPass()
@@ -251,6 +634,7 @@ void DeferredPBR::SetupSSAORenderPass()
     attachmentInfo.width = imageWidth;
     attachmentInfo.height = imageHeight;
     attachmentInfo.layerCount = 1;
+    attachmentInfo.sharedAcrossFrames = true;
     // this attachment is input and ouput, specify usage input and color attachment bit
     attachmentInfo.usage = VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     attachmentInfo.binding = 0;
@@ -262,16 +646,14 @@ void DeferredPBR::SetupSSAORenderPass()
     attachmentInfo.width = imageWidth;
     attachmentInfo.height = imageHeight;
     attachmentInfo.layerCount = 1;
+    // transfer source for the readback of the ssao comparison
     attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     attachmentInfo.binding = 1;
     attachmentInfo.name = "G_Occlusion";
     attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
     ssaoRenderPass->AddAttachment(attachmentInfo);
 
-    // 不能重用MRT的G_Occlusion，因为底下的image会被删除两次，目前没有管理相关内存的方法，暂时放弃这种想法
-    //    vks::VulkanFrameBuffer* mrtFrameBuffer = mrtRenderPass->vulkanFrameBuffer.get();
-    //    std::vector<vks::FramebufferAttachment> copyAOAttachment = mrtFrameBuffer->CopySpecifiedFrameBufferAttachment("G_Occlusion");
-    //    ssaoRenderPass->AddAttachments(copyAOAttachment);
+    // the lighting pass samples G_Occlusion directly
 
     // subpass
     // ssao subpass
@@ -301,9 +683,9 @@ void DeferredPBR::SetupSSAORenderPass()
             {
                 1,VK_SUBPASS_EXTERNAL,
                     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                    VK_ACCESS_MEMORY_READ_BIT,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
                     VK_DEPENDENCY_BY_REGION_BIT
             }
         });
@@ -322,6 +704,42 @@ void DeferredPBR::SetupSSAORenderPass()
     // ssaoFrameBuffer->CrateDescriptorSet();
 }
 
+void DeferredPBR::SetupSSAOComputeTargets()
+{
+    // the blur and upsample filter by depth, so depth and normals are downsampled alongside the occlusion
+    const SsaoQualityTier& tier = GetSsaoQualityTier(graphicSettings->ssaoQuality);
+    const uint32_t width = (ssaoFrameBuffer->Width() + tier.downsample - 1) / tier.downsample;
+    const uint32_t height = (ssaoFrameBuffer->Height() + tier.downsample - 1) / tier.downsample;
+
+    // only the history outlives a frame, the render graph creates the other targets at the history's size
+    ssaoComputeTargets.resize(maxFrameInFlight);
+    for (SsaoComputeTargets& targets : ssaoComputeTargets)
+    {
+        if (targets.history == nullptr)
+            targets.history = std::make_unique<vks::VulkanStorageImage>(vulkanDevice.get(), queue);
+        targets.history->Create(width, height, VK_FORMAT_R16G16B16A16_SFLOAT);
+    }
+    ssaoHistoryValid = false;
+}
+
+void DeferredPBR::SetupDepthPyramid()
+{
+    // level 0 halves the depth rounded up to a power of two, so every level holds the texels the shader
+    // reduces the rendered region to, the last level is a single texel
+    uint32_t width = 1;
+    while (width < (swapChain->imageExtent.width + 1) / 2)
+        width *= 2;
+    uint32_t height = 1;
+    while (height < (swapChain->imageExtent.height + 1) / 2)
+        height *= 2;
+    uint32_t levelCount = 1;
+    while ((std::max(width, height) >> levelCount) > 0 && levelCount < GlobalVars::MAX_DEPTH_PYRAMID_LEVEL_COUNT)
+        levelCount++;
+    if (depthPyramid == nullptr)
+        depthPyramid = std::make_unique<vks::VulkanStorageImage>(vulkanDevice.get(), queue);
+    depthPyramid->Create(width, height, VK_FORMAT_R32_SFLOAT, 0, levelCount);
+}
+
 void DeferredPBR::SetupShadowRenderPass()
 {
     shadowRenderPass = std::make_unique<vks::VulkanRenderPass>("shadowRenderPass", vulkanDevice.get());
@@ -332,6 +750,7 @@ void DeferredPBR::SetupShadowRenderPass()
     attachmentInfo.width = imageWidth;
     attachmentInfo.height = imageHeight;
     attachmentInfo.layerCount = 1;
+    attachmentInfo.sharedAcrossFrames = true;
 
     // shadow result attachment
     attachmentInfo.name = "G_Shadow";
@@ -340,54 +759,22 @@ void DeferredPBR::SetupShadowRenderPass()
     attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     shadowRenderPass->AddAttachment(attachmentInfo);
 
-    // depth attachment
-    attachmentInfo.name = "_Depth_ShadowMap";
-    attachmentInfo.binding = shadowRenderPass->AttachmentCount();
-    attachmentInfo.format = depthFormat;
-    attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
-        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
-    shadowRenderPass->AddAttachment(attachmentInfo);
-
-    // depth attachment
-    attachmentInfo.name = "_Depth_ShadowResult";
-    attachmentInfo.binding = shadowRenderPass->AttachmentCount();
-    attachmentInfo.format = depthFormat;
-    attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
-        VK_IMAGE_USAGE_SAMPLED_BIT;
-    shadowRenderPass->AddAttachment(attachmentInfo);
-
-    std::vector<uint32_t> subPassColorAttachmentIndices = {1};
-    shadowRenderPass->AddSubPass("shadowMap",VK_PIPELINE_BIND_POINT_GRAPHICS, subPassColorAttachmentIndices,{});
-    subPassColorAttachmentIndices = {0, 2};
-    shadowRenderPass->AddSubPass("directionalShadowResult",VK_PIPELINE_BIND_POINT_GRAPHICS,subPassColorAttachmentIndices,{1});
+    // the cascades are rendered into cascadeShadowMap before this pass,
+    // a full screen triangle resolves them for the G-buffer positions
+    std::vector<uint32_t> subPassColorAttachmentIndices = {0};
+    shadowRenderPass->AddSubPass("directionalShadowResult",VK_PIPELINE_BIND_POINT_GRAPHICS,subPassColorAttachmentIndices,{});
     shadowRenderPass->AddSubPassDependency(
             {
                     {
                             VK_SUBPASS_EXTERNAL, 0,
                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-                            VK_ACCESS_SHADER_READ_BIT,
-                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                            VK_DEPENDENCY_BY_REGION_BIT,
-                    },
-                    {
-                        0,1,
-                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                        VK_ACCESS_SHADER_READ_BIT,
-                        VK_DEPENDENCY_BY_REGION_BIT,
-                      },
-                    {
-                            0,1,
                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                            VK_ACCESS_SHADER_READ_BIT,
                             VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                            VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
-                            VK_DEPENDENCY_BY_REGION_BIT
+                            VK_DEPENDENCY_BY_REGION_BIT,
                     },
                     {
-                    1,VK_SUBPASS_EXTERNAL,
+                    0,VK_SUBPASS_EXTERNAL,
                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                         VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
@@ -409,40 +796,101 @@ void DeferredPBR::SetupShadowRenderPass()
     // shadowFrameBuffer->CrateDescriptorSet();
 }
 
+void DeferredPBR::SetupShadowHistory()
+{
+    // one per frame in flight, frame i accumulates into shadowHistory[i] from the one of the frame before
+    shadowHistory.resize(maxFrameInFlight);
+    for (std::unique_ptr<vks::VulkanStorageImage>& history : shadowHistory)
+    {
+        if (history == nullptr)
+            history = std::make_unique<vks::VulkanStorageImage>(vulkanDevice.get(), queue);
+        history->Create(shadowFrameBuffer->Width(), shadowFrameBuffer->Height(), VK_FORMAT_R16G16B16A16_SFLOAT);
+    }
+    shadowHistoryValid = false;
+}
+
+void DeferredPBR::SetupCascadeShadowMap()
+{
+    // independent of the swap chain, only recreated when the cascade settings change
+    if (cascadeShadowMap == nullptr)
+        cascadeShadowMap = std::make_unique<vks::VulkanShadowMap>("_Depth_CascadeShadowMap", vulkanDevice.get(), depthFormat,
+                                                                queue);
+
+    graphicSettings->shadowCascadeCount = std::clamp(graphicSettings->shadowCascadeCount, 1,
+                                                     static_cast<int>(GlobalVars::MAX_SHADOW_CASCADE_COUNT));
+    cascadeShadowMap->Create(static_cast<uint32_t>(graphicSettings->shadowMapResolution),
+                             static_cast<uint32_t>(graphicSettings->shadowCascadeCount),
+                             graphicSettings->shadowCaching);
+    shadowCache.valid.fill(false);
+}
+
+void DeferredPBR::SetupShadowAtlas()
+{
+    // one layer for all tiles, never resized, tiles are updated with BeginTileRenderPass
+    shadowAtlasMap = std::make_unique<vks::VulkanShadowMap>("_Depth_ShadowAtlas", vulkanDevice.get(), depthFormat, queue);
+    shadowAtlasMap->Create(shadowAtlas.AtlasSize(), 1);
+}
+
+void DeferredPBR::SetupPostProcessTargets()
+{
+    // only the result and the upscale history outlive a frame, the UI samples the result after the graph,
+    // the bloom chain and the upscaled color are created by the render graph
+    postProcessTargets.resize(maxFrameInFlight);
+    for (PostProcessTargets& targets : postProcessTargets)
+    {
+        if (targets.result == nullptr)
+            targets.result = std::make_unique<vks::VulkanStorageImage>(vulkanDevice.get(), queue);
+        targets.result->Create(lightingFrameBuffer->Width(), lightingFrameBuffer->Height(), VK_FORMAT_R8G8B8A8_UNORM);
+        if (targets.upscaleHistory == nullptr)
+            targets.upscaleHistory = std::make_unique<vks::VulkanStorageImage>(vulkanDevice.get(), queue);
+        targets.upscaleHistory->Create(lightingFrameBuffer->Width(), lightingFrameBuffer->Height(),
+                                       VK_FORMAT_R16G16B16A16_SFLOAT);
+    }
+    upscaleHistoryValid = false;
+}
+
 void DeferredPBR::SetupLightingRenderPass()
 {
     lightingRenderPass = std::make_unique<vks::VulkanRenderPass>("lightingRenderPass", vulkanDevice.get());
     const uint32_t imageWidth = swapChain->imageExtent.width;
     const uint32_t imageHeight = swapChain->imageExtent.height;
 
-    // Four attachments (1 color)
     vks::AttachmentCreateInfo attachmentInfo = {};
     attachmentInfo.width = imageWidth;
     attachmentInfo.height = imageHeight;
     attachmentInfo.layerCount = 1;
     attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    // Color attachments
-    attachmentInfo.binding = 0;
-    attachmentInfo.name = "LightingResult";
-    attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    // Color attachments, the HDR scene color is only read by the post process passes of the same frame
+    attachmentInfo.binding = lightingRenderPass->AttachmentCount();
+    attachmentInfo.name = "SceneColor";
+    attachmentInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    attachmentInfo.sharedAcrossFrames = true;
+    lightingRenderPass->AddAttachment(attachmentInfo);
+
+    // depth of the prepass, lighting only shades the pixels in front of the far plane and the skybox fills the rest
+    attachmentInfo.binding = lightingRenderPass->AttachmentCount();
+    attachmentInfo.name = "Depth";
+    attachmentInfo.format = depthFormat;
+    attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    attachmentInfo.readOnly = true;
+    attachmentInfo.sharedAcrossFrames = false;
+    attachmentInfo.sharedFrameBuffer = mrtFrameBuffer.get();
     lightingRenderPass->AddAttachment(attachmentInfo);
 
     lightingRenderPass->Init(true);
 
-    // frame buffer
+    // frame buffer, the bloom downsample filters the scene color bilinearly
     lightingFrameBuffer = std::make_unique<vks::VulkanFrameBuffer>(vulkanDevice.get(), imageWidth, imageHeight, maxFrameInFlight);
     vks::utils::VulkanSamplerCreateInfo samplerCreateInfo;
-    samplerCreateInfo.minFiler = VK_FILTER_NEAREST;
-    samplerCreateInfo.magFiler = VK_FILTER_NEAREST;
+    samplerCreateInfo.minFiler = VK_FILTER_LINEAR;
+    samplerCreateInfo.magFiler = VK_FILTER_LINEAR;
     samplerCreateInfo.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
     lightingFrameBuffer->Init(lightingRenderPass.get(),samplerCreateInfo);
-
-    lightingFrameBuffer->CrateDescriptorSet();
 }
 
-void DeferredPBR::SetupSkyboxRenderPass()
+void DeferredPBR::SetupDeferredRenderPass()
 {
-    skyboxRenderPass = std::make_unique<vks::VulkanRenderPass>("skyboxRenderPass", vulkanDevice.get());
+    deferredRenderPass = std::make_unique<vks::VulkanRenderPass>("deferredRenderPass", vulkanDevice.get());
     const uint32_t imageWidth = swapChain->imageExtent.width;
     const uint32_t imageHeight = swapChain->imageExtent.height;
 
@@ -450,55 +898,96 @@ void DeferredPBR::SetupSkyboxRenderPass()
     attachmentInfo.width = imageWidth;
     attachmentInfo.height = imageHeight;
     attachmentInfo.layerCount = 1;
-    attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    // Color attachments
-    attachmentInfo.binding = skyboxRenderPass->AttachmentCount();
-    attachmentInfo.name = "skybox";
+    attachmentInfo.sharedAcrossFrames = true;
+    // only read by the lighting subpass, never stored and lazily allocated where the device supports it
+    attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
+                           VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
     attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    skyboxRenderPass->AddAttachment(attachmentInfo);
-
-    skyboxRenderPass->Init(true);
-
-    // frame buffer
-    skyboxFrameBuffer = std::make_unique<vks::VulkanFrameBuffer>(vulkanDevice.get(), imageWidth, imageHeight, maxFrameInFlight);
-    vks::utils::VulkanSamplerCreateInfo samplerCreateInfo;
-    samplerCreateInfo.minFiler = VK_FILTER_NEAREST;
-    samplerCreateInfo.magFiler = VK_FILTER_NEAREST;
-    samplerCreateInfo.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    skyboxFrameBuffer->Init(skyboxRenderPass.get(),samplerCreateInfo);
+    // Attachments 0 - 2: albedo, material and emissive of the G-buffer
+    for (const char* name : {"G_Color", "G_Material", "G_Emissive"})
+    {
+        attachmentInfo.binding = deferredRenderPass->AttachmentCount();
+        attachmentInfo.name = name;
+        deferredRenderPass->AddAttachment(attachmentInfo);
+    }
 
-    // skyboxFrameBuffer->CrateDescriptorSet();
-}
+    // Attachment 3: the scene color of the lighting frame buffer, read by the post process passes
+    attachmentInfo.binding = deferredRenderPass->AttachmentCount();
+    attachmentInfo.name = "SceneColor";
+    attachmentInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    attachmentInfo.sharedAcrossFrames = false;
+    attachmentInfo.sharedFrameBuffer = lightingFrameBuffer.get();
+    deferredRenderPass->AddAttachment(attachmentInfo);
 
-void DeferredPBR::SetupPostprocessRenderPass()
-{
-    postprocessRenderPass = std::make_unique<vks::VulkanRenderPass>("PostprocessRenderPass", vulkanDevice.get());
-    const uint32_t imageWidth = swapChain->imageExtent.width;
-    const uint32_t imageHeight = swapChain->imageExtent.height;
+    // Attachment 4: depth of the prepass, tested for equality by the G-buffer fill,
+    // read by lighting and tested against by lighting and the skybox
+    attachmentInfo.binding = deferredRenderPass->AttachmentCount();
+    attachmentInfo.name = "Depth";
+    attachmentInfo.format = depthFormat;
+    attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    attachmentInfo.readOnly = true;
+    attachmentInfo.sharedFrameBuffer = mrtFrameBuffer.get();
+    deferredRenderPass->AddAttachment(attachmentInfo);
 
-    vks::AttachmentCreateInfo attachmentInfo = {};
-    attachmentInfo.width = imageWidth;
-    attachmentInfo.height = imageHeight;
-    attachmentInfo.layerCount = 1;
-    attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    // Color attachments
-    attachmentInfo.binding = postprocessRenderPass->AttachmentCount();
-    attachmentInfo.name = "Result";
-    attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    postprocessRenderPass->AddAttachment(attachmentInfo);
+    // subpass
+    // G-buffer fill, mrt.frag writes normals and velocity to unused attachments, the prepass has them
+    std::vector<uint32_t> subPassColorAttachmentIndices = {VK_ATTACHMENT_UNUSED, 0, 1, 2, VK_ATTACHMENT_UNUSED, 4};
+    deferredRenderPass->AddSubPass("GBuffer", VK_PIPELINE_BIND_POINT_GRAPHICS, subPassColorAttachmentIndices, {});
+    // lighting and skybox subpass, the depth is both input attachment and read only depth attachment
+    subPassColorAttachmentIndices = {3, 4};
+    deferredRenderPass->AddSubPass("Lighting", VK_PIPELINE_BIND_POINT_GRAPHICS, subPassColorAttachmentIndices, {4, 0, 1, 2});
+    deferredRenderPass->AddSubPassDependency(
+        {
+            {
+                VK_SUBPASS_EXTERNAL, DeferredSubpassGBuffer,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_MEMORY_READ_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                VK_DEPENDENCY_BY_REGION_BIT,
+            },
+            {
+                DeferredSubpassGBuffer, DeferredSubpassLighting,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+                VK_DEPENDENCY_BY_REGION_BIT
+            },
+            {
+                DeferredSubpassLighting, VK_SUBPASS_EXTERNAL,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_ACCESS_MEMORY_READ_BIT,
+                VK_DEPENDENCY_BY_REGION_BIT,
+            }
+        });
 
-    postprocessRenderPass->Init(true);
+    deferredRenderPass->Init();
 
-    // frame buffer
-    postprocessFrameBuffer = std::make_unique<vks::VulkanFrameBuffer>(vulkanDevice.get(), imageWidth, imageHeight, maxFrameInFlight);
+    // frame buffer, the transient attachments are only read as input attachments
+    deferredFrameBuffer = std::make_unique<vks::VulkanFrameBuffer>(vulkanDevice.get(), imageWidth, imageHeight, maxFrameInFlight);
     vks::utils::VulkanSamplerCreateInfo samplerCreateInfo;
     samplerCreateInfo.minFiler = VK_FILTER_NEAREST;
     samplerCreateInfo.magFiler = VK_FILTER_NEAREST;
     samplerCreateInfo.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    postprocessFrameBuffer->Init(postprocessRenderPass.get(), samplerCreateInfo);
+    deferredFrameBuffer->Init(deferredRenderPass.get(), samplerCreateInfo);
+}
 
-    // show on UI
-    postprocessFrameBuffer->CrateDescriptorSet();
+void DeferredPBR::SetupShadingRenderPasses()
+{
+    // the lighting frame buffer owns the scene color, the merged path shares it and the depth of mrtFrameBuffer
+    deferredRenderPass.reset();
+    deferredFrameBuffer.reset();
+    lightingRenderPass.reset();
+    lightingFrameBuffer.reset();
+
+    SetupLightingRenderPass();
+    if (graphicSettings->subpassDeferred)
+        SetupDeferredRenderPass();
 }
 
 void DeferredPBR::BakingIrradianceCubeMap()
@@ -1620,40 +2109,856 @@ void DeferredPBR::PrepareSSAOGenData()
                                  queue, VK_FILTER_NEAREST);
 }
 
-void DeferredPBR::Prepare()
+void DeferredPBR::PrepareLightBuffers()
 {
-    VulkanApplicationBase::Prepare();
+    lightClusterGrid = vks::LightClusterGrid();
 
-    LoadAsset();
+    // lights are rewritten every frame, so keep them host visible
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &lightBuffer, sizeof(vks::ClusterLight) * GlobalVars::MAX_LIGHT_COUNT));
+    CheckVulkanResult(lightBuffer.Map());
 
-    // baking cubemap
-    BakingIrradianceCubeMap();
-    BakingPreFilteringCubeMap();
-    BakingSpecularBRDFCubeMap();
+    // cluster lists are written by lightCulling.comp or by the cpu reference, and read back for statistics
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &clusterLightCountBuffer,
+                                                 sizeof(uint32_t) * lightClusterGrid.ClusterCount()));
+    CheckVulkanResult(clusterLightCountBuffer.Map());
+    memset(clusterLightCountBuffer.mapped, 0, sizeof(uint32_t) * lightClusterGrid.ClusterCount());
 
-    // SSAO
-    PrepareSSAOGenData();
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &clusterLightIndexBuffer,
+                                                 sizeof(uint32_t) * lightClusterGrid.ClusterCount() *
+                                                 GlobalVars::MAX_LIGHTS_PER_CLUSTER));
+    CheckVulkanResult(clusterLightIndexBuffer.Map());
 
-    // render pass
-    SetupMrtRenderPass();
-    SetupSSAORenderPass();
-    SetupShadowRenderPass();
-    SetupLightingRenderPass();
-    SetupSkyboxRenderPass();
-    SetupPostprocessRenderPass();
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &shadowTileBuffer,
+                                                 sizeof(vks::ShadowAtlasTile) * vks::ShadowAtlas::MAX_TILE_COUNT));
+    CheckVulkanResult(shadowTileBuffer.Map());
+    memcpy(shadowTileBuffer.mapped, shadowAtlas.GetTiles().data(),
+           sizeof(vks::ShadowAtlasTile) * vks::ShadowAtlas::MAX_TILE_COUNT);
+}
 
+void DeferredPBR::PrepareIndirectDrawBuffers()
+{
+    if (drawIndirectCountSupported)
+        vkCmdDrawIndexedIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+
+    // a command per record and view, the batches of a view own consecutive ranges of its commands,
+    // the late camera draws count as a view
+    const uint32_t viewCount = LATE_CAMERA_VIEW + 1;
+    const uint32_t recordCount = std::max(gltfModel->indirectDraws.recordCount, 1u);
+    const uint32_t batchCount = static_cast<uint32_t>(gltfModel->indirectDraws.batches.size());
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indirectCommandBuffer,
+                                                 sizeof(VkDrawIndexedIndirectCommand) * recordCount * viewCount));
+
+    // cleared before every culling pass, the host reads the counts of the last frame for the statistics
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &indirectCountBuffer, sizeof(uint32_t) * batchCount * viewCount));
+    CheckVulkanResult(indirectCountBuffer.Map());
+    memset(indirectCountBuffer.mapped, 0, sizeof(uint32_t) * batchCount * viewCount);
+
+    // nothing was visible before the first frame, the late phase draws all of it
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &drawVisibilityBuffer, sizeof(uint32_t) * recordCount));
+    CheckVulkanResult(drawVisibilityBuffer.Map());
+    memset(drawVisibilityBuffer.mapped, 0, sizeof(uint32_t) * recordCount);
+
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &occlusionStatsBuffer, sizeof(OcclusionStats)));
+    CheckVulkanResult(occlusionStatsBuffer.Map());
+    memset(occlusionStatsBuffer.mapped, 0, sizeof(OcclusionStats));
+
+    // zero between the pyramid dispatches, the last work group of each one resets it
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &depthPyramidCounterBuffer, sizeof(uint32_t)));
+    CheckVulkanResult(depthPyramidCounterBuffer.Map());
+    memset(depthPyramidCounterBuffer.mapped, 0, sizeof(uint32_t));
+}
+
+void DeferredPBR::UpdateDrawCulling()
+{
+    // the camera without the projection jitter, then the cascades in use
+    const uint32_t cascadeCount = cascadeShadowMap->LayerCount();
+    std::copy(std::begin(cameraFrustum.planes), std::end(cameraFrustum.planes), drawCullingUbo.values.frustumPlanes);
+    for (uint32_t i = 0; i < cascadeCount; i++)
+        std::copy(std::begin(shadowCascadeFrustums[i].planes), std::end(shadowCascadeFrustums[i].planes),
+                  drawCullingUbo.values.frustumPlanes + (i + 1) * 6);
+    drawCullingUbo.values.counts = glm::uvec4(gltfModel->indirectDraws.recordCount, 1 + cascadeCount,
+                                              static_cast<uint32_t>(gltfModel->indirectDraws.batches.size()),
+                                              OcclusionCulling() ? 1 : 0);
+    // the late phase projects the boxes onto the pyramid of the rendered region
+    Camera* camera = Singleton<Camera>::Instance();
+    const VkExtent2D renderExtent = RenderExtent();
+    drawCullingUbo.values.viewProjection = camera->matrices.perspective * camera->matrices.view;
+    drawCullingUbo.values.pyramid = glm::uvec4(renderExtent.width, renderExtent.height, depthPyramid->LevelCount(), 0);
+    memcpy(drawCullingUbo.buffer.mapped, &drawCullingUbo.values, sizeof(drawCullingUbo.values));
+}
+
+bool DeferredPBR::GpuDrivenRendering() const
+{
+    return gpuDrivenSupported && graphicSettings->gpuDrivenRendering;
+}
+
+bool DeferredPBR::OcclusionCulling() const
+{
+    return GpuDrivenRendering() && occlusionCullingSupported && graphicSettings->occlusionCulling;
+}
+
+void DeferredPBR::DrawIndirectView(VkCommandBuffer commandBuffer, uint32_t view, uint32_t firstBatch, uint32_t batchCount,
+                                   uint32_t renderFlags, VkPipelineLayout pipelineLayout)
+{
+    const vks::geometry::VulkanGLTFModel& model = *gltfModel;
+    const uint32_t batchStride = static_cast<uint32_t>(model.indirectDraws.batches.size());
+    // the counts of the last frame for the statistics, this frame's culling has not run yet
+    const uint32_t* drawCounts = static_cast<const uint32_t*>(indirectCountBuffer.mapped) + view * batchStride;
+    gltfModel->DrawIndirect(commandBuffer, renderFlags, firstBatch, batchCount, indirectCommandBuffer.buffer,
+                            sizeof(VkDrawIndexedIndirectCommand) * model.indirectDraws.recordCount * view,
+                            indirectCountBuffer.buffer, sizeof(uint32_t) * batchStride * view, pipelineLayout, 1,
+                            vkCmdDrawIndexedIndirectCountKHR, drawCounts);
+}
+
+void DeferredPBR::DrawSceneIndirect(VkCommandBuffer commandBuffer, VkPipeline pipeline, const std::vector<uint32_t>& views)
+{
+    // set 1 is bound per material batch
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mrtIndirectPipelineLayout, 0, 1,
+                            &mrtDescriptorSets_Vertex[currentFrame], 0, nullptr);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mrtIndirectPipelineLayout, 2, 1,
+                            &drawDataDescriptorSets[currentFrame], 0, nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    uint32_t drawCount = 0;
+    uint32_t culledCount = 0;
+    for (uint32_t view : views)
+    {
+        DrawIndirectView(commandBuffer, view, 0, gltfModel->indirectDraws.materialBatchCount,
+                         vks::geometry::RenderFlags::BindImages, mrtIndirectPipelineLayout);
+        drawCount += gltfModel->drawStatistics.drawCount;
+        culledCount += gltfModel->drawStatistics.culledCount;
+    }
+    // the statistics of all views together
+    gltfModel->drawStatistics.drawCount = drawCount;
+    gltfModel->drawStatistics.culledCount = culledCount;
+}
+
+void DeferredPBR::DrawScene(VkCommandBuffer commandBuffer, VkPipeline pipeline)
+{
+    // Bind scene matrices descriptor to set 0, the objects of this frame to set 2
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mrtPipelineLayout, 0, 1,
+                            &mrtDescriptorSets_Vertex[currentFrame], 0, nullptr);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mrtPipelineLayout, 2, 1,
+                            &drawDataDescriptorSets[currentFrame], 0, nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+    const uint32_t renderFlags = vks::geometry::RenderFlags::BindImages | vks::geometry::RenderFlags::PushObjectIndex;
+    const uint32_t order = graphicSettings->sortedDrawLists ? 1 : 0;
+    auto tStart = std::chrono::high_resolution_clock::now();
+    if (order == 1)
+        gltfModel->DrawSorted(commandBuffer, renderFlags, true, mrtPipelineLayout, 1, mrtUBO.values.view, &cameraFrustum);
+    else
+        gltfModel->Draw(commandBuffer, renderFlags, true, mrtPipelineLayout, 1, &cameraFrustum);
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    const float recordTime = static_cast<float>(std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+    sceneDrawStats.recordTime[order] = glm::mix(sceneDrawStats.recordTime[order], recordTime, 0.05f);
+    sceneDrawStats.bindCount[order] = gltfModel->drawStatistics.descriptorBindCount;
+}
+
+void DeferredPBR::PreparePostProcessBuffers()
+{
+    // the exposure pass clears the bins after reading them, so they only start cleared
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &luminanceHistogramBuffer,
+                                                 sizeof(uint32_t) * GlobalVars::LUMINANCE_HISTOGRAM_BIN_COUNT));
+    CheckVulkanResult(luminanceHistogramBuffer.Map());
+    memset(luminanceHistogramBuffer.mapped, 0, sizeof(uint32_t) * GlobalVars::LUMINANCE_HISTOGRAM_BIN_COUNT);
+
+    // average luminance and exposure, starts at the fixed exposure and is read back for the statistics
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &exposureBuffer, sizeof(glm::vec2)));
+    CheckVulkanResult(exposureBuffer.Map());
+    const glm::vec2 exposureState(EXPOSURE_KEY_VALUE / graphicSettings->exposure, graphicSettings->exposure);
+    memcpy(exposureBuffer.mapped, &exposureState, sizeof(exposureState));
+}
+
+void DeferredPBR::UpdateShadowAtlas()
+{
+    // UpdateUniformBuffers may run more than once per frame, a tile marked rendered here has to be drawn by the
+    // command buffer being recorded, before its lighting pass reads it
+    Camera* camera = Singleton<Camera>::Instance();
+    if (graphicSettings->localLightShadows)
+        shadowAtlas.Update(shadowAtlasLights, camera->matrices.view, camera->matrices.perspective,
+                           static_cast<float>(viewportHeight),
+                           static_cast<uint32_t>(std::max(graphicSettings->shadowAtlasUpdateBudget, 0)));
+    else
+        shadowAtlas.Reset();
+    WriteShadowAtlasTiles();
+    if (!clusterLights.empty())
+        memcpy(lightBuffer.mapped, clusterLights.data(), clusterLights.size() * sizeof(vks::ClusterLight));
+}
+
+void DeferredPBR::WriteShadowAtlasTiles()
+{
+    // lights without a fully rendered set of tiles are unshadowed
+    for (size_t i = 0; i < clusterLights.size() && i < shadowAtlasLights.size(); i++)
+    {
+        const int32_t firstTile = shadowAtlas.GetFirstTile(static_cast<uint32_t>(i));
+        clusterLights[i].spotShadow.z = static_cast<float>(firstTile);
+        clusterLights[i].spotShadow.w = firstTile < 0 ? 0.0f : (shadowAtlasLights[i].spot ? 1.0f : 6.0f);
+    }
+    memcpy(shadowTileBuffer.mapped, shadowAtlas.GetTiles().data(),
+           sizeof(vks::ShadowAtlasTile) * vks::ShadowAtlas::MAX_TILE_COUNT);
+}
+
+void DeferredPBR::UpdateLightBuffers()
+{
+    // the previous frame has finished, its cluster lists are still in the buffers
+    if (lightClusterStats.validateRequested)
+    {
+        ValidateLightClusters();
+        lightClusterStats.validateRequested = false;
+    }
+
+    const uint32_t* clusterLightCounts = static_cast<const uint32_t*>(clusterLightCountBuffer.mapped);
+    uint32_t totalClusterLights = 0;
+    lightClusterStats.maxLightsPerCluster = 0;
+    for (uint32_t i = 0; i < lightClusterGrid.ClusterCount(); i++)
+    {
+        totalClusterLights += clusterLightCounts[i];
+        lightClusterStats.maxLightsPerCluster = std::max(lightClusterStats.maxLightsPerCluster, clusterLightCounts[i]);
+    }
+    lightClusterStats.averageLightsPerCluster =
+        static_cast<float>(totalClusterLights) / static_cast<float>(lightClusterGrid.ClusterCount());
+
+    std::vector<vks::geometry::Light> lights = gltfModel->lights;
+
+    // add default lights
+    if (lights.empty())
+    {
+        // y杞翠笌Houdini y杞寸浉鍙
+        vks::geometry::Light light;
+        light.color = glm::vec4(1.0f);
+        light.intensity = 1.0f;
+        light.position = glm::vec4(0.0f, -1.85776f, 0.0f, 1.0f);
+        lights.push_back(light);
+
+        light.position = glm::vec4(0.149955f, -0.3774542f, 2.68973f, 1.0f);
+        lights.push_back(light);
+    }
+    lights.insert(lights.end(), benchmarkLights.begin(), benchmarkLights.end());
+
+    if (lights.size() > GlobalVars::MAX_LIGHT_COUNT)
+        lights.resize(GlobalVars::MAX_LIGHT_COUNT);
+
+    // lighting is done in view space
+    Camera* camera = Singleton<Camera>::Instance();
+    clusterLights.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        const vks::geometry::Light& light = lights[i];
+        glm::vec3 position = glm::vec3(camera->matrices.view * glm::vec4(glm::vec3(light.position), 1.0f));
+        float range = light.range > 0.0f ? light.range : vks::ComputeLightRange(glm::vec3(light.color));
+        clusterLights[i].positionRange = glm::vec4(position, range);
+        clusterLights[i].colorIntensity = glm::vec4(glm::vec3(light.color), light.intensity);
+
+        // KHR_lights_punctual cone falloff, scale 0 and offset 1 leave point lights unattenuated
+        float coneScale = 0.0f;
+        float coneOffset = 1.0f;
+        if (light.type == vks::geometry::Light::LIGHTTYPE_SPOT)
+        {
+            float cosOuter = std::cos(light.outerConeAngle);
+            coneScale = 1.0f / std::max(std::cos(light.innerConeAngle) - cosOuter, 0.001f);
+            coneOffset = -cosOuter * coneScale;
+        }
+        glm::vec3 direction = glm::normalize(glm::mat3(camera->matrices.view) * light.direction);
+        clusterLights[i].spotDirection = glm::vec4(direction, 0.0f);
+        clusterLights[i].spotShadow = glm::vec4(coneScale, coneOffset, -1.0f, 0.0f);
+    }
+
+    // the atlas schedules its tiles in UpdateShadowAtlas, until then the lights keep the tiles already rendered
+    std::vector<vks::ShadowAtlasLight>& atlasLights = shadowAtlasLights;
+    atlasLights.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        const vks::geometry::Light& light = lights[i];
+        atlasLights[i].position = glm::vec3(light.position);
+        atlasLights[i].direction = light.direction;
+        atlasLights[i].range = clusterLights[i].positionRange.w;
+        atlasLights[i].spot = light.type == vks::geometry::Light::LIGHTTYPE_SPOT;
+        atlasLights[i].outerConeAngle = light.outerConeAngle;
+        atlasLights[i].castsShadow = light.type != vks::geometry::Light::LIGHTTYPE_DIRECTIONAL;
+    }
+    WriteShadowAtlasTiles();
+
+    if (!clusterLights.empty())
+        memcpy(lightBuffer.mapped, clusterLights.data(), clusterLights.size() * sizeof(vks::ClusterLight));
+    lightClusterStats.lightCount = static_cast<uint32_t>(clusterLights.size());
+
+    lightClusterGrid.nearPlane = camera->GetNearClip();
+    lightClusterGrid.farPlane = camera->GetFarClip();
+    lightCullingUbo.values.invProjection = glm::inverse(camera->matrices.perspective);
+    lightCullingUbo.values.clusterGrid = glm::uvec4(lightClusterGrid.tileCountX, lightClusterGrid.tileCountY,
+                                                    lightClusterGrid.sliceCount, lightClusterStats.lightCount);
+    lightCullingUbo.values.clusterDepth = glm::vec4(lightClusterGrid.nearPlane, lightClusterGrid.farPlane, 0.0f, 0.0f);
+    memcpy(lightCullingUbo.buffer.mapped, &lightCullingUbo.values, sizeof(lightCullingUbo.values));
+
+    // cpu reference path, the compute dispatch is skipped in PrepareRenderPass
+    if (!graphicSettings->lightCullingOnGPU)
+    {
+        std::vector<uint32_t> counts, indices;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        vks::BinLightsToClusters(lightClusterGrid, lightCullingUbo.values.invProjection, clusterLights,
+                                 GlobalVars::MAX_LIGHTS_PER_CLUSTER, counts, indices);
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        lightClusterStats.cpuBinningTime = static_cast<float>(
+            std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+        memcpy(clusterLightCountBuffer.mapped, counts.data(), counts.size() * sizeof(uint32_t));
+        memcpy(clusterLightIndexBuffer.mapped, indices.data(), indices.size() * sizeof(uint32_t));
+    }
+}
+
+void DeferredPBR::GenerateBenchmarkLights(uint32_t lightCount)
+{
+    benchmarkLights.clear();
+    if (lightCount == 0)
+        return;
+
+    // fixed seed, so every run of the benchmark uses the same light distribution
+    std::default_random_engine generator(1337);
+    std::uniform_real_distribution<float> randomFloats(0.0f, 1.0f);
+    glm::vec3 sceneMin = gltfModel->dimensions.min;
+    glm::vec3 sceneSize = gltfModel->dimensions.max - gltfModel->dimensions.min;
+    for (uint32_t i = 0; i < lightCount; i++)
+    {
+        vks::geometry::Light light;
+        glm::vec3 position = sceneMin + sceneSize * glm::vec3(randomFloats(generator), randomFloats(generator),
+                                                              randomFloats(generator));
+        light.position = glm::vec4(position, 1.0f);
+        light.color = glm::vec4(randomFloats(generator), randomFloats(generator), randomFloats(generator), 0.0f) * 0.2f;
+        light.intensity = 1.0f;
+        light.range = graphicSettings->benchmarkLightRange;
+        benchmarkLights.push_back(light);
+    }
+}
+
+void DeferredPBR::ValidateLightClusters()
+{
+    std::vector<uint32_t> counts, indices;
+    auto tStart = std::chrono::high_resolution_clock::now();
+    vks::BinLightsToClusters(lightClusterGrid, lightCullingUbo.values.invProjection, clusterLights,
+                             GlobalVars::MAX_LIGHTS_PER_CLUSTER, counts, indices);
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    lightClusterStats.cpuBinningTime = static_cast<float>(
+        std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+
+    // the gpu appends lights in any order, compare sorted lists of clusters that did not overflow
+    const uint32_t* gpuCounts = static_cast<const uint32_t*>(clusterLightCountBuffer.mapped);
+    const uint32_t* gpuIndices = static_cast<const uint32_t*>(clusterLightIndexBuffer.mapped);
+    const uint32_t maxLights = GlobalVars::MAX_LIGHTS_PER_CLUSTER;
+    lightClusterStats.validationMismatches = 0;
+    for (uint32_t i = 0; i < lightClusterGrid.ClusterCount(); i++)
+    {
+        if (gpuCounts[i] != counts[i])
+        {
+            lightClusterStats.validationMismatches++;
+            continue;
+        }
+        if (counts[i] == maxLights)
+            continue;
+
+        std::vector<uint32_t> gpuList(gpuIndices + i * maxLights, gpuIndices + i * maxLights + counts[i]);
+        std::vector<uint32_t> cpuList(indices.begin() + i * maxLights, indices.begin() + i * maxLights + counts[i]);
+        std::sort(gpuList.begin(), gpuList.end());
+        std::sort(cpuList.begin(), cpuList.end());
+        if (gpuList != cpuList)
+            lightClusterStats.validationMismatches++;
+    }
+    lightClusterStats.validated = true;
+}
+
+void DeferredPBR::StartLightScalingBenchmark()
+{
+    LightScalingBenchmark& benchmark = lightScalingBenchmark;
+    vks::FrameBenchmark::Callbacks callbacks;
+    callbacks.apply = [this](uint32_t step)
+    {
+        const uint32_t lightCount = lightScalingBenchmark.lightCounts[step];
+        graphicSettings->benchmarkLightCount = static_cast<int>(lightCount);
+        GenerateBenchmarkLights(lightCount);
+        return true;
+    };
+    callbacks.measure = [this](uint32_t)
+    {
+        std::vector<uint32_t> counts, indices;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        vks::BinLightsToClusters(lightClusterGrid, lightCullingUbo.values.invProjection, clusterLights,
+                                 GlobalVars::MAX_LIGHTS_PER_CLUSTER, counts, indices);
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        const float cpuBinningTime = static_cast<float>(std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+        return vks::FormatReport("%5u lights: culling %.3f ms, lighting %.3f ms, cpu %.3f ms",
+                                 lightClusterStats.lightCount, gpuProfiler->GetTime("LightCulling"),
+                                 gpuProfiler->GetTime("Lighting"), cpuBinningTime);
+    };
+    benchmark.run.Start(static_cast<uint32_t>(benchmark.lightCounts.size()), std::move(callbacks));
+}
+
+void DeferredPBR::UpdateShadowCascades()
+{
+    Camera* camera = Singleton<Camera>::Instance();
+    const float nearPlane = camera->GetNearClip();
+    const float farPlane = camera->GetFarClip();
+    const float shadowDistance = std::clamp(graphicSettings->shadowDistance, nearPlane + 0.01f, farPlane);
+
+    float elevation = glm::radians(graphicSettings->sunElevation);
+    float azimuth = glm::radians(graphicSettings->sunAzimuth);
+    glm::vec3 lightDirection = -glm::vec3(std::cos(elevation) * std::cos(azimuth), std::sin(elevation),
+                                          std::cos(elevation) * std::sin(azimuth));
+
+    // the shadow map's layer count is authoritative, the setting may be ahead of it for a frame
+    const uint32_t cascadeCount = cascadeShadowMap->LayerCount();
+    std::vector<float> splitDepths;
+    vks::ComputeCascadeSplits(nearPlane, shadowDistance, cascadeCount, graphicSettings->cascadeSplitLambda, splitDepths);
+    glm::mat4 invViewProjection = glm::inverse(camera->matrices.perspective * camera->matrices.view);
+    // coarse steps while caching, the cached static depth is reused until a cascade moves a whole step
+    const uint32_t snapTexels = cascadeShadowMap->HasCache() ? GlobalVars::SHADOW_CACHE_SNAP_TEXELS : 1;
+    vks::FitShadowCascades(invViewProjection, nearPlane, farPlane, splitDepths, lightDirection,
+                           gltfModel->dimensions.min, gltfModel->dimensions.max, cascadeShadowMap->Resolution(),
+                           graphicSettings->stableShadowCascades, snapTexels, shadowCascades);
+
+    // same y convention as the camera so the shadow pass keeps its back face culling
+    glm::mat4 flip = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, camera->flipY ? -1.0f : 1.0f, 1.0f));
+    for (uint32_t i = 0; i < cascadeCount; i++)
+    {
+        shadowCascades[i].viewProjection = flip * shadowCascades[i].viewProjection;
+        shadowCascadeFrustums[i].Update(shadowCascades[i].viewProjection);
+        shadowUbo.values.cascadeViewProjection[i] = shadowCascades[i].viewProjection;
+        shadowUbo.values.cascadeSplits[i] = shadowCascades[i].splitDepth;
+    }
+
+    shadowUbo.values.nearPlane = nearPlane;
+    shadowUbo.values.farPlane = farPlane;
+    shadowUbo.values.projection = camera->matrices.perspective;
+    shadowUbo.values.view = camera->matrices.view;
+    shadowUbo.values.invViewProjection = glm::inverse(RenderRegionTransform(RenderScale()) *
+                                                      camera->GetJitteredPerspective(ProjectionJitter()) *
+                                                      camera->matrices.view);
+    shadowUbo.values.lightDirection = glm::vec4(lightDirection, static_cast<float>(cascadeCount));
+    shadowUbo.values.filterParams = glm::vec4(GetShadowFilterTier(graphicSettings->shadowFilterQuality).radius,
+                                              graphicSettings->shadowPenumbraScale, GlobalVars::MAX_SHADOW_FILTER_RADIUS, 0.0f);
+    // golden angle steps spread the rotations of consecutive frames evenly over the disk
+    if (graphicSettings->temporalAccumulation)
+        shadowUbo.values.filterParams.w = 2.39996323f * static_cast<float>(temporalFrameIndex % GlobalVars::TEMPORAL_SEQUENCE_LENGTH);
+    memcpy(shadowUbo.buffer.mapped, &shadowUbo.values, sizeof(shadowUbo.values));
+}
+
+void DeferredPBR::StartShadowCascadeBenchmark()
+{
+    shadowCascadeBenchmark.cascadeCount = graphicSettings->shadowCascadeCount;
+    vks::FrameBenchmark::Callbacks callbacks;
+    callbacks.apply = [this](uint32_t step)
+    {
+        // the shadow map is rebuilt with the cascade count before the step settles
+        if (cascadeShadowMap->LayerCount() == step + 1)
+            return true;
+        graphicSettings->shadowCascadeCount = static_cast<int>(step + 1);
+        shadowMapDirty = true;
+        return false;
+    };
+    callbacks.measure = [this](uint32_t)
+    {
+        const uint32_t cascadeCount = cascadeShadowMap->LayerCount();
+        uint32_t drawCount = 0;
+        uint32_t culledCount = 0;
+        for (uint32_t i = 0; i < cascadeCount; i++)
+        {
+            drawCount += shadowStats.drawCount[i];
+            culledCount += shadowStats.culledCount[i];
+        }
+        // the world space texel size of the first cascade, smaller is sharper
+        return vks::FormatReport("%u x %u: shadow %.3f ms, near texel %.4f, draws %u, culled %u", cascadeCount,
+                                 cascadeShadowMap->Resolution(), gpuProfiler->GetTime("Shadow"),
+                                 shadowCascades[0].texelSize, drawCount, culledCount);
+    };
+    callbacks.finish = [this]()
+    {
+        graphicSettings->shadowCascadeCount = shadowCascadeBenchmark.cascadeCount;
+        shadowMapDirty = true;
+    };
+    shadowCascadeBenchmark.run.Start(GlobalVars::MAX_SHADOW_CASCADE_COUNT, std::move(callbacks));
+}
+
+void DeferredPBR::RunCullingBenchmark()
+{
+    const glm::vec3 sceneSize = gltfModel->dimensions.max - gltfModel->dimensions.min;
+    std::vector<glm::vec3> boxMin, boxMax;
+    math::AABBArray boxes;
+    GenerateBenchmarkBoxes(gltfModel->dimensions.center, sceneSize, boxMin, boxMax, boxes);
+
+    std::vector<uint8_t> scalarVisible(CULLING_BENCHMARK_BOX_COUNT);
+    std::vector<uint8_t> batchVisible(CULLING_BENCHMARK_BOX_COUNT);
+    auto tStart = std::chrono::high_resolution_clock::now();
+    for (uint32_t run = 0; run < CULLING_BENCHMARK_RUNS; run++)
+    {
+        for (uint32_t i = 0; i < CULLING_BENCHMARK_BOX_COUNT; i++)
+            scalarVisible[i] = cameraFrustum.IntersectsAABB(boxMin[i], boxMax[i]) ? 1 : 0;
+    }
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    const double scalarTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+    tStart = std::chrono::high_resolution_clock::now();
+    for (uint32_t run = 0; run < CULLING_BENCHMARK_RUNS; run++)
+        cameraFrustum.IntersectsAABBs(boxes, batchVisible.data());
+    tEnd = std::chrono::high_resolution_clock::now();
+    const double batchTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+    cullingBenchmark = {};
+    cullingBenchmark.boxCount = CULLING_BENCHMARK_BOX_COUNT;
+    cullingBenchmark.scalarTime = static_cast<float>(scalarTime / CULLING_BENCHMARK_RUNS);
+    cullingBenchmark.batchTime = static_cast<float>(batchTime / CULLING_BENCHMARK_RUNS);
+    for (uint32_t i = 0; i < CULLING_BENCHMARK_BOX_COUNT; i++)
+    {
+        cullingBenchmark.visibleCount += batchVisible[i];
+        cullingBenchmark.mismatchCount += scalarVisible[i] != batchVisible[i] ? 1 : 0;
+    }
+}
+
+void DeferredPBR::RunBVHBenchmark()
+{
+    const glm::vec3 sceneCenter = gltfModel->dimensions.center;
+    const glm::vec3 sceneSize = gltfModel->dimensions.max - gltfModel->dimensions.min;
+    std::vector<glm::vec3> boxMin, boxMax;
+    math::AABBArray boxes;
+    GenerateBenchmarkBoxes(sceneCenter, sceneSize, boxMin, boxMax, boxes);
+    using Clock = std::chrono::high_resolution_clock;
+    auto milliseconds = [](Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    bvhBenchmark = {};
+    bvhBenchmark.boxCount = CULLING_BENCHMARK_BOX_COUNT;
+    vks::BoundingVolumeHierarchy bvh;
+    auto tStart = Clock::now();
+    bvh.Build(boxes);
+    bvhBenchmark.buildTime = static_cast<float>(milliseconds(tStart, Clock::now()));
+    bvhBenchmark.nodeCount = static_cast<uint32_t>(bvh.GetNodes().size());
+    bvhBenchmark.depth = bvh.Depth();
+
+    // a part of the boxes moves by up to a hundredth of the scene, like the animated nodes of a scene
+    std::default_random_engine generator(7);
+    std::uniform_real_distribution<float> randomFloats(0.0f, 1.0f);
+    std::vector<uint32_t> movedBoxes;
+    for (uint32_t i = 0; i < CULLING_BENCHMARK_BOX_COUNT; i += BVH_BENCHMARK_REFIT_STRIDE)
+        movedBoxes.push_back(i);
+    double refitTime = 0.0;
+    for (uint32_t run = 0; run < CULLING_BENCHMARK_RUNS; run++)
+    {
+        for (uint32_t i : movedBoxes)
+        {
+            const glm::vec3 offset = sceneSize * 0.01f * (glm::vec3(randomFloats(generator), randomFloats(generator),
+                                                                    randomFloats(generator)) * 2.0f - 1.0f);
+            boxMin[i] += offset;
+            boxMax[i] += offset;
+            boxes.Set(i, boxMin[i], boxMax[i]);
+        }
+        tStart = Clock::now();
+        bvh.Refit(boxes, movedBoxes);
+        refitTime += milliseconds(tStart, Clock::now());
+    }
+    bvhBenchmark.refitBoxCount = static_cast<uint32_t>(movedBoxes.size());
+    bvhBenchmark.refitTime = static_cast<float>(refitTime / CULLING_BENCHMARK_RUNS);
+
+    std::vector<uint8_t> bvhVisible, batchVisible(CULLING_BENCHMARK_BOX_COUNT);
+    tStart = Clock::now();
+    for (uint32_t run = 0; run < CULLING_BENCHMARK_RUNS; run++)
+        bvh.QueryFrustum(cameraFrustum, bvhVisible);
+    bvhBenchmark.frustumTime = static_cast<float>(milliseconds(tStart, Clock::now()) / CULLING_BENCHMARK_RUNS);
+    tStart = Clock::now();
+    for (uint32_t run = 0; run < CULLING_BENCHMARK_RUNS; run++)
+        cameraFrustum.IntersectsAABBs(boxes, batchVisible.data());
+    bvhBenchmark.linearFrustumTime = static_cast<float>(milliseconds(tStart, Clock::now()) / CULLING_BENCHMARK_RUNS);
+    for (uint32_t i = 0; i < CULLING_BENCHMARK_BOX_COUNT; i++)
+        bvhBenchmark.mismatchCount += bvhVisible[i] != batchVisible[i] ? 1 : 0;
+
+    // spheres the size of a light covering a tenth of the scene
+    const float sphereRadius = glm::length(sceneSize) * 0.1f;
+    std::vector<uint8_t> sphereVisible;
+    double sphereTime = 0.0;
+    for (uint32_t run = 0; run < CULLING_BENCHMARK_RUNS; run++)
+    {
+        const glm::vec3 center = sceneCenter + sceneSize * (glm::vec3(randomFloats(generator), randomFloats(generator),
+                                                                      randomFloats(generator)) * 2.0f - 1.0f);
+        tStart = Clock::now();
+        bvh.QuerySphere(center, sphereRadius, sphereVisible);
+        sphereTime += milliseconds(tStart, Clock::now());
+    }
+    bvhBenchmark.sphereTime = static_cast<float>(sphereTime / CULLING_BENCHMARK_RUNS);
+
+    // rays from the scene center in all directions, the boxes stand in for the geometry
+    double rayTime = 0.0;
+    for (uint32_t ray = 0; ray < BVH_BENCHMARK_RAY_COUNT; ray++)
+    {
+        const glm::vec3 direction = glm::normalize(glm::vec3(randomFloats(generator), randomFloats(generator),
+                                                             randomFloats(generator)) * 2.0f - 1.0f + 1e-4f);
+        const glm::vec3 inverseDirection = 1.0f / direction;
+        auto intersectBox = [&](uint32_t box, float maxDistance)
+        {
+            float distance = 0.0f;
+            return math::IntersectRayAABB(sceneCenter, inverseDirection, boxMin[box], boxMax[box], maxDistance, distance)
+                       ? distance : -1.0f;
+        };
+        uint32_t hitBox = 0;
+        float hitDistance = 0.0f;
+        tStart = Clock::now();
+        if (bvh.Raycast(sceneCenter, direction, std::numeric_limits<float>::max(), intersectBox, hitBox, hitDistance))
+            bvhBenchmark.rayHitCount++;
+        rayTime += milliseconds(tStart, Clock::now());
+    }
+    bvhBenchmark.rayTime = static_cast<float>(rayTime / BVH_BENCHMARK_RAY_COUNT);
+}
+
+void DeferredPBR::RunTransformBenchmark()
+{
+    using Clock = std::chrono::high_resolution_clock;
+    auto milliseconds = [](Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    std::default_random_engine generator(7);
+    std::uniform_real_distribution<float> randomFloats(-1.0f, 1.0f);
+    std::vector<glm::vec3> translations(TRANSFORM_BENCHMARK_NODE_COUNT);
+    std::vector<glm::quat> rotations(TRANSFORM_BENCHMARK_NODE_COUNT);
+    std::vector<uint32_t> depths(TRANSFORM_BENCHMARK_NODE_COUNT, 0);
+    vks::TransformHierarchy hierarchy;
+    transformBenchmark = {};
+    transformBenchmark.nodeCount = TRANSFORM_BENCHMARK_NODE_COUNT;
+    for (uint32_t i = 0; i < TRANSFORM_BENCHMARK_NODE_COUNT; i++)
+    {
+        uint32_t parent = vks::TransformHierarchy::NO_PARENT;
+        if (i > 0)
+        {
+            std::uniform_int_distribution<uint32_t> parentDistance(1, std::min(i, TRANSFORM_BENCHMARK_MAX_PARENT_DISTANCE));
+            parent = i - parentDistance(generator);
+            depths[i] = depths[parent] + 1;
+            transformBenchmark.depth = std::max(transformBenchmark.depth, depths[i]);
+        }
+        // small steps, so the matrices stay well conditioned down the whole chain
+        translations[i] = glm::vec3(randomFloats(generator), randomFloats(generator), randomFloats(generator)) * 0.1f;
+        rotations[i] = glm::normalize(glm::quat(1.0f, randomFloats(generator) * 0.01f, randomFloats(generator) * 0.01f,
+                                                randomFloats(generator) * 0.01f));
+        hierarchy.Add(parent, translations[i], rotations[i], glm::vec3(1.0f));
+    }
+
+    // the local matrices of the whole parent chain per node, as the nodes computed their world matrix before
+    auto localMatrix = [&](uint32_t i)
+    {
+        return glm::translate(glm::mat4(1.0f), translations[i]) * glm::mat4(rotations[i]);
+    };
+    std::vector<glm::mat4> walkedMatrices(TRANSFORM_BENCHMARK_NODE_COUNT);
+    auto tStart = Clock::now();
+    for (uint32_t i = 0; i < TRANSFORM_BENCHMARK_NODE_COUNT; i++)
+    {
+        glm::mat4 m = localMatrix(i);
+        for (uint32_t p = hierarchy.GetParent(i); p != vks::TransformHierarchy::NO_PARENT; p = hierarchy.GetParent(p))
+            m = localMatrix(p) * m;
+        walkedMatrices[i] = m;
+    }
+    transformBenchmark.walkTime = static_cast<float>(milliseconds(tStart, Clock::now()));
+
+    tStart = Clock::now();
+    for (uint32_t run = 0; run < CULLING_BENCHMARK_RUNS; run++)
+        hierarchy.UpdateAll();
+    transformBenchmark.fullTime = static_cast<float>(milliseconds(tStart, Clock::now()) / CULLING_BENCHMARK_RUNS);
+    for (uint32_t i = 0; i < TRANSFORM_BENCHMARK_NODE_COUNT; i++)
+    {
+        const glm::mat4& world = hierarchy.GetWorldMatrix(i);
+        for (int column = 0; column < 4; column++)
+        {
+            const glm::vec4 difference = glm::abs(world[column] - walkedMatrices[i][column]);
+            transformBenchmark.maxError = std::max(transformBenchmark.maxError,
+                                                   std::max(std::max(difference.x, difference.y),
+                                                            std::max(difference.z, difference.w)));
+        }
+    }
+
+    // one node of the last tenth turns per run, like an animated limb, only its subtree is recomputed
+    std::uniform_int_distribution<uint32_t> animatedNode(TRANSFORM_BENCHMARK_NODE_COUNT / 10 * 9,
+                                                         TRANSFORM_BENCHMARK_NODE_COUNT - 1);
+    double dirtyTime = 0.0;
+    uint32_t dirtyUpdateCount = 0;
+    for (uint32_t run = 0; run < CULLING_BENCHMARK_RUNS; run++)
+    {
+        const uint32_t node = animatedNode(generator);
+        tStart = Clock::now();
+        hierarchy.SetRotation(node, glm::normalize(glm::quat(1.0f, randomFloats(generator) * 0.1f, 0.0f, 0.0f)));
+        dirtyUpdateCount += hierarchy.Update();
+        dirtyTime += milliseconds(tStart, Clock::now());
+    }
+    transformBenchmark.dirtyTime = static_cast<float>(dirtyTime / CULLING_BENCHMARK_RUNS);
+    transformBenchmark.dirtyUpdateCount = dirtyUpdateCount / CULLING_BENCHMARK_RUNS;
+}
+
+void DeferredPBR::PickScene(const glm::vec2& uv)
+{
+    // the unjittered camera, a ray from the near to the far plane through the pixel
+    Camera* camera = Singleton<Camera>::Instance();
+    const glm::mat4 inverseViewProjection = glm::inverse(camera->matrices.perspective * camera->matrices.view);
+    const glm::vec2 ndc = uv * 2.0f - 1.0f;
+    const glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, 0.0f, 1.0f);
+    const glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+    const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    const glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+    const auto tStart = std::chrono::high_resolution_clock::now();
+    scenePick.hit = gltfModel->Raycast(origin, direction, scenePick.rayHit);
+    const auto tEnd = std::chrono::high_resolution_clock::now();
+    scenePick.time = static_cast<float>(std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+}
+
+void DeferredPBR::StartSSAOComparison()
+{
+    SsaoComparison& comparison = ssaoComparison;
+    comparison.enabled = graphicSettings->useSSAO;
+    comparison.compute = graphicSettings->ssaoCompute;
+    comparison.quality = graphicSettings->ssaoQuality;
+    comparison.paused = paused;
+    // every step has to see the same frame
+    paused = true;
+
+    // one rgba8 G_Occlusion, the buffer is idle since every frame waits for the queue
+    comparison.readbackBuffer.Destroy();
+    CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                 &comparison.readbackBuffer,
+                                                 4 * ssaoFrameBuffer->Width() * ssaoFrameBuffer->Height()));
+    CheckVulkanResult(comparison.readbackBuffer.Map());
+
+    vks::FrameBenchmark::Callbacks callbacks;
+    callbacks.apply = [this](uint32_t step)
+    {
+        const bool compute = step > 0;
+        const int quality = compute ? static_cast<int>(step - 1) : graphicSettings->ssaoQuality;
+        graphicSettings->useSSAO = true;
+        graphicSettings->ssaoCompute = compute;
+        if (quality != graphicSettings->ssaoQuality)
+        {
+            graphicSettings->ssaoQuality = quality;
+            ssaoDirty = true;
+        }
+        return true;
+    };
+    // the frame recorded next copies G_Occlusion, SubmitFrame() waits for the queue before it is measured
+    callbacks.prepareMeasure = [this](uint32_t) { ssaoComparison.readbackRequested = true; };
+    callbacks.measure = [this](uint32_t step)
+    {
+        SsaoComparison& comparison = ssaoComparison;
+        const uint32_t pixelCount = ssaoFrameBuffer->Width() * ssaoFrameBuffer->Height();
+        const uint8_t* pixels = static_cast<const uint8_t*>(comparison.readbackBuffer.mapped);
+        const float ssaoTime = gpuProfiler->GetTime("SSAO");
+        if (step == 0)
+        {
+            // red channel of every rgba8 texel
+            comparison.reference.resize(pixelCount);
+            for (uint32_t i = 0; i < pixelCount; i++)
+                comparison.reference[i] = pixels[4 * i];
+            return vks::FormatReport("%-8s: ssao %.3f ms, reference", "fragment", ssaoTime);
+        }
+
+        // absolute occlusion difference to the reference, occlusion is in [0, 1]
+        double absoluteErrorSum = 0.0;
+        double squaredErrorSum = 0.0;
+        float maxError = 0.0f;
+        for (uint32_t i = 0; i < pixelCount && i < comparison.reference.size(); i++)
+        {
+            const float error = std::abs(static_cast<float>(pixels[4 * i]) - static_cast<float>(comparison.reference[i])) / 255.0f;
+            absoluteErrorSum += error;
+            squaredErrorSum += error * error;
+            maxError = std::max(maxError, error);
+        }
+        const double meanSquaredError = squaredErrorSum / pixelCount;
+        const float psnr = meanSquaredError > 0.0 ? static_cast<float>(10.0 * std::log10(1.0 / meanSquaredError))
+                                                  : std::numeric_limits<float>::infinity();
+        return vks::FormatReport("%-8s: ssao %.3f ms, mean error %.4f, max error %.3f, psnr %.1f dB",
+                                 ssaoQualityTiers[step - 1].name, ssaoTime,
+                                 static_cast<float>(absoluteErrorSum / pixelCount), maxError, psnr);
+    };
+    callbacks.finish = [this]()
+    {
+        SsaoComparison& comparison = ssaoComparison;
+        graphicSettings->useSSAO = comparison.enabled;
+        graphicSettings->ssaoCompute = comparison.compute;
+        if (graphicSettings->ssaoQuality != comparison.quality)
+        {
+            graphicSettings->ssaoQuality = comparison.quality;
+            ssaoDirty = true;
+        }
+        paused = comparison.paused;
+    };
+    comparison.run.Start(static_cast<uint32_t>(IM_ARRAYSIZE(ssaoQualityTiers)) + 1, std::move(callbacks));
+}
+
+void DeferredPBR::Prepare()
+{
+    VulkanApplicationBase::Prepare();
+
+    LoadAsset();
+
+    // baking cubemap
+    BakingIrradianceCubeMap();
+    BakingPreFilteringCubeMap();
+    BakingSpecularBRDFCubeMap();
+
+    // SSAO
+    PrepareSSAOGenData();
+
+    // render pass
+    SetupMrtRenderPass();
+    SetupSSAORenderPass();
+    SetupSSAOComputeTargets();
+    SetupDepthPyramid();
+    SetupCascadeShadowMap();
+    SetupShadowAtlas();
+    SetupShadowRenderPass();
+    SetupShadowHistory();
+    SetupShadingRenderPasses();
+    SetupPostProcessTargets();
+
+    PrepareLightBuffers();
+    PrepareIndirectDrawBuffers();
+    PreparePostProcessBuffers();
     PrepareUniformBuffers();
+    SetupRenderGraph();
     SetupDescriptorSets();
 
     // prepare pipelines
     PrepareMrtPipeline();
     PrepareSSAOPipeline();
     PrepareSSAOBlurPipeline();
+    PrepareSSAOComputePipelines();
     PrepareShadowMapPipeline();
     PrepareDirectionalShadowPipeline();
+    PrepareShadowTemporalPipeline();
+    PrepareLightCullingPipeline();
+    PrepareDrawCullingPipeline();
+    PrepareDepthPyramidPipeline();
     PrepareLightingPipeline();
     PrepareSkyboxPipeline();
-    PreparePostprocessPipeline();
+    PreparePostProcessPipelines();
+
+    gpuProfiler = std::make_unique<vks::GpuProfiler>(vulkanDevice.get(), maxFrameInFlight);
     prepared = true;
 }
 
@@ -1680,6 +2985,8 @@ void DeferredPBR::LoadAsset()
     gltfModel = std::make_unique<vks::geometry::VulkanGLTFModel>();
     gltfModel->LoadGLTFFile(vks::helper::GetAssetPath() + "/models/buster_drone/scene.gltf",
                             vulkanDevice.get(), queue, gltfLoadingFlags, descriptorBindingFlags, 1);
+    gltfModel->PrepareObjects(maxFrameInFlight);
+    gltfModel->PrepareIndirectDraws();
 
     //     gltfModel->LoadGLTFFile(vks::helper::GetAssetPath() + "/models/Sponza/glTF/sponza.gltf",
     //     	vulkanDevice.get(), queue, gltfLoadingFlags, descriptorBindingFlags,1);
@@ -1715,6 +3022,22 @@ void DeferredPBR::PrepareUniformBuffers()
         sizeof(lightingUbo.values)));
     CheckVulkanResult(lightingUbo.buffer.Map());
 
+    // light culling uniform buffer
+    CheckVulkanResult(vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &lightCullingUbo.buffer,
+        sizeof(lightCullingUbo.values)));
+    CheckVulkanResult(lightCullingUbo.buffer.Map());
+
+    // draw culling uniform buffer
+    CheckVulkanResult(vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &drawCullingUbo.buffer,
+        sizeof(drawCullingUbo.values)));
+    CheckVulkanResult(drawCullingUbo.buffer.Map());
+
     // skybox uniform buffer
     CheckVulkanResult(vulkanDevice->CreateBuffer(
         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
@@ -1723,16 +3046,26 @@ void DeferredPBR::PrepareUniformBuffers()
         sizeof(skyboxUbo.values)));
     CheckVulkanResult(skyboxUbo.buffer.Map());
 
+    // no camera motion in the first frame
+    Camera* camera = Singleton<Camera>::Instance();
+    previousViewProjection = camera->matrices.perspective * camera->matrices.view;
+
     UpdateUniformBuffers();
 }
 
 void DeferredPBR::UpdateUniformBuffers()
 {
     Camera* camera = Singleton<Camera>::Instance();
+    // the passes drawing or reconstructing the scene share the jitter, light culling and shadows stay unjittered
+    const glm::vec2 jitter = ProjectionJitter();
+    const glm::mat4 projection = camera->GetJitteredPerspective(jitter);
     mrtUBO.values.nearPlane = camera->GetNearClip();
     mrtUBO.values.farPlane = camera->GetFarClip();
-    mrtUBO.values.projection = camera->matrices.perspective;
+    mrtUBO.values.projection = projection;
     mrtUBO.values.view = camera->matrices.view;
+    mrtUBO.values.previousViewProjection = previousViewProjection;
+    mrtUBO.values.jitter = glm::vec4(jitter, previousJitter);
+    cameraFrustum.Update(camera->matrices.perspective * camera->matrices.view);
     memcpy(mrtUBO.buffer.mapped, &mrtUBO.values, sizeof(mrtUBO.values));
 
     // ssao uniform buffer
@@ -1740,52 +3073,36 @@ void DeferredPBR::UpdateUniformBuffers()
     glm::mat4 viewMat  = camera->matrices.view;
     ssaoCreateUbo.values.view = viewMat;
     ssaoCreateUbo.values.invViewT = glm::inverseTranspose(glm::mat3(viewMat));
-    ssaoCreateUbo.values.projection = camera->matrices.perspective;
+    const glm::mat4 renderRegion = RenderRegionTransform(RenderScale());
+    ssaoCreateUbo.values.projection = renderRegion * projection;
+    ssaoCreateUbo.values.invProjection = glm::inverse(ssaoCreateUbo.values.projection);
     ssaoCreateUbo.values.ssaoRadius = graphicSettings->ssaoRadius;
     ssaoCreateUbo.values.ssaoBias = graphicSettings->ssaoBias;
+    ssaoCreateUbo.values.temporalFrame = graphicSettings->temporalAccumulation
+                                             ? static_cast<int32_t>(temporalFrameIndex % GlobalVars::TEMPORAL_SEQUENCE_LENGTH)
+                                             : 0;
     memcpy(ssaoCreateUbo.buffer.mapped, &ssaoCreateUbo.values, sizeof(ssaoCreateUbo.values));
 
     // shadow uniform buffer
-    shadowUbo.values.nearPlane = camera->GetNearClip();
-    shadowUbo.values.farPlane = camera->GetFarClip();
-    shadowUbo.values.projection = camera->matrices.perspective;
-    shadowUbo.values.view = camera->matrices.view;
-    shadowUbo.values.lightPosition = glm::vec3(0.0f, 1.85776f, 0.0f);
-    shadowUbo.values.lightSpace = camera->matrices.perspective * glm::lookAt(glm::vec3(0.0f, 1.85776f, 0.0f),
-        glm::vec3(0.0f),glm::vec3(0.0f,0.0f,1.0f));
-    memcpy(shadowUbo.buffer.mapped, &shadowUbo.values,sizeof(shadowUbo.values));
-
-    for (uint32_t i = 0; i < gltfModel->lights.size(); i++)
-    {
-        vks::geometry::Light light = gltfModel->lights[i];
-        lightingUbo.values.lights[i].color = light.color;
-        lightingUbo.values.lights[i].intensity = light.intensity;
-        lightingUbo.values.lights[i].position = light.position;
-    }
+    UpdateShadowCascades();
+    // after the camera and cascade frustums
+    UpdateDrawCulling();
 
-    // add default lights
-    if (gltfModel->lights.size() == 0)
-    {
-        // y杞翠笌Houdini y杞寸浉鍙
-        glm::vec3 lightPos = glm::vec3(0.0f, -1.85776f, 0.0f);
-        lightingUbo.values.lights[0].color = glm::vec4(1.0f);
-        lightingUbo.values.lights[0].intensity = 1.0f;
-        lightingUbo.values.lights[0].position = glm::vec4(lightPos, 1.0f);
-
-        lightPos = glm::vec3(0.149955f, -0.3774542f, 2.68973f);
-        lightingUbo.values.lights[1].color = glm::vec4(1.0f);
-        lightingUbo.values.lights[1].intensity = 1.0f;
-        lightingUbo.values.lights[1].position = glm::vec4(lightPos, 1.0f);
-    }
+    UpdateLightBuffers();
 
     lightingUbo.values.viewPos = glm::vec4(camera->position, 1.0f);
     lightingUbo.values.viewMat = camera->matrices.view;
+    lightingUbo.values.invViewProjection = glm::inverse(renderRegion * projection * camera->matrices.view);
+    lightingUbo.values.renderScale = glm::vec4(RenderScale(), 0.0f, 0.0f);
+    lightingUbo.values.clusterGrid = lightCullingUbo.values.clusterGrid;
+    lightingUbo.values.clusterDepth = glm::vec4(lightClusterGrid.nearPlane, lightClusterGrid.farPlane,
+                                                lightClusterGrid.SliceScale(), lightClusterGrid.SliceBias());
     memcpy(lightingUbo.buffer.mapped, &lightingUbo.values, sizeof(lightingUbo.values));
 
     // skybox uniform buffer
     skyboxUbo.values.model = glm::scale(glm::mat4(1.0f), glm::vec3(10, 10, 10));
     skyboxUbo.values.view = camera->matrices.view;
-    skyboxUbo.values.projection = camera->matrices.perspective;
+    skyboxUbo.values.projection = projection;
     memcpy(skyboxUbo.buffer.mapped, &skyboxUbo.values, sizeof(skyboxUbo.values));
 }
 
@@ -1793,26 +3110,52 @@ void DeferredPBR::SetupDescriptorSets()
 {
     if (mrtDescriptorSetLayout_Vertex != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, mrtDescriptorSetLayout_Vertex, nullptr);
+    if (drawDataDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, drawDataDescriptorSetLayout, nullptr);
 
     if(ssaoDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, ssaoDescriptorSetLayout, nullptr);
     if(ssaoBlurDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, ssaoBlurDescriptorSetLayout, nullptr);
+    if(ssaoDownsampleDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoDownsampleDescriptorSetLayout, nullptr);
+    if(ssaoComputeDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoComputeDescriptorSetLayout, nullptr);
+    if(ssaoTemporalDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoTemporalDescriptorSetLayout, nullptr);
+    if(ssaoBilateralBlurDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoBilateralBlurDescriptorSetLayout, nullptr);
+    if(ssaoUpsampleDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, ssaoUpsampleDescriptorSetLayout, nullptr);
 
     if(shadowMapDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, shadowMapDescriptorSetLayout, nullptr);
     if(directionalShadowDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, directionalShadowDescriptorSetLayout, nullptr);
+    if(shadowTemporalDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, shadowTemporalDescriptorSetLayout, nullptr);
+
+    if (lightCullingDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, lightCullingDescriptorSetLayout, nullptr);
+    if (drawCullingDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, drawCullingDescriptorSetLayout, nullptr);
+    if (depthPyramidDescriptorSetLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, depthPyramidDescriptorSetLayout, nullptr);
 
     if (lightingDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, lightingDescriptorSetLayout, nullptr);
 
-    if (postprocessDescriptorSetLayout != VK_NULL_HANDLE)
-        vkDestroyDescriptorSetLayout(device, postprocessDescriptorSetLayout, nullptr);
-
     if (skyboxDescriptorSetLayout != VK_NULL_HANDLE)
         vkDestroyDescriptorSetLayout(device, skyboxDescriptorSetLayout, nullptr);
 
+    for (VkDescriptorSetLayout descriptorSetLayout : {autoExposureDescriptorSetLayout, bloomDescriptorSetLayout,
+                                                      temporalUpscaleDescriptorSetLayout, sharpenDescriptorSetLayout,
+                                                      postProcessDescriptorSetLayout, postProcessResultDescriptorSetLayout})
+    {
+        if (descriptorSetLayout != VK_NULL_HANDLE)
+            vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    }
+
     if (descriptorPool != VK_NULL_HANDLE)
         vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
@@ -1821,7 +3164,36 @@ void DeferredPBR::SetupDescriptorSets()
         vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 100),
         // 3 for lighting pass => fragment shader
         vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 100),
-
+        // light and cluster buffers for light culling and lighting
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 * maxFrameInFlight),
+        // shadow atlas tiles for the atlas pass and lighting
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * maxFrameInFlight),
+        // compute ssao: downsample 2, ssao 3, temporal 4, blur 2 x 2, upsample 3 samplers and 6 storage images per frame
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16 * maxFrameInFlight),
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 6 * maxFrameInFlight),
+        // shadow accumulation: 4 samplers and 1 storage image per frame
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 * maxFrameInFlight),
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxFrameInFlight),
+        // merged deferred path: lighting 4 input attachments per frame
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 4 * maxFrameInFlight),
+        // post processing: auto exposure 1, bloom 2 per level pass, post process 4 x 2 and the UI 1 sampler,
+        // auto exposure 2 and post process 4 x 1 storage buffers, a storage image per bloom pass and post process set
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                              (10 + 2 * (2 * GlobalVars::BLOOM_LEVEL_COUNT - 1)) * maxFrameInFlight),
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 * maxFrameInFlight),
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                              (2 * GlobalVars::BLOOM_LEVEL_COUNT + 3) * maxFrameInFlight),
+        // temporal upscaling: temporal 4 and sharpen 1 samplers, 1 storage image each per frame
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5 * maxFrameInFlight),
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * maxFrameInFlight),
+        // GPU driven rendering: draw data 3 and draw culling 7 storage buffers, draw culling 1 uniform buffer per frame
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10 * maxFrameInFlight),
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxFrameInFlight),
+        // occlusion culling: draw culling and depth pyramid 1 sampler each, the pyramid levels and its counter per frame
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * maxFrameInFlight),
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                              GlobalVars::MAX_DEPTH_PYRAMID_LEVEL_COUNT * maxFrameInFlight),
+        vks::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxFrameInFlight),
     };
     
     VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::DescriptorPoolCreateInfo(
@@ -1851,6 +3223,37 @@ void DeferredPBR::SetupDescriptorSets()
         }
     }
 
+    // the model's draw records for the indirect draws, and the objects of the frame
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_VERTEX_BIT, 0),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_VERTEX_BIT, 1),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
+            setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &drawDataDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &drawDataDescriptorSetLayout, 1);
+        drawDataDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &drawDataDescriptorSets[i]));
+            VkDescriptorBufferInfo objectDescriptor = gltfModel->ObjectDescriptor(i);
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(drawDataDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      0, &gltfModel->indirectDraws.recordBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(drawDataDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      1, &objectDescriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()),
+                                   writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
     // for ssao subpass
     {
          std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
@@ -1886,9 +3289,9 @@ void DeferredPBR::SetupDescriptorSets()
             CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &ssaoDescriptorSets[i]));
             vks::FrameBuffer* frameBuffer = mrtFrameBuffer->GetFrameBuffer(i);
             int binding = 0;
-            // position
+            // depth, view space positions are reconstructed from it
             {
-                const vks::FramebufferAttachment& attachmentInfo = frameBuffer->GetAttachment("G_WorldPosition");
+                const vks::FramebufferAttachment& attachmentInfo = frameBuffer->GetAttachment("Depth");
                 VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(
                         ssaoDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding,
                         &const_cast<VkDescriptorImageInfo&>(attachmentInfo.descriptor));
@@ -1897,7 +3300,7 @@ void DeferredPBR::SetupDescriptorSets()
             }
             // normal
             {
-                const vks::FramebufferAttachment& attachmentInfo = frameBuffer->GetAttachment("G_WorldNormal");
+                const vks::FramebufferAttachment& attachmentInfo = frameBuffer->GetAttachment("G_Normal");
                 VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(
                         ssaoDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding,
                         &const_cast<VkDescriptorImageInfo&>(attachmentInfo.descriptor));
@@ -1964,13 +3367,236 @@ void DeferredPBR::SetupDescriptorSets()
         }
     }
 
-    // for shadowmap subpass
+    // for compute ssao, depth and normal downsample
     {
-        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings ={
-                vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,0)
-        };
-
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // depth
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // normal
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // reduced depth and normal
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+            // ubo
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 4),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &ssaoDownsampleDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &ssaoDownsampleDescriptorSetLayout, 1);
+        ssaoDownsampleDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &ssaoDownsampleDescriptorSets[i]));
+            vks::FrameBuffer* frameBuffer = mrtFrameBuffer->GetFrameBuffer(i);
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(ssaoDownsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("Depth").descriptor)),
+                vks::initializers::WriteDescriptorSet(ssaoDownsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("G_Normal").descriptor)),
+                vks::initializers::WriteDescriptorSet(ssaoDownsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
+                                                      &ssaoComputeTargets[i].depth->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoDownsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3,
+                                                      &ssaoComputeTargets[i].normal->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoDownsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4,
+                                                      &ssaoCreateUbo.buffer.descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for compute ssao
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // reduced depth
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // reduced normal
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // noise
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+            // ubo
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+            // occlusion
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 4),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &ssaoComputeDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &ssaoComputeDescriptorSetLayout, 1);
+        ssaoComputeDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &ssaoComputeDescriptorSets[i]));
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(ssaoComputeDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &ssaoComputeTargets[i].depth->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoComputeDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                      &ssaoComputeTargets[i].normal->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoComputeDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+                                                      &ssaoNoiseTexture->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoComputeDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3,
+                                                      &ssaoCreateUbo.buffer.descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoComputeDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4,
+                                                      &ssaoComputeTargets[i].occlusion->descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for compute ssao accumulation, frame i reads the history of the frame before and writes its own
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // raw occlusion
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // reduced depth
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // previous history
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+            // velocity
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+            // history
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 4),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &ssaoTemporalDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &ssaoTemporalDescriptorSetLayout, 1);
+        ssaoTemporalDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &ssaoTemporalDescriptorSets[i]));
+            SsaoComputeTargets& targets = ssaoComputeTargets[i];
+            SsaoComputeTargets& previousTargets = ssaoComputeTargets[(i + maxFrameInFlight - 1) % maxFrameInFlight];
+            vks::FrameBuffer* frameBuffer = mrtFrameBuffer->GetFrameBuffer(i);
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(ssaoTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &targets.occlusion->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                      &targets.depth->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+                                                      &previousTargets.history->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("G_Velocity").descriptor)),
+                vks::initializers::WriteDescriptorSet(ssaoTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4,
+                                                      &targets.history->descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for compute ssao bilateral blur, the horizontal pass reads the accumulated history and the vertical pass writes occlusion
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // source occlusion
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // reduced depth
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // blurred occlusion
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &ssaoBilateralBlurDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &ssaoBilateralBlurDescriptorSetLayout, 1);
+        ssaoBilateralBlurDescriptorSets.resize(2 * maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            SsaoComputeTargets& targets = ssaoComputeTargets[i];
+            const std::array<std::pair<VkDescriptorImageInfo*, VkDescriptorImageInfo*>, 2> passes = {
+                std::make_pair(&targets.history->descriptor, &targets.blurred->descriptor),
+                std::make_pair(&targets.blurred->descriptor, &targets.occlusion->descriptor),
+            };
+            for (uint32_t pass = 0; pass < passes.size(); pass++)
+            {
+                VkDescriptorSet& descriptorSet = ssaoBilateralBlurDescriptorSets[2 * i + pass];
+                CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+                std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                          passes[pass].first),
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                          &targets.depth->descriptor),
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
+                                                          passes[pass].second),
+                };
+                vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+            }
+        }
+    }
+
+    // for compute ssao upsample, replaces the blur subpass of the ssao render pass
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // blurred occlusion
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+            // reduced depth
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+            // depth
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+            // ubo
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &ssaoUpsampleDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &ssaoUpsampleDescriptorSetLayout, 1);
+        ssaoUpsampleDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &ssaoUpsampleDescriptorSets[i]));
+            vks::FrameBuffer* frameBuffer = mrtFrameBuffer->GetFrameBuffer(i);
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(ssaoUpsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &ssaoComputeTargets[i].occlusion->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoUpsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                      &ssaoComputeTargets[i].depth->descriptor),
+                vks::initializers::WriteDescriptorSet(ssaoUpsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("Depth").descriptor)),
+                vks::initializers::WriteDescriptorSet(ssaoUpsampleDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3,
+                                                      &ssaoCreateUbo.buffer.descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for shadowmap subpass
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings ={
+                vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,0)
+        };
+
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
                 setLayoutBindings.data(), setLayoutBindings.size());
         CheckVulkanResult(
@@ -1991,13 +3617,42 @@ void DeferredPBR::SetupDescriptorSets()
         }
     }
 
+    // for shadow atlas tiles, the cube pass reads them in the geometry shader
+    {
+        VkShaderStageFlags tileStages = VK_SHADER_STAGE_VERTEX_BIT;
+        if (singlePassPointShadowsSupported)
+            tileStages |= VK_SHADER_STAGE_GEOMETRY_BIT;
+        VkDescriptorSetLayoutBinding setLayoutBinding = vks::initializers::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, tileStages, 0);
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
+            &setLayoutBinding, 1);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &shadowAtlasDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(descriptorPool,
+            &shadowAtlasDescriptorSetLayout, 1);
+        shadowAtlasDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &shadowAtlasDescriptorSets[i]));
+            VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(
+                shadowAtlasDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &shadowTileBuffer.descriptor);
+            vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+        }
+    }
+
     // for directional shadow subpass
     {
         std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings ={
                 vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,0),
+                                                              VK_SHADER_STAGE_FRAGMENT_BIT,0),
                 vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                                               VK_SHADER_STAGE_FRAGMENT_BIT,1),
+                vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                              VK_SHADER_STAGE_FRAGMENT_BIT,2),
+                vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                              VK_SHADER_STAGE_FRAGMENT_BIT,3),
+                vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                              VK_SHADER_STAGE_FRAGMENT_BIT,4),
         };
 
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
@@ -2017,34 +3672,105 @@ void DeferredPBR::SetupDescriptorSets()
                     directionalShadowDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, binding, &shadowUbo.buffer.descriptor);
             vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
             binding++;
-            vks::FrameBuffer* frameBuffer = shadowFrameBuffer->GetFrameBuffer(i);
-            const vks::FramebufferAttachment& depthAttachment = frameBuffer->GetAttachment("_Depth_ShadowMap");
+            // all cascades as one sampler2DArrayShadow
             writeDescriptorSet = vks::initializers::WriteDescriptorSet(
                     directionalShadowDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    binding, &const_cast<VkDescriptorImageInfo&>(depthAttachment.descriptor));
+                    binding, &cascadeShadowMap->compareDescriptor);
             vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
             binding++;
+            // G-buffer depth and normals of the same frame
+            vks::FrameBuffer* frameBuffer = mrtFrameBuffer->GetFrameBuffer(i);
+            for (const char* attachmentName : {"Depth", "G_Normal"})
+            {
+                const vks::FramebufferAttachment& attachmentInfo = frameBuffer->GetAttachment(attachmentName);
+                writeDescriptorSet = vks::initializers::WriteDescriptorSet(
+                        directionalShadowDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding,
+                        &const_cast<VkDescriptorImageInfo&>(attachmentInfo.descriptor));
+                vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+                binding++;
+            }
+            // raw depth of the cascades for the blocker search
+            writeDescriptorSet = vks::initializers::WriteDescriptorSet(
+                    directionalShadowDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    binding, &cascadeShadowMap->descriptor);
+            vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+        }
+    }
+
+    // for shadow accumulation, frame i reads the history of the frame before and writes its own
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // G_Shadow
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // depth
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // previous history
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+            // velocity
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+            // history
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 4),
+            // shadow ubo
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 5),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &shadowTemporalDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &shadowTemporalDescriptorSetLayout, 1);
+        shadowTemporalDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &shadowTemporalDescriptorSets[i]));
+            vks::FrameBuffer* frameBuffer = mrtFrameBuffer->GetFrameBuffer(i);
+            const uint32_t previous = (i + maxFrameInFlight - 1) % maxFrameInFlight;
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(shadowTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &const_cast<VkDescriptorImageInfo&>(shadowFrameBuffer->GetFrameBuffer(i)->GetAttachment("G_Shadow").descriptor)),
+                vks::initializers::WriteDescriptorSet(shadowTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("Depth").descriptor)),
+                vks::initializers::WriteDescriptorSet(shadowTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+                                                      &shadowHistory[previous]->descriptor),
+                vks::initializers::WriteDescriptorSet(shadowTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("G_Velocity").descriptor)),
+                vks::initializers::WriteDescriptorSet(shadowTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4,
+                                                      &shadowHistory[i]->descriptor),
+                vks::initializers::WriteDescriptorSet(shadowTemporalDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5,
+                                                      &shadowUbo.buffer.descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
         }
     }
     
+    // the merged deferred path reads the attachments written in the same render pass as input attachments
+    const VkDescriptorType gBufferDescriptorType = graphicSettings->subpassDeferred
+        ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
     // for lighting pass
     {
         std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
         {
-            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            vks::initializers::DescriptorSetLayoutBinding(gBufferDescriptorType,
                                                           VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+            // normals are sampled by the screen space passes as well, they always come from the mrt pass
             vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                                           VK_SHADER_STAGE_FRAGMENT_BIT, 1),
-            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            vks::initializers::DescriptorSetLayoutBinding(gBufferDescriptorType,
                                                           VK_SHADER_STAGE_FRAGMENT_BIT, 2),
-            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            vks::initializers::DescriptorSetLayoutBinding(gBufferDescriptorType,
                                                           VK_SHADER_STAGE_FRAGMENT_BIT, 3),
-            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            vks::initializers::DescriptorSetLayoutBinding(gBufferDescriptorType,
                                                           VK_SHADER_STAGE_FRAGMENT_BIT, 4),
             vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                                           VK_SHADER_STAGE_FRAGMENT_BIT, 5),
-            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 6),
+            // 6 was the color copy of the depth buffer
             vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                                           VK_SHADER_STAGE_FRAGMENT_BIT, 7),
             vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
@@ -2056,6 +3782,18 @@ void DeferredPBR::SetupDescriptorSets()
             vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
                                                           VK_SHADER_STAGE_FRAGMENT_BIT,
                                                           11),
+            // lights, cluster light counts, cluster light indices
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 12),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 13),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 14),
+            // shadow atlas and its tiles
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 15),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 16),
         };
 
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
@@ -2070,17 +3808,28 @@ void DeferredPBR::SetupDescriptorSets()
         {
             CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &lightingDescriptorSets[i]));
             vks::FrameBuffer* frameBuffer = mrtRenderPass->vulkanFrameBuffer->GetFrameBuffer(i);
-            // attachment
+            vks::FrameBuffer* gBufferFrameBuffer = graphicSettings->subpassDeferred
+                ? deferredFrameBuffer->GetFrameBuffer(i) : frameBuffer;
+            // attachment, depth first and then the color attachments in order
             int binding = 0;
-            for (uint32_t s = 0; s < frameBuffer->attachments.size(); s++)
+            for (const char* attachmentName : {"Depth", "G_Normal", "G_Color", "G_Material", "G_Emissive"})
             {
-                if (frameBuffer->attachments[s].IsDepthStencil()) continue;
+                const bool sampled = binding == 1;
+                const vks::FramebufferAttachment& attachmentInfo = (sampled ? frameBuffer : gBufferFrameBuffer)
+                    ->GetAttachment(attachmentName);
                 VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(
-                    lightingDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding,
-                    &frameBuffer->attachments[s].descriptor);
+                    lightingDescriptorSets[i], sampled ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : gBufferDescriptorType,
+                    binding, &const_cast<VkDescriptorImageInfo&>(attachmentInfo.descriptor));
                 vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
                 binding++;
             }
+            // blurred ssao of the same frame, multiplied with the material ao in the shader
+            const vks::FramebufferAttachment& ssaoAttachment = ssaoFrameBuffer->GetFrameBuffer(i)->GetAttachment("G_Occlusion");
+            VkWriteDescriptorSet ssaoWriteDescriptorSet = vks::initializers::WriteDescriptorSet(
+                lightingDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding,
+                &const_cast<VkDescriptorImageInfo&>(ssaoAttachment.descriptor));
+            vkUpdateDescriptorSets(device, 1, &ssaoWriteDescriptorSet, 0, nullptr);
+            binding = 7;
 
             // IrradianceCube
             VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(
@@ -2103,11 +3852,10 @@ void DeferredPBR::SetupDescriptorSets()
             vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
             binding++;
 
-            // shadow result
-            const vks::FramebufferAttachment& shadowAttachment = shadowFrameBuffer->GetFrameBuffer(i)->GetAttachment("G_Shadow");
+            // shadow result, accumulated over the previous frames
             writeDescriptorSet = vks::initializers::WriteDescriptorSet(lightingDescriptorSets[i],
                                                                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                                                       binding, &const_cast<VkDescriptorImageInfo&>(shadowAttachment.descriptor));
+                                                                       binding, &shadowHistory[i]->descriptor);
             vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
             binding++;
 
@@ -2117,6 +3865,163 @@ void DeferredPBR::SetupDescriptorSets()
                                                                        binding, &lightingUbo.buffer.descriptor);
             vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
             binding++;
+
+            // clustered lights
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(lightingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      binding, &lightBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(lightingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      binding + 1, &clusterLightCountBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(lightingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      binding + 2, &clusterLightIndexBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(lightingDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                      binding + 3, &shadowAtlasMap->compareDescriptor),
+                vks::initializers::WriteDescriptorSet(lightingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      binding + 4, &shadowTileBuffer.descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()),
+                                   writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for light culling compute pass
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+        };
+
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
+            setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &lightCullingDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(descriptorPool,
+            &lightCullingDescriptorSetLayout,
+            1);
+        lightCullingDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &lightCullingDescriptorSets[i]));
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(lightCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                      0, &lightCullingUbo.buffer.descriptor),
+                vks::initializers::WriteDescriptorSet(lightCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      1, &lightBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(lightCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      2, &clusterLightCountBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(lightCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      3, &clusterLightIndexBuffer.descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()),
+                                   writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for draw culling compute pass
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        };
+        for (uint32_t binding = 1; binding <= 7; binding++)
+            setLayoutBindings.push_back(vks::initializers::DescriptorSetLayoutBinding(
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, binding));
+        // depth pyramid of the late phase
+        setLayoutBindings.push_back(vks::initializers::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 8));
+
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
+            setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &drawCullingDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(descriptorPool,
+            &drawCullingDescriptorSetLayout,
+            1);
+        drawCullingDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &drawCullingDescriptorSets[i]));
+            VkDescriptorBufferInfo objectDescriptor = gltfModel->ObjectDescriptor(i);
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                      0, &drawCullingUbo.buffer.descriptor),
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      1, &gltfModel->indirectDraws.recordBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      2, &objectDescriptor),
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      3, &gltfModel->indirectDraws.batchBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      4, &indirectCommandBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      5, &indirectCountBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      6, &drawVisibilityBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      7, &occlusionStatsBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(drawCullingDescriptorSets[i],
+                                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 8,
+                                                      &depthPyramid->descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()),
+                                   writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for the depth pyramid compute pass
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1,
+                                                          GlobalVars::MAX_DEPTH_PYRAMID_LEVEL_COUNT),
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
+            setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &depthPyramidDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(descriptorPool,
+            &depthPyramidDescriptorSetLayout, 1);
+
+        // the array has a descriptor for every possible level, the ones past the last level repeat it
+        std::vector<VkDescriptorImageInfo> levelDescriptors(GlobalVars::MAX_DEPTH_PYRAMID_LEVEL_COUNT);
+        for (uint32_t level = 0; level < GlobalVars::MAX_DEPTH_PYRAMID_LEVEL_COUNT; level++)
+        {
+            const uint32_t levelCount = depthPyramid->LevelCount();
+            levelDescriptors[level] = depthPyramid->descriptor;
+            levelDescriptors[level].sampler = VK_NULL_HANDLE;
+            if (levelCount > 1)
+                levelDescriptors[level].imageView = depthPyramid->levelViews[std::min(level, levelCount - 1)];
+        }
+        depthPyramidDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &depthPyramidDescriptorSets[i]));
+            vks::FrameBuffer* frameBuffer = mrtRenderPass->vulkanFrameBuffer->GetFrameBuffer(i);
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(depthPyramidDescriptorSets[i],
+                                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("Depth").descriptor)),
+                vks::initializers::WriteDescriptorSet(depthPyramidDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                      1, levelDescriptors.data(),
+                                                      GlobalVars::MAX_DEPTH_PYRAMID_LEVEL_COUNT),
+                vks::initializers::WriteDescriptorSet(depthPyramidDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                      2, &depthPyramidCounterBuffer.descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()),
+                                   writeDescriptorSets.data(), 0, nullptr);
         }
     }
 
@@ -2160,79 +4065,270 @@ void DeferredPBR::SetupDescriptorSets()
         }
     }
 
-    // for postprocess pass
+    // for the luminance histogram and exposure passes
     {
         std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
         {
+            // scene color
             vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // histogram
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // exposure
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &autoExposureDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &autoExposureDescriptorSetLayout, 1);
+        autoExposureDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &autoExposureDescriptorSets[i]));
+            vks::FrameBuffer* frameBuffer = lightingFrameBuffer->GetFrameBuffer(i);
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(autoExposureDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("SceneColor").descriptor)),
+                vks::initializers::WriteDescriptorSet(autoExposureDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                                                      &luminanceHistogramBuffer.descriptor),
+                vks::initializers::WriteDescriptorSet(autoExposureDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2,
+                                                      &exposureBuffer.descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for the bloom chain, each downsample reads the level above and each upsample the smaller upsampled level
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // source
             vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // downsampled level added by the upsample
             vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                                          VK_SHADER_STAGE_FRAGMENT_BIT, 2)
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // level
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
         };
-
-        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
-            setLayoutBindings.data(), setLayoutBindings.size());
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
         CheckVulkanResult(
-            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &postprocessDescriptorSetLayout));
-        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(descriptorPool,
-            &postprocessDescriptorSetLayout,
-            1);
-        postprocessDescriptorSets.resize(maxFrameInFlight);
-
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &bloomDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &bloomDescriptorSetLayout, 1);
+        const uint32_t setsPerFrame = 2 * GlobalVars::BLOOM_LEVEL_COUNT - 1;
+        bloomDescriptorSets.resize(setsPerFrame * maxFrameInFlight);
         for (uint32_t i = 0; i < maxFrameInFlight; i++)
         {
-            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &postprocessDescriptorSets[i]));
-            vks::FrameBuffer* frameBuffer = mrtRenderPass->vulkanFrameBuffer->GetFrameBuffer(i);
-            int binding = 0;
-            // update mrt depth
-            for (uint32_t s = 0; s < frameBuffer->attachments.size(); s++)
+            PostProcessTargets& targets = postProcessTargets[i];
+            VkDescriptorImageInfo* sceneColor = &const_cast<VkDescriptorImageInfo&>(
+                lightingFrameBuffer->GetFrameBuffer(i)->GetAttachment("SceneColor").descriptor);
+            // source, added level and target of every pass, the downsamples do not read the added level
+            std::vector<std::array<VkDescriptorImageInfo*, 3>> passes;
+            for (uint32_t level = 0; level < GlobalVars::BLOOM_LEVEL_COUNT; level++)
             {
-                if (frameBuffer->attachments[s].name != "G_Depth") continue;
-                VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(
-                    postprocessDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding,
-                    &frameBuffer->attachments[s].descriptor);
-                vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
-                binding++;
+                VkDescriptorImageInfo* source = level == 0 ? sceneColor : &targets.bloomDown[level - 1]->descriptor;
+                passes.push_back({source, source, &targets.bloomDown[level]->descriptor});
             }
-            // update light result
-            vks::FrameBuffer* lightingFrameBuffer = lightingRenderPass->vulkanFrameBuffer->GetFrameBuffer(i);
-            vks::FramebufferAttachment& lightingResultAttachment = lightingFrameBuffer->attachments[0];
-            VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(
-                postprocessDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding,
-                &lightingResultAttachment.descriptor);
-            vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
-            binding++;
+            for (uint32_t level = 0; level < GlobalVars::BLOOM_LEVEL_COUNT - 1; level++)
+            {
+                VkDescriptorImageInfo* source = level == GlobalVars::BLOOM_LEVEL_COUNT - 2
+                    ? &targets.bloomDown[level + 1]->descriptor : &targets.bloomUp[level + 1]->descriptor;
+                passes.push_back({source, &targets.bloomDown[level]->descriptor, &targets.bloomUp[level]->descriptor});
+            }
+            for (uint32_t pass = 0; pass < setsPerFrame; pass++)
+            {
+                VkDescriptorSet& descriptorSet = bloomDescriptorSets[setsPerFrame * i + pass];
+                CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+                std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                          passes[pass][0]),
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                          passes[pass][1]),
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
+                                                          passes[pass][2]),
+                };
+                vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+            }
+        }
+    }
 
-            // update env cube map
-            vks::FrameBuffer* skyboxFrameBuffer = skyboxRenderPass->vulkanFrameBuffer->GetFrameBuffer(i);
-            auto skyboxResultAttachment = skyboxFrameBuffer->attachments[0];
-            writeDescriptorSet = vks::initializers::WriteDescriptorSet(
-                postprocessDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding,
-                &skyboxResultAttachment.descriptor);
-            vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
-            binding++;
+    // for the temporal upscale pass, accumulates into the history of this frame from the one of the frame before
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // scene color
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // depth
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // velocity
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+            // previous history
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+            // history
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 4),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &temporalUpscaleDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &temporalUpscaleDescriptorSetLayout, 1);
+        temporalUpscaleDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &temporalUpscaleDescriptorSets[i]));
+            vks::FrameBuffer* frameBuffer = mrtFrameBuffer->GetFrameBuffer(i);
+            const uint32_t previous = (i + maxFrameInFlight - 1) % maxFrameInFlight;
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(temporalUpscaleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &const_cast<VkDescriptorImageInfo&>(lightingFrameBuffer->GetFrameBuffer(i)->GetAttachment("SceneColor").descriptor)),
+                vks::initializers::WriteDescriptorSet(temporalUpscaleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("Depth").descriptor)),
+                vks::initializers::WriteDescriptorSet(temporalUpscaleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+                                                      &const_cast<VkDescriptorImageInfo&>(frameBuffer->GetAttachment("G_Velocity").descriptor)),
+                vks::initializers::WriteDescriptorSet(temporalUpscaleDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3,
+                                                      &postProcessTargets[previous].upscaleHistory->descriptor),
+                vks::initializers::WriteDescriptorSet(temporalUpscaleDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4,
+                                                      &postProcessTargets[i].upscaleHistory->descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
         }
     }
-}
 
-void DeferredPBR::PrepareMrtPipeline()
+    // for the sharpen pass, the history stays unsharpened so the sharpening does not accumulate
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // history
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // upscaled
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &sharpenDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &sharpenDescriptorSetLayout, 1);
+        sharpenDescriptorSets.resize(maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &sharpenDescriptorSets[i]));
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                vks::initializers::WriteDescriptorSet(sharpenDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                      &postProcessTargets[i].upscaleHistory->descriptor),
+                vks::initializers::WriteDescriptorSet(sharpenDescriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
+                                                      &postProcessTargets[i].upscaled->descriptor),
+            };
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        }
+    }
+
+    // for the post process pass, the scene comes from the scene color or the upscaled color, the bloom chain is not
+    // written while bloom is off, the second set of each scene source binds that source in its place
+    {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // scene color
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+            // bloom
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+            // exposure
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+            // result
+            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &postProcessDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &postProcessDescriptorSetLayout, 1);
+        postProcessDescriptorSets.resize(4 * maxFrameInFlight);
+        for (uint32_t i = 0; i < maxFrameInFlight; i++)
+        {
+            PostProcessTargets& targets = postProcessTargets[i];
+            VkDescriptorImageInfo* sceneColor = &const_cast<VkDescriptorImageInfo&>(
+                lightingFrameBuffer->GetFrameBuffer(i)->GetAttachment("SceneColor").descriptor);
+            const std::array<VkDescriptorImageInfo*, 2> sceneSources = {sceneColor, &targets.upscaled->descriptor};
+            for (uint32_t set = 0; set < 4; set++)
+            {
+                VkDescriptorImageInfo* sceneSource = sceneSources[set / 2];
+                VkDescriptorImageInfo* bloomSource = set % 2 == 0 ? &targets.bloomUp[0]->descriptor : sceneSource;
+                VkDescriptorSet& descriptorSet = postProcessDescriptorSets[4 * i + set];
+                CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+                std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                                          sceneSource),
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                                          bloomSource),
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2,
+                                                          &exposureBuffer.descriptor),
+                    vks::initializers::WriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3,
+                                                          &targets.result->descriptor),
+                };
+                vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+            }
+        }
+    }
+
+    // the UI draws the post process result with the same single sampler layout as the frame buffer attachments
+    {
+        VkDescriptorSetLayoutBinding setLayoutBinding = vks::initializers::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::DescriptorSetLayoutCreateInfo(
+            &setLayoutBinding, 1);
+        CheckVulkanResult(
+            vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &postProcessResultDescriptorSetLayout));
+        VkDescriptorSetAllocateInfo allocInfo = vks::initializers::DescriptorSetAllocateInfo(
+            descriptorPool, &postProcessResultDescriptorSetLayout, 1);
+        for (PostProcessTargets& targets : postProcessTargets)
+        {
+            CheckVulkanResult(vkAllocateDescriptorSets(device, &allocInfo, &targets.resultDescriptorSet));
+            VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(
+                targets.resultDescriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &targets.result->descriptor);
+            vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+        }
+    }
+}
+
+void DeferredPBR::PrepareMrtPipeline()
 {
     // create pipeline layout
-    // Pipeline layout using both descriptor sets (set 0 = matrices, set 1 = material)
+    // Pipeline layout using three descriptor sets (set 0 = matrices, set 1 = material, set 2 = records and objects)
     std::vector<VkDescriptorSetLayout> setLayouts;
     setLayouts.push_back(mrtDescriptorSetLayout_Vertex);
     setLayouts.push_back(vks::geometry::descriptorSetLayoutImage);
+    setLayouts.push_back(drawDataDescriptorSetLayout);
     VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
         setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
-    // We will use push constants to push the local matrices of a primitive to the vertex shader
+    // We will use push constants to push the object index of a primitive to the vertex shader
     VkPushConstantRange pushConstantRange = vks::initializers::PushConstantRange(
-        VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
+        VK_SHADER_STAGE_VERTEX_BIT, sizeof(uint32_t), 0);
     // Push constant ranges are part of the pipeline layout
     pipelineLayoutCI.pushConstantRangeCount = 1;
     pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
-    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &mrtPipelineLayout));
+    // kept when the pipelines are rebuilt for the other deferred path
+    if (mrtPipelineLayout == VK_NULL_HANDLE)
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &mrtPipelineLayout));
+    // the indirect draws take the object index from the draw records in set 2
+    pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(setLayouts.data(),
+                                                                   static_cast<uint32_t>(setLayouts.size()));
+    if (mrtIndirectPipelineLayout == VK_NULL_HANDLE)
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &mrtIndirectPipelineLayout));
 
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI =
         vks::initializers::PipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
@@ -2246,8 +4342,6 @@ void DeferredPBR::PrepareMrtPipeline()
         vks::initializers::PipelineColorBlendAttachmentState(0xf, VK_FALSE),
         vks::initializers::PipelineColorBlendAttachmentState(0xf, VK_FALSE),
         vks::initializers::PipelineColorBlendAttachmentState(0xf, VK_FALSE),
-        vks::initializers::PipelineColorBlendAttachmentState(0xf, VK_FALSE),
-        vks::initializers::PipelineColorBlendAttachmentState(0xf, VK_FALSE),
     };
     VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::PipelineColorBlendStateCreateInfo(
         blendAttachmentStates.size(), blendAttachmentStates.data());
@@ -2293,6 +4387,10 @@ void DeferredPBR::PrepareMrtPipeline()
         LoadShader(vks::helper::GetShaderBasePath() + "deferred/mrt.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
         LoadShader(vks::helper::GetShaderBasePath() + "deferred/mrt.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
     };
+    const std::array<VkPipelineShaderStageCreateInfo, 2> indirectShaderStages = {
+        LoadShader(vks::helper::GetShaderBasePath() + "deferred/mrtIndirect.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+        shaderStages[1]
+    };
 
     VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::PipelineCreateInfo();
     pipelineCI.layout = mrtPipelineLayout;
@@ -2309,18 +4407,44 @@ void DeferredPBR::PrepareMrtPipeline()
     pipelineCI.pStages = shaderStages.data();
     pipelineCI.flags = 0;
 
+    // every pipeline with the same state for the indirect draws
+    auto createPipelines = [&](VkPipeline* pipeline, VkPipeline* indirectPipeline)
+    {
+        pipelineCI.layout = mrtPipelineLayout;
+        pipelineCI.pStages = shaderStages.data();
+        CheckVulkanResult(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, pipeline));
+        pipelineCI.layout = mrtIndirectPipelineLayout;
+        pipelineCI.pStages = indirectShaderStages.data();
+        CheckVulkanResult(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, indirectPipeline));
+    };
+
     // deferred rendering pipeline
     pipelineCI.renderPass = mrtRenderPass->renderPass;
     rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
-    CheckVulkanResult(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreen));
+    createPipelines(&pipelines.offscreen, &pipelines.offscreenIndirect);
 
     if (deviceFeatures.fillModeNonSolid)
     {
         rasterizationStateCI.polygonMode = VK_POLYGON_MODE_LINE;
         rasterizationStateCI.lineWidth = 1.0f;
-        CheckVulkanResult(
-            vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr,
-                &pipelines.offscreenWireframe));
+        createPipelines(&pipelines.offscreenWireframe, &pipelines.offscreenIndirectWireframe);
+    }
+
+    if (graphicSettings->subpassDeferred)
+    {
+        // G-buffer fill of the merged path, only the fragments matching the depth of the prepass are shaded
+        pipelineCI.renderPass = deferredRenderPass->renderPass;
+        pipelineCI.subpass = DeferredSubpassGBuffer;
+        depthStencilStateCI.depthWriteEnable = VK_FALSE;
+        depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_EQUAL;
+        rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
+        createPipelines(&pipelines.gBufferFill, &pipelines.gBufferFillIndirect);
+
+        if (deviceFeatures.fillModeNonSolid)
+        {
+            rasterizationStateCI.polygonMode = VK_POLYGON_MODE_LINE;
+            createPipelines(&pipelines.gBufferFillWireframe, &pipelines.gBufferFillIndirectWireframe);
+        }
     }
 }
 
@@ -2443,6 +4567,127 @@ void DeferredPBR::PrepareSSAOBlurPipeline()
     CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.ssaoBlur));
 }
 
+void DeferredPBR::PrepareSSAOComputePipelines()
+{
+    // create pipeline layouts, kept when only the quality tier changes
+    if (ssaoDownsamplePipelineLayout == VK_NULL_HANDLE)
+    {
+        VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&ssaoDownsampleDescriptorSetLayout, 1);
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &ssaoDownsamplePipelineLayout));
+
+        pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&ssaoComputeDescriptorSetLayout, 1);
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &ssaoComputePipelineLayout));
+
+        // history weight
+        VkPushConstantRange historyPushConstantRange = vks::initializers::PushConstantRange(
+            VK_SHADER_STAGE_COMPUTE_BIT, sizeof(TemporalPushConstants), 0);
+        pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&ssaoTemporalDescriptorSetLayout, 1);
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &historyPushConstantRange;
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &ssaoTemporalPipelineLayout));
+
+        // blur direction
+        VkPushConstantRange pushConstantRange = vks::initializers::PushConstantRange(
+            VK_SHADER_STAGE_COMPUTE_BIT, sizeof(glm::ivec2), 0);
+        pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&ssaoBilateralBlurDescriptorSetLayout, 1);
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &ssaoBilateralBlurPipelineLayout));
+
+        pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&ssaoUpsampleDescriptorSetLayout, 1);
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &ssaoUpsamplePipelineLayout));
+    }
+
+    // downsample
+    {
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(ssaoDownsamplePipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/ssaoDownsample.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.ssaoDownsample));
+    }
+
+    // ssao, the kernel size of the quality tier is a specialization constant,
+    // a fraction of it per frame when the accumulation covers the rest
+    {
+        const SsaoQualityTier& tier = GetSsaoQualityTier(graphicSettings->ssaoQuality);
+        struct SpecializationData {
+            int32_t kernelSize;
+        } specializationData{static_cast<int32_t>(graphicSettings->temporalAccumulation ? tier.temporalKernelSize : tier.kernelSize)};
+        VkSpecializationMapEntry specializationMapEntry = vks::initializers::SpecializationMapEntry(
+            0, offsetof(SpecializationData, kernelSize), sizeof(SpecializationData::kernelSize));
+        VkSpecializationInfo specializationInfo = vks::initializers::SpecializationInfo(
+            1, &specializationMapEntry, sizeof(specializationData), &specializationData);
+
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(ssaoComputePipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/ssaoCompute.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        pipelineCI.stage.pSpecializationInfo = &specializationInfo;
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.ssaoCompute));
+    }
+
+    // accumulation over frames, before the blur so it filters the converged occlusion
+    {
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(ssaoTemporalPipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/ssaoTemporal.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.ssaoTemporal));
+    }
+
+    // separable bilateral blur, both directions share the pipeline
+    {
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(ssaoBilateralBlurPipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/ssaoBilateralBlur.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.ssaoBilateralBlur));
+    }
+
+    // joint bilateral upsample into G_Occlusion, drawn in the blur subpass of the ssao render pass
+    {
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI =
+            vks::initializers::PipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+        VkPipelineRasterizationStateCreateInfo rasterizationStateCI =
+            vks::initializers::PipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_FRONT_BIT,
+                                                                    VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
+        std::array<VkPipelineColorBlendAttachmentState, 1> blendAttachmentStates =
+        {
+            vks::initializers::PipelineColorBlendAttachmentState(0xf, VK_FALSE),
+        };
+        VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::PipelineColorBlendStateCreateInfo(
+            blendAttachmentStates.size(), blendAttachmentStates.data());
+        VkPipelineDepthStencilStateCreateInfo depthStencilStateCI = vks::initializers::PipelineDepthStencilStateCreateInfo(
+            VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
+        VkPipelineViewportStateCreateInfo viewportStateCI = vks::initializers::PipelineViewportStateCreateInfo(1, 1, 0);
+        VkPipelineMultisampleStateCreateInfo multisampleStateCI = vks::initializers::PipelineMultisampleStateCreateInfo(
+            VK_SAMPLE_COUNT_1_BIT, 0);
+        const std::vector<VkDynamicState> dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamicStateCI = vks::initializers::PipelineDynamicStateCreateInfo(
+            dynamicStateEnables.data(), static_cast<uint32_t>(dynamicStateEnables.size()), 0);
+        VkPipelineVertexInputStateCreateInfo vertexInputStateCI = vks::initializers::PipelineVertexInputStateCreateInfo();
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
+            LoadShader(vks::helper::GetShaderBasePath() + "deferred/fullscreen.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+            LoadShader(vks::helper::GetShaderBasePath() + "deferred/ssaoUpsample.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+        };
+
+        VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::PipelineCreateInfo();
+        pipelineCI.layout = ssaoUpsamplePipelineLayout;
+        pipelineCI.renderPass = ssaoRenderPass->renderPass;
+        pipelineCI.pVertexInputState = &vertexInputStateCI;
+        pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
+        pipelineCI.pRasterizationState = &rasterizationStateCI;
+        pipelineCI.pColorBlendState = &colorBlendStateCI;
+        pipelineCI.pMultisampleState = &multisampleStateCI;
+        pipelineCI.pViewportState = &viewportStateCI;
+        pipelineCI.pDepthStencilState = &depthStencilStateCI;
+        pipelineCI.pDynamicState = &dynamicStateCI;
+        pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineCI.pStages = shaderStages.data();
+        pipelineCI.flags = 0;
+        pipelineCI.subpass = 1;
+        CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.ssaoUpsample));
+    }
+}
+
 void DeferredPBR::PrepareShadowMapPipeline()
 {
     // create pipeline layout
@@ -2450,8 +4695,9 @@ void DeferredPBR::PrepareShadowMapPipeline()
     VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
         setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
     // We will use push constants to push the local matrices of a primitive to the vertex shader
+    // followed by the index of the cascade being rendered
     VkPushConstantRange pushConstantRange = vks::initializers::PushConstantRange(
-        VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
+        VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4) + sizeof(uint32_t), 0);
     // Push constant ranges are part of the pipeline layout
     pipelineLayoutCI.pushConstantRangeCount = 1;
     pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
@@ -2463,9 +4709,13 @@ void DeferredPBR::PrepareShadowMapPipeline()
         vks::initializers::PipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_FRONT_BIT,
                                                                 VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
     rasterizationStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
-    std::array<VkPipelineColorBlendAttachmentState, 1> blendAttachmentStates{};
+    // slope scaled bias against acne, the cascades have very different depth ranges
+    rasterizationStateCI.depthBiasEnable = VK_TRUE;
+    rasterizationStateCI.depthBiasConstantFactor = 1.25f;
+    rasterizationStateCI.depthBiasSlopeFactor = 1.75f;
+    // depth only
     VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::PipelineColorBlendStateCreateInfo(
-        blendAttachmentStates.size(), blendAttachmentStates.data());
+        0, nullptr);
     VkPipelineDepthStencilStateCreateInfo depthStencilStateCI = vks::initializers::PipelineDepthStencilStateCreateInfo(
         VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
     VkPipelineViewportStateCreateInfo viewportStateCI = vks::initializers::PipelineViewportStateCreateInfo(1, 1, 0);
@@ -2511,7 +4761,7 @@ void DeferredPBR::PrepareShadowMapPipeline()
 
     VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::PipelineCreateInfo();
     pipelineCI.layout = shadowMapPipelineLayout;
-    pipelineCI.renderPass = shadowRenderPass->renderPass;
+    pipelineCI.renderPass = cascadeShadowMap->GetRenderPass();
     pipelineCI.pVertexInputState = &vertexInputStateCI;
     pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
     pipelineCI.pRasterizationState = &rasterizationStateCI;
@@ -2525,26 +4775,75 @@ void DeferredPBR::PrepareShadowMapPipeline()
     pipelineCI.subpass = 0;
     pipelineCI.flags = 0;
     CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.shadowMap));
+
+    // indirect draws of the cascades, the matrices come from the draw records and only the cascade index is pushed
+    const std::array<VkDescriptorSetLayout, 2> indirectSetLayouts = {shadowMapDescriptorSetLayout,
+                                                                     drawDataDescriptorSetLayout};
+    VkPipelineLayoutCreateInfo indirectPipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
+        indirectSetLayouts.data(), static_cast<uint32_t>(indirectSetLayouts.size()));
+    VkPushConstantRange cascadePushConstantRange = vks::initializers::PushConstantRange(
+        VK_SHADER_STAGE_VERTEX_BIT, sizeof(uint32_t), 0);
+    indirectPipelineLayoutCI.pushConstantRangeCount = 1;
+    indirectPipelineLayoutCI.pPushConstantRanges = &cascadePushConstantRange;
+    CheckVulkanResult(vkCreatePipelineLayout(device, &indirectPipelineLayoutCI, nullptr, &shadowMapIndirectPipelineLayout));
+    shaderStages[0] = LoadShader(vks::helper::GetShaderBasePath() + "deferred/shadowMapIndirect.vert.spv",
+                                 VK_SHADER_STAGE_VERTEX_BIT);
+    pipelineCI.layout = shadowMapIndirectPipelineLayout;
+    CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.shadowMapIndirect));
+
+    // shadow atlas tiles, same push constants with the tile index, light matrices come from the tile buffer
+    setLayouts = {shadowAtlasDescriptorSetLayout};
+    pipelineLayoutCI.pSetLayouts = setLayouts.data();
+    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &shadowAtlasPipelineLayout));
+    // the cube faces' look at matrices do not share one handedness, so render both sides
+    rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
+    shaderStages[0] = LoadShader(vks::helper::GetShaderBasePath() + "deferred/shadowAtlas.vert.spv",
+                                 VK_SHADER_STAGE_VERTEX_BIT);
+    pipelineCI.layout = shadowAtlasPipelineLayout;
+    pipelineCI.renderPass = shadowAtlasMap->GetRenderPass();
+    CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.shadowAtlas));
+
+    // point light cubes in one pass, the geometry shader emits each triangle to the viewports of the faces it touches
+    if (!singlePassPointShadowsSupported)
+        return;
+    // the model matrix is pushed for the vertex stage only by VulkanGLTFModel::Draw, the tile index for both
+    std::array<VkPushConstantRange, 2> cubePushConstantRanges = {
+        vks::initializers::PushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0),
+        vks::initializers::PushConstantRange(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT,
+                                             sizeof(uint32_t), sizeof(glm::mat4)),
+    };
+    pipelineLayoutCI.pushConstantRangeCount = static_cast<uint32_t>(cubePushConstantRanges.size());
+    pipelineLayoutCI.pPushConstantRanges = cubePushConstantRanges.data();
+    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &shadowAtlasCubePipelineLayout));
+    viewportStateCI = vks::initializers::PipelineViewportStateCreateInfo(6, 6, 0);
+    std::array<VkPipelineShaderStageCreateInfo, 3> cubeShaderStages = {
+        LoadShader(vks::helper::GetShaderBasePath() + "deferred/shadowAtlasCube.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+        LoadShader(vks::helper::GetShaderBasePath() + "deferred/shadowAtlasCube.geom.spv", VK_SHADER_STAGE_GEOMETRY_BIT),
+        shaderStages[1]
+    };
+    pipelineCI.layout = shadowAtlasCubePipelineLayout;
+    pipelineCI.stageCount = static_cast<uint32_t>(cubeShaderStages.size());
+    pipelineCI.pStages = cubeShaderStages.data();
+    CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.shadowAtlasCube));
 }
 
 void DeferredPBR::PrepareDirectionalShadowPipeline()
 {
-    // create pipeline layout
-    std::vector<VkDescriptorSetLayout> setLayouts = {directionalShadowDescriptorSetLayout};
-    VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
-        setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
-    // We will use push constants to push the local matrices of a primitive to the vertex shader
-    VkPushConstantRange pushConstantRange = vks::initializers::PushConstantRange(
-        VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
-    // Push constant ranges are part of the pipeline layout
-    pipelineLayoutCI.pushConstantRangeCount = 1;
-    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
-    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &directionalShadowPipelineLayout));
+    // create pipeline layout, kept when only the filter quality changes
+    if (directionalShadowPipelineLayout == VK_NULL_HANDLE)
+    {
+        std::vector<VkDescriptorSetLayout> setLayouts = {directionalShadowDescriptorSetLayout};
+        VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
+            setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+        pipelineLayoutCI.pushConstantRangeCount = 0;
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &directionalShadowPipelineLayout));
+    }
 
+    // full screen triangle over the G-buffer, independent of the scene's geometry
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI =
         vks::initializers::PipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
     VkPipelineRasterizationStateCreateInfo rasterizationStateCI =
-        vks::initializers::PipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT,
+        vks::initializers::PipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE,
                                                                 VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
     std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates
     {
@@ -2553,48 +4852,35 @@ void DeferredPBR::PrepareDirectionalShadowPipeline()
     VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::PipelineColorBlendStateCreateInfo(
         blendAttachmentStates.size(), blendAttachmentStates.data());
     VkPipelineDepthStencilStateCreateInfo depthStencilStateCI = vks::initializers::PipelineDepthStencilStateCreateInfo(
-        VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+        VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
     VkPipelineViewportStateCreateInfo viewportStateCI = vks::initializers::PipelineViewportStateCreateInfo(1, 1, 0);
     VkPipelineMultisampleStateCreateInfo multisampleStateCI = vks::initializers::PipelineMultisampleStateCreateInfo(
         VK_SAMPLE_COUNT_1_BIT, 0);
     const std::vector<VkDynamicState> dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
     VkPipelineDynamicStateCreateInfo dynamicStateCI = vks::initializers::PipelineDynamicStateCreateInfo(
         dynamicStateEnables.data(), static_cast<uint32_t>(dynamicStateEnables.size()), 0);
-    // Vertex input bindings and attributes
-    const std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
-        vks::initializers::VertexInputBindingDescription(0, sizeof(vks::geometry::VulkanGLTFModel::Vertex),
-                                                         VK_VERTEX_INPUT_RATE_VERTEX),
-    };
-    const std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-        // Location 0: Position
-        vks::initializers::VertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT,
-                                                           offsetof(vks::geometry::VulkanGLTFModel::Vertex, pos)),
-        // Location 1: Texture coordinates
-        vks::initializers::VertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32_SFLOAT,
-                                                           offsetof(vks::geometry::VulkanGLTFModel::Vertex, uv)),
-        // Location 2: Color
-        vks::initializers::VertexInputAttributeDescription(0, 2, VK_FORMAT_R32G32B32A32_SFLOAT,
-                                                           offsetof(vks::geometry::VulkanGLTFModel::Vertex, color)),
-        // Location 3: Normal
-        vks::initializers::VertexInputAttributeDescription(0, 3, VK_FORMAT_R32G32B32_SFLOAT,
-                                                           offsetof(vks::geometry::VulkanGLTFModel::Vertex,
-                                                                    normal)),
-        // Location 4: Tangent
-        vks::initializers::VertexInputAttributeDescription(0, 4, VK_FORMAT_R32G32B32A32_SFLOAT,
-                                                           offsetof(vks::geometry::VulkanGLTFModel::Vertex,
-                                                                    tangent)),
-    };
     VkPipelineVertexInputStateCreateInfo vertexInputStateCI = vks::initializers::PipelineVertexInputStateCreateInfo();
-    vertexInputStateCI.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
-    vertexInputStateCI.pVertexBindingDescriptions = vertexInputBindings.data();
-    vertexInputStateCI.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
-    vertexInputStateCI.pVertexAttributeDescriptions = vertexInputAttributes.data();
 
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
-        LoadShader(vks::helper::GetShaderBasePath() + "deferred/directionalShadow.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+        LoadShader(vks::helper::GetShaderBasePath() + "deferred/fullscreen.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
         LoadShader(vks::helper::GetShaderBasePath() + "deferred/directionalShadow.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
     };
 
+    // the filter's tap count and blocker search are fixed per quality tier, so they are specialization constants,
+    // the accumulation over frames lets the filter take fewer taps per frame
+    const ShadowFilterTier& tier = GetShadowFilterTier(graphicSettings->shadowFilterQuality);
+    const uint32_t sampleCount = graphicSettings->temporalAccumulation ? tier.temporalSampleCount : tier.sampleCount;
+    struct SpecializationData {
+        int32_t sampleCount;
+        VkBool32 blockerSearch;
+    } specializationData{static_cast<int32_t>(sampleCount), tier.blockerSearch};
+    std::vector<VkSpecializationMapEntry> specializationMapEntries = {
+        vks::initializers::SpecializationMapEntry(0, offsetof(SpecializationData, sampleCount), sizeof(SpecializationData::sampleCount)),
+        vks::initializers::SpecializationMapEntry(1, offsetof(SpecializationData, blockerSearch), sizeof(SpecializationData::blockerSearch))
+    };
+    VkSpecializationInfo specializationInfo = vks::initializers::SpecializationInfo(specializationMapEntries.size(), specializationMapEntries.data(), sizeof(specializationData), &specializationData);
+    shaderStages[1].pSpecializationInfo = &specializationInfo;
+
     VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::PipelineCreateInfo();
     pipelineCI.layout = directionalShadowPipelineLayout;
     pipelineCI.renderPass = shadowRenderPass->renderPass;
@@ -2608,11 +4894,81 @@ void DeferredPBR::PrepareDirectionalShadowPipeline()
     pipelineCI.pDynamicState = &dynamicStateCI;
     pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
     pipelineCI.pStages = shaderStages.data();
-    pipelineCI.subpass = 1;
+    pipelineCI.subpass = 0;
     pipelineCI.flags = 0;
     CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.directionalShadow));
 }
 
+void DeferredPBR::PrepareShadowTemporalPipeline()
+{
+    // history weight
+    VkPushConstantRange pushConstantRange = vks::initializers::PushConstantRange(
+        VK_SHADER_STAGE_COMPUTE_BIT, sizeof(TemporalPushConstants), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&shadowTemporalDescriptorSetLayout, 1);
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &shadowTemporalPipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(shadowTemporalPipelineLayout);
+    pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/shadowTemporal.comp.spv",
+                                  VK_SHADER_STAGE_COMPUTE_BIT);
+    CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.shadowTemporal));
+}
+
+void DeferredPBR::PrepareLightCullingPipeline()
+{
+    std::vector<VkDescriptorSetLayout> setLayouts = {lightCullingDescriptorSetLayout};
+    VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
+        setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+    pipelineLayoutCI.pushConstantRangeCount = 0;
+    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &lightCullingPipelineLayout));
+
+    uint32_t maxLightsPerCluster = GlobalVars::MAX_LIGHTS_PER_CLUSTER;
+    VkSpecializationMapEntry specializationMapEntry = vks::initializers::SpecializationMapEntry(0, 0, sizeof(uint32_t));
+    VkSpecializationInfo specializationInfo = vks::initializers::SpecializationInfo(1, &specializationMapEntry,
+        sizeof(uint32_t), &maxLightsPerCluster);
+
+    VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(lightCullingPipelineLayout);
+    pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/lightCulling.comp.spv",
+                                  VK_SHADER_STAGE_COMPUTE_BIT);
+    pipelineCI.stage.pSpecializationInfo = &specializationInfo;
+    CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.lightCulling));
+}
+
+void DeferredPBR::PrepareDrawCullingPipeline()
+{
+    std::vector<VkDescriptorSetLayout> setLayouts = {drawCullingDescriptorSetLayout};
+    VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
+        setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+    // the DrawCullingPhase
+    VkPushConstantRange pushConstantRange = vks::initializers::PushConstantRange(
+        VK_SHADER_STAGE_COMPUTE_BIT, sizeof(uint32_t), 0);
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &drawCullingPipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(drawCullingPipelineLayout);
+    pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/drawCulling.comp.spv",
+                                  VK_SHADER_STAGE_COMPUTE_BIT);
+    CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.drawCulling));
+}
+
+void DeferredPBR::PrepareDepthPyramidPipeline()
+{
+    VkPushConstantRange pushConstantRange = vks::initializers::PushConstantRange(
+        VK_SHADER_STAGE_COMPUTE_BIT, sizeof(DepthPyramidPushConstants), 0);
+    VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
+        &depthPyramidDescriptorSetLayout, 1);
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &depthPyramidPipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(depthPyramidPipelineLayout);
+    pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/depthPyramid.comp.spv",
+                                  VK_SHADER_STAGE_COMPUTE_BIT);
+    CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.depthPyramid));
+}
+
 void DeferredPBR::PrepareLightingPipeline()
 {
     // create pipeline layout
@@ -2637,8 +4993,10 @@ void DeferredPBR::PrepareLightingPipeline()
     };
     VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::PipelineColorBlendStateCreateInfo(
         blendAttachmentStates.size(), blendAttachmentStates.data());
+    // the triangle lies on the far plane, the early depth test skips the pixels no geometry covered,
+    // the skybox is drawn there afterwards
     VkPipelineDepthStencilStateCreateInfo depthStencilStateCI = vks::initializers::PipelineDepthStencilStateCreateInfo(
-        VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+        VK_TRUE, VK_FALSE, VK_COMPARE_OP_GREATER);
     VkPipelineViewportStateCreateInfo viewportStateCI = vks::initializers::PipelineViewportStateCreateInfo(1, 1, 0);
     VkPipelineMultisampleStateCreateInfo multisampleStateCI = vks::initializers::PipelineMultisampleStateCreateInfo(
         VK_SAMPLE_COUNT_1_BIT, 0);
@@ -2647,14 +5005,26 @@ void DeferredPBR::PrepareLightingPipeline()
         dynamicStateEnables.data(), static_cast<uint32_t>(dynamicStateEnables.size()), 0);
     VkPipelineVertexInputStateCreateInfo vertexInputStateCI = vks::initializers::PipelineVertexInputStateCreateInfo();
 
-    const std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
+    // cluster light lists have a fixed stride, shared with lightCulling.comp
+    uint32_t maxLightsPerCluster = GlobalVars::MAX_LIGHTS_PER_CLUSTER;
+    VkSpecializationMapEntry specializationMapEntry = vks::initializers::SpecializationMapEntry(0, 0, sizeof(uint32_t));
+    VkSpecializationInfo specializationInfo = vks::initializers::SpecializationInfo(1, &specializationMapEntry,
+        sizeof(uint32_t), &maxLightsPerCluster);
+
+    // the merged path reads the G-buffer as input attachments
+    const bool subpassDeferred = graphicSettings->subpassDeferred;
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
         LoadShader(vks::helper::GetShaderBasePath() + "deferred/lighting.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-        LoadShader(vks::helper::GetShaderBasePath() + "deferred/lighting.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+        LoadShader(vks::helper::GetShaderBasePath() +
+                   (subpassDeferred ? "deferred/lightingSubpass.frag.spv" : "deferred/lighting.frag.spv"),
+                   VK_SHADER_STAGE_FRAGMENT_BIT)
     };
+    shaderStages[1].pSpecializationInfo = &specializationInfo;
 
     VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::PipelineCreateInfo();
     pipelineCI.layout = lightingPipelineLayout;
-    pipelineCI.renderPass = lightingRenderPass->renderPass;
+    pipelineCI.renderPass = subpassDeferred ? deferredRenderPass->renderPass : lightingRenderPass->renderPass;
+    pipelineCI.subpass = subpassDeferred ? DeferredSubpassLighting : 0;
     pipelineCI.pVertexInputState = &vertexInputStateCI;
     pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
     pipelineCI.pRasterizationState = &rasterizationStateCI;
@@ -2694,8 +5064,9 @@ void DeferredPBR::PrepareSkyboxPipeline()
     };
     VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::PipelineColorBlendStateCreateInfo(
         blendAttachmentStates.size(), blendAttachmentStates.data());
+    // drawn on the far plane after lighting into the same target, only where the G-buffer depth is still cleared
     VkPipelineDepthStencilStateCreateInfo depthStencilStateCI = vks::initializers::PipelineDepthStencilStateCreateInfo(
-        VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+        VK_TRUE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
     VkPipelineViewportStateCreateInfo viewportStateCI = vks::initializers::PipelineViewportStateCreateInfo(1, 1, 0);
     VkPipelineMultisampleStateCreateInfo multisampleStateCI = vks::initializers::PipelineMultisampleStateCreateInfo(
         VK_SAMPLE_COUNT_1_BIT, 0);
@@ -2742,7 +5113,13 @@ void DeferredPBR::PrepareSkyboxPipeline()
 
     VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::PipelineCreateInfo();
     pipelineCI.layout = skyboxPipelineLayout;
-    pipelineCI.renderPass = skyboxRenderPass->renderPass;
+    if (graphicSettings->subpassDeferred)
+    {
+        pipelineCI.renderPass = deferredRenderPass->renderPass;
+        pipelineCI.subpass = DeferredSubpassLighting;
+    }
+    else
+        pipelineCI.renderPass = lightingRenderPass->renderPass;
     pipelineCI.pVertexInputState = &vertexInputStateCI;
     pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
     pipelineCI.pRasterizationState = &rasterizationStateCI;
@@ -2757,132 +5134,575 @@ void DeferredPBR::PrepareSkyboxPipeline()
     CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.skybox));
 }
 
-void DeferredPBR::PreparePostprocessPipeline()
+void DeferredPBR::PreparePostProcessPipelines()
 {
-    // create pipeline layout
-    std::vector<VkDescriptorSetLayout> setLayouts = {postprocessDescriptorSetLayout};
-    VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(
-        setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
-    // Push constant ranges are part of the pipeline layout
-    pipelineLayoutCI.pushConstantRangeCount = 0;
-    CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &postprocessPipelineLayout));
+    // create pipeline layouts
+    {
+        VkPushConstantRange pushConstantRange = vks::initializers::PushConstantRange(
+            VK_SHADER_STAGE_COMPUTE_BIT, sizeof(AutoExposurePushConstants), 0);
+        VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&autoExposureDescriptorSetLayout, 1);
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &autoExposurePipelineLayout));
+
+        pushConstantRange = vks::initializers::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(BloomPushConstants), 0);
+        pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&bloomDescriptorSetLayout, 1);
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &bloomPipelineLayout));
+
+        pushConstantRange = vks::initializers::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                                                 sizeof(TemporalUpscalePushConstants), 0);
+        pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&temporalUpscaleDescriptorSetLayout, 1);
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &temporalUpscalePipelineLayout));
+
+        pushConstantRange = vks::initializers::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(SharpenPushConstants), 0);
+        pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&sharpenDescriptorSetLayout, 1);
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &sharpenPipelineLayout));
+
+        pushConstantRange = vks::initializers::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                                                 sizeof(PostProcessPushConstants), 0);
+        pipelineLayoutCI = vks::initializers::PipelineLayoutCreateInfo(&postProcessDescriptorSetLayout, 1);
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+        CheckVulkanResult(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &postProcessPipelineLayout));
+    }
 
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI =
-        vks::initializers::PipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-    VkPipelineRasterizationStateCreateInfo rasterizationStateCI =
-        vks::initializers::PipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT,
-                                                                VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
-    rasterizationStateCI.cullMode = VK_CULL_MODE_FRONT_BIT;
-    std::array<VkPipelineColorBlendAttachmentState, 1> blendAttachmentStates =
+    // luminance histogram of the scene color
     {
-        vks::initializers::PipelineColorBlendAttachmentState(0xf, VK_FALSE),
-    };
-    VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::PipelineColorBlendStateCreateInfo(
-        blendAttachmentStates.size(), blendAttachmentStates.data());
-    VkPipelineDepthStencilStateCreateInfo depthStencilStateCI = vks::initializers::PipelineDepthStencilStateCreateInfo(
-        VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
-    VkPipelineViewportStateCreateInfo viewportStateCI = vks::initializers::PipelineViewportStateCreateInfo(1, 1, 0);
-    VkPipelineMultisampleStateCreateInfo multisampleStateCI = vks::initializers::PipelineMultisampleStateCreateInfo(
-        VK_SAMPLE_COUNT_1_BIT, 0);
-    const std::vector<VkDynamicState> dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-    VkPipelineDynamicStateCreateInfo dynamicStateCI = vks::initializers::PipelineDynamicStateCreateInfo(
-        dynamicStateEnables.data(), static_cast<uint32_t>(dynamicStateEnables.size()), 0);
-    VkPipelineVertexInputStateCreateInfo vertexInputStateCI = vks::initializers::PipelineVertexInputStateCreateInfo();
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(autoExposurePipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/histogram.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.luminanceHistogram));
+    }
 
-    const std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
-        LoadShader(vks::helper::GetShaderBasePath() + "deferred/postprocess.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-        LoadShader(vks::helper::GetShaderBasePath() + "deferred/postprocess.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
-    };
+    // average of the histogram adapted into the exposure, a single work group
+    {
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(autoExposurePipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/exposure.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.exposure));
+    }
 
-    VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::PipelineCreateInfo();
-    pipelineCI.layout = postprocessPipelineLayout;
-    pipelineCI.renderPass = postprocessRenderPass->renderPass;
-    pipelineCI.pVertexInputState = &vertexInputStateCI;
-    pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
-    pipelineCI.pRasterizationState = &rasterizationStateCI;
-    pipelineCI.pColorBlendState = &colorBlendStateCI;
-    pipelineCI.pMultisampleState = &multisampleStateCI;
-    pipelineCI.pViewportState = &viewportStateCI;
-    pipelineCI.pDepthStencilState = &depthStencilStateCI;
-    pipelineCI.pDynamicState = &dynamicStateCI;
-    pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
-    pipelineCI.pStages = shaderStages.data();
-    pipelineCI.flags = 0;
-    CheckVulkanResult(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &pipelines.postprocess));
+    // bloom chain, every level of a direction shares the pipeline
+    {
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(bloomPipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/bloomDownsample.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.bloomDownsample));
+
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/bloomUpsample.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.bloomUpsample));
+    }
+
+    // jittered scene color accumulated at the output resolution
+    {
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(temporalUpscalePipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/temporalUpscale.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.temporalUpscale));
+    }
+
+    // contrast adaptive sharpening of the upscaled color
+    {
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(sharpenPipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/sharpen.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.sharpen));
+    }
+
+    // exposure, bloom, tonemapping, grading and gamma into the result
+    {
+        VkComputePipelineCreateInfo pipelineCI = vks::initializers::ComputePipelineCreateInfo(postProcessPipelineLayout);
+        pipelineCI.stage = LoadShader(vks::helper::GetShaderBasePath() + "deferred/postprocess.comp.spv",
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+        CheckVulkanResult(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.postProcess));
+    }
 }
 
-void DeferredPBR::PrepareRenderPass(VkCommandBuffer commandBuffer)
+float DeferredPBR::HistoryWeight(bool historyValid) const
 {
-    // mrt render pass
+    return historyValid && graphicSettings->temporalAccumulation ? graphicSettings->temporalHistoryWeight : 0.0f;
+}
+
+void DeferredPBR::UpdateRenderScale()
+{
+    dynamicResolution.framesSinceChange++;
+    float scale = 1.0f;
+    if (graphicSettings->dynamicResolution)
     {
-        VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::RenderPassBeginInfo();
+        scale = dynamicResolution.scale;
+        const float gpuTime = gpuProfiler->GetTime("Frame");
+        const float targetTime = graphicSettings->targetFrameTime;
+        // the scale is kept while the GPU time stays between the headroom and the target
+        if (gpuTime > 0.0f && dynamicResolution.framesSinceChange >= GlobalVars::RESOLUTION_SCALE_SETTLE_FRAMES &&
+            (gpuTime > targetTime || gpuTime < targetTime * GlobalVars::RESOLUTION_SCALE_HEADROOM))
+        {
+            // the GPU time grows about with the pixel count, the square of the scale, aim at the middle of the band
+            const float aimTime = targetTime * (1.0f + GlobalVars::RESOLUTION_SCALE_HEADROOM) * 0.5f;
+            scale = std::round(scale * std::sqrt(aimTime / gpuTime) / GlobalVars::RESOLUTION_SCALE_STEP) *
+                    GlobalVars::RESOLUTION_SCALE_STEP;
+        }
+        scale = std::clamp(scale, graphicSettings->minResolutionScale, 1.0f);
+    }
+    if (scale == dynamicResolution.scale)
+        return;
+
+    dynamicResolution.scale = scale;
+    dynamicResolution.framesSinceChange = 0;
+    // the histories were accumulated at the uvs of the previous region
+    ssaoHistoryValid = false;
+    shadowHistoryValid = false;
+}
 
-        vks::FrameBuffer* mrtFrameBuffer = mrtRenderPass->vulkanFrameBuffer->GetFrameBuffer(currentFrame);
-        renderPassBeginInfo.renderPass = mrtRenderPass->renderPass;
-        renderPassBeginInfo.framebuffer = mrtFrameBuffer->frameBuffer;
+VkExtent2D DeferredPBR::RenderExtent() const
+{
+    // the camera aspect follows the viewport, the targets are at least as large,
+    // temporal upscaling renders at a fixed fraction of the dynamic resolution
+    const float scale = dynamicResolution.scale * GetUpscaleQualityTier(graphicSettings->upscaleQuality).scale;
+    return {std::clamp(static_cast<uint32_t>(std::lround(viewportWidth * scale)), 1u, swapChain->imageExtent.width),
+            std::clamp(static_cast<uint32_t>(std::lround(viewportHeight * scale)), 1u, swapChain->imageExtent.height)};
+}
+
+glm::vec2 DeferredPBR::RenderScale() const
+{
+    const VkExtent2D renderExtent = RenderExtent();
+    return glm::vec2(static_cast<float>(renderExtent.width) / static_cast<float>(swapChain->imageExtent.width),
+                     static_cast<float>(renderExtent.height) / static_cast<float>(swapChain->imageExtent.height));
+}
+
+VkExtent2D DeferredPBR::RenderRegion(uint32_t width, uint32_t height) const
+{
+    const glm::vec2 renderScale = RenderScale();
+    return {std::min(static_cast<uint32_t>(std::ceil(width * renderScale.x)), width),
+            std::min(static_cast<uint32_t>(std::ceil(height * renderScale.y)), height)};
+}
+
+void DeferredPBR::SetViewport(VkCommandBuffer commandBuffer, VkExtent2D extent) const
+{
+    const VkViewport viewport = vks::initializers::Viewport(static_cast<float>(extent.width),
+                                                            static_cast<float>(extent.height), 0.0f, 1.0f);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+}
+
+glm::vec2 DeferredPBR::ProjectionJitter() const
+{
+    if (graphicSettings->upscaleQuality <= 0)
+        return glm::vec2(0.0f);
+
+    // Halton (2, 3) offsets within a rendered pixel, the sequence is long enough for every output pixel to receive
+    // about the same number of samples, fewer rendered pixels need more frames
+    const float scale = GetUpscaleQualityTier(graphicSettings->upscaleQuality).scale;
+    const uint32_t phaseCount = static_cast<uint32_t>(std::ceil(GlobalVars::UPSCALE_SAMPLES_PER_PIXEL / (scale * scale)));
+    const uint32_t index = temporalFrameIndex % phaseCount + 1;
+    const VkExtent2D renderExtent = RenderExtent();
+    return glm::vec2((math::Halton(index, 2) - 0.5f) * 2.0f / static_cast<float>(renderExtent.width),
+                     (math::Halton(index, 3) - 0.5f) * 2.0f / static_cast<float>(renderExtent.height));
+}
 
-        renderPassBeginInfo.renderArea.offset = {0, 0};
-        renderPassBeginInfo.renderArea.extent = {viewportWidth, viewportHeight};
+void DeferredPBR::RecordShadowTemporal(VkCommandBuffer commandBuffer)
+{
+    const TemporalPushConstants pushConstants{HistoryWeight(shadowHistoryValid), RenderScale()};
+    const vks::VulkanStorageImage& history = *shadowHistory[currentFrame];
+    const VkExtent2D region = RenderRegion(history.Width(), history.Height());
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.shadowTemporal);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadowTemporalPipelineLayout, 0, 1,
+                            &shadowTemporalDescriptorSets[currentFrame], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, shadowTemporalPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(TemporalPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (region.width + 7) / 8, (region.height + 7) / 8, 1);
+}
 
-        std::vector<VkClearValue> clearValues
+void DeferredPBR::SetupRenderGraph()
+{
+    using vks::RenderGraphAccess;
+    using PassBuilder = vks::VulkanRenderGraph::PassBuilder;
+
+    renderGraph = std::make_unique<vks::VulkanRenderGraph>(vulkanDevice.get(), maxFrameInFlight);
+    vks::VulkanRenderGraph& graph = *renderGraph;
+    // the render passes only cover the rendered region, it follows the dynamic resolution without a rebuild
+    const auto renderArea = [this]() { return RenderExtent(); };
+
+    // attachments, one per frame in flight
+    const vks::RenderGraphResource depth = graph.ImportAttachment(mrtFrameBuffer.get(), "Depth");
+    const vks::RenderGraphResource gNormal = graph.ImportAttachment(mrtFrameBuffer.get(), "G_Normal");
+    const vks::RenderGraphResource gVelocity = graph.ImportAttachment(mrtFrameBuffer.get(), "G_Velocity");
+    const vks::RenderGraphResource gOcclusion = graph.ImportAttachment(ssaoFrameBuffer.get(), "G_Occlusion");
+    const vks::RenderGraphResource gShadow = graph.ImportAttachment(shadowFrameBuffer.get(), "G_Shadow");
+    const vks::RenderGraphResource sceneColor = graph.ImportAttachment(lightingFrameBuffer.get(), "SceneColor");
+    // albedo, material and emissive, the merged deferred path keeps them in transient attachments of deferredRenderPass
+    const bool subpassDeferred = graphicSettings->subpassDeferred;
+    std::vector<vks::RenderGraphResource> gSurface;
+    if (!subpassDeferred)
+    {
+        for (const char* attachmentName : {"G_Color", "G_Material", "G_Emissive"})
+            gSurface.push_back(graph.ImportAttachment(mrtFrameBuffer.get(), attachmentName));
+    }
+
+    // histories of the accumulated effects, the previous frame's one is read outside of the graph
+    const VkImageSubresourceRange colorRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    std::vector<VkImage> ssaoHistoryImages;
+    std::vector<VkImage> shadowHistoryImages;
+    for (uint32_t i = 0; i < maxFrameInFlight; i++)
+    {
+        ssaoHistoryImages.push_back(ssaoComputeTargets[i].history->image);
+        shadowHistoryImages.push_back(shadowHistory[i]->image);
+    }
+    const vks::RenderGraphResource ssaoHistory = graph.ImportImage("SSAOHistory", ssaoHistoryImages, colorRange,
+                                                                   VK_IMAGE_LAYOUT_GENERAL);
+    const vks::RenderGraphResource shadowHistoryResource = graph.ImportImage("ShadowHistory", shadowHistoryImages,
+                                                                             colorRange, VK_IMAGE_LAYOUT_GENERAL);
+
+    // post process result shown on UI and the upscale history, one per frame in flight
+    std::vector<VkImage> resultImages;
+    std::vector<VkImage> upscaleHistoryImages;
+    for (const PostProcessTargets& targets : postProcessTargets)
+    {
+        resultImages.push_back(targets.result->image);
+        upscaleHistoryImages.push_back(targets.upscaleHistory->image);
+    }
+    const vks::RenderGraphResource result = graph.ImportImage("Result", resultImages, colorRange, VK_IMAGE_LAYOUT_GENERAL);
+    const vks::RenderGraphResource upscaleHistory = graph.ImportImage("UpscaleHistory", upscaleHistoryImages, colorRange,
+                                                                      VK_IMAGE_LAYOUT_GENERAL);
+
+    // shared by all frames in flight, they rest in the layout their render passes load from
+    const vks::RenderGraphResource cascadeShadowMapResource = graph.ImportImage(
+        "CascadeShadowMap", {cascadeShadowMap->Image()},
+        {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, cascadeShadowMap->LayerCount()},
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+    const vks::RenderGraphResource shadowAtlasResource = graph.ImportImage(
+        "ShadowAtlas", {shadowAtlasMap->Image()}, {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, shadowAtlasMap->LayerCount()},
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+
+    // the host reads the cluster lists for the statistics
+    const vks::RenderGraphResource clusterLightCount = graph.ImportBuffer(
+        "ClusterLightCount", clusterLightCountBuffer.buffer, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    const vks::RenderGraphResource clusterLightIndex = graph.ImportBuffer(
+        "ClusterLightIndex", clusterLightIndexBuffer.buffer, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    // and the exposure, the histogram stays on the device
+    const vks::RenderGraphResource luminanceHistogram = graph.ImportBuffer("LuminanceHistogram",
+                                                                           luminanceHistogramBuffer.buffer);
+    const vks::RenderGraphResource exposure = graph.ImportBuffer("Exposure", exposureBuffer.buffer,
+                                                                 VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    // and the draw counts of the indirect draws
+    const vks::RenderGraphResource indirectCommands = graph.ImportBuffer("IndirectCommands", indirectCommandBuffer.buffer);
+    const vks::RenderGraphResource indirectCounts = graph.ImportBuffer("IndirectCounts", indirectCountBuffer.buffer,
+                                                                       VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    // and the occlusion culling statistics, the visibility carries over to the next frame's culling
+    const vks::RenderGraphResource drawVisibility = graph.ImportBuffer("DrawVisibility", drawVisibilityBuffer.buffer);
+    const vks::RenderGraphResource occlusionStats = graph.ImportBuffer("OcclusionStats", occlusionStatsBuffer.buffer,
+                                                                       VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    // rebuilt from every frame's depth, shared by all frames in flight
+    const vks::RenderGraphResource depthPyramidResource = graph.ImportImage(
+        "DepthPyramid", {depthPyramid->image}, {VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramid->LevelCount(), 0, 1},
+        VK_IMAGE_LAYOUT_GENERAL);
+
+    // reduced resolution compute ssao targets, the normals and the horizontal blur share memory
+    const uint32_t ssaoWidth = ssaoComputeTargets[0].history->Width();
+    const uint32_t ssaoHeight = ssaoComputeTargets[0].history->Height();
+    const vks::RenderGraphResource ssaoDepth = graph.CreateImage("SSAODepth", ssaoWidth, ssaoHeight, VK_FORMAT_R32_SFLOAT);
+    const vks::RenderGraphResource ssaoNormal = graph.CreateImage("SSAONormal", ssaoWidth, ssaoHeight,
+                                                                  VK_FORMAT_R8G8B8A8_SNORM);
+    const vks::RenderGraphResource ssaoOcclusion = graph.CreateImage("SSAOOcclusion", ssaoWidth, ssaoHeight,
+                                                                     VK_FORMAT_R8G8B8A8_UNORM);
+    const vks::RenderGraphResource ssaoBlurred = graph.CreateImage("SSAOBlurred", ssaoWidth, ssaoHeight,
+                                                                   VK_FORMAT_R8G8B8A8_UNORM);
+
+    // bloom chain from half resolution down, the levels no later pass reads share memory
+    std::array<vks::RenderGraphResource, GlobalVars::BLOOM_LEVEL_COUNT> bloomDown{};
+    std::array<vks::RenderGraphResource, GlobalVars::BLOOM_LEVEL_COUNT - 1> bloomUp{};
+    for (uint32_t level = 0; level < GlobalVars::BLOOM_LEVEL_COUNT; level++)
+    {
+        const uint32_t levelWidth = std::max(lightingFrameBuffer->Width() >> (level + 1), 1u);
+        const uint32_t levelHeight = std::max(lightingFrameBuffer->Height() >> (level + 1), 1u);
+        bloomDown[level] = graph.CreateImage("BloomDown" + std::to_string(level), levelWidth, levelHeight,
+                                             VK_FORMAT_R16G16B16A16_SFLOAT);
+        if (level < bloomUp.size())
+            bloomUp[level] = graph.CreateImage("BloomUp" + std::to_string(level), levelWidth, levelHeight,
+                                               VK_FORMAT_R16G16B16A16_SFLOAT);
+    }
+    // sharpened upscale at the output resolution
+    const vks::RenderGraphResource upscaled = graph.CreateImage("Upscaled", lightingFrameBuffer->Width(),
+                                                                lightingFrameBuffer->Height(),
+                                                                VK_FORMAT_R16G16B16A16_SFLOAT);
+
+    // GPU driven rendering, the culling appends the commands of the visible records to their batch of each view
+    auto gpuDriven = [this]() { return GpuDrivenRendering(); };
+    graph.AddPass("DrawCullingReset", [&](PassBuilder& builder)
+    {
+        builder.Write(indirectCommands, RenderGraphAccess::TransferWrite);
+        builder.Write(indirectCounts, RenderGraphAccess::TransferWrite);
+        builder.Write(occlusionStats, RenderGraphAccess::TransferWrite);
+        builder.SetCondition(gpuDriven);
+        builder.SetProfileScope("DrawCulling");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        // zero instances keep the commands no record landed in empty when they are drawn without the counts
+        vkCmdFillBuffer(commandBuffer, indirectCommandBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, indirectCountBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, occlusionStatsBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    });
+    graph.AddPass("DrawCulling", [&](PassBuilder& builder)
+    {
+        // the cleared contents are kept where no command is written
+        builder.Read(indirectCommands, RenderGraphAccess::ComputeRead);
+        builder.Read(indirectCounts, RenderGraphAccess::ComputeRead);
+        builder.Write(indirectCommands, RenderGraphAccess::ComputeWrite);
+        builder.Write(indirectCounts, RenderGraphAccess::ComputeWrite);
+        // the camera draws what the last frame's late phase found visible
+        builder.Read(drawVisibility, RenderGraphAccess::ComputeRead);
+        builder.Write(occlusionStats, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(gpuDriven);
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        const uint32_t phase = DrawCullingPhaseEarly;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.drawCulling);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, drawCullingPipelineLayout, 0, 1,
+                                &drawCullingDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, drawCullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t),
+                           &phase);
+        // a row of invocations per view, local size 64 as in drawCulling.comp
+        vkCmdDispatch(commandBuffer, (gltfModel->indirectDraws.recordCount + 63) / 64, drawCullingUbo.values.counts.y, 1);
+    });
+
+    // mrt render pass
+    graph.AddPass("MRT", [&](PassBuilder& builder)
+    {
+        builder.Read(indirectCommands, RenderGraphAccess::IndirectRead);
+        builder.Read(indirectCounts, RenderGraphAccess::IndirectRead);
+        // attachments in the order of mrtRenderPass
+        std::vector<VkClearValue> clearValues;
+        builder.Write(gNormal, RenderGraphAccess::ColorAttachment);
+        clearValues.push_back({0.0f, 0.0f, 0.0f, 1.0f});
+        for (vks::RenderGraphResource attachment : gSurface)
         {
-            {0.0f, 0.0f, 0.0f, 1.0f},
-            {0.0f, 0.0f, 0.0f, 1.0f},
-            {0.0f, 0.0f, 0.0f, 1.0f},
-            {0.0f, 0.0f, 0.0f, 1.0f},
-            {0.0f, 0.0f, 0.0f, 1.0f},
-            {0.0f, 0.0f, 0.0f, 1.0f},
-            {1.0f, 1.0f, 1.0f, 1.0f},
-        };
+            builder.Write(attachment, RenderGraphAccess::ColorAttachment);
+            clearValues.push_back({0.0f, 0.0f, 0.0f, 1.0f});
+        }
+        builder.Write(gVelocity, RenderGraphAccess::ColorAttachment);
+        // no motion for the background
+        clearValues.push_back({0.0f, 0.0f, 0.0f, 0.0f});
+        builder.Write(depth, RenderGraphAccess::DepthAttachment);
 
         VkClearValue depthClearValue;
         depthClearValue.depthStencil = {1.0f, 0};
         clearValues.push_back(depthClearValue);
+        builder.SetRenderPass(mrtRenderPass.get(), clearValues, renderArea);
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        if (GpuDrivenRendering())
+        {
+            DrawSceneIndirect(commandBuffer, wireframe ? pipelines.offscreenIndirectWireframe : pipelines.offscreenIndirect,
+                              {0});
+        }
+        else
+        {
+            DrawScene(commandBuffer, wireframe ? pipelines.offscreenWireframe : pipelines.offscreen);
+        }
+        sceneDrawStats.drawCount = gltfModel->drawStatistics.drawCount;
+        sceneDrawStats.culledCount = gltfModel->drawStatistics.culledCount;
+        sceneDrawStats.lateDrawCount = 0;
+    });
+
+    // occlusion culling, the depth of the early draws is reduced to a pyramid, the records it does not hide are
+    // drawn on top of the early ones, measured together with them as the mrt scope
+    auto occlusionCulling = [this]() { return OcclusionCulling(); };
+    graph.AddPass("DepthPyramid", [&](PassBuilder& builder)
+    {
+        builder.Read(depth, RenderGraphAccess::ComputeRead);
+        builder.Write(depthPyramidResource, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(occlusionCulling);
+        builder.SetProfileScope("MRT");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        // a 64 x 64 depth tile per work group, as in depthPyramid.comp
+        const VkExtent2D renderExtent = RenderExtent();
+        const uint32_t groupCountX = (renderExtent.width + 63) / 64;
+        const uint32_t groupCountY = (renderExtent.height + 63) / 64;
+        DepthPyramidPushConstants pushConstants{};
+        pushConstants.renderSize = glm::uvec2(renderExtent.width, renderExtent.height);
+        pushConstants.levelCount = depthPyramid->LevelCount();
+        pushConstants.groupCount = groupCountX * groupCountY;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.depthPyramid);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipelineLayout, 0, 1,
+                                &depthPyramidDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(DepthPyramidPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+    });
+
+    graph.AddPass("DrawCullingLate", [&](PassBuilder& builder)
+    {
+        builder.Read(depthPyramidResource, RenderGraphAccess::ComputeRead);
+        builder.Read(indirectCommands, RenderGraphAccess::ComputeRead);
+        builder.Read(indirectCounts, RenderGraphAccess::ComputeRead);
+        builder.Write(indirectCommands, RenderGraphAccess::ComputeWrite);
+        builder.Write(indirectCounts, RenderGraphAccess::ComputeWrite);
+        builder.Read(drawVisibility, RenderGraphAccess::ComputeRead);
+        builder.Write(drawVisibility, RenderGraphAccess::ComputeWrite);
+        builder.Write(occlusionStats, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(occlusionCulling);
+        builder.SetProfileScope("MRT");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        const uint32_t phase = DrawCullingPhaseLate;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.drawCulling);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, drawCullingPipelineLayout, 0, 1,
+                                &drawCullingDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, drawCullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t),
+                           &phase);
+        // the camera only
+        vkCmdDispatch(commandBuffer, (gltfModel->indirectDraws.recordCount + 63) / 64, 1, 1);
+    });
+
+    graph.AddPass("MRTLate", [&](PassBuilder& builder)
+    {
+        builder.Read(indirectCommands, RenderGraphAccess::IndirectRead);
+        builder.Read(indirectCounts, RenderGraphAccess::IndirectRead);
+        // attachments in the order of mrtLoadRenderPass, everything is loaded
+        std::vector<VkClearValue> clearValues;
+        builder.Write(gNormal, RenderGraphAccess::ColorAttachmentLoad);
+        clearValues.push_back({0.0f, 0.0f, 0.0f, 1.0f});
+        for (vks::RenderGraphResource attachment : gSurface)
+        {
+            builder.Write(attachment, RenderGraphAccess::ColorAttachmentLoad);
+            clearValues.push_back({0.0f, 0.0f, 0.0f, 1.0f});
+        }
+        builder.Write(gVelocity, RenderGraphAccess::ColorAttachmentLoad);
+        clearValues.push_back({0.0f, 0.0f, 0.0f, 0.0f});
+        builder.Write(depth, RenderGraphAccess::DepthAttachmentLoad);
 
-        renderPassBeginInfo.clearValueCount = clearValues.size();
-        renderPassBeginInfo.pClearValues = clearValues.data();
-
-        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        const VkViewport viewport =
-            vks::initializers::Viewport((float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
-        const VkRect2D scissor = vks::initializers::Rect2D(viewportWidth, viewportHeight, 0, 0);
-
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-        // Bind scene matrices descriptor to set 0
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mrtPipelineLayout, 0, 1,
-                                &mrtDescriptorSets_Vertex[currentFrame], 0, nullptr);
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          wireframe ? pipelines.offscreenWireframe : pipelines.offscreen);
-        gltfModel->Draw(commandBuffer, vks::geometry::RenderFlags::BindImages, true, mrtPipelineLayout, 1);
-        vkCmdEndRenderPass(commandBuffer);
-    }
-
-    // ssao render pass
-    if(graphicSettings->useSSAO)
-    {
-        vks::FrameBuffer *currentSsaoFrameBuffer = ssaoFrameBuffer->GetFrameBuffer(currentFrame);
-        VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::RenderPassBeginInfo();
-        renderPassBeginInfo.renderPass = ssaoRenderPass->renderPass;
-        renderPassBeginInfo.framebuffer = currentSsaoFrameBuffer->frameBuffer;
-        renderPassBeginInfo.renderArea.offset = {0, 0};
-        renderPassBeginInfo.renderArea.extent = {viewportWidth, viewportHeight};
-        std::vector<VkClearValue> clearValues
-        {
-            {0.0f, 0.0f, 0.0f, 1.0f},
-            {0.0f, 0.0f, 0.0f, 1.0f},
-        };
-        renderPassBeginInfo.clearValueCount = clearValues.size();
-        renderPassBeginInfo.pClearValues = clearValues.data();
-        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        const VkViewport viewport =
-                vks::initializers::Viewport((float) viewportWidth, (float) viewportHeight, 0.0f, 1.0f);
-        const VkRect2D scissor = vks::initializers::Rect2D(viewportWidth, viewportHeight, 0, 0);
+        VkClearValue depthClearValue;
+        depthClearValue.depthStencil = {1.0f, 0};
+        clearValues.push_back(depthClearValue);
+        builder.SetRenderPass(mrtLoadRenderPass.get(), clearValues, renderArea);
+        builder.SetCondition(occlusionCulling);
+        builder.SetProfileScope("MRT");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        DrawSceneIndirect(commandBuffer, wireframe ? pipelines.offscreenIndirectWireframe : pipelines.offscreenIndirect,
+                          {LATE_CAMERA_VIEW});
+        sceneDrawStats.lateDrawCount = gltfModel->drawStatistics.drawCount;
+        sceneDrawStats.drawCount += sceneDrawStats.lateDrawCount;
+        // the late draws are among the ones the early phase counted as culled
+        sceneDrawStats.culledCount -= std::min(sceneDrawStats.culledCount, sceneDrawStats.lateDrawCount);
+    });
+
+    // compute ssao, every pass only waits for the writes of the one before
+    auto computeSSAO = [this]() { return graphicSettings->useSSAO && graphicSettings->ssaoCompute; };
+    graph.AddPass("SSAODownsample", [&](PassBuilder& builder)
+    {
+        builder.Read(depth, RenderGraphAccess::ComputeRead);
+        builder.Read(gNormal, RenderGraphAccess::ComputeRead);
+        builder.Write(ssaoDepth, RenderGraphAccess::ComputeWrite);
+        builder.Write(ssaoNormal, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(computeSSAO);
+        builder.SetProfileScope("SSAO");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        // depth and normal downsample, 8 x 8 work groups over the rendered region
+        const vks::RenderGraphImage& target = *ssaoComputeTargets[currentFrame].depth;
+        const VkExtent2D region = RenderRegion(target.width, target.height);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.ssaoDownsample);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ssaoDownsamplePipelineLayout, 0, 1,
+                                &ssaoDownsampleDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdDispatch(commandBuffer, (region.width + 7) / 8, (region.height + 7) / 8, 1);
+    });
+
+    graph.AddPass("SSAOCompute", [&](PassBuilder& builder)
+    {
+        builder.Read(ssaoDepth, RenderGraphAccess::ComputeRead);
+        builder.Read(ssaoNormal, RenderGraphAccess::ComputeRead);
+        builder.Write(ssaoOcclusion, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(computeSSAO);
+        builder.SetProfileScope("SSAO");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        const vks::RenderGraphImage& target = *ssaoComputeTargets[currentFrame].occlusion;
+        const VkExtent2D region = RenderRegion(target.width, target.height);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.ssaoCompute);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ssaoComputePipelineLayout, 0, 1,
+                                &ssaoComputeDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdDispatch(commandBuffer, (region.width + 7) / 8, (region.height + 7) / 8, 1);
+    });
+
+    ssaoTemporalPass = graph.AddPass("SSAOTemporal", [&](PassBuilder& builder)
+    {
+        builder.Read(ssaoOcclusion, RenderGraphAccess::ComputeRead);
+        builder.Read(ssaoDepth, RenderGraphAccess::ComputeRead);
+        builder.Read(gVelocity, RenderGraphAccess::ComputeRead);
+        builder.Write(ssaoHistory, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(computeSSAO);
+        builder.SetProfileScope("SSAO");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        // blends into the history of the previous frame, or only copies when there is none
+        const vks::VulkanStorageImage& history = *ssaoComputeTargets[currentFrame].history;
+        const VkExtent2D region = RenderRegion(history.Width(), history.Height());
+        const TemporalPushConstants pushConstants{HistoryWeight(ssaoHistoryValid), RenderScale()};
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.ssaoTemporal);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ssaoTemporalPipelineLayout, 0, 1,
+                                &ssaoTemporalDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, ssaoTemporalPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(TemporalPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, (region.width + 7) / 8, (region.height + 7) / 8, 1);
+    });
+
+    // rows then columns, 64 texels per work group and one work group row per image row or column
+    const std::array<std::pair<vks::RenderGraphResource, vks::RenderGraphResource>, 2> blurPasses = {
+        std::make_pair(ssaoHistory, ssaoBlurred),
+        std::make_pair(ssaoBlurred, ssaoOcclusion),
+    };
+    for (uint32_t pass = 0; pass < blurPasses.size(); pass++)
+    {
+        graph.AddPass(pass == 0 ? "SSAOBlurHorizontal" : "SSAOBlurVertical", [&](PassBuilder& builder)
+        {
+            builder.Read(blurPasses[pass].first, RenderGraphAccess::ComputeRead);
+            builder.Read(ssaoDepth, RenderGraphAccess::ComputeRead);
+            builder.Write(blurPasses[pass].second, RenderGraphAccess::ComputeWrite);
+            builder.SetCondition(computeSSAO);
+            builder.SetProfileScope("SSAO");
+        }, [this, pass](VkCommandBuffer commandBuffer)
+        {
+            const vks::RenderGraphImage& target = *ssaoComputeTargets[currentFrame].occlusion;
+            const VkExtent2D region = RenderRegion(target.width, target.height);
+            const glm::ivec2 direction = pass == 0 ? glm::ivec2(1, 0) : glm::ivec2(0, 1);
+            const uint32_t lineLength = pass == 0 ? region.width : region.height;
+            const uint32_t lineCount = pass == 0 ? region.height : region.width;
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.ssaoBilateralBlur);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ssaoBilateralBlurPipelineLayout, 0, 1,
+                                    &ssaoBilateralBlurDescriptorSets[2 * currentFrame + pass], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, ssaoBilateralBlurPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(glm::ivec2), &direction);
+            vkCmdDispatch(commandBuffer, (lineLength + 63) / 64, lineCount, 1);
+        });
+    }
 
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    // ssao render pass, when disabled it only clears the occlusion the lighting pass samples to 1
+    graph.AddPass("SSAO", [&](PassBuilder& builder)
+    {
+        // fragment path
+        builder.Read(depth, RenderGraphAccess::FragmentRead);
+        builder.Read(gNormal, RenderGraphAccess::FragmentRead);
+        // upsample of the compute path
+        builder.Read(ssaoOcclusion, RenderGraphAccess::FragmentRead);
+        builder.Read(ssaoDepth, RenderGraphAccess::FragmentRead);
+        builder.Write(gOcclusion, RenderGraphAccess::ColorAttachment);
+        builder.SetRenderPass(ssaoRenderPass.get(), {{0.0f, 0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}}, renderArea);
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        // the compute path leaves the ssao subpass empty and upsamples in the blur subpass
+        const bool computeSSAO = graphicSettings->useSSAO && graphicSettings->ssaoCompute;
+        // the fullscreen triangles span the targets so their uvs address them, the scissor keeps to the rendered region
+        SetViewport(commandBuffer, swapChain->imageExtent);
 
         // ssao subpass
+        if (graphicSettings->useSSAO && !computeSSAO)
         {
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssao);
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ssaoPipelineLayout, 0, 1,
@@ -2891,216 +5711,547 @@ void DeferredPBR::PrepareRenderPass(VkCommandBuffer commandBuffer)
         }
 
         // ssao blur subpass
+        vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+        if (computeSSAO)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoUpsample);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ssaoUpsamplePipelineLayout, 0, 1,
+                                    &ssaoUpsampleDescriptorSets[currentFrame], 0, nullptr);
+            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        }
+        else if (graphicSettings->useSSAO)
         {
-            vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoBlur);
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ssaoBlurPipelineLayout, 0, 1,
                                     &ssaoBlurDescriptorSets[currentFrame], 0, nullptr);
             vkCmdDraw(commandBuffer, 3, 1, 0, 0);
         }
-        vkCmdEndRenderPass(commandBuffer);
-
-        // copy realtime AO to target AO
-        vks::FrameBuffer *targetMrtFrameBuffer = mrtFrameBuffer->GetFrameBuffer(currentFrame);
-        
-        const vks::FramebufferAttachment& sourceAttachment = currentSsaoFrameBuffer->GetAttachment("G_Occlusion");
-        const vks::FramebufferAttachment& targetAttachment = targetMrtFrameBuffer->GetAttachment("G_Occlusion");
-        VkImage sourceImage = sourceAttachment.image;
-        VkImage targetImage = targetAttachment.image;
+    });
 
-        vks::utils::SetImageLayout(
-               commandBuffer,sourceImage,
-               VK_IMAGE_ASPECT_COLOR_BIT,
-               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-        
-        vks::utils::SetImageLayout(
-               commandBuffer,targetImage,
-               VK_IMAGE_ASPECT_COLOR_BIT,
-               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-        
-        // Copy region for transfer from framebuffer to cube face
-        VkImageCopy copyRegion = {};
-        
-        copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyRegion.srcSubresource.baseArrayLayer = 0;
-        copyRegion.srcSubresource.mipLevel = 0;
-        copyRegion.srcSubresource.layerCount = 1;
-        copyRegion.srcOffset = {0, 0, 0};
-        
-        copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyRegion.dstSubresource.baseArrayLayer = 0;
-        copyRegion.dstSubresource.mipLevel = 0;
-        copyRegion.dstSubresource.layerCount = 1;
-        copyRegion.dstOffset = {0, 0, 0};
-        
-        copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-        copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-        copyRegion.extent.depth = 1;
-        
-        vkCmdCopyImage(
-            commandBuffer,
-            sourceImage,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            targetImage,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &copyRegion);
-        
-        vks::utils::SetImageLayout(
-            commandBuffer,
-            sourceImage,
-            VK_IMAGE_ASPECT_COLOR_BIT,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-        
-        vks::utils::SetImageLayout(
-            commandBuffer,
-            targetImage,
-            VK_IMAGE_ASPECT_COLOR_BIT,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    }
-
-    // shadow render pass
+    // the ssao comparison reads the final occlusion of this frame back to the host
+    graph.AddPass("SSAOReadback", [&](PassBuilder& builder)
     {
-        vks::FrameBuffer *currentShadowFrameBuffer = shadowFrameBuffer->GetFrameBuffer(currentFrame);
-        VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::RenderPassBeginInfo();
-        renderPassBeginInfo.renderPass = shadowRenderPass->renderPass;
-        renderPassBeginInfo.framebuffer = currentShadowFrameBuffer->frameBuffer;
-        renderPassBeginInfo.renderArea.offset = {0, 0};
-        renderPassBeginInfo.renderArea.extent = {viewportWidth, viewportHeight};
-        std::vector<VkClearValue> clearValues =
-        {
-            {0.0f,0.0f,0.0f,0.0f}
-        };
-        VkClearValue clearValue = {1.0f, 0.0f};
-        clearValues.push_back(clearValue);
-        clearValues.push_back(clearValue);
-        renderPassBeginInfo.clearValueCount = clearValues.size();
-        renderPassBeginInfo.pClearValues = clearValues.data();
-        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        const VkViewport viewport =
-                vks::initializers::Viewport((float) viewportWidth, (float) viewportHeight, 0.0f, 1.0f);
-        const VkRect2D scissor = vks::initializers::Rect2D(viewportWidth, viewportHeight, 0, 0);
-    
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-    
-        // shadow map subpass
+        builder.Read(gOcclusion, RenderGraphAccess::TransferRead);
+        builder.SetCondition([this]() { return ssaoComparison.readbackRequested; });
+        builder.SetSideEffect();
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        const vks::FramebufferAttachment& occlusion = ssaoFrameBuffer->GetFrameBuffer(currentFrame)->GetAttachment("G_Occlusion");
+        VkBufferImageCopy copyRegion{};
+        copyRegion.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        copyRegion.imageExtent = {ssaoFrameBuffer->Width(), ssaoFrameBuffer->Height(), 1};
+        vkCmdCopyImageToBuffer(commandBuffer, occlusion.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               ssaoComparison.readbackBuffer.buffer, 1, &copyRegion);
+        ssaoComparison.readbackRequested = false;
+    });
+
+    // cascaded shadow maps, one depth only pass per cascade layer
+    graph.AddPass("Shadow", [&](PassBuilder& builder)
+    {
+        builder.Write(cascadeShadowMapResource, RenderGraphAccess::DepthAttachmentLoad);
+        builder.Read(indirectCommands, RenderGraphAccess::IndirectRead);
+        builder.Read(indirectCounts, RenderGraphAccess::IndirectRead);
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        auto drawShadowCasters = [&](uint32_t cascadeIndex, uint32_t renderFlags)
         {
+            if (GpuDrivenRendering())
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadowMapIndirect);
+                const std::array<VkDescriptorSet, 2> descriptorSets = {shadowMapDescriptorSets[currentFrame],
+                                                                       drawDataDescriptorSets[currentFrame]};
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMapIndirectPipelineLayout,
+                                        0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+                vkCmdPushConstants(commandBuffer, shadowMapIndirectPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                                   sizeof(uint32_t), &cascadeIndex);
+                // the static or dynamic caster batch for the cache, else both
+                const bool split = renderFlags & (vks::geometry::RenderFlags::RenderStaticNodes |
+                                                  vks::geometry::RenderFlags::RenderDynamicNodes);
+                DrawIndirectView(commandBuffer, cascadeIndex + 1,
+                                 gltfModel->CasterBatch(renderFlags & vks::geometry::RenderFlags::RenderDynamicNodes),
+                                 split ? 1u : 2u, 0, shadowMapIndirectPipelineLayout);
+                return;
+            }
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadowMap);
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMapPipelineLayout, 0, 1,
                                     &shadowMapDescriptorSets[currentFrame], 0, nullptr);
-            gltfModel->Draw(commandBuffer, 0, true, shadowMapPipelineLayout, NULL);
+            vkCmdPushConstants(commandBuffer, shadowMapPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4),
+                               sizeof(uint32_t), &cascadeIndex);
+            // only primitives inside the cascade's light volume
+            gltfModel->Draw(commandBuffer, renderFlags, true, shadowMapPipelineLayout, NULL,
+                            &shadowCascadeFrustums[cascadeIndex]);
+        };
+
+        if (cascadeShadowMap->HasCache())
+        {
+            // static casters only when the cascade's light matrix moved, the matrices are the ones in the shadow ubo
+            for (uint32_t i = 0; i < cascadeShadowMap->LayerCount(); i++)
+            {
+                shadowStats.drawCount[i] = 0;
+                shadowStats.culledCount[i] = 0;
+                shadowStats.skippedCount[i] = 0;
+                if (shadowCache.valid[i] && shadowCache.viewProjection[i] == shadowCascades[i].viewProjection)
+                {
+                    shadowStats.skippedCount[i] = shadowCache.staticDrawCount[i];
+                    continue;
+                }
+
+                cascadeShadowMap->BeginCacheRenderPass(commandBuffer, i);
+                drawShadowCasters(i, vks::geometry::RenderFlags::RenderStaticNodes);
+                cascadeShadowMap->EndRenderPass(commandBuffer);
+                shadowCache.viewProjection[i] = shadowCascades[i].viewProjection;
+                shadowCache.valid[i] = true;
+                shadowCache.staticDrawCount[i] = gltfModel->drawStatistics.drawCount;
+                shadowStats.drawCount[i] = gltfModel->drawStatistics.drawCount;
+                shadowStats.culledCount[i] = gltfModel->drawStatistics.culledCount;
+            }
+
+            // animated and skinned casters on top of the cached depth
+            cascadeShadowMap->CopyCache(commandBuffer);
+            for (uint32_t i = 0; i < cascadeShadowMap->LayerCount(); i++)
+            {
+                cascadeShadowMap->BeginLoadRenderPass(commandBuffer, i);
+                drawShadowCasters(i, vks::geometry::RenderFlags::RenderDynamicNodes);
+                cascadeShadowMap->EndRenderPass(commandBuffer);
+                shadowStats.drawCount[i] += gltfModel->drawStatistics.drawCount;
+                shadowStats.culledCount[i] += gltfModel->drawStatistics.culledCount;
+            }
         }
-    
-        // shadow subpass
+        else
         {
-            vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.directionalShadow);
-            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, directionalShadowPipelineLayout, 0, 1,
-                                    &directionalShadowDescriptorSets[currentFrame], 0, nullptr);
-            gltfModel->Draw(commandBuffer, 0, true, directionalShadowPipelineLayout, NULL);
+            for (uint32_t i = 0; i < cascadeShadowMap->LayerCount(); i++)
+            {
+                cascadeShadowMap->BeginRenderPass(commandBuffer, i);
+                drawShadowCasters(i, 0);
+                shadowStats.drawCount[i] = gltfModel->drawStatistics.drawCount;
+                shadowStats.culledCount[i] = gltfModel->drawStatistics.culledCount;
+                shadowStats.skippedCount[i] = 0;
+                cascadeShadowMap->EndRenderPass(commandBuffer);
+            }
         }
-        vkCmdEndRenderPass(commandBuffer);
-    }
-    
-    // lighting renderPass
-    {
-        vks::FrameBuffer* lightingFrameBuffer = lightingRenderPass->vulkanFrameBuffer->GetFrameBuffer(currentFrame);
-        VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::RenderPassBeginInfo();
+    });
 
-        renderPassBeginInfo.renderPass = lightingRenderPass->renderPass;
-        renderPassBeginInfo.framebuffer = lightingFrameBuffer->frameBuffer;
-        renderPassBeginInfo.renderArea.offset = {0, 0};
-        renderPassBeginInfo.renderArea.extent = {viewportWidth, viewportHeight};
+    // spot and point light tiles picked by the atlas budget, the rest of the atlas keeps its depth
+    graph.AddPass("ShadowAtlas", [&](PassBuilder& builder)
+    {
+        builder.Write(shadowAtlasResource, RenderGraphAccess::DepthAttachmentLoad);
+        builder.SetCondition([this]() { return !shadowAtlas.GetTileUpdates().empty(); });
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        const bool singlePassPointShadows = singlePassPointShadowsSupported && graphicSettings->singlePassPointShadows;
+        // the six pass comparison walks the model once per face, only worth it while someone reads it
+        const bool countSixPasses = singlePassPointShadows && performanceViewVisible;
+        for (const vks::ShadowAtlas::LightUpdate& lightUpdate : shadowAtlas.GetLightUpdates())
+        {
+            const vks::ShadowAtlasLight& light = shadowAtlasLights[lightUpdate.lightIndex];
+            const bool pointLight = !light.spot;
+            // casters are picked once per light from its range, tiles only test those against their frustum
+            gltfModel->CullPrimitives(light.position, light.range, shadowCasterVisibility);
+            uint32_t sixPassVertexCount = 0;
+            for (uint32_t i = 0; i < lightUpdate.updateCount; i++)
+            {
+                const vks::ShadowAtlas::TileUpdate& update = shadowAtlas.GetTileUpdates()[lightUpdate.firstUpdate + i];
+                math::Frustum tileFrustum;
+                tileFrustum.Update(shadowAtlas.GetTiles()[update.tile].viewProjection);
+                if (pointLight && singlePassPointShadows)
+                {
+                    if (countSixPasses)
+                        sixPassVertexCount += gltfModel->CountIndices(0, &tileFrustum);
+                    continue;
+                }
+                gltfModel->CullPrimitives(tileFrustum, shadowCasterVisibility, tileCasterVisibility);
+                shadowAtlasMap->BeginTileRenderPass(commandBuffer, 0, update.x, update.y, update.size);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadowAtlas);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowAtlasPipelineLayout, 0, 1,
+                                        &shadowAtlasDescriptorSets[currentFrame], 0, nullptr);
+                vkCmdPushConstants(commandBuffer, shadowAtlasPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4),
+                                   sizeof(uint32_t), &update.tile);
+                gltfModel->Draw(commandBuffer, 0, true, shadowAtlasPipelineLayout, NULL, tileCasterVisibility);
+                shadowAtlasDrawCount += gltfModel->drawStatistics.drawCount;
+                sixPassVertexCount += gltfModel->drawStatistics.indexCount;
+                shadowAtlasMap->EndRenderPass(commandBuffer);
+            }
+            if (!pointLight)
+                continue;
+            pointShadowStats.lightCount++;
+            pointShadowStats.sixPassVertexCount += sixPassVertexCount;
+            if (!singlePassPointShadows)
+            {
+                pointShadowStats.vertexCount += sixPassVertexCount;
+                continue;
+            }
 
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-        clearValues[1].color = {0.0f, 0.0f, 0.0f, 1.0f};
+            // primitives are culled against the light's range once, the geometry shader culls per face
+            std::array<VkRect2D, 6> faceTiles;
+            for (uint32_t i = 0; i < 6; i++)
+            {
+                const vks::ShadowAtlas::TileUpdate& update = shadowAtlas.GetTileUpdates()[lightUpdate.firstUpdate + i];
+                faceTiles[i] = vks::initializers::Rect2D(update.size, update.size, static_cast<int32_t>(update.x),
+                                                         static_cast<int32_t>(update.y));
+            }
+            const uint32_t firstTile = shadowAtlas.GetTileUpdates()[lightUpdate.firstUpdate].tile;
+            shadowAtlasMap->BeginTileRenderPass(commandBuffer, 0, faceTiles.data(), static_cast<uint32_t>(faceTiles.size()));
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadowAtlasCube);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowAtlasCubePipelineLayout, 0, 1,
+                                    &shadowAtlasDescriptorSets[currentFrame], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, shadowAtlasCubePipelineLayout,
+                               VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT, sizeof(glm::mat4),
+                               sizeof(uint32_t), &firstTile);
+            gltfModel->Draw(commandBuffer, 0, true, shadowAtlasCubePipelineLayout, NULL, shadowCasterVisibility);
+            shadowAtlasDrawCount += gltfModel->drawStatistics.drawCount;
+            pointShadowStats.vertexCount += gltfModel->drawStatistics.indexCount;
+            shadowAtlasMap->EndRenderPass(commandBuffer);
+        }
+    });
 
-        renderPassBeginInfo.clearValueCount = clearValues.size();
-        renderPassBeginInfo.pClearValues = clearValues.data();
+    // shadow render pass
+    graph.AddPass("ShadowResolve", [&](PassBuilder& builder)
+    {
+        builder.Read(depth, RenderGraphAccess::FragmentRead);
+        builder.Read(gNormal, RenderGraphAccess::FragmentRead);
+        builder.Read(cascadeShadowMapResource, RenderGraphAccess::FragmentRead);
+        builder.Write(gShadow, RenderGraphAccess::ColorAttachment);
+        builder.SetRenderPass(shadowRenderPass.get(), {{0.0f, 0.0f, 0.0f, 0.0f}}, renderArea);
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        // shadow subpass, the fullscreen triangle spans the targets
+        SetViewport(commandBuffer, swapChain->imageExtent);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.directionalShadow);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, directionalShadowPipelineLayout, 0, 1,
+                                &directionalShadowDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    });
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        const VkViewport viewport =
-            vks::initializers::Viewport((float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
-        const VkRect2D scissor = vks::initializers::Rect2D(viewportWidth, viewportHeight, 0, 0);
+    // the filter takes fewer taps per frame and the accumulation covers the rest
+    shadowTemporalPass = graph.AddPass("ShadowTemporal", [&](PassBuilder& builder)
+    {
+        builder.Read(gShadow, RenderGraphAccess::ComputeRead);
+        builder.Read(depth, RenderGraphAccess::ComputeRead);
+        builder.Read(gVelocity, RenderGraphAccess::ComputeRead);
+        builder.Write(shadowHistoryResource, RenderGraphAccess::ComputeWrite);
+        builder.SetProfileScope("ShadowResolve");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        RecordShadowTemporal(commandBuffer);
+    });
 
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    // light culling, bins lights into the view space cluster grid
+    graph.AddPass("LightCulling", [&](PassBuilder& builder)
+    {
+        builder.Write(clusterLightCount, RenderGraphAccess::ComputeWrite);
+        builder.Write(clusterLightIndex, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition([this]() { return graphicSettings->lightCullingOnGPU; });
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.lightCulling);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, lightCullingPipelineLayout, 0, 1,
+                                &lightCullingDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdDispatch(commandBuffer, lightClusterGrid.tileCountX, lightClusterGrid.tileCountY,
+                      lightClusterGrid.sliceCount);
+    });
+
+    // lighting and the skybox write the scene color, the depth test leaves each pixel to one of them
+    // the lighting triangle spans the targets like the other fullscreen passes, the skybox is projected by the camera
+    const auto drawLightingAndSkybox = [this](VkCommandBuffer commandBuffer)
+    {
+        SetViewport(commandBuffer, swapChain->imageExtent);
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.lighting);
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipelineLayout, 0, 1,
                                 &lightingDescriptorSets[currentFrame], 0, nullptr);
         vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-        vkCmdEndRenderPass(commandBuffer);
-    }
-
-    // skybox renderPass
-    {
-        vks::FrameBuffer* skyboxFrameBuffer = skyboxRenderPass->vulkanFrameBuffer->GetFrameBuffer(
-            currentFrame);
-        VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::RenderPassBeginInfo();
-
-        renderPassBeginInfo.renderPass = skyboxRenderPass->renderPass;
-        renderPassBeginInfo.framebuffer = skyboxFrameBuffer->frameBuffer;
-        renderPassBeginInfo.renderArea.offset = {0, 0};
-        renderPassBeginInfo.renderArea.extent = {viewportWidth, viewportHeight};
 
-        std::array<VkClearValue, 1> clearValues{};
-        clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+        SetViewport(commandBuffer, RenderExtent());
 
-        renderPassBeginInfo.clearValueCount = clearValues.size();
-        renderPassBeginInfo.pClearValues = clearValues.data();
-
-        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        const VkViewport viewport =
-            vks::initializers::Viewport((float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
-        const VkRect2D scissor = vks::initializers::Rect2D(viewportWidth, viewportHeight, 0, 0);
-
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.skybox);
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipelineLayout, 0, 1,
                                 &skyboxDescriptorSets[currentFrame], 0, nullptr);
         skybox->Draw(commandBuffer, 0, false, skyboxPipelineLayout, 0);
-        vkCmdEndRenderPass(commandBuffer);
-    }
+    };
+    VkClearValue depthClearValue;
+    depthClearValue.depthStencil = {1.0f, 0};
 
-    // postprocess renderPass
+    if (subpassDeferred)
     {
-        vks::FrameBuffer* postprocessFrameBuffer = postprocessRenderPass->vulkanFrameBuffer->GetFrameBuffer(
-            currentFrame);
-        VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::RenderPassBeginInfo();
-
-        renderPassBeginInfo.renderPass = postprocessRenderPass->renderPass;
-        renderPassBeginInfo.framebuffer = postprocessFrameBuffer->frameBuffer;
-        renderPassBeginInfo.renderArea.offset = {0, 0};
-        renderPassBeginInfo.renderArea.extent = {viewportWidth, viewportHeight};
-
-        std::array<VkClearValue, 1> clearValues{};
-        clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+        // G-buffer fill and lighting with the skybox as subpasses of deferredRenderPass,
+        // everything but the scene color stays in tile memory, measured together as the lighting scope
+        graph.AddPass("Deferred", [&](PassBuilder& builder)
+        {
+            builder.Read(depth, RenderGraphAccess::DepthAttachmentRead);
+            builder.Read(indirectCommands, RenderGraphAccess::IndirectRead);
+            builder.Read(indirectCounts, RenderGraphAccess::IndirectRead);
+            for (vks::RenderGraphResource resource : {gNormal, gOcclusion, shadowHistoryResource, shadowAtlasResource,
+                                                      clusterLightCount, clusterLightIndex})
+                builder.Read(resource, RenderGraphAccess::FragmentRead);
+            builder.Write(sceneColor, RenderGraphAccess::ColorAttachment);
+
+            // G_Color, G_Material, G_Emissive, SceneColor and the loaded depth
+            std::vector<VkClearValue> clearValues
+            {
+                {0.0f, 0.0f, 0.0f, 1.0f},
+                {0.0f, 0.0f, 0.0f, 1.0f},
+                {0.0f, 0.0f, 0.0f, 1.0f},
+                {0.0f, 0.0f, 0.0f, 1.0f},
+                depthClearValue,
+            };
+            builder.SetRenderPass(deferredRenderPass.get(), clearValues, renderArea);
+            builder.SetProfileScope("Lighting");
+        }, [this, drawLightingAndSkybox](VkCommandBuffer commandBuffer)
+        {
+            // G-buffer fill, the scene is drawn again with the depth of the prepass
+            if (GpuDrivenRendering())
+            {
+                // both phases of the camera draws
+                std::vector<uint32_t> views = {0};
+                if (OcclusionCulling())
+                    views.push_back(LATE_CAMERA_VIEW);
+                DrawSceneIndirect(commandBuffer, wireframe ? pipelines.gBufferFillIndirectWireframe
+                                                           : pipelines.gBufferFillIndirect, views);
+            }
+            else
+            {
+                DrawScene(commandBuffer, wireframe ? pipelines.gBufferFillWireframe : pipelines.gBufferFill);
+            }
 
-        renderPassBeginInfo.clearValueCount = clearValues.size();
-        renderPassBeginInfo.pClearValues = clearValues.data();
+            vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+            drawLightingAndSkybox(commandBuffer);
+        });
+    }
+    else
+    {
+        // lighting renderPass, the depth is tested against and sampled in its read only layout
+        graph.AddPass("Lighting", [&](PassBuilder& builder)
+        {
+            builder.Read(depth, RenderGraphAccess::DepthAttachmentRead);
+            for (vks::RenderGraphResource resource : {gNormal, gOcclusion, shadowHistoryResource,
+                                                      shadowAtlasResource, clusterLightCount, clusterLightIndex})
+                builder.Read(resource, RenderGraphAccess::FragmentRead);
+            for (vks::RenderGraphResource resource : gSurface)
+                builder.Read(resource, RenderGraphAccess::FragmentRead);
+            builder.Write(sceneColor, RenderGraphAccess::ColorAttachment);
+            builder.SetRenderPass(lightingRenderPass.get(), {{0.0f, 0.0f, 0.0f, 1.0f}, depthClearValue}, renderArea);
+        }, drawLightingAndSkybox);
+    }
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        const VkViewport viewport =
-            vks::initializers::Viewport((float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
-        const VkRect2D scissor = vks::initializers::Rect2D(viewportWidth, viewportHeight, 0, 0);
+    // auto exposure, bins the scene luminance and adapts the exposure of the post process pass to its average
+    auto autoExposure = [this]() { return graphicSettings->autoExposure; };
+    graph.AddPass("LuminanceHistogram", [&](PassBuilder& builder)
+    {
+        builder.Read(sceneColor, RenderGraphAccess::ComputeRead);
+        builder.Write(luminanceHistogram, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(autoExposure);
+        builder.SetProfileScope("PostProcess");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        // 16 x 16 work groups over the rendered region, one invocation per bin clears and flushes the shared histogram
+        const VkExtent2D renderExtent = RenderExtent();
+        AutoExposurePushConstants pushConstants{HISTOGRAM_MIN_LOG_LUMINANCE, HISTOGRAM_LOG_LUMINANCE_RANGE};
+        pushConstants.renderSize = glm::uvec2(renderExtent.width, renderExtent.height);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.luminanceHistogram);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, autoExposurePipelineLayout, 0, 1,
+                                &autoExposureDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, autoExposurePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(AutoExposurePushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, (renderExtent.width + 15) / 16, (renderExtent.height + 15) / 16, 1);
+    });
+
+    graph.AddPass("Exposure", [&](PassBuilder& builder)
+    {
+        // both are read and updated in place, the histogram is cleared for the next frame
+        builder.Read(luminanceHistogram, RenderGraphAccess::ComputeRead);
+        builder.Write(luminanceHistogram, RenderGraphAccess::ComputeWrite);
+        builder.Read(exposure, RenderGraphAccess::ComputeRead);
+        builder.Write(exposure, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(autoExposure);
+        builder.SetProfileScope("PostProcess");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        // frame rate independent adaptation, paused frames keep the exposure
+        const float frameTime = paused ? 0.0f : frameTimer;
+        AutoExposurePushConstants pushConstants;
+        pushConstants.minLogLuminance = HISTOGRAM_MIN_LOG_LUMINANCE;
+        pushConstants.logLuminanceRange = HISTOGRAM_LOG_LUMINANCE_RANGE;
+        pushConstants.adaptation = 1.0f - std::exp(-frameTime * graphicSettings->exposureAdaptationRate);
+        pushConstants.keyValue = EXPOSURE_KEY_VALUE * std::exp2(graphicSettings->exposureCompensation);
+        pushConstants.renderSize = glm::uvec2(RenderExtent().width, RenderExtent().height);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.exposure);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, autoExposurePipelineLayout, 0, 1,
+                                &autoExposureDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, autoExposurePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(AutoExposurePushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
+    });
+
+    // bloom, the thresholded scene halved down the chain and filtered back up, adding each level on the way
+    auto bloom = [this]() { return graphicSettings->bloom; };
+    const uint32_t bloomSetsPerFrame = 2 * GlobalVars::BLOOM_LEVEL_COUNT - 1;
+    for (uint32_t level = 0; level < GlobalVars::BLOOM_LEVEL_COUNT; level++)
+    {
+        graph.AddPass("BloomDownsample" + std::to_string(level), [&](PassBuilder& builder)
+        {
+            builder.Read(level == 0 ? sceneColor : bloomDown[level - 1], RenderGraphAccess::ComputeRead);
+            builder.Write(bloomDown[level], RenderGraphAccess::ComputeWrite);
+            builder.SetCondition(bloom);
+            builder.SetProfileScope("PostProcess");
+        }, [this, level, bloomSetsPerFrame](VkCommandBuffer commandBuffer)
+        {
+            const vks::RenderGraphImage& target = *postProcessTargets[currentFrame].bloomDown[level];
+            const VkExtent2D region = RenderRegion(target.width, target.height);
+            const BloomPushConstants pushConstants{graphicSettings->bloomThreshold, graphicSettings->bloomKnee, 1.0f,
+                                                   level == 0 ? 1 : 0, RenderScale()};
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.bloomDownsample);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bloomPipelineLayout, 0, 1,
+                                    &bloomDescriptorSets[bloomSetsPerFrame * currentFrame + level], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, bloomPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(BloomPushConstants), &pushConstants);
+            vkCmdDispatch(commandBuffer, (region.width + 7) / 8, (region.height + 7) / 8, 1);
+        });
+    }
+    for (uint32_t level = GlobalVars::BLOOM_LEVEL_COUNT - 1; level-- > 0;)
+    {
+        graph.AddPass("BloomUpsample" + std::to_string(level), [&](PassBuilder& builder)
+        {
+            builder.Read(level == GlobalVars::BLOOM_LEVEL_COUNT - 2 ? bloomDown[level + 1] : bloomUp[level + 1],
+                         RenderGraphAccess::ComputeRead);
+            builder.Read(bloomDown[level], RenderGraphAccess::ComputeRead);
+            builder.Write(bloomUp[level], RenderGraphAccess::ComputeWrite);
+            builder.SetCondition(bloom);
+            builder.SetProfileScope("PostProcess");
+        }, [this, level, bloomSetsPerFrame](VkCommandBuffer commandBuffer)
+        {
+            const vks::RenderGraphImage& target = *postProcessTargets[currentFrame].bloomUp[level];
+            const VkExtent2D region = RenderRegion(target.width, target.height);
+            const BloomPushConstants pushConstants{0.0f, 0.0f, 1.0f, 0, RenderScale()};
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.bloomUpsample);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bloomPipelineLayout, 0, 1,
+                                    &bloomDescriptorSets[bloomSetsPerFrame * currentFrame +
+                                                         GlobalVars::BLOOM_LEVEL_COUNT + level], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, bloomPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(BloomPushConstants), &pushConstants);
+            vkCmdDispatch(commandBuffer, (region.width + 7) / 8, (region.height + 7) / 8, 1);
+        });
+    }
 
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.postprocess);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, postprocessPipelineLayout, 0, 1,
-                                &postprocessDescriptorSets[currentFrame], 0, nullptr);
-        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-        vkCmdEndRenderPass(commandBuffer);
+    // temporal upscaling, the jittered scene color is accumulated at the output resolution and sharpened,
+    // bloom and auto exposure keep reading the scene color at the rendered resolution
+    auto upscale = [this]() { return graphicSettings->upscaleQuality > 0; };
+    temporalUpscalePass = graph.AddPass("TemporalUpscale", [&](PassBuilder& builder)
+    {
+        builder.Read(sceneColor, RenderGraphAccess::ComputeRead);
+        builder.Read(depth, RenderGraphAccess::ComputeRead);
+        builder.Read(gVelocity, RenderGraphAccess::ComputeRead);
+        builder.Write(upscaleHistory, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(upscale);
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        const vks::VulkanStorageImage& target = *postProcessTargets[currentFrame].upscaleHistory;
+        const VkExtent2D renderExtent = RenderExtent();
+        // the jitter in texels of the scene color, y of the normalized device coordinates points down the texels
+        const TemporalUpscalePushConstants pushConstants{
+            ProjectionJitter() * glm::vec2(renderExtent.width, renderExtent.height) * 0.5f,
+            glm::uvec2(renderExtent.width, renderExtent.height),
+            upscaleHistoryValid ? graphicSettings->temporalHistoryWeight : 0.0f};
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.temporalUpscale);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, temporalUpscalePipelineLayout, 0, 1,
+                                &temporalUpscaleDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, temporalUpscalePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(TemporalUpscalePushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, (target.Width() + 7) / 8, (target.Height() + 7) / 8, 1);
+    });
+
+    graph.AddPass("Sharpen", [&](PassBuilder& builder)
+    {
+        builder.Read(upscaleHistory, RenderGraphAccess::ComputeRead);
+        builder.Write(upscaled, RenderGraphAccess::ComputeWrite);
+        builder.SetCondition(upscale);
+        builder.SetProfileScope("TemporalUpscale");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        const vks::RenderGraphImage& target = *postProcessTargets[currentFrame].upscaled;
+        const SharpenPushConstants pushConstants{graphicSettings->upscaleSharpness};
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.sharpen);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sharpenPipelineLayout, 0, 1,
+                                &sharpenDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, sharpenPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(SharpenPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, (target.width + 7) / 8, (target.height + 7) / 8, 1);
+    });
+
+    // exposure, bloom, tonemapping, grading and gamma in one dispatch, the scene color is read once
+    graph.AddPass("PostProcess", [&](PassBuilder& builder)
+    {
+        builder.Read(sceneColor, RenderGraphAccess::ComputeRead);
+        builder.Read(upscaled, RenderGraphAccess::ComputeRead);
+        builder.Read(bloomUp[0], RenderGraphAccess::ComputeRead);
+        builder.Read(exposure, RenderGraphAccess::ComputeRead);
+        builder.Write(result, RenderGraphAccess::ComputeWrite);
+        builder.SetProfileScope("PostProcess");
+    }, [this](VkCommandBuffer commandBuffer)
+    {
+        const vks::VulkanStorageImage& target = *postProcessTargets[currentFrame].result;
+        PostProcessPushConstants pushConstants;
+        pushConstants.colorFilter = glm::vec4(graphicSettings->colorFilter[0], graphicSettings->colorFilter[1],
+                                              graphicSettings->colorFilter[2], 1.0f);
+        pushConstants.exposure = graphicSettings->exposure;
+        pushConstants.autoExposure = graphicSettings->autoExposure ? 1 : 0;
+        pushConstants.bloomIntensity = graphicSettings->bloom ? graphicSettings->bloomIntensity : 0.0f;
+        pushConstants.contrast = graphicSettings->contrast;
+        pushConstants.saturation = graphicSettings->saturation;
+        // the upscaled color covers the whole target, the bloom chain only the rendered region
+        const bool upscaling = graphicSettings->upscaleQuality > 0;
+        pushConstants.sceneScale = upscaling ? glm::vec2(1.0f) : RenderScale();
+        pushConstants.bloomScale = RenderScale();
+        const uint32_t set = 4 * currentFrame + (upscaling ? 2 : 0) + (graphicSettings->bloom ? 0 : 1);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.postProcess);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcessPipelineLayout, 0, 1,
+                                &postProcessDescriptorSets[set], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, postProcessPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(PostProcessPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, (target.Width() + 7) / 8, (target.Height() + 7) / 8, 1);
+    });
+
+    // the UI shows the final image and the G-buffer, passes only they depend on are culled while hidden
+    graph.AddOutput(result, [this]() { return sceneViewVisible; });
+    for (vks::RenderGraphResource attachment : {gNormal, gVelocity})
+        graph.AddOutput(attachment, [this]() { return gBufferViewVisible; });
+    for (vks::RenderGraphResource attachment : gSurface)
+        graph.AddOutput(attachment, [this]() { return gBufferViewVisible; });
+    graph.Compile();
+
+    for (uint32_t i = 0; i < maxFrameInFlight; i++)
+    {
+        SsaoComputeTargets& targets = ssaoComputeTargets[i];
+        targets.depth = graph.GetImage(ssaoDepth, i);
+        targets.normal = graph.GetImage(ssaoNormal, i);
+        targets.occlusion = graph.GetImage(ssaoOcclusion, i);
+        targets.blurred = graph.GetImage(ssaoBlurred, i);
+
+        PostProcessTargets& postTargets = postProcessTargets[i];
+        for (uint32_t level = 0; level < GlobalVars::BLOOM_LEVEL_COUNT; level++)
+            postTargets.bloomDown[level] = graph.GetImage(bloomDown[level], i);
+        for (uint32_t level = 0; level < bloomUp.size(); level++)
+            postTargets.bloomUp[level] = graph.GetImage(bloomUp[level], i);
+        postTargets.upscaled = graph.GetImage(upscaled, i);
     }
 }
 
+void DeferredPBR::PrepareRenderPass(VkCommandBuffer commandBuffer)
+{
+    gpuProfiler->BeginFrame(commandBuffer, currentFrame);
+    shadowAtlasDrawCount = 0;
+    pointShadowStats = {};
+    UpdateShadowAtlas();
+
+    // the whole frame drives the dynamic resolution
+    gpuProfiler->BeginScope(commandBuffer, "Frame");
+    renderGraph->Execute(commandBuffer, currentFrame, gpuProfiler.get());
+    gpuProfiler->EndScope(commandBuffer, "Frame");
+
+    // frames that skip an accumulation leave its history behind
+    ssaoHistoryValid = renderGraph->Executed(ssaoTemporalPass);
+    shadowHistoryValid = renderGraph->Executed(shadowTemporalPass);
+    upscaleHistoryValid = renderGraph->Executed(temporalUpscalePass);
+}
+
 void DeferredPBR::ReCreateVulkanResource_Child()
 {
     mrtRenderPass.reset();
@@ -3108,25 +6259,25 @@ void DeferredPBR::ReCreateVulkanResource_Child()
 
     ssaoRenderPass.reset();
     SetupSSAORenderPass();
+    SetupSSAOComputeTargets();
+    SetupDepthPyramid();
 
     shadowRenderPass.reset();
     SetupShadowRenderPass();
+    SetupShadowHistory();
 
-    lightingRenderPass.reset();
-    SetupLightingRenderPass();
-
-    skyboxRenderPass.reset();
-    SetupSkyboxRenderPass();
-
-    postprocessRenderPass.reset();
-    SetupPostprocessRenderPass();
+    SetupShadingRenderPasses();
+    SetupPostProcessTargets();
 
+    SetupRenderGraph();
     SetupDescriptorSets();
 }
 
 void DeferredPBR::NewGUIFrame()
 {
-    if (ImGui::Begin("UI_GBuffer_View"))
+    // graph outputs of hidden windows are not rendered, the next frame sees the change
+    gBufferViewVisible = ImGui::Begin("UI_GBuffer_View");
+    if (gBufferViewVisible)
     {
         ImVec2 viewportPanelSize = ImGui::GetContentRegionAvail();
         vks::FrameBuffer* frameBuffer = mrtRenderPass->vulkanFrameBuffer->GetFrameBuffer(currentFrame);
@@ -3142,20 +6293,26 @@ void DeferredPBR::NewGUIFrame()
         ImGui::End();
     }
 
-    if (ImGui::Begin("UI_View", nullptr, ImGuiWindowFlags_ForwardBackend))
+    sceneViewVisible = ImGui::Begin("UI_View", nullptr, ImGuiWindowFlags_ForwardBackend);
+    if (sceneViewVisible)
     {
         ImVec2 viewportPanelSize = ImGui::GetContentRegionAvail();
-        vks::FrameBuffer* frameBuffer = postprocessRenderPass->vulkanFrameBuffer->GetFrameBuffer(currentFrame);
-        //        vks::FrameBuffer *frameBuffer = lightingRenderPass->vulkanFrameBuffer->GetFrameBuffer(currentFrame);
         float scale = std::min(viewportPanelSize.x / (float)viewportWidth,
                                viewportPanelSize.y / (float)viewportHeight);
         ImVec2 windowSize = ImGui::GetWindowSize();
         ImVec2 imageSize = ImVec2(viewportWidth * scale, viewportHeight * scale);
         ImGui::SetCursorPos(ImVec2((windowSize.x - imageSize.x) * 0.5f, (windowSize.y - imageSize.y) * 0.5f));
-        ImGui::Image((ImTextureID)frameBuffer->attachments[0].descriptorSet, imageSize);
+        ImGui::Image((ImTextureID)postProcessTargets[currentFrame].resultDescriptorSet, imageSize);
+        if (ImGui::IsItemClicked(ImGuiMouseButton_Left))
+        {
+            const ImVec2 mouse = ImGui::GetMousePos();
+            const ImVec2 imageMin = ImGui::GetItemRectMin();
+            PickScene(glm::vec2((mouse.x - imageMin.x) / imageSize.x, (mouse.y - imageMin.y) / imageSize.y));
+        }
         ImGui::End();
     }
 
+    performanceViewVisible = false;
     if (ImGui::Begin("UI_Status"))
     {
         if (ImGui::CollapsingHeader("State", ImGuiTreeNodeFlags_DefaultOpen))
@@ -3169,6 +6326,18 @@ void DeferredPBR::NewGUIFrame()
                         camera->position.x, camera->position.y, camera->position.z);
             ImGui::Text("Rotation: (%g, %g, %g)",
                         camera->rotation.x, camera->rotation.y, camera->rotation.z);
+
+            ImGui::SeparatorText("Picking");
+            if (scenePick.hit)
+            {
+                const glm::vec3& position = scenePick.rayHit.position;
+                ImGui::Text("%s, primitive %u", scenePick.rayHit.node->name.c_str(),
+                            scenePick.rayHit.primitive->boundsIndex);
+                ImGui::Text("distance %.3f at (%g, %g, %g), %.3f ms", scenePick.rayHit.distance, position.x, position.y,
+                            position.z, scenePick.time);
+            }
+            else
+                ImGui::Text("click into the view to pick a primitive");
         }
         
         if(ImGui::CollapsingHeader("Settings", ImGuiTreeNodeFlags_DefaultOpen))
@@ -3179,6 +6348,116 @@ void DeferredPBR::NewGUIFrame()
                 ImGui::Checkbox("enable", &graphicSettings->useSSAO);
                 ImGui::SliderFloat("radius", &graphicSettings->ssaoRadius,0.0f,1.0f);
                 ImGui::SliderFloat("bias", & graphicSettings->ssaoBias,0.0f,1.0f);
+                ImGui::Checkbox("compute ssao", &graphicSettings->ssaoCompute);
+                if (graphicSettings->ssaoCompute)
+                {
+                    const char* ssaoQualityNames[IM_ARRAYSIZE(ssaoQualityTiers)];
+                    for (int i = 0; i < IM_ARRAYSIZE(ssaoQualityTiers); i++)
+                        ssaoQualityNames[i] = ssaoQualityTiers[i].name;
+                    if (ImGui::Combo("ssao quality", &graphicSettings->ssaoQuality, ssaoQualityNames, IM_ARRAYSIZE(ssaoQualityNames)))
+                        ssaoDirty = true;
+                }
+
+                ImGui::SeparatorText("Temporal Accumulation");
+                // changes the samples per frame of both the ssao and the shadow filter pipelines
+                if (ImGui::Checkbox("accumulate ssao and shadows", &graphicSettings->temporalAccumulation))
+                {
+                    ssaoDirty = true;
+                    shadowFilterDirty = true;
+                }
+                ImGui::SliderFloat("history weight", &graphicSettings->temporalHistoryWeight, 0.0f, 0.98f);
+
+                ImGui::SeparatorText("Clustered Lighting");
+                ImGui::Checkbox("gpu light culling", &graphicSettings->lightCullingOnGPU);
+                if (ImGui::SliderInt("benchmark lights", &graphicSettings->benchmarkLightCount, 0,
+                                     static_cast<int>(GlobalVars::MAX_LIGHT_COUNT)))
+                    GenerateBenchmarkLights(static_cast<uint32_t>(graphicSettings->benchmarkLightCount));
+                if (ImGui::SliderFloat("benchmark light range", &graphicSettings->benchmarkLightRange, 0.1f, 10.0f))
+                    GenerateBenchmarkLights(static_cast<uint32_t>(graphicSettings->benchmarkLightCount));
+
+                ImGui::SeparatorText("Shadows");
+                if (ImGui::SliderInt("cascades", &graphicSettings->shadowCascadeCount, 1,
+                                     static_cast<int>(GlobalVars::MAX_SHADOW_CASCADE_COUNT)))
+                    shadowMapDirty = true;
+                const int shadowMapResolutions[] = {1024, 2048, 4096};
+                const char* shadowMapResolutionNames[] = {"1024", "2048", "4096"};
+                int resolutionIndex = 0;
+                for (int i = 0; i < IM_ARRAYSIZE(shadowMapResolutions); i++)
+                    if (shadowMapResolutions[i] == graphicSettings->shadowMapResolution)
+                        resolutionIndex = i;
+                if (ImGui::Combo("resolution", &resolutionIndex, shadowMapResolutionNames, IM_ARRAYSIZE(shadowMapResolutionNames)))
+                {
+                    graphicSettings->shadowMapResolution = shadowMapResolutions[resolutionIndex];
+                    shadowMapDirty = true;
+                }
+                ImGui::SliderFloat("shadow distance", &graphicSettings->shadowDistance, 1.0f, 64.0f);
+                ImGui::SliderFloat("split lambda", &graphicSettings->cascadeSplitLambda, 0.0f, 1.0f);
+                ImGui::Checkbox("stable cascades", &graphicSettings->stableShadowCascades);
+                if (ImGui::Checkbox("cache static casters", &graphicSettings->shadowCaching))
+                    shadowMapDirty = true;
+                if (graphicSettings->shadowCaching && !graphicSettings->stableShadowCascades)
+                    ImGui::TextDisabled("tight cascades refit on every camera move, the cache only hits while it is still");
+                ImGui::SliderFloat("sun elevation", &graphicSettings->sunElevation, 5.0f, 90.0f);
+                ImGui::SliderFloat("sun azimuth", &graphicSettings->sunAzimuth, 0.0f, 360.0f);
+                const char* shadowFilterNames[IM_ARRAYSIZE(shadowFilterTiers)];
+                for (int i = 0; i < IM_ARRAYSIZE(shadowFilterTiers); i++)
+                    shadowFilterNames[i] = shadowFilterTiers[i].name;
+                if (ImGui::Combo("filter quality", &graphicSettings->shadowFilterQuality, shadowFilterNames, IM_ARRAYSIZE(shadowFilterNames)))
+                    shadowFilterDirty = true;
+                if (GetShadowFilterTier(graphicSettings->shadowFilterQuality).blockerSearch)
+                    ImGui::SliderFloat("penumbra scale", &graphicSettings->shadowPenumbraScale, 0.0f, 2000.0f);
+                ImGui::Checkbox("local light shadows", &graphicSettings->localLightShadows);
+                ImGui::SliderInt("atlas tiles per frame", &graphicSettings->shadowAtlasUpdateBudget, 0, 64);
+                if (singlePassPointShadowsSupported)
+                    ImGui::Checkbox("single pass point shadows", &graphicSettings->singlePassPointShadows);
+
+                ImGui::SeparatorText("Deferred Path");
+                if (ImGui::Checkbox("merged subpasses", &graphicSettings->subpassDeferred))
+                    deferredPathDirty = true;
+                if (gpuDrivenSupported)
+                    ImGui::Checkbox("gpu driven draws", &graphicSettings->gpuDrivenRendering);
+                if (occlusionCullingSupported && graphicSettings->gpuDrivenRendering)
+                    ImGui::Checkbox("occlusion culling", &graphicSettings->occlusionCulling);
+
+                ImGui::SeparatorText("Post Processing");
+                ImGui::Checkbox("auto exposure", &graphicSettings->autoExposure);
+                if (graphicSettings->autoExposure)
+                {
+                    ImGui::SliderFloat("exposure compensation", &graphicSettings->exposureCompensation, -4.0f, 4.0f);
+                    ImGui::SliderFloat("adaptation rate", &graphicSettings->exposureAdaptationRate, 0.1f, 10.0f);
+                }
+                else
+                    ImGui::SliderFloat("exposure", &graphicSettings->exposure, 0.1f, 16.0f);
+                ImGui::Checkbox("bloom", &graphicSettings->bloom);
+                if (graphicSettings->bloom)
+                {
+                    ImGui::SliderFloat("bloom threshold", &graphicSettings->bloomThreshold, 0.0f, 8.0f);
+                    ImGui::SliderFloat("bloom knee", &graphicSettings->bloomKnee, 0.0f, 1.0f);
+                    ImGui::SliderFloat("bloom intensity", &graphicSettings->bloomIntensity, 0.0f, 1.0f);
+                }
+                ImGui::ColorEdit3("color filter", graphicSettings->colorFilter);
+                ImGui::SliderFloat("contrast", &graphicSettings->contrast, 0.5f, 2.0f);
+                ImGui::SliderFloat("saturation", &graphicSettings->saturation, 0.0f, 2.0f);
+
+                ImGui::SeparatorText("Dynamic Resolution");
+                ImGui::Checkbox("dynamic resolution", &graphicSettings->dynamicResolution);
+                if (graphicSettings->dynamicResolution)
+                {
+                    ImGui::SliderFloat("target GPU time (ms)", &graphicSettings->targetFrameTime, 1.0f, 50.0f);
+                    ImGui::SliderFloat("min scale", &graphicSettings->minResolutionScale, 0.25f, 1.0f);
+                }
+                const char* upscaleQualityNames[IM_ARRAYSIZE(upscaleQualityTiers)];
+                for (int i = 0; i < IM_ARRAYSIZE(upscaleQualityTiers); i++)
+                    upscaleQualityNames[i] = upscaleQualityTiers[i].name;
+                if (ImGui::Combo("temporal upscaling", &graphicSettings->upscaleQuality, upscaleQualityNames,
+                                 IM_ARRAYSIZE(upscaleQualityNames)))
+                {
+                    // the histories were accumulated at the uvs of the previous region
+                    ssaoHistoryValid = false;
+                    shadowHistoryValid = false;
+                }
+                if (graphicSettings->upscaleQuality > 0)
+                    ImGui::SliderFloat("sharpness", &graphicSettings->upscaleSharpness, 0.0f, 1.0f);
                 ImGui::TreePop();
                 ImGui::Spacing();
             }
@@ -3200,6 +6479,258 @@ void DeferredPBR::NewGUIFrame()
 
         if (ImGui::CollapsingHeader("Performance"))
         {
+            performanceViewVisible = true;
+            ImGui::SeparatorText("GPU Time");
+            if (!gpuProfiler->Supported())
+                ImGui::Text("timestamp queries are not supported");
+            for (const std::string& scopeName : gpuProfiler->GetScopeNames())
+                ImGui::Text("%s: %.3f ms", scopeName.c_str(), gpuProfiler->GetTime(scopeName));
+
+            ImGui::SeparatorText("Render Graph");
+            {
+                const vks::VulkanRenderGraph::Statistics& graphStats = renderGraph->GetStatistics();
+                ImGui::Text("passes: %u executed, %u culled", graphStats.executedPassCount, graphStats.culledPassCount);
+                ImGui::Text("barriers: %u, %u image barriers", graphStats.barrierCount, graphStats.imageBarrierCount);
+                ImGui::Text("transient memory: %.2f MB, %.2f MB without aliasing",
+                            static_cast<float>(graphStats.transientMemorySize) / (1024.0f * 1024.0f),
+                            static_cast<float>(graphStats.unaliasedTransientMemorySize) / (1024.0f * 1024.0f));
+            }
+
+            ImGui::SeparatorText("Render Targets");
+            {
+                VkDeviceSize memorySize = 0;
+                VkDeviceSize perFrameMemorySize = 0;
+                for (const vks::VulkanFrameBuffer* frameBuffer : {mrtFrameBuffer.get(), ssaoFrameBuffer.get(),
+                                                                  shadowFrameBuffer.get(), lightingFrameBuffer.get(),
+                                                                  deferredFrameBuffer.get()})
+                {
+                    if (frameBuffer == nullptr)
+                        continue;
+                    memorySize += frameBuffer->MemorySize();
+                    perFrameMemorySize += frameBuffer->PerFrameMemorySize();
+                }
+                const float megabyte = 1024.0f * 1024.0f;
+                ImGui::Text("memory: %.2f MB, %.2f MB with a set per frame in flight, %.2f MB saved",
+                            static_cast<float>(memorySize) / megabyte, static_cast<float>(perFrameMemorySize) / megabyte,
+                            static_cast<float>(perFrameMemorySize - memorySize) / megabyte);
+
+                // the skybox is drawn into the scene color, a separate skybox target would be written and read back
+                // along with the depth by the post process pass
+                const uint32_t colorBytes = vks::utils::FormatSize(VK_FORMAT_R16G16B16A16_SFLOAT);
+                const uint32_t savedBytesPerPixel = 2 * colorBytes + vks::utils::FormatSize(depthFormat);
+                ImGui::Text("fused sky: %u bytes per pixel, %.2f MB per frame not written or read",
+                            savedBytesPerPixel,
+                            static_cast<float>(savedBytesPerPixel) * viewportWidth * viewportHeight / megabyte);
+            }
+
+            ImGui::SeparatorText("G-Buffer");
+            {
+                uint32_t colorBytes = 0;
+                uint32_t depthBytes = 0;
+                for (const vks::FramebufferAttachment& attachment : mrtFrameBuffer->GetFrameBuffer(currentFrame)->attachments)
+                    (vks::utils::IsDepthStencil(attachment.format) ? depthBytes : colorBytes) += vks::utils::FormatSize(attachment.format);
+                ImGui::Text("%u bytes per pixel, %u color + %u depth", colorBytes + depthBytes, colorBytes, depthBytes);
+
+                if (graphicSettings->subpassDeferred)
+                {
+                    // the attachments that only live within deferredRenderPass
+                    uint32_t transientBytes = 0;
+                    VkDeviceSize committedBytes = 0;
+                    bool lazilyAllocated = false;
+                    for (const vks::FramebufferAttachment& attachment : deferredFrameBuffer->GetFrameBuffer(currentFrame)->attachments)
+                    {
+                        if (attachment.shared)
+                            continue;
+                        transientBytes += vks::utils::FormatSize(attachment.format);
+                        if (attachment.lazilyAllocated)
+                        {
+                            VkDeviceSize committed = 0;
+                            vkGetDeviceMemoryCommitment(device, attachment.memory, &committed);
+                            committedBytes += committed;
+                            lazilyAllocated = true;
+                        }
+                    }
+                    ImGui::Text("transient: %u bytes per pixel", transientBytes);
+                    if (lazilyAllocated)
+                        ImGui::Text("committed lazily allocated memory: %.2f MB",
+                                    static_cast<float>(committedBytes) / (1024.0f * 1024.0f));
+                    else
+                        ImGui::Text("no lazily allocated memory, the transient attachments are device local");
+                }
+            }
+
+            ImGui::SeparatorText("Post Processing");
+            {
+                // written by the exposure pass of the last completed frame
+                const float* exposureState = static_cast<const float*>(exposureBuffer.mapped);
+                if (graphicSettings->autoExposure)
+                    ImGui::Text("average luminance %.4f, exposure %.3f", exposureState[0], exposureState[1]);
+                else
+                    ImGui::Text("fixed exposure %.3f", graphicSettings->exposure);
+                if (graphicSettings->bloom)
+                {
+                    const PostProcessTargets& targets = postProcessTargets[currentFrame];
+                    ImGui::Text("bloom: %u levels, %u x %u to %u x %u", GlobalVars::BLOOM_LEVEL_COUNT,
+                                targets.bloomDown[0]->width, targets.bloomDown[0]->height,
+                                targets.bloomDown[GlobalVars::BLOOM_LEVEL_COUNT - 1]->width,
+                                targets.bloomDown[GlobalVars::BLOOM_LEVEL_COUNT - 1]->height);
+                }
+            }
+
+            ImGui::SeparatorText("Dynamic Resolution");
+            {
+                const VkExtent2D renderExtent = RenderExtent();
+                ImGui::Text("scale %.2f: %u x %u of %u x %u", dynamicResolution.scale, renderExtent.width,
+                            renderExtent.height, viewportWidth, viewportHeight);
+                ImGui::Text("GPU frame %.3f ms, target %.3f ms", gpuProfiler->GetTime("Frame"),
+                            graphicSettings->targetFrameTime);
+                const UpscaleQualityTier& tier = GetUpscaleQualityTier(graphicSettings->upscaleQuality);
+                if (graphicSettings->upscaleQuality > 0)
+                    ImGui::Text("temporal upscaling %s (%.2f): %.3f ms", tier.name, tier.scale,
+                                gpuProfiler->GetTime("TemporalUpscale"));
+                else
+                    ImGui::Text("temporal upscaling off");
+            }
+
+            ImGui::SeparatorText("SSAO");
+            if (graphicSettings->ssaoCompute)
+            {
+                const SsaoQualityTier& tier = GetSsaoQualityTier(graphicSettings->ssaoQuality);
+                ImGui::Text("compute: %u x %u, %u samples", ssaoComputeTargets[currentFrame].occlusion->width,
+                            ssaoComputeTargets[currentFrame].occlusion->height, tier.kernelSize);
+            }
+            else
+                ImGui::Text("fragment: %u x %u, %u samples", ssaoFrameBuffer->Width(), ssaoFrameBuffer->Height(),
+                            GlobalVars::SSAO_KERNEL_SIZE);
+            if (ImGui::Button("compare against the fragment path") && !ssaoComparison.run.Running())
+                StartSSAOComparison();
+            if (ssaoComparison.run.Running())
+                ImGui::Text("running %u / %u, keep the camera still", ssaoComparison.run.Step() + 1,
+                            ssaoComparison.run.StepCount());
+            for (const std::string& report : ssaoComparison.run.Reports())
+                ImGui::TextUnformatted(report.c_str());
+
+            ImGui::SeparatorText("Clustered Lighting");
+            ImGui::Text("lights: %u", lightClusterStats.lightCount);
+            ImGui::Text("clusters: %u x %u x %u", lightClusterGrid.tileCountX, lightClusterGrid.tileCountY,
+                        lightClusterGrid.sliceCount);
+            ImGui::Text("lights per cluster: avg %.2f, max %u", lightClusterStats.averageLightsPerCluster,
+                        lightClusterStats.maxLightsPerCluster);
+            ImGui::Text("cpu binning: %.3f ms", lightClusterStats.cpuBinningTime);
+            if (ImGui::Button("validate against cpu reference"))
+                lightClusterStats.validateRequested = true;
+            if (lightClusterStats.validated)
+                ImGui::Text("mismatching clusters: %u", lightClusterStats.validationMismatches);
+
+            if (ImGui::Button("run light scaling benchmark") && !lightScalingBenchmark.run.Running())
+                StartLightScalingBenchmark();
+            if (lightScalingBenchmark.run.Running())
+                ImGui::Text("running %u / %u", lightScalingBenchmark.run.Step() + 1, lightScalingBenchmark.run.StepCount());
+            for (const std::string& report : lightScalingBenchmark.run.Reports())
+                ImGui::TextUnformatted(report.c_str());
+
+            ImGui::SeparatorText("Frustum Culling");
+            ImGui::Text("camera: %u draws, %u culled", sceneDrawStats.drawCount, sceneDrawStats.culledCount);
+            ImGui::Checkbox("sorted draw lists", &graphicSettings->sortedDrawLists);
+            // only the active order is recorded, the other one shows its last measurement
+            const char* drawOrderNames[] = { "scene order", "sorted" };
+            for (uint32_t order = 0; order < 2; order++)
+            {
+                const bool active = (order == 1) == graphicSettings->sortedDrawLists;
+                if (!active && sceneDrawStats.recordTime[order] == 0.0f)
+                    ImGui::Text("%s: not measured yet", drawOrderNames[order]);
+                else
+                    ImGui::Text("%s: %u material binds, %.3f ms%s", drawOrderNames[order], sceneDrawStats.bindCount[order],
+                                sceneDrawStats.recordTime[order], active ? "" : " (last measured)");
+            }
+            if (GpuDrivenRendering())
+                ImGui::Text("gpu driven: %u records, %u indirect calls per view, %s", gltfModel->indirectDraws.recordCount,
+                            gltfModel->indirectDraws.materialBatchCount,
+                            drawIndirectCountSupported ? "draw count buffer" : "zeroed commands");
+            if (GpuDrivenRendering())
+            {
+                // written by the culling of the last frame
+                const OcclusionStats& stats = *static_cast<const OcclusionStats*>(occlusionStatsBuffer.mapped);
+                const float triangleCount = static_cast<float>(std::max(stats.triangleCount, 1u));
+                ImGui::Text("triangles: %u, %.1f%% outside the frustum, %.1f%% occluded", stats.triangleCount,
+                            100.0f * stats.frustumCulledTriangles / triangleCount,
+                            100.0f * stats.occludedTriangles / triangleCount);
+                if (OcclusionCulling())
+                    ImGui::Text("late phase: %u draws, %u triangles", sceneDrawStats.lateDrawCount, stats.lateTriangles);
+                ImGui::Text("mrt: %.3f ms without occlusion culling, %.3f ms with it", sceneDrawStats.mrtTime[0],
+                            sceneDrawStats.mrtTime[1]);
+            }
+            if (ImGui::Button("run culling benchmark"))
+                RunCullingBenchmark();
+            if (cullingBenchmark.boxCount > 0)
+                ImGui::Text("%u boxes: one at a time %.3f ms, batches of %zu %.3f ms (%.2fx), %u visible, %u mismatches",
+                            cullingBenchmark.boxCount, cullingBenchmark.scalarTime, math::AABBArray::BATCH_SIZE,
+                            cullingBenchmark.batchTime,
+                            cullingBenchmark.scalarTime / std::max(cullingBenchmark.batchTime, 1e-6f),
+                            cullingBenchmark.visibleCount, cullingBenchmark.mismatchCount);
+            ImGui::Checkbox("bounding volume hierarchy", &gltfModel->bvhCulling);
+            ImGui::Text("hierarchy: %zu nodes over %zu primitives, depth %u", gltfModel->bvh.GetNodes().size(),
+                        gltfModel->bvh.ItemCount(), gltfModel->bvh.Depth());
+            if (ImGui::Button("run bvh benchmark"))
+                RunBVHBenchmark();
+            if (bvhBenchmark.boxCount > 0)
+            {
+                ImGui::Text("%u boxes, %u nodes, depth %u: build %.3f ms, refit of %u boxes %.3f ms",
+                            bvhBenchmark.boxCount, bvhBenchmark.nodeCount, bvhBenchmark.depth, bvhBenchmark.buildTime,
+                            bvhBenchmark.refitBoxCount, bvhBenchmark.refitTime);
+                ImGui::Text("frustum %.3f ms (batches %.3f ms), %u mismatches, sphere %.3f ms, ray %.4f ms, %u / %u hit",
+                            bvhBenchmark.frustumTime, bvhBenchmark.linearFrustumTime, bvhBenchmark.mismatchCount,
+                            bvhBenchmark.sphereTime, bvhBenchmark.rayTime, bvhBenchmark.rayHitCount,
+                            BVH_BENCHMARK_RAY_COUNT);
+            }
+
+            ImGui::SeparatorText("Transforms");
+            ImGui::Text("scene: %u transforms", gltfModel->transforms.Size());
+            if (ImGui::Button("run transform benchmark"))
+                RunTransformBenchmark();
+            if (transformBenchmark.nodeCount > 0)
+            {
+                ImGui::Text("%u nodes, depth %u: parent walk %.3f ms, flattened update %.3f ms (%.1fx), max error %.2e",
+                            transformBenchmark.nodeCount, transformBenchmark.depth, transformBenchmark.walkTime,
+                            transformBenchmark.fullTime,
+                            transformBenchmark.walkTime / std::max(transformBenchmark.fullTime, 1e-6f),
+                            transformBenchmark.maxError);
+                ImGui::Text("one changed node: %u transforms updated, %.4f ms", transformBenchmark.dirtyUpdateCount,
+                            transformBenchmark.dirtyTime);
+            }
+
+            ImGui::SeparatorText("Shadows");
+            ImGui::Text("shadow map: %u x %u, %u layers", cascadeShadowMap->Resolution(), cascadeShadowMap->Resolution(),
+                        cascadeShadowMap->LayerCount());
+            for (uint32_t i = 0; i < cascadeShadowMap->LayerCount() && i < shadowCascades.size(); i++)
+                ImGui::Text("cascade %u: split %.2f, texel %.4f, draws %u, culled %u", i, shadowCascades[i].splitDepth,
+                            shadowCascades[i].texelSize, shadowStats.drawCount[i], shadowStats.culledCount[i]);
+            uint32_t skippedShadowDraws = 0;
+            for (uint32_t i = 0; i < cascadeShadowMap->LayerCount(); i++)
+                skippedShadowDraws += shadowStats.skippedCount[i];
+            ImGui::Text("skipped shadow draws per frame: %u", skippedShadowDraws);
+
+            const vks::ShadowAtlas::Statistics& atlasStats = shadowAtlas.GetStatistics();
+            ImGui::Text("atlas: %u shadowed of %u visible lights", atlasStats.shadowedLightCount,
+                        atlasStats.candidateLightCount);
+            ImGui::Text("atlas tiles: %u / %u allocated, %u updated, %u pending, %u draws",
+                        atlasStats.allocatedTileCount, vks::ShadowAtlas::MAX_TILE_COUNT, atlasStats.updatedTileCount,
+                        atlasStats.pendingTileCount, shadowAtlasDrawCount);
+            if (pointShadowStats.lightCount > 0 && pointShadowStats.sixPassVertexCount == 0)
+                ImGui::Text("point shadows: %u lights, %u vertices", pointShadowStats.lightCount,
+                            pointShadowStats.vertexCount);
+            else if (pointShadowStats.lightCount > 0)
+                ImGui::Text("point shadows: %u lights, %u vertices, %u in six passes (%.2fx)", pointShadowStats.lightCount,
+                            pointShadowStats.vertexCount, pointShadowStats.sixPassVertexCount,
+                            static_cast<float>(pointShadowStats.sixPassVertexCount) /
+                            static_cast<float>(std::max(pointShadowStats.vertexCount, 1u)));
+            if (ImGui::Button("run shadow cascade benchmark") && !shadowCascadeBenchmark.run.Running())
+                StartShadowCascadeBenchmark();
+            if (shadowCascadeBenchmark.run.Running())
+                ImGui::Text("running %u / %u", shadowCascadeBenchmark.run.Step() + 1,
+                            shadowCascadeBenchmark.run.StepCount());
+            for (const std::string& report : shadowCascadeBenchmark.run.Reports())
+                ImGui::TextUnformatted(report.c_str());
         }
 
         ImGui::End();
@@ -3213,14 +6744,124 @@ void DeferredPBR::ViewChanged()
     UpdateUniformBuffers();
 }
 
+void DeferredPBR::GetEnabledFeatures()
+{
+    VulkanApplicationBase::GetEnabledFeatures();
+    // single pass point light shadows, a geometry shader routes each triangle to the viewports of its cube faces
+    singlePassPointShadowsSupported = deviceFeatures.geometryShader && deviceFeatures.multiViewport;
+    if (singlePassPointShadowsSupported)
+    {
+        enabledFeatures.geometryShader = VK_TRUE;
+        enabledFeatures.multiViewport = VK_TRUE;
+    }
+    // GPU driven rendering, one indirect call draws a batch of commands whose first instance is their draw record
+    gpuDrivenSupported = deviceFeatures.multiDrawIndirect && deviceFeatures.drawIndirectFirstInstance;
+    if (gpuDrivenSupported)
+    {
+        enabledFeatures.multiDrawIndirect = VK_TRUE;
+        enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+    }
+    // occlusion culling, the depth pyramid pass picks the storage view of a level by index
+    occlusionCullingSupported = gpuDrivenSupported && deviceFeatures.shaderStorageImageArrayDynamicIndexing;
+    if (occlusionCullingSupported)
+        enabledFeatures.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+}
+
+void DeferredPBR::GetEnabledExtensions()
+{
+    VulkanApplicationBase::GetEnabledExtensions();
+    // the indirect draws stop at the count the culling wrote instead of drawing the zeroed commands after it
+    drawIndirectCountSupported = vulkanDevice->ExtensionSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (drawIndirectCountSupported)
+        enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+}
+
 void DeferredPBR::Render()
 {
+    if (shadowMapDirty)
+    {
+        // the cascade layers are referenced by the recorded frames and the descriptor sets
+        vkDeviceWaitIdle(device);
+        SetupCascadeShadowMap();
+        SetupRenderGraph();
+        SetupDescriptorSets();
+        UpdateUniformBuffers();
+        shadowMapDirty = false;
+    }
+    if (ssaoDirty)
+    {
+        // a new quality tier changes the target resolution and the kernel size of the ssao pipeline
+        vkDeviceWaitIdle(device);
+        SetupSSAOComputeTargets();
+        SetupRenderGraph();
+        SetupDescriptorSets();
+        vkDestroyPipeline(device, pipelines.ssaoCompute, nullptr);
+        vkDestroyPipeline(device, pipelines.ssaoTemporal, nullptr);
+        vkDestroyPipeline(device, pipelines.ssaoDownsample, nullptr);
+        vkDestroyPipeline(device, pipelines.ssaoBilateralBlur, nullptr);
+        vkDestroyPipeline(device, pipelines.ssaoUpsample, nullptr);
+        PrepareSSAOComputePipelines();
+        ssaoDirty = false;
+    }
+    if (shadowFilterDirty)
+    {
+        // a new quality tier changes the specialization constants of the resolve pipeline
+        vkDeviceWaitIdle(device);
+        vkDestroyPipeline(device, pipelines.directionalShadow, nullptr);
+        PrepareDirectionalShadowPipeline();
+        shadowFilterDirty = false;
+    }
+    if (deferredPathDirty)
+    {
+        // the shading passes move between render passes and read the G-buffer through other descriptor types
+        vkDeviceWaitIdle(device);
+        SetupMrtRenderPass();
+        SetupShadingRenderPasses();
+        SetupRenderGraph();
+        SetupDescriptorSets();
+        for (VkPipeline* pipeline : {&pipelines.offscreen, &pipelines.offscreenWireframe, &pipelines.gBufferFill,
+                                     &pipelines.gBufferFillWireframe, &pipelines.offscreenIndirect,
+                                     &pipelines.offscreenIndirectWireframe, &pipelines.gBufferFillIndirect,
+                                     &pipelines.gBufferFillIndirectWireframe, &pipelines.lighting, &pipelines.skybox})
+        {
+            if (*pipeline != VK_NULL_HANDLE)
+                vkDestroyPipeline(device, *pipeline, nullptr);
+            *pipeline = VK_NULL_HANDLE;
+        }
+        vkDestroyPipelineLayout(device, lightingPipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, skyboxPipelineLayout, nullptr);
+        PrepareMrtPipeline();
+        PrepareLightingPipeline();
+        PrepareSkyboxPipeline();
+        shadowHistoryValid = false;
+        ssaoHistoryValid = false;
+        deferredPathDirty = false;
+    }
+
     RenderFrame();
     Camera* camera = Singleton<Camera>::Instance();
 
+    // the smoothed time settles a few frames after occlusion culling is toggled
+    if (GpuDrivenRendering())
+        sceneDrawStats.mrtTime[OcclusionCulling() ? 1 : 0] = gpuProfiler->GetTime("MRT");
+
+    // the frame just rendered is the history of the next one
+    previousViewProjection = mrtUBO.values.projection * mrtUBO.values.view;
+    previousJitter = glm::vec2(mrtUBO.values.jitter);
+    gltfModel->StorePreviousMatrices();
+    temporalFrameIndex++;
+
+    // the next frame renders at the scale the GPU time asks for
+    UpdateRenderScale();
     // if (camera->updated)
     UpdateUniformBuffers();
 
     if (!gltfModel->animations.empty() && !paused && animationSettings->useAnimation)
         gltfModel->UpdateAnimation(0, timer);
+    // the section of the next frame, also when paused, the previous matrices caught up with the current ones
+    gltfModel->UpdateObjects(currentFrame);
+
+    lightScalingBenchmark.run.Update();
+    shadowCascadeBenchmark.run.Update();
+    ssaoComparison.run.Update();
 }
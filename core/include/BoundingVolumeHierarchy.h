@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <MathUtils.h>
+
+namespace vks
+{
+    /**
+    * @brief Bounding volume hierarchy over a set of axis aligned boxes, e.g. the world bounds of the scene primitives
+    *
+    * Built top down with binned SAH splits, subtrees of large ranges are built on separate threads. Nodes are
+    * stored depth first in one array: the left child of an inner node follows it, the right child is at its offset.
+    * The items of a leaf are a range of the item index array. Moved boxes are refit without changing the tree.
+    */
+    class BoundingVolumeHierarchy
+    {
+    public:
+        static constexpr uint32_t BIN_COUNT = 16;
+        static constexpr uint32_t MAX_LEAF_SIZE = 4;
+        // item ranges from which the two subtrees are built in parallel
+        static constexpr uint32_t PARALLEL_BUILD_SIZE = 1024;
+
+        // 32 bytes, two per cache line
+        struct Node
+        {
+            float boundsMin[3];
+            // leaf: first entry in the item index array, inner node: index of the right child
+            uint32_t offset;
+            float boundsMax[3];
+            // 0 for inner nodes
+            uint32_t itemCount;
+        };
+
+        void Build(const math::AABBArray& boxes);
+        // refits the nodes above the given items to their current boxes, the boxes must not be added or removed
+        void Refit(const math::AABBArray& boxes, const std::vector<uint32_t>& changedItems);
+
+        // visible[i] is 1 for the items whose box intersects the frustum, same result as Frustum::IntersectsAABBs
+        void QueryFrustum(const math::Frustum& frustum, std::vector<uint8_t>& visible) const;
+        // visible[i] is 1 for the items whose box intersects the sphere
+        void QuerySphere(const glm::vec3& center, float radius, std::vector<uint8_t>& visible) const;
+        /**
+        * @brief Closest hit along origin + t * direction, t in [0, maxDistance]
+        * @param intersectItem distance to the item's own geometry, negative on a miss, called nearest box first
+        * @return whether an item was hit, hitItem and hitDistance are only written then
+        */
+        bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                     const std::function<float(uint32_t item, float maxDistance)>& intersectItem,
+                     uint32_t& hitItem, float& hitDistance) const;
+
+        const std::vector<Node>& GetNodes() const { return nodes; }
+        size_t ItemCount() const { return items.size(); }
+        uint32_t Depth() const { return depth; }
+
+    private:
+        // a copy of the item's box, so the leaves test their items without the source array
+        struct Item
+        {
+            glm::vec3 boundsMin;
+            glm::vec3 boundsMax;
+            uint32_t index;
+        };
+
+        // the subtree of items[first, first + count) with offsets relative to its root, the subtrees of the
+        // first parallelLevels levels are built on their own threads
+        std::vector<Node> BuildSubtree(uint32_t first, uint32_t count, uint32_t parallelLevels, uint32_t& subtreeDepth);
+        void LinkNodes();
+
+        std::vector<Node> nodes;
+        // in leaf order
+        std::vector<Item> items;
+        // per node, the root is its own parent
+        std::vector<uint32_t> parents;
+        // per item index, its entry in items and the leaf holding it
+        std::vector<uint32_t> itemSlots;
+        std::vector<uint32_t> itemLeaves;
+        uint32_t depth = 0;
+        // refit scratch
+        std::vector<uint8_t> dirtyNodes;
+        std::vector<uint32_t> refitNodes;
+    };
+}
@@ -71,6 +71,8 @@ public:
 	bool Moving() const;
 	void SetPerspective(float fov, float aspect, float znear, float zfar);
 	void UpdateAspectRatio(float aspect);
+	// perspective shifted by a sub pixel offset in normalized device coordinates, for temporal accumulation
+	glm::mat4 GetJitteredPerspective(const glm::vec2& jitter) const;
 	void SetPosition(glm::vec3 position);
 	void SetRotation(glm::vec3 rotation);
 	void Rotate(glm::vec3 delta);
@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace vks
+{
+    /**
+    * @brief Draws of a pass ordered by 64 bit sort keys, the item of a draw indexes the caller's own draw data
+    *
+    * Sorted with a least significant digit radix sort over 8 bit digits on the calling thread, a scene's draws sort
+    * in microseconds. Digits shared by every key are skipped, so the passes follow the key bits that actually vary.
+    */
+    class DrawList
+    {
+    public:
+        static constexpr uint32_t DIGIT_BITS = 8;
+        static constexpr uint32_t BUCKET_COUNT = 1u << DIGIT_BITS;
+
+        struct Draw
+        {
+            uint64_t key;
+            uint32_t item;
+        };
+
+        /**
+        * @brief Opaque and alpha masked draws, grouped by pipeline, then by material, then front to back
+        * @param pipeline 8 bits, e.g. the alpha mode
+        * @param material 24 bits
+        * @param depth view space distance, positive in front of the camera
+        */
+        static uint64_t OpaqueKey(uint32_t pipeline, uint32_t material, float depth);
+        // blended draws back to front, after every opaque key with a pipeline below 0xff
+        static uint64_t BlendedKey(float depth);
+
+        void Clear() { draws.clear(); }
+        void Add(uint64_t key, uint32_t item) { draws.push_back({key, item}); }
+        // stable, draws with equal keys keep the order they were added in
+        void Sort();
+
+        const std::vector<Draw>& GetDraws() const { return draws; }
+        // digits actually sorted by the last Sort()
+        uint32_t SortedDigitCount() const { return sortedDigitCount; }
+
+    private:
+        std::vector<Draw> draws;
+        // the other buffer of the scatter, kept to avoid an allocation per sort
+        std::vector<Draw> scratch;
+        uint32_t sortedDigitCount = 0;
+    };
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace vks
+{
+    /**
+    * @brief Measures a list of configurations one after the other over several frames, every configuration is
+    * applied, left to settle until the smoothed GPU timers follow it and then measured
+    * @note Update() is called once per frame, the reports are shown by the UI
+    */
+    class FrameBenchmark
+    {
+    public:
+        static constexpr uint32_t DEFAULT_WARMUP_FRAMES = 120;
+
+        struct Callbacks
+        {
+            // applies the configuration of a step, false while it is not in effect yet, e.g. before a rebuild
+            std::function<bool(uint32_t step)> apply;
+            // optional, on the last settling frame, the frame recorded next is complete when the step is measured
+            std::function<void(uint32_t step)> prepareMeasure;
+            // measures a step, the line reported for it
+            std::function<std::string(uint32_t step)> measure;
+            // optional, after the last step, e.g. to restore the settings
+            std::function<void()> finish;
+        };
+
+        /** @brief Starts over, the reports of a previous run are cleared */
+        void Start(uint32_t stepCount, Callbacks callbacks, uint32_t warmupFrames = DEFAULT_WARMUP_FRAMES);
+        void Update();
+
+        bool Running() const { return running; }
+        uint32_t Step() const { return step; }
+        uint32_t StepCount() const { return stepCount; }
+        const std::vector<std::string>& Reports() const { return reports; }
+
+    private:
+        Callbacks callbacks;
+        bool running = false;
+        uint32_t step = 0;
+        uint32_t stepCount = 0;
+        uint32_t frame = 0;
+        uint32_t warmupFrames = DEFAULT_WARMUP_FRAMES;
+        std::vector<std::string> reports;
+    };
+
+    /** @brief printf style formatting of a report line */
+    std::string FormatReport(const char* format, ...);
+}
@@ -4,7 +4,36 @@
 namespace GlobalVars
 {
     // render
-    constexpr int LIGHT_COUNT = 2;
+    constexpr uint32_t MAX_LIGHT_COUNT = 8192;
+    // clustered lighting, view space froxel grid
+    constexpr uint32_t CLUSTER_GRID_X = 16;
+    constexpr uint32_t CLUSTER_GRID_Y = 9;
+    constexpr uint32_t CLUSTER_GRID_Z = 24;
+    constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+    // directional light shadow cascades, layers of one depth array
+    constexpr uint32_t MAX_SHADOW_CASCADE_COUNT = 4;
+    // stable cascades move in steps of this many texels while static casters are cached
+    constexpr uint32_t SHADOW_CACHE_SNAP_TEXELS = 32;
+    // widest penumbra of the contact hardening shadow filter, in shadow map texels
+    constexpr float MAX_SHADOW_FILTER_RADIUS = 8.0f;
+    // spot and point light shadows share one square depth atlas
+    constexpr uint32_t SHADOW_ATLAS_SIZE = 4096;
     constexpr uint32_t SSAO_NOISE_DIM = 4;
     constexpr uint32_t SSAO_KERNEL_SIZE = 64;
+    // frames until the per frame sample offsets of the temporally accumulated effects repeat
+    constexpr uint32_t TEMPORAL_SEQUENCE_LENGTH = 64;
+    // auto exposure, bins of the scene luminance histogram, one invocation per bin in the shaders
+    constexpr uint32_t LUMINANCE_HISTOGRAM_BIN_COUNT = 256;
+    // bloom downsample chain, the first level at half resolution
+    constexpr uint32_t BLOOM_LEVEL_COUNT = 5;
+    // dynamic resolution, the scale changes in steps and waits for the smoothed GPU time to settle after each one
+    constexpr float RESOLUTION_SCALE_STEP = 0.05f;
+    constexpr uint32_t RESOLUTION_SCALE_SETTLE_FRAMES = 30;
+    // fraction of the target frame time below which the scale grows again
+    constexpr float RESOLUTION_SCALE_HEADROOM = 0.8f;
+    // temporal upscaling, jittered samples accumulated per output pixel, the jitter sequence grows as the scale shrinks
+    constexpr uint32_t UPSCALE_SAMPLES_PER_PIXEL = 8;
+    // occlusion culling, levels of the depth pyramid whose first level has half the depth resolution,
+    // enough to reduce a 8192 wide target to a single texel
+    constexpr uint32_t MAX_DEPTH_PYRAMID_LEVEL_COUNT = 13;
 }
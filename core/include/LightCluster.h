@@ -0,0 +1,63 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <GloalVars.h>
+
+namespace vks
+{
+    /**
+    * @brief GPU layout of a punctual light, mirrors struct Light in lightCulling.comp and lighting.frag
+    */
+    struct ClusterLight
+    {
+        // xyz: view space position, w: range
+        glm::vec4 positionRange;
+        // rgb: color, a: intensity
+        glm::vec4 colorIntensity;
+        // xyz: view space direction of a spot light
+        glm::vec4 spotDirection;
+        // x: cone scale, y: cone offset (0 and 1 for point lights), z: first shadow atlas tile or -1, w: tile count
+        glm::vec4 spotShadow;
+    };
+
+    /**
+    * @brief View space froxel grid, screen tiles in x/y and exponential depth slices in z
+    */
+    struct LightClusterGrid
+    {
+        uint32_t tileCountX = GlobalVars::CLUSTER_GRID_X;
+        uint32_t tileCountY = GlobalVars::CLUSTER_GRID_Y;
+        uint32_t sliceCount = GlobalVars::CLUSTER_GRID_Z;
+        float nearPlane = 0.1f;
+        float farPlane = 256.0f;
+
+        uint32_t ClusterCount() const { return tileCountX * tileCountY * sliceCount; }
+        uint32_t ClusterIndex(uint32_t x, uint32_t y, uint32_t z) const { return x + y * tileCountX + z * tileCountX * tileCountY; }
+
+        // slice = log(viewDepth) * SliceScale() - SliceBias()
+        float SliceScale() const;
+        float SliceBias() const;
+
+        // view space AABB of a froxel, same construction as lightCulling.comp
+        void GetClusterBounds(const glm::mat4& invProjection, uint32_t x, uint32_t y, uint32_t z,
+                              glm::vec3& aabbMin, glm::vec3& aabbMax) const;
+    };
+
+    /**
+    * @brief Distance at which the windowed inverse square falloff drops below cutoff
+    */
+    float ComputeLightRange(const glm::vec3& color, float cutoff = 1.0f / 256.0f);
+
+    /**
+    * @brief CPU reference of lightCulling.comp
+    *
+    * @param lights View space lights
+    * @param clusterLightCounts Receives grid.ClusterCount() light counts
+    * @param clusterLightIndices Receives grid.ClusterCount() * maxLightsPerCluster light indices
+    */
+    void BinLightsToClusters(const LightClusterGrid& grid, const glm::mat4& invProjection,
+                             const std::vector<ClusterLight>& lights, uint32_t maxLightsPerCluster,
+                             std::vector<uint32_t>& clusterLightCounts, std::vector<uint32_t>& clusterLightIndices);
+}
@@ -1,4 +1,7 @@
 ﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 #include <glm/glm.hpp>
 #include <glm/ext/scalar_constants.hpp>
 
@@ -15,6 +18,72 @@ namespace math
     glm::vec4 GetTranslateFromTransformMatrix(glm::mat4 mat);
 
     float Lerp(float a, float b, float f);
+
+    // radical inverse of index in base, the low discrepancy Halton sequence in [0, 1) for index >= 1
+    float Halton(uint32_t index, uint32_t base);
+
+    // out = a * b with SSE when the compiler targets it, out may be a or b
+    void MultiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out);
+
+    // axis aligned box enclosing a transformed box
+    void TransformAABB(const glm::mat4& mat, const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+                       glm::vec3& outMin, glm::vec3& outMax);
+
+    // sphere against axis aligned box, by the distance to the closest point of the box
+    bool IntersectsSphereAABB(const glm::vec3& center, float radius, const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+
+    /**
+    * @brief Slab test of the ray origin + t * direction, t in [0, maxDistance], against an axis aligned box
+    * @param inverseDirection 1 / direction per component, infinite for axis parallel rays
+    * @param entryDistance t where the ray enters the box, 0 for an origin inside it
+    */
+    bool IntersectRayAABB(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& aabbMin,
+                          const glm::vec3& aabbMax, float maxDistance, float& entryDistance);
+
+    /**
+    * @brief Moller-Trumbore ray triangle test, both faces are hit
+    * @param distance t of the hit along origin + t * direction
+    */
+    bool IntersectRayTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0,
+                              const glm::vec3& v1, const glm::vec3& v2, float& distance);
+
+    /**
+    * @brief Axis aligned boxes stored as one array per coordinate, so a batch of boxes loads into SIMD registers
+    * @note The arrays are padded to a multiple of BATCH_SIZE, the padding boxes are never reported
+    */
+    struct AABBArray
+    {
+        static constexpr size_t BATCH_SIZE = 8;
+
+        std::vector<float> minX, minY, minZ;
+        std::vector<float> maxX, maxY, maxZ;
+
+        void Resize(size_t size);
+        void Set(size_t index, const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+        size_t Size() const { return count; }
+
+    private:
+        size_t count = 0;
+    };
+
+    /**
+    * @brief Clip planes of a view projection matrix, normals point inside
+    * @note Assumes a [0, 1] depth range (GLM_FORCE_DEPTH_ZERO_TO_ONE)
+    */
+    struct Frustum
+    {
+        glm::vec4 planes[6];
+
+        void Update(const glm::mat4& viewProjection);
+        // axis aligned box as a frustum, e.g. the bounds of a point light
+        void Update(const glm::vec3& boxMin, const glm::vec3& boxMax);
+        bool IntersectsAABB(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const;
+        /**
+        * @brief Same test as IntersectsAABB for every box, visible[i] is 1 for the boxes intersecting the frustum
+        * @note Tests BATCH_SIZE boxes per step, with AVX when the compiler targets it, otherwise with SSE
+        */
+        void IntersectsAABBs(const AABBArray& boxes, uint8_t* visible) const;
+    };
 }
 
 
@@ -8,10 +8,91 @@ struct GraphicSettings
     bool fullscreen = false;
     bool vsync = false;
 
+    // a depth, normal and velocity prepass, then one render pass whose subpasses fill the rest of the G-buffer,
+    // light and draw the skybox, the attachments that never leave it are transient
+    bool subpassDeferred = true;
+    // the scene's primitives are culled by a compute shader into indirect draws of the G-buffer and cascade passes
+    // instead of being culled and drawn one by one on the CPU
+    bool gpuDrivenRendering = true;
+    // the GPU driven camera draws skip the records hidden behind the depth of the ones visible in the last frame
+    bool occlusionCulling = true;
+    // the CPU path draws the camera's primitives in the order of a sorted draw list, grouped by material and front
+    // to back, instead of the scene order
+    bool sortedDrawLists = true;
+
     // ssao
     bool useSSAO = true;
     float ssaoRadius = 0.3f;
     float ssaoBias = 0.025f;
+    // reduced resolution compute path instead of the full resolution fragment shaders
+    bool ssaoCompute = true;
+    // compute ssao tier: 0 low, 1 medium, 2 high
+    int ssaoQuality = 1;
+
+    // temporal accumulation, ssao and the directional shadow filter take a fraction of their samples per frame
+    // and reproject the result of the previous frames with the G-buffer motion vectors
+    bool temporalAccumulation = true;
+    // weight of a valid history, higher converges to a smoother result but reacts slower
+    float temporalHistoryWeight = 0.9f;
+
+    // clustered lighting
+    bool lightCullingOnGPU = true;
+    int benchmarkLightCount = 0;
+    float benchmarkLightRange = 1.0f;
+
+    // cascaded shadow maps
+    int shadowCascadeCount = 4;
+    int shadowMapResolution = 2048;
+    float shadowDistance = 8.0f;
+    // blend between uniform (0) and logarithmic (1) cascade splits
+    float cascadeSplitLambda = 0.95f;
+    bool stableShadowCascades = true;
+    // sun direction in degrees, elevation 90 points straight down
+    float sunElevation = 90.0f;
+    float sunAzimuth = 0.0f;
+    // static casters are kept in a cache and only dynamic casters are drawn every frame
+    bool shadowCaching = true;
+    // directional shadow filter tier: 0 low, 1 medium, 2 high, 3 ultra with contact hardening
+    int shadowFilterQuality = 2;
+    // contact hardening penumbra width in texels per unit of light space depth between blocker and receiver
+    float shadowPenumbraScale = 400.0f;
+
+    // spot and point light shadow atlas
+    bool localLightShadows = true;
+    // atlas tiles rendered per frame
+    int shadowAtlasUpdateBudget = 12;
+    // the six cube faces of a point light in one geometry shader pass instead of six passes
+    bool singlePassPointShadows = true;
+
+    // post processing, exposure, bloom, tonemapping and color grading in one compute dispatch
+    // exposure adapted to a luminance histogram of the scene instead of the fixed exposure
+    bool autoExposure = true;
+    float exposure = 2.5f;
+    // stops added to the auto exposure
+    float exposureCompensation = 0.0f;
+    // how fast the auto exposure follows the scene, per second
+    float exposureAdaptationRate = 1.5f;
+    bool bloom = true;
+    // scene color above the threshold blooms, the knee softens the transition
+    float bloomThreshold = 1.0f;
+    float bloomKnee = 0.5f;
+    float bloomIntensity = 0.05f;
+    // color grading of the tonemapped color
+    float colorFilter[3] = {1.0f, 1.0f, 1.0f};
+    float contrast = 1.0f;
+    float saturation = 1.0f;
+
+    // dynamic resolution, the scene renders into part of its targets and the post process upscales it
+    // the scale follows the measured GPU frame time towards the target
+    bool dynamicResolution = true;
+    // in milliseconds
+    float targetFrameTime = 16.6f;
+    float minResolutionScale = 0.5f;
+    // temporal upscaling, the scene renders at a fixed fraction of the dynamic resolution with a jittered projection
+    // and is accumulated at the output resolution: 0 native, 1 quality, 2 balanced, 3 performance
+    int upscaleQuality = 0;
+    // 0 - 1, sharpening of the upscaled color
+    float upscaleSharpness = 0.5f;
 };
 
 struct GuiSettings
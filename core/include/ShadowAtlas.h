@@ -0,0 +1,144 @@
+﻿#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <GloalVars.h>
+
+namespace vks
+{
+    /**
+    * @brief GPU layout of one atlas tile, mirrors struct ShadowTile in shadowAtlas.vert and lighting.frag
+    */
+    struct ShadowAtlasTile
+    {
+        // world space to the tile's clip space, the matrix the tile was last rendered with
+        glm::mat4 viewProjection;
+        // xy: offset, zw: size, in atlas uv
+        glm::vec4 atlasRect;
+        // x: world space texel size at distance 1, scales the normal offset
+        glm::vec4 params;
+    };
+
+    /**
+    * @brief World space punctual light as seen by the shadow atlas
+    */
+    struct ShadowAtlasLight
+    {
+        glm::vec3 position;
+        glm::vec3 direction;
+        float range;
+        // point lights take six tiles, one per cube face, spot lights one
+        bool spot;
+        float outerConeAngle;
+        bool castsShadow;
+    };
+
+    /**
+    * @brief Tile allocator and update scheduler for spot and point light shadows in one depth atlas
+    *
+    * Tiles come in three sizes, each with a fixed region of the atlas. Visible lights are ranked by their projected
+    * screen radius, larger lights get larger tiles and keep them while their size stays in range. Only updateBudget
+    * tiles are rendered per frame: lights that are new or changed first, then the least recently rendered ones. A
+    * light's tiles are always scheduled together, so the six faces of a point light can be rendered in one pass.
+    */
+    class ShadowAtlas
+    {
+    public:
+        static constexpr uint32_t SIZE_CLASS_COUNT = 3;
+        // 8 x 4 large, 16 x 4 medium and 32 x 8 small tiles
+        static constexpr uint32_t MAX_TILE_COUNT = 352;
+
+        struct TileUpdate
+        {
+            uint32_t tile;
+            // texel rectangle in the atlas
+            uint32_t x;
+            uint32_t y;
+            uint32_t size;
+        };
+
+        /** @brief All tiles of one light scheduled this frame, a range of GetTileUpdates() */
+        struct LightUpdate
+        {
+            uint32_t lightIndex;
+            uint32_t firstUpdate;
+            uint32_t updateCount;
+        };
+
+        struct Statistics
+        {
+            uint32_t candidateLightCount = 0;
+            uint32_t shadowedLightCount = 0;
+            uint32_t allocatedTileCount = 0;
+            uint32_t updatedTileCount = 0;
+            // tiles waiting for the budget
+            uint32_t pendingTileCount = 0;
+        };
+
+        explicit ShadowAtlas(uint32_t atlasSize = GlobalVars::SHADOW_ATLAS_SIZE);
+
+        /**
+        * @brief Allocates tiles for this frame's lights and picks the tiles to render
+        *
+        * @param lights Lights in a stable order, the index identifies a light between frames
+        * @param viewportHeight Height of the camera viewport in pixels, for the projected light size
+        */
+        void Update(const std::vector<ShadowAtlasLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                    float viewportHeight, uint32_t updateBudget);
+        /** @brief Frees all tiles */
+        void Reset();
+
+        /** @brief First tile of a light, -1 until all of its tiles have been rendered */
+        int32_t GetFirstTile(uint32_t lightIndex) const;
+        const std::vector<ShadowAtlasTile>& GetTiles() const { return tiles; }
+        const std::vector<TileUpdate>& GetTileUpdates() const { return tileUpdates; }
+        const std::vector<LightUpdate>& GetLightUpdates() const { return lightUpdates; }
+        const Statistics& GetStatistics() const { return statistics; }
+        uint32_t AtlasSize() const { return atlasSize; }
+
+    private:
+        struct SizeClass
+        {
+            uint32_t tileSize;
+            uint32_t originY;
+            uint32_t columns;
+            uint32_t firstTile;
+            uint32_t tileCount;
+        };
+
+        struct TileState
+        {
+            int32_t owner = -1;
+            uint64_t lastUpdateFrame = 0;
+            bool rendered = false;
+            bool dirty = false;
+        };
+
+        struct LightState
+        {
+            int32_t sizeClass = -1;
+            uint32_t firstTile = 0;
+            uint32_t tileCount = 0;
+            float screenRadius = 0.0f;
+            // parameters of the last allocation or change, compared to detect moving lights
+            ShadowAtlasLight light{};
+        };
+
+        bool Allocate(uint32_t lightIndex, uint32_t sizeClass, uint32_t tileCount);
+        void Free(uint32_t lightIndex);
+        void UpdateTile(uint32_t tile);
+        void UpdateLight(uint32_t lightIndex);
+
+        uint32_t atlasSize;
+        std::array<SizeClass, SIZE_CLASS_COUNT> sizeClasses;
+        std::vector<ShadowAtlasTile> tiles;
+        std::vector<TileState> tileStates;
+        std::vector<LightState> lightStates;
+        std::vector<TileUpdate> tileUpdates;
+        std::vector<LightUpdate> lightUpdates;
+        Statistics statistics;
+        uint64_t frameIndex = 0;
+    };
+}
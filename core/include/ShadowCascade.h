@@ -0,0 +1,43 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace vks
+{
+    /**
+    * @brief Light space projection of one directional shadow cascade
+    */
+    struct ShadowCascade
+    {
+        glm::mat4 viewProjection;
+        // view space distance where the cascade ends
+        float splitDepth;
+        // world space size of one shadow map texel
+        float texelSize;
+    };
+
+    /**
+    * @brief Practical split scheme, blends uniform (lambda = 0) and logarithmic (lambda = 1) split distances
+    *
+    * @param splitDepths Receives cascadeCount view space far distances, the last one is farPlane
+    */
+    void ComputeCascadeSplits(float nearPlane, float farPlane, uint32_t cascadeCount, float lambda,
+                              std::vector<float>& splitDepths);
+
+    /**
+    * @brief Fits an orthographic light projection around each split of the camera frustum
+    *
+    * @param invViewProjection Inverse of the camera projection * view, nearPlane and farPlane are its clip distances
+    * @param lightDirection World space direction the light travels in
+    * @param sceneMin, sceneMax World space scene bounds, casters between the light and a split stay in its depth range
+    * @param stable Fit a bounding sphere so the cascade size does not change when the camera rotates, otherwise a tight box
+    * @param snapTexels Stable cascades move in steps of this many texels, the window grows by one step to still cover
+    * the split. Larger steps keep the light matrix, and a depth cache rendered with it, valid over small camera moves
+    * @note Cascades are snapped to whole texels of a resolution sized map to keep the shadow edges from crawling
+    */
+    void FitShadowCascades(const glm::mat4& invViewProjection, float nearPlane, float farPlane,
+                           const std::vector<float>& splitDepths, const glm::vec3& lightDirection,
+                           const glm::vec3& sceneMin, const glm::vec3& sceneMax, uint32_t resolution, bool stable,
+                           uint32_t snapTexels, std::vector<ShadowCascade>& cascades);
+}
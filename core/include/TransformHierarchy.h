@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace vks
+{
+    /**
+    * @brief Local and world transforms of a node hierarchy, one array per component
+    *
+    * Transforms are stored in topological order: a parent is always added before its children. So Update
+    * computes every world matrix from its parent's in one linear pass. Only the transforms changed since the
+    * last Update and their subtrees are recomputed, starting at the first changed index.
+    */
+    class TransformHierarchy
+    {
+    public:
+        static constexpr uint32_t NO_PARENT = ~0u;
+
+        /**
+        * @brief Appends a transform whose local matrix is translate * rotate * scale * matrix
+        * @param parent index of an earlier transform or NO_PARENT for a root
+        * @return index of the new transform
+        */
+        uint32_t Add(uint32_t parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale,
+                     const glm::mat4& matrix = glm::mat4(1.0f));
+        void Clear();
+
+        void SetTranslation(uint32_t index, const glm::vec3& translation);
+        void SetRotation(uint32_t index, const glm::quat& rotation);
+        void SetScale(uint32_t index, const glm::vec3& scale);
+
+        // recomputes the changed transforms and their subtrees, returns the number of world matrices written
+        uint32_t Update();
+        // recomputes every transform, e.g. for comparisons with Update
+        void UpdateAll();
+
+        const glm::mat4& GetWorldMatrix(uint32_t index) const { return worldMatrices[index]; }
+        const glm::mat4& GetLocalMatrix(uint32_t index) const { return localMatrices[index]; }
+        uint32_t GetParent(uint32_t index) const { return parents[index]; }
+        uint32_t Size() const { return static_cast<uint32_t>(parents.size()); }
+
+    private:
+        enum Flags : uint8_t
+        {
+            LOCAL_CHANGED = 1,
+            WORLD_CHANGED = 2,
+        };
+
+        void MarkChanged(uint32_t index);
+
+        std::vector<uint32_t> parents;
+        std::vector<glm::vec3> translations;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> scales;
+        // applied after the scale, the matrix of a glTF node, identity for most
+        std::vector<glm::mat4> matrices;
+        std::vector<glm::mat4> localMatrices;
+        std::vector<glm::mat4> worldMatrices;
+        std::vector<uint8_t> flags;
+        // no transform below it has changed
+        uint32_t firstChanged = 0;
+    };
+}
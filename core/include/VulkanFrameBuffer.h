@@ -38,8 +38,10 @@ namespace vks
         uint32_t binding;
         VkImage image = VK_NULL_HANDLE;
         VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize memorySize = 0;
         VkImageView view = VK_NULL_HANDLE;
         VkFormat format;
+        VkImageUsageFlags usage = 0;
         VkImageSubresourceRange subresourceRange;
         VkAttachmentDescription description;
 
@@ -48,6 +50,11 @@ namespace vks
 
         uint32_t refCount = 0;
 
+        // the image belongs to the frame buffer of another render pass and is not destroyed with this one
+        bool shared = false;
+        // transient attachment backed by lazily allocated memory, tile memory on tilers
+        bool lazilyAllocated = false;
+
         /**
         * @brief Returns true if the attachment has a depth component
         */
@@ -92,6 +99,8 @@ namespace vks
         ~FrameBuffer();
 
         uint32_t CreateAttachment(const VulkanAttachmentDescription* attachmentDescription);
+        /** @brief Uses the image of an attachment owned by another frame buffer */
+        uint32_t AddSharedAttachment(const FramebufferAttachment& sharedAttachment);
 
         const FramebufferAttachment& GetAttachment(const std::string& attachmentName);
 
@@ -118,6 +127,11 @@ namespace vks
         
         void CrateDescriptorSet(bool skipDepthStencil = true);
 
+        /** @brief Device memory of the attachments the frame buffers own */
+        VkDeviceSize MemorySize() const;
+        /** @brief Device memory the owned attachments would take with one image per frame in flight */
+        VkDeviceSize PerFrameMemorySize() const;
+
     private:
         vks::VulkanDevice* vulkanDevice = nullptr;
         uint32_t width = 0, height = 0;
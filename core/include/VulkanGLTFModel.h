@@ -19,6 +19,10 @@
 #endif
 
 #include <Settings.hpp>
+#include <MathUtils.h>
+#include <BoundingVolumeHierarchy.h>
+#include <DrawList.h>
+#include <TransformHierarchy.h>
 
 namespace tinygltf
 {
@@ -32,7 +36,6 @@ namespace vks
 	{
 
 		extern VkDescriptorSetLayout descriptorSetLayoutImage;
-		extern VkDescriptorSetLayout descriptorSetLayoutUbo;
 		extern VkMemoryPropertyFlags memoryPropertyFlags;
 
 		void LoadTextureFromGLTFImage(Texture* texture, tinygltf::Image& gltfImage, std::string path, vks::VulkanDevice* device, VkQueue copyQueue);
@@ -55,7 +58,14 @@ namespace vks
 			BindImages = 0x00000001,
 			RenderOpaqueNodes = 0x00000002,
 			RenderAlphaMaskedNodes = 0x00000004,
-			RenderAlphaBlendedNodes = 0x00000008
+			RenderAlphaBlendedNodes = 0x00000008,
+			// split by Node::dynamic, e.g. for cached shadow maps
+			RenderStaticNodes = 0x00000010,
+			RenderDynamicNodes = 0x00000020,
+			// pushes Node::previousMatrix after the current matrix, e.g. for motion vectors
+			PushPreviousMatrix = 0x00000040,
+			// pushes Primitive::boundsIndex, the primitive's entry of the object buffer, instead of the node's matrices
+			PushObjectIndex = 0x00000080
 		};
 
 		struct Light
@@ -63,6 +73,15 @@ namespace vks
 			alignas(4)float intensity;
 			alignas(16)glm::vec4 position;
 			alignas(16)glm::vec4 color;
+			// KHR_lights_punctual range, 0 means unlimited
+			float range = 0.0f;
+			enum LightType { LIGHTTYPE_POINT, LIGHTTYPE_SPOT, LIGHTTYPE_DIRECTIONAL };
+			LightType type = LIGHTTYPE_POINT;
+			// world space, spot and directional lights shine along it
+			glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+			// spot cone in radians
+			float innerConeAngle = 0.0f;
+			float outerConeAngle = 0.7853981634f;
 		};
 		
 		// Contains everything required to render a glTF model in Vulkan
@@ -171,6 +190,8 @@ namespace vks
 				uint32_t firstVertex;
 				uint32_t vertexCount;
 				Material& material;
+				// index of the world space bounds in VulkanGLTFModel::worldBounds
+				uint32_t boundsIndex = 0;
 
 				struct Dimensions {
 					glm::vec3 min = glm::vec3(FLT_MAX);
@@ -193,21 +214,7 @@ namespace vks
 				std::vector<Primitive*> primitives;
 				std::string name;
 
-				struct UniformBuffer {
-					VkBuffer buffer;
-					VkDeviceMemory memory;
-					VkDescriptorBufferInfo descriptor;
-					VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-					void* mapped;
-				} uniformBuffer;
-
-				struct UniformBlock {
-					glm::mat4 matrix;
-					glm::mat4 jointMatrix[64]{};
-					float jointcount{ 0 };
-				} uniformBlock;
-
-				Mesh(vks::VulkanDevice* device, glm::mat4 matrix);
+				Mesh(vks::VulkanDevice* device);
 				~Mesh();
 			};
 
@@ -228,17 +235,19 @@ namespace vks
 				Node* parent;
 				uint32_t index;
 				std::vector<Node*> children;
-				glm::mat4 matrix;
 				std::string name;
 				Mesh* mesh;
 				Skin* skin;
 				int32_t skinIndex = -1;
-				glm::vec3 translation{};
-				glm::vec3 scale{ 1.0f };
-				glm::quat rotation{};
-				glm::mat4 LocalMatrix();
-				glm::mat4 GetMatrix();
-				void Update();
+				// local and world transform of the node, see VulkanGLTFModel::transforms
+				TransformHierarchy* transforms = nullptr;
+				uint32_t transformIndex = 0;
+				// animated, skinned or below an animated node
+				bool dynamic = false;
+				// world matrix of the last rendered frame, see VulkanGLTFModel::StorePreviousMatrices
+				glm::mat4 previousMatrix{ 1.0f };
+				// world matrix cached by the last TransformHierarchy::Update
+				const glm::mat4& GetMatrix() const;
 				~Node();
 			};
 
@@ -282,6 +291,8 @@ namespace vks
 			std::vector<Node*> nodes;
 			std::map<std::string, Node*> nodeName2LinearNodeMap;
 			std::vector<Node*> linearNodes;
+			// the node transforms in load order, parents before children
+			TransformHierarchy transforms;
 			std::vector<Skin*> skins;
             std::vector<Animation> animations;
 
@@ -293,6 +304,94 @@ namespace vks
 				float radius;
 			} dimensions;
 
+			// world space bounds of every primitive, updated with the node matrices
+			math::AABBArray worldBounds;
+			// node and primitive of every entry of worldBounds
+			std::vector<Node*> boundsNodes;
+			std::vector<Primitive*> boundsPrimitives;
+			// over worldBounds, built at load and refit when animated nodes move
+			BoundingVolumeHierarchy bvh;
+			// CullPrimitives walks bvh instead of testing every primitive
+			bool bvhCulling = true;
+
+			// vertex positions and indices as uploaded, kept on the CPU for ray casts
+			std::vector<glm::vec3> vertexPositions;
+			std::vector<uint32_t> triangleIndices;
+
+			/*
+				GPU driven drawing, the primitives as records culled by a compute shader into indirect commands
+			*/
+			// mirrors struct DrawRecord in drawCulling.comp and the indirect vertex shaders
+			struct DrawRecord {
+				// local space bounds
+				glm::vec4 boundsMin;
+				glm::vec4 boundsMax;
+				uint32_t firstIndex;
+				uint32_t indexCount;
+				// entry of the object buffer, the primitive's Primitive::boundsIndex
+				uint32_t objectIndex;
+				// batches the primitive is drawn in by the camera and as a shadow caster
+				uint32_t materialBatch;
+				uint32_t casterBatch;
+				uint32_t padding[3];
+			};
+
+			// commands [firstCommand, firstCommand + commandCount) of a view, drawn with one indirect call
+			struct IndirectBatch {
+				// null for the shadow caster batches
+				Material* material = nullptr;
+				uint32_t firstCommand = 0;
+				uint32_t commandCount = 0;
+			};
+
+			struct {
+				vks::Buffer recordBuffer;
+				// uvec2 first command and command count of every batch
+				vks::Buffer batchBuffer;
+				// one per material in use, then the static and the dynamic shadow casters
+				std::vector<IndirectBatch> batches;
+				uint32_t materialBatchCount = 0;
+				uint32_t recordCount = 0;
+			} indirectDraws;
+
+			/*
+				Per object data of the vertex shaders, one object per primitive indexed by Primitive::boundsIndex
+			*/
+			// mirrors struct ObjectData in drawRecord.glsl
+			struct ObjectData {
+				glm::mat4 model;
+				glm::mat4 previousModel;
+				// inverse transpose of the upper 3x3 of model, columns padded to vec4 as a std430 mat3
+				glm::vec4 normalMatrix[3];
+				uint32_t materialIndex;
+				uint32_t padding[3];
+			};
+
+			// persistently mapped, a section of objects per frame in flight
+			struct {
+				vks::Buffer buffer;
+				uint32_t frameCount = 0;
+				// sections are frameStride apart, aligned for storage buffer offsets
+				VkDeviceSize frameStride = 0;
+			} objects;
+
+			struct RayHit {
+				Node* node = nullptr;
+				Primitive* primitive = nullptr;
+				float distance = 0.0f;
+				glm::vec3 position{};
+			};
+
+			// primitives submitted and frustum culled by the last Draw call
+			struct DrawStatistics {
+				uint32_t drawCount = 0;
+				uint32_t culledCount = 0;
+				// indices of the submitted primitives, an upper bound of the vertex shader invocations
+				uint32_t indexCount = 0;
+				// material descriptor sets bound with RenderFlags::BindImages
+				uint32_t descriptorBindCount = 0;
+			} drawStatistics;
+
 			Texture* emptyTexture;
 
 			bool metallicRoughnessWorkflow = true;
@@ -317,18 +416,71 @@ namespace vks
 			*/
 			void BindBuffers(VkCommandBuffer commandBuffer);
             void UpdateAnimation(uint32_t index, float time);
+            // keeps the current world matrix of every node as its previous one, call after a frame is rendered
+            void StorePreviousMatrices();
+            // transforms the bounds of every primitive by its node's world matrix into worldBounds
+            void UpdateWorldBounds();
             // Draw a single node including child nodes (if present)
-			void DrawNode(Node* node, VkCommandBuffer commandBuffer, bool pushConstant, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+			// Primitives whose entry in visibility is 0 are skipped, see CullPrimitives
+			void DrawNode(Node* node, VkCommandBuffer commandBuffer, bool pushConstant, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, const uint8_t* visibility = nullptr);
 			// Draw the glTF scene starting at the top-level-nodes
-			void Draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant,  VkPipelineLayout pipelineLayout, uint32_t bindImageSet);
+			// Primitives whose world space bounds are outside frustum are skipped
+			void Draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant,  VkPipelineLayout pipelineLayout, uint32_t bindImageSet, const math::Frustum* frustum = nullptr);
+			// Primitives whose entry in visibility is 0 are skipped, e.g. a mask of CullPrimitives
+			void Draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant,  VkPipelineLayout pipelineLayout, uint32_t bindImageSet, const std::vector<uint8_t>& visibility);
+			// Draw in DrawList order instead of the scene order, opaque primitives grouped by material and front to back,
+			// blended ones back to front after them, material sets are only bound when the material changes
+			void DrawSorted(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, const glm::mat4& view, const math::Frustum* frustum = nullptr);
+			// indices Draw would submit with the same flags and frustum, without recording anything
+			uint32_t CountIndices(uint32_t renderFlags, const math::Frustum* frustum = nullptr) const;
+			// batch frustum test of worldBounds, visible is indexed by Primitive::boundsIndex
+			void CullPrimitives(const math::Frustum& frustum, std::vector<uint8_t>& visible) const;
+			// primitives whose world space bounds intersect the sphere, e.g. the range of a point light
+			void CullPrimitives(const glm::vec3& center, float radius, std::vector<uint8_t>& visible) const;
+			// narrows candidates, e.g. the primitives in range of a light, to the ones intersecting the frustum
+			void CullPrimitives(const math::Frustum& frustum, const std::vector<uint8_t>& candidates, std::vector<uint8_t>& visible) const;
+			// closest triangle along origin + t * direction, skinned meshes are tested in their bind pose
+			bool Raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const;
+			// uploads the records and batches of indirectDraws, call once after loading
+			void PrepareIndirectDraws();
+			// creates the object buffer with a section per frame and writes every object to all of them
+			void PrepareObjects(uint32_t frameCount);
+			// writes the objects of the animated nodes to the section of frame
+			void UpdateObjects(uint32_t frame);
+			// the objects of the section of frame, for storage buffer descriptors
+			VkDescriptorBufferInfo ObjectDescriptor(uint32_t frame) const;
+			// index of the static (false) or dynamic (true) shadow caster batch in indirectDraws.batches
+			uint32_t CasterBatch(bool dynamic) const { return indirectDraws.materialBatchCount + (dynamic ? 1 : 0); }
+			/**
+			* @brief One indirect draw per batch in [firstBatch, firstBatch + batchCount) of indirectDraws, binding the
+			* images of the material batches to bindImageSet with RenderFlags::BindImages
+			* @param commandOffset byte offset of the view's commands in indirectBuffer
+			* @param drawIndexedIndirectCount reads the draw count of every batch from countBuffer at countOffset,
+			* without it all commands of a batch are drawn and the unused ones have to be zeroed
+			* @param drawCounts host copy of the view's counts, e.g. of the last frame, drawStatistics are taken from it
+			*/
+			void DrawIndirect(VkCommandBuffer commandBuffer, uint32_t renderFlags, uint32_t firstBatch, uint32_t batchCount,
+			                  VkBuffer indirectBuffer, VkDeviceSize commandOffset, VkBuffer countBuffer,
+			                  VkDeviceSize countOffset, VkPipelineLayout pipelineLayout, uint32_t bindImageSet,
+			                  PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr,
+			                  const uint32_t* drawCounts = nullptr);
 
 		private:
             Texture* GetTexture(uint32_t index);
             void GetSceneDimensions();
             void GetNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max);
-            void PrepareNodeDescriptor(Node* node, VkDescriptorSetLayout descriptorSetLayout);
+            void MarkDynamicNodes();
+            void WriteObject(uint32_t boundsIndex, ObjectData& object) const;
             void LoadAnimations(tinygltf::Model &gltfModel);
             void LoadSkins(tinygltf::Model& gltfModel);
+            void DrawVisible(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, const uint8_t* visibility);
+
+            // frustum test of the Draw call being recorded
+            std::vector<uint8_t> primitiveVisibility;
+            // items are entries of worldBounds, reused by every DrawSorted call
+            DrawList drawList;
+            // entries of worldBounds below animated or skinned nodes, refit after an animation update
+            std::vector<uint32_t> dynamicBounds;
 		};
 	}
 }
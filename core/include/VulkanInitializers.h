@@ -19,6 +19,8 @@ namespace vks
         VkBufferCreateInfo BufferCreateInfo(VkBufferUsageFlags usage,VkDeviceSize size);
         VkMemoryAllocateInfo MemoryAllocateInfo();
         VkMappedMemoryRange MappedMemoryRange();
+        /** @brief Initialize a buffer memory barrier with no buffer transfer ownership */
+        VkBufferMemoryBarrier BufferMemoryBarrier();
     	
 #pragma endregion Memory
 
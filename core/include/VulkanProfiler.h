@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+#include <VulkanDevice.h>
+
+namespace vks
+{
+    /**
+    * @brief Measures GPU time of named command buffer scopes with timestamp queries
+    * @note One query pool per frame in flight, results are read back when the frame's pool is reused
+    */
+    class GpuProfiler
+    {
+    public:
+        GpuProfiler() = delete;
+        GpuProfiler(VulkanDevice* vulkanDevice, uint32_t frameCount, uint32_t maxScopeCount = 32);
+        ~GpuProfiler();
+
+        /** @brief Collects the results of the last use of this frame's pool and resets it, must be called outside a render pass */
+        void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+        void BeginScope(VkCommandBuffer commandBuffer, const std::string& name);
+        void EndScope(VkCommandBuffer commandBuffer, const std::string& name);
+
+        /** @brief Smoothed GPU time of a scope in milliseconds, 0 if it has not been measured yet */
+        float GetTime(const std::string& name) const;
+        const std::vector<std::string>& GetScopeNames() const { return scopeNames; }
+        bool Supported() const { return supported; }
+
+    private:
+        struct FrameQueries
+        {
+            VkQueryPool queryPool = VK_NULL_HANDLE;
+            // scope name -> first query of the begin/end pair
+            std::map<std::string, uint32_t> scopes;
+            uint32_t queryCount = 0;
+        };
+
+        VulkanDevice* vulkanDevice = nullptr;
+        std::vector<FrameQueries> frames;
+        uint32_t maxScopeCount = 0;
+        uint32_t frameIndex = 0;
+        bool supported = false;
+        float timestampPeriod = 1.0f;
+
+        std::map<std::string, float> times;
+        std::vector<std::string> scopeNames;
+    };
+}
@@ -0,0 +1,246 @@
+﻿#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+#include <VulkanDevice.h>
+#include <VulkanFrameBuffer.h>
+#include <VulkanProfiler.h>
+#include <VulkanRenderPass.h>
+
+namespace vks
+{
+    /** @brief How a pass accesses a resource, decides the stages, access masks and layouts of the barriers around it */
+    enum class RenderGraphAccess
+    {
+        // attachments of the pass' render pass, cleared from an undefined layout and left in the resting layout
+        ColorAttachment,
+        DepthAttachment,
+        // color attachment whose contents are kept, e.g. a G-buffer a second pass draws more geometry into
+        ColorAttachmentLoad,
+        // depth attachment whose contents are kept, e.g. shadow maps that are only partly redrawn
+        DepthAttachmentLoad,
+        // read only depth attachment of a render pass that loads it, tested against and read as an input attachment
+        // or sampled in the same read only layout
+        DepthAttachmentRead,
+        // sampled images in their resting layout and storage buffers
+        FragmentRead,
+        ComputeRead,
+        // buffers of indirect draw commands and draw counts
+        IndirectRead,
+        // storage images in the general layout and storage buffers, also read-modify-write such as atomics
+        ComputeWrite,
+        TransferRead,
+        TransferWrite,
+    };
+
+    using RenderGraphResource = uint32_t;
+    using RenderGraphPass = uint32_t;
+
+    /** @brief Single level 2D image created by the render graph, it only keeps its contents within a frame */
+    struct RenderGraphImage
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        // general layout with a linear clamped sampler, valid for both storage and sampled descriptors
+        VkDescriptorImageInfo descriptor{};
+        uint32_t width = 0;
+        uint32_t height = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+    };
+
+    /**
+    * @brief Records the passes of a frame in dependency order with barriers derived from the accesses they declare
+    * @note Build the graph once with the Import*() functions, CreateImage() and AddPass(), then Compile() it.
+    * Rebuild it when an imported resource is recreated.
+    *
+    * Execute() culls the passes whose writes reach neither a consumed output nor a side effect and tracks the layout
+    * and the pending accesses of every resource, so each barrier only waits for the stages that touched it.
+    * Every frame starts without pending accesses, SubmitFrame() waits for the queue before the next one is recorded.
+    * Transient images only live within a frame, the ones whose lifetimes do not overlap share memory.
+    */
+    class VulkanRenderGraph
+    {
+    public:
+        /** @brief Declares the accesses and the options of a pass while it is added */
+        class PassBuilder
+        {
+        public:
+            void Read(RenderGraphResource resource, RenderGraphAccess access);
+            void Write(RenderGraphResource resource, RenderGraphAccess access);
+            /**
+            * @brief The graph begins the render pass on the frame's framebuffer around the pass,
+            * with a viewport and scissor covering the render area
+            */
+            void SetRenderPass(VulkanRenderPass* renderPass, const std::vector<VkClearValue>& clearValues,
+                               VkExtent2D renderArea);
+            /** @brief renderArea is evaluated whenever the pass is recorded, the area may shrink below the framebuffer */
+            void SetRenderPass(VulkanRenderPass* renderPass, const std::vector<VkClearValue>& clearValues,
+                               std::function<VkExtent2D()> renderArea);
+            /** @brief The pass is skipped in the frames where condition returns false */
+            void SetCondition(std::function<bool()> condition);
+            /** @brief The pass is never culled, e.g. because the host reads its results */
+            void SetSideEffect();
+            /** @brief Consecutive passes of the same scope are measured together, the scope is the pass name by default */
+            void SetProfileScope(const std::string& scope);
+
+        private:
+            friend class VulkanRenderGraph;
+            PassBuilder(VulkanRenderGraph& graph, RenderGraphPass pass) : graph(graph), pass(pass) {}
+            void AddUse(RenderGraphResource resource, RenderGraphAccess access, bool write);
+
+            VulkanRenderGraph& graph;
+            RenderGraphPass pass;
+        };
+
+        struct Statistics
+        {
+            uint32_t executedPassCount = 0;
+            uint32_t culledPassCount = 0;
+            uint32_t barrierCount = 0;
+            uint32_t imageBarrierCount = 0;
+            // all frames in flight
+            VkDeviceSize transientMemorySize = 0;
+            VkDeviceSize unaliasedTransientMemorySize = 0;
+        };
+
+        VulkanRenderGraph() = delete;
+        VulkanRenderGraph(VulkanDevice* vulkanDevice, uint32_t frameCount);
+        ~VulkanRenderGraph();
+
+        /**
+        * @brief One image per frame in flight or one shared by all frames,
+        * the image rests in layout between passes and sampled reads use that layout
+        */
+        RenderGraphResource ImportImage(const std::string& name, const std::vector<VkImage>& images,
+                                        const VkImageSubresourceRange& subresourceRange, VkImageLayout layout);
+        /** @brief The attachment of every framebuffer, resting in the layout of its descriptor */
+        RenderGraphResource ImportAttachment(const VulkanFrameBuffer* frameBuffer, const std::string& attachmentName);
+        /** @brief finalStageMask and finalAccessMask make the writes of a frame visible after it, e.g. to the host */
+        RenderGraphResource ImportBuffer(const std::string& name, VkBuffer buffer,
+                                         VkPipelineStageFlags finalStageMask = 0, VkAccessFlags finalAccessMask = 0);
+        /** @brief Transient image for every frame in flight, created by Compile() and resting in the general layout */
+        RenderGraphResource CreateImage(const std::string& name, uint32_t width, uint32_t height, VkFormat format,
+                                        VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+        /**
+        * @brief The passes writing the resource are kept while consumed returns true,
+        * afterwards the image is sampled by fragment shaders, e.g. by the UI
+        */
+        void AddOutput(RenderGraphResource resource, std::function<bool()> consumed = nullptr);
+
+        RenderGraphPass AddPass(const std::string& name, const std::function<void(PassBuilder&)>& setup,
+                                std::function<void(VkCommandBuffer)> execute);
+
+        /** @brief Orders the passes and creates the transient images, the graph cannot be changed afterwards */
+        void Compile();
+        /** @brief Records the passes kept in this frame, must be called outside a render pass */
+        void Execute(VkCommandBuffer commandBuffer, uint32_t frameIndex, GpuProfiler* profiler = nullptr);
+
+        RenderGraphImage* GetImage(RenderGraphResource resource, uint32_t frameIndex);
+        /** @brief The pass was recorded by the last Execute() */
+        bool Executed(RenderGraphPass pass) const { return passes[pass].executed; }
+        const std::string& GetPassName(RenderGraphPass pass) const { return passes[pass].name; }
+        const std::vector<RenderGraphPass>& GetExecutionOrder() const { return executionOrder; }
+        const Statistics& GetStatistics() const { return statistics; }
+
+    private:
+        struct ResourceUse
+        {
+            RenderGraphResource resource = 0;
+            VkPipelineStageFlags stageMask = 0;
+            VkAccessFlags accessMask = 0;
+            // UNDEFINED: the contents are discarded, the render pass transitions the image itself
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            bool read = false;
+            bool write = false;
+        };
+
+        struct Resource
+        {
+            std::string name;
+            bool isImage = true;
+            bool transient = false;
+            // imported images, one or one per frame
+            std::vector<VkImage> images;
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkImageSubresourceRange subresourceRange{};
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags finalStageMask = 0;
+            VkAccessFlags finalAccessMask = 0;
+
+            // transient images, one per frame
+            VkImageCreateInfo imageCI{};
+            std::vector<RenderGraphImage> transientImages;
+            uint32_t memoryBlock = 0;
+            uint32_t firstUse = 0;
+            uint32_t lastUse = 0;
+
+            bool output = false;
+            std::function<bool()> consumed;
+        };
+
+        struct Pass
+        {
+            std::string name;
+            std::string profileScope;
+            std::vector<ResourceUse> uses;
+            std::vector<RenderGraphPass> dependencies;
+            VulkanRenderPass* renderPass = nullptr;
+            std::vector<VkClearValue> clearValues;
+            std::function<VkExtent2D()> renderArea;
+            std::function<bool()> condition;
+            std::function<void(VkCommandBuffer)> execute;
+            bool sideEffect = false;
+            bool active = false;
+            bool executed = false;
+        };
+
+        // pending accesses of a resource within the frame being recorded
+        struct ResourceState
+        {
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags writeStageMask = 0;
+            VkAccessFlags writeAccessMask = 0;
+            // reads since the last write, a write has to wait for them
+            VkPipelineStageFlags readStageMask = 0;
+            // reads the last write has already been made visible to
+            VkPipelineStageFlags visibleStageMask = 0;
+            VkAccessFlags visibleAccessMask = 0;
+        };
+
+        // memory shared by transient images with disjoint lifetimes
+        struct MemoryBlock
+        {
+            VkDeviceSize size = 0;
+            uint32_t memoryTypeBits = ~0u;
+            std::vector<RenderGraphResource> resources;
+            std::vector<VkDeviceMemory> memory;
+            // accesses of all images placed in the block within the frame being recorded
+            VkPipelineStageFlags stageMask = 0;
+            VkAccessFlags accessMask = 0;
+        };
+
+        class BarrierBatch;
+
+        void SortPasses();
+        void CreateTransientImages();
+        void DestroyTransientImages();
+        void CullPasses();
+        void AddBarriers(const ResourceUse& use, uint32_t frameIndex, BarrierBatch& batch);
+        void AddFinalBarriers(uint32_t frameIndex, BarrierBatch& batch);
+        VkImage GetVkImage(const Resource& resource, uint32_t frameIndex) const;
+
+        VulkanDevice* vulkanDevice = nullptr;
+        uint32_t frameCount = 0;
+        VkSampler sampler = VK_NULL_HANDLE;
+        bool compiled = false;
+
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+        std::vector<RenderGraphPass> executionOrder;
+        std::vector<MemoryBlock> memoryBlocks;
+        std::vector<ResourceState> states;
+        Statistics statistics;
+    };
+}
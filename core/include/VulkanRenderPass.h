@@ -40,6 +40,14 @@ namespace vks {
         VkImageUsageFlags usage;
         VkSampleCountFlagBits imageSampleCount = VK_SAMPLE_COUNT_1_BIT;
 //        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // loaded in its final layout and never written, e.g. a depth buffer an earlier render pass filled,
+        // a depth reference to it is read only
+        bool readOnly = false;
+        // the frame buffers use the attachment of the same name in sharedFrameBuffer instead of creating an image
+        const VulkanFrameBuffer* sharedFrameBuffer = nullptr;
+        // rewritten within every frame before it is read, the frame buffers of all frames in flight use one image,
+        // frames never overlap on the GPU because the application waits for the queue after each one
+        bool sharedAcrossFrames = false;
     };
 
     class VulkanAttachmentDescription
@@ -54,6 +62,9 @@ namespace vks {
         uint32_t width, height, layerCount;
         VkSampleCountFlagBits imageSampleCount = VK_SAMPLE_COUNT_1_BIT;
         VkImageUsageFlags usage;
+        bool readOnly = false;
+        const VulkanFrameBuffer* sharedFrameBuffer = nullptr;
+        bool sharedAcrossFrames = false;
         VkAttachmentDescription description;
     };
 
@@ -64,6 +75,7 @@ namespace vks {
         VulkanSubPass(const std::string &subPassName,
                       VkPipelineBindPoint subPassBindPoint, VulkanDevice *device);
 
+        /** @brief VK_ATTACHMENT_UNUSED keeps a color location without an attachment, e.g. for outputs another subpass writes */
         void AddAttachments(const std::vector<VulkanAttachmentDescription*>& attachmentDescriptions,
                             const std::vector<uint32_t>& colorAttachmentIndices,
                             const std::vector<uint32_t>& inputAttachmentIndices);
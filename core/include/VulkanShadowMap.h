@@ -0,0 +1,93 @@
+﻿#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+#include <VulkanDevice.h>
+#include <VulkanRenderPass.h>
+
+namespace vks
+{
+    /**
+    * @brief Layered depth target for shadow maps with one framebuffer per layer
+    * @note The size does not follow the swap chain, call Create() again to change resolution or layer count
+    *
+    * With a cache, static casters are rendered into a second layered image only when a layer is invalidated.
+    * Every frame CopyCache() restores the shadow map from it and dynamic casters are drawn on top
+    * inside BeginLoadRenderPass().
+    *
+    * Outside of its render passes the shadow map stays in DEPTH_STENCIL_READ_ONLY_OPTIMAL, so tiles of an atlas
+    * can be updated with BeginTileRenderPass() while the rest keeps its depth.
+    */
+    class VulkanShadowMap
+    {
+    public:
+        VulkanShadowMap() = delete;
+        VulkanShadowMap(const std::string& name, VulkanDevice* vulkanDevice, VkFormat depthFormat, VkQueue queue);
+        ~VulkanShadowMap();
+
+        /** @brief (Re)creates the depth images, the device must not use the previous ones anymore */
+        void Create(uint32_t resolution, uint32_t layerCount, bool useCache = false);
+
+        /** @brief Begins the depth only render pass on one cleared layer and sets a viewport and scissor covering it */
+        void BeginRenderPass(VkCommandBuffer commandBuffer, uint32_t layer);
+        /** @brief Same as BeginRenderPass, but clears and renders into a layer of the cache */
+        void BeginCacheRenderPass(VkCommandBuffer commandBuffer, uint32_t layer);
+        /** @brief Copies all cache layers into the shadow map, must be called outside a render pass */
+        void CopyCache(VkCommandBuffer commandBuffer);
+        /** @brief Begins a render pass that keeps the depth copied by CopyCache() */
+        void BeginLoadRenderPass(VkCommandBuffer commandBuffer, uint32_t layer);
+        /** @brief Begins a render pass limited to a square tile of a layer, only the tile is cleared */
+        void BeginTileRenderPass(VkCommandBuffer commandBuffer, uint32_t layer, uint32_t x, uint32_t y, uint32_t size);
+        /**
+        * @brief Same as BeginTileRenderPass for several tiles, viewport and scissor i cover tile i
+        * @note More than one tile needs the multiViewport feature
+        */
+        void BeginTileRenderPass(VkCommandBuffer commandBuffer, uint32_t layer, const VkRect2D* tiles, uint32_t tileCount);
+        void EndRenderPass(VkCommandBuffer commandBuffer);
+
+        VkRenderPass GetRenderPass() const { return renderPass->renderPass; }
+        uint32_t Resolution() const { return resolution; }
+        uint32_t LayerCount() const { return layerCount; }
+        bool HasCache() const { return cache.image != VK_NULL_HANDLE; }
+        // the layered shadow map image, e.g. for barriers recorded by its users
+        VkImage Image() const { return shadowMap.image; }
+
+        // array view of all layers, fetches raw depth
+        VkDescriptorImageInfo descriptor{};
+        // same view with a comparison sampler, for hardware filtered sampler2DArrayShadow lookups
+        VkDescriptorImageInfo compareDescriptor{};
+
+    private:
+        struct LayeredImage
+        {
+            VkImage image = VK_NULL_HANDLE;
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkImageView arrayView = VK_NULL_HANDLE;
+            std::vector<VkImageView> layerViews;
+            std::vector<VkFramebuffer> frameBuffers;
+        };
+
+        void CreateLayeredImage(LayeredImage& layeredImage, VkImageUsageFlags usage);
+        void DestroyLayeredImage(LayeredImage& layeredImage);
+        void BeginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass pass, VkFramebuffer frameBuffer,
+                             const VkRect2D& renderArea);
+
+        std::string name;
+        VulkanDevice* vulkanDevice = nullptr;
+        VkFormat depthFormat;
+        // initial layout transitions
+        VkQueue queue = VK_NULL_HANDLE;
+        uint32_t resolution = 0;
+        uint32_t layerCount = 0;
+
+        // clears the layer
+        std::unique_ptr<VulkanRenderPass> renderPass = nullptr;
+        // keeps the layer contents, compatible with renderPass
+        std::unique_ptr<VulkanRenderPass> loadRenderPass = nullptr;
+        LayeredImage shadowMap;
+        LayeredImage cache;
+        VkSampler sampler = VK_NULL_HANDLE;
+        VkSampler compareSampler = VK_NULL_HANDLE;
+    };
+}
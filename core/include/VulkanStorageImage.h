@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <vulkan/vulkan_core.h>
+#include <VulkanDevice.h>
+#include <vector>
+
+namespace vks
+{
+    /**
+    * @brief 2D color image written by compute shaders and sampled by later passes, a single level by default
+    * @note The image stays in VK_IMAGE_LAYOUT_GENERAL, so only memory barriers are needed between writes and reads.
+    * The size does not follow the swap chain, call Create() again to resize
+    */
+    class VulkanStorageImage
+    {
+    public:
+        VulkanStorageImage() = delete;
+        VulkanStorageImage(VulkanDevice* vulkanDevice, VkQueue queue);
+        ~VulkanStorageImage();
+
+        /** @brief (Re)creates the image, the device must not use the previous one anymore */
+        void Create(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage = 0,
+                    uint32_t levelCount = 1);
+        void Destroy();
+
+        uint32_t Width() const { return width; }
+        uint32_t Height() const { return height; }
+        VkFormat Format() const { return format; }
+        uint32_t LevelCount() const { return levelCount; }
+
+        VkImage image = VK_NULL_HANDLE;
+        // all levels
+        VkImageView view = VK_NULL_HANDLE;
+        // a view of every level for the storage descriptors, empty for a single level
+        std::vector<VkImageView> levelViews;
+        // general layout with a linear clamped sampler, valid for both storage and sampled descriptors
+        VkDescriptorImageInfo descriptor{};
+
+    private:
+        VulkanDevice* vulkanDevice = nullptr;
+        // initial layout transition
+        VkQueue queue = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkSampler sampler = VK_NULL_HANDLE;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t levelCount = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+    };
+}
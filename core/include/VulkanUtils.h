@@ -42,6 +42,9 @@ namespace vks
 
     	bool IsDepthStencil(VkFormat format);
 
+    	// bytes per texel of the render target formats used here, 0 for the others
+    	uint32_t FormatSize(VkFormat format);
+
         Texture2D* CreateDefaultTexture2D(VulkanDevice* vulkanDevice, VkQueue transferQueue, uint32_t width, uint32_t height, glm::vec4 clearColor = glm::vec4(1.0f));
 
     	VkSampler CreateSampler(const VulkanDevice* device, const VulkanSamplerCreateInfo& samplerCreateInfo);
@@ -0,0 +1,407 @@
+﻿#include <BoundingVolumeHierarchy.h>
+#include <algorithm>
+#include <cfloat>
+#include <future>
+#include <thread>
+#include <utility>
+
+namespace vks
+{
+    namespace
+    {
+        // half the surface area, proportional to the chance of a random ray hitting the box
+        float HalfArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+        {
+            const glm::vec3 size = boundsMax - boundsMin;
+            return size.x * size.y + size.y * size.z + size.z * size.x;
+        }
+
+        glm::vec3 NodeMin(const BoundingVolumeHierarchy::Node& node)
+        {
+            return glm::vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]);
+        }
+
+        glm::vec3 NodeMax(const BoundingVolumeHierarchy::Node& node)
+        {
+            return glm::vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]);
+        }
+
+        void SetNodeBounds(BoundingVolumeHierarchy::Node& node, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                node.boundsMin[i] = boundsMin[i];
+                node.boundsMax[i] = boundsMax[i];
+            }
+        }
+
+        enum class Containment { Outside, Intersecting, Inside };
+
+        Containment ClassifyAABB(const math::Frustum& frustum, const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+        {
+            Containment result = Containment::Inside;
+            for (const glm::vec4& plane : frustum.planes)
+            {
+                const glm::vec3 normal = glm::vec3(plane);
+                // corners furthest along and against the plane normal
+                const glm::vec3 positive = glm::mix(aabbMin, aabbMax, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+                const glm::vec3 negative = glm::mix(aabbMax, aabbMin, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+                if (glm::dot(normal, positive) + plane.w < 0.0f)
+                    return Containment::Outside;
+                if (glm::dot(normal, negative) + plane.w < 0.0f)
+                    result = Containment::Intersecting;
+            }
+            return result;
+        }
+    }
+
+    void BoundingVolumeHierarchy::Build(const math::AABBArray& boxes)
+    {
+        const uint32_t count = static_cast<uint32_t>(boxes.Size());
+        items.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            items[i].boundsMin = glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]);
+            items[i].boundsMax = glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]);
+            items[i].index = i;
+        }
+
+        nodes.clear();
+        depth = 0;
+        if (count > 0)
+        {
+            // one level of parallel subtrees per doubling of the hardware threads
+            uint32_t parallelLevels = 0;
+            for (uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u); threads > 1; threads >>= 1)
+                parallelLevels++;
+            nodes = BuildSubtree(0, count, parallelLevels, depth);
+        }
+        LinkNodes();
+    }
+
+    std::vector<BoundingVolumeHierarchy::Node> BoundingVolumeHierarchy::BuildSubtree(uint32_t first, uint32_t count,
+                                                                                     uint32_t parallelLevels,
+                                                                                     uint32_t& subtreeDepth)
+    {
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            boundsMin = glm::min(boundsMin, items[i].boundsMin);
+            boundsMax = glm::max(boundsMax, items[i].boundsMax);
+            const glm::vec3 centroid = (items[i].boundsMin + items[i].boundsMax) * 0.5f;
+            centroidMin = glm::min(centroidMin, centroid);
+            centroidMax = glm::max(centroidMax, centroid);
+        }
+
+        Node node;
+        SetNodeBounds(node, boundsMin, boundsMax);
+        if (count <= MAX_LEAF_SIZE)
+        {
+            node.offset = first;
+            node.itemCount = count;
+            subtreeDepth = 1;
+            return {node};
+        }
+
+        // binned SAH: items go to BIN_COUNT bins along each axis by their centroid, the split between two bins
+        // with the lowest sum of child area times item count wins
+        struct Bin
+        {
+            glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+            glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+            uint32_t count = 0;
+        };
+        const glm::vec3 centroidExtent = centroidMax - centroidMin;
+        int bestAxis = -1;
+        uint32_t bestSplit = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (centroidExtent[axis] <= 0.0f)
+                continue;
+            const float binScale = static_cast<float>(BIN_COUNT) / centroidExtent[axis];
+            Bin bins[BIN_COUNT];
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const float centroid = (items[i].boundsMin[axis] + items[i].boundsMax[axis]) * 0.5f;
+                Bin& bin = bins[std::min(static_cast<uint32_t>((centroid - centroidMin[axis]) * binScale), BIN_COUNT - 1)];
+                bin.boundsMin = glm::min(bin.boundsMin, items[i].boundsMin);
+                bin.boundsMax = glm::max(bin.boundsMax, items[i].boundsMax);
+                bin.count++;
+            }
+
+            // split s puts bins [0, s] to the left
+            float leftCost[BIN_COUNT - 1];
+            uint32_t leftCount[BIN_COUNT - 1];
+            Bin left;
+            for (uint32_t s = 0; s < BIN_COUNT - 1; s++)
+            {
+                left.boundsMin = glm::min(left.boundsMin, bins[s].boundsMin);
+                left.boundsMax = glm::max(left.boundsMax, bins[s].boundsMax);
+                left.count += bins[s].count;
+                leftCount[s] = left.count;
+                leftCost[s] = left.count > 0 ? HalfArea(left.boundsMin, left.boundsMax) * left.count : 0.0f;
+            }
+            Bin right;
+            for (uint32_t s = BIN_COUNT - 1; s > 0; s--)
+            {
+                right.boundsMin = glm::min(right.boundsMin, bins[s].boundsMin);
+                right.boundsMax = glm::max(right.boundsMax, bins[s].boundsMax);
+                right.count += bins[s].count;
+                if (leftCount[s - 1] == 0 || right.count == 0)
+                    continue;
+                const float cost = leftCost[s - 1] + HalfArea(right.boundsMin, right.boundsMax) * right.count;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = s - 1;
+                }
+            }
+        }
+
+        // all centroids in one point, the items are split in half in any order
+        uint32_t leftCount = count / 2;
+        if (bestAxis >= 0)
+        {
+            const float binScale = static_cast<float>(BIN_COUNT) / centroidExtent[bestAxis];
+            auto middle = std::partition(items.begin() + first, items.begin() + first + count, [&](const Item& item)
+            {
+                const float centroid = (item.boundsMin[bestAxis] + item.boundsMax[bestAxis]) * 0.5f;
+                return std::min(static_cast<uint32_t>((centroid - centroidMin[bestAxis]) * binScale), BIN_COUNT - 1) <=
+                       bestSplit;
+            });
+            leftCount = static_cast<uint32_t>(middle - (items.begin() + first));
+        }
+
+        std::vector<Node> leftNodes, rightNodes;
+        uint32_t leftDepth = 0, rightDepth = 0;
+        if (parallelLevels > 0 && count >= PARALLEL_BUILD_SIZE)
+        {
+            // the two ranges are disjoint, each thread only reorders its own items
+            std::future<std::vector<Node>> rightBuild = std::async(std::launch::async, [&]()
+            {
+                return BuildSubtree(first + leftCount, count - leftCount, parallelLevels - 1, rightDepth);
+            });
+            leftNodes = BuildSubtree(first, leftCount, parallelLevels - 1, leftDepth);
+            rightNodes = rightBuild.get();
+        }
+        else
+        {
+            leftNodes = BuildSubtree(first, leftCount, 0, leftDepth);
+            rightNodes = BuildSubtree(first + leftCount, count - leftCount, 0, rightDepth);
+        }
+
+        std::vector<Node> subtree;
+        subtree.reserve(1 + leftNodes.size() + rightNodes.size());
+        node.offset = static_cast<uint32_t>(1 + leftNodes.size());
+        node.itemCount = 0;
+        subtree.push_back(node);
+        // child offsets become relative to this node
+        for (const std::pair<std::vector<Node>*, uint32_t>& child : {std::make_pair(&leftNodes, 1u),
+                                                                     std::make_pair(&rightNodes, node.offset)})
+        {
+            for (Node childNode : *child.first)
+            {
+                if (childNode.itemCount == 0)
+                    childNode.offset += child.second;
+                subtree.push_back(childNode);
+            }
+        }
+        subtreeDepth = 1 + std::max(leftDepth, rightDepth);
+        return subtree;
+    }
+
+    void BoundingVolumeHierarchy::LinkNodes()
+    {
+        parents.assign(nodes.size(), 0);
+        itemSlots.assign(items.size(), 0);
+        itemLeaves.assign(items.size(), 0);
+        dirtyNodes.assign(nodes.size(), 0);
+        for (uint32_t i = 0; i < nodes.size(); i++)
+        {
+            const Node& node = nodes[i];
+            if (node.itemCount == 0)
+            {
+                parents[i + 1] = i;
+                parents[node.offset] = i;
+                continue;
+            }
+            for (uint32_t slot = node.offset; slot < node.offset + node.itemCount; slot++)
+            {
+                itemSlots[items[slot].index] = slot;
+                itemLeaves[items[slot].index] = i;
+            }
+        }
+    }
+
+    void BoundingVolumeHierarchy::Refit(const math::AABBArray& boxes, const std::vector<uint32_t>& changedItems)
+    {
+        refitNodes.clear();
+        for (uint32_t item : changedItems)
+        {
+            Item& entry = items[itemSlots[item]];
+            entry.boundsMin = glm::vec3(boxes.minX[item], boxes.minY[item], boxes.minZ[item]);
+            entry.boundsMax = glm::vec3(boxes.maxX[item], boxes.maxY[item], boxes.maxZ[item]);
+            // the path to the root stops at the first node another item already marked, the root is its own parent
+            for (uint32_t node = itemLeaves[item]; !dirtyNodes[node]; node = parents[node])
+            {
+                dirtyNodes[node] = 1;
+                refitNodes.push_back(node);
+            }
+        }
+
+        // children are stored after their parents
+        std::sort(refitNodes.begin(), refitNodes.end(), std::greater<uint32_t>());
+        for (uint32_t index : refitNodes)
+        {
+            Node& node = nodes[index];
+            dirtyNodes[index] = 0;
+            glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+            if (node.itemCount > 0)
+            {
+                for (uint32_t slot = node.offset; slot < node.offset + node.itemCount; slot++)
+                {
+                    boundsMin = glm::min(boundsMin, items[slot].boundsMin);
+                    boundsMax = glm::max(boundsMax, items[slot].boundsMax);
+                }
+            }
+            else
+            {
+                boundsMin = glm::min(NodeMin(nodes[index + 1]), NodeMin(nodes[node.offset]));
+                boundsMax = glm::max(NodeMax(nodes[index + 1]), NodeMax(nodes[node.offset]));
+            }
+            SetNodeBounds(node, boundsMin, boundsMax);
+        }
+    }
+
+    void BoundingVolumeHierarchy::QueryFrustum(const math::Frustum& frustum, std::vector<uint8_t>& visible) const
+    {
+        visible.assign(items.size(), 0);
+        if (nodes.empty())
+            return;
+
+        // the items below a node inside the frustum are visible without further tests
+        std::vector<std::pair<uint32_t, bool>> stack;
+        stack.reserve(depth + 1);
+        stack.emplace_back(0, false);
+        while (!stack.empty())
+        {
+            auto [index, inside] = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[index];
+            if (!inside)
+            {
+                const Containment containment = ClassifyAABB(frustum, NodeMin(node), NodeMax(node));
+                if (containment == Containment::Outside)
+                    continue;
+                inside = containment == Containment::Inside;
+            }
+            if (node.itemCount == 0)
+            {
+                stack.emplace_back(node.offset, inside);
+                stack.emplace_back(index + 1, inside);
+                continue;
+            }
+            for (uint32_t slot = node.offset; slot < node.offset + node.itemCount; slot++)
+            {
+                const Item& item = items[slot];
+                visible[item.index] = inside || frustum.IntersectsAABB(item.boundsMin, item.boundsMax) ? 1 : 0;
+            }
+        }
+    }
+
+    void BoundingVolumeHierarchy::QuerySphere(const glm::vec3& center, float radius, std::vector<uint8_t>& visible) const
+    {
+        visible.assign(items.size(), 0);
+        if (nodes.empty())
+            return;
+
+        std::vector<uint32_t> stack;
+        stack.reserve(depth + 1);
+        stack.push_back(0);
+        while (!stack.empty())
+        {
+            const Node& node = nodes[stack.back()];
+            const uint32_t index = stack.back();
+            stack.pop_back();
+            if (!math::IntersectsSphereAABB(center, radius, NodeMin(node), NodeMax(node)))
+                continue;
+            if (node.itemCount == 0)
+            {
+                stack.push_back(node.offset);
+                stack.push_back(index + 1);
+                continue;
+            }
+            for (uint32_t slot = node.offset; slot < node.offset + node.itemCount; slot++)
+            {
+                const Item& item = items[slot];
+                visible[item.index] = math::IntersectsSphereAABB(center, radius, item.boundsMin, item.boundsMax) ? 1 : 0;
+            }
+        }
+    }
+
+    bool BoundingVolumeHierarchy::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                                          const std::function<float(uint32_t item, float maxDistance)>& intersectItem,
+                                          uint32_t& hitItem, float& hitDistance) const
+    {
+        if (nodes.empty())
+            return false;
+
+        const glm::vec3 inverseDirection = 1.0f / direction;
+        float closest = maxDistance;
+        bool hit = false;
+        // nodes with the distance the ray enters them, the nearer child is visited first
+        std::vector<std::pair<uint32_t, float>> stack;
+        stack.reserve(depth + 1);
+        float entry = 0.0f;
+        if (math::IntersectRayAABB(origin, inverseDirection, NodeMin(nodes[0]), NodeMax(nodes[0]), closest, entry))
+            stack.emplace_back(0, entry);
+        while (!stack.empty())
+        {
+            const auto [index, nodeEntry] = stack.back();
+            stack.pop_back();
+            // a closer hit was found since the node was pushed
+            if (nodeEntry > closest)
+                continue;
+            const Node& node = nodes[index];
+            if (node.itemCount > 0)
+            {
+                for (uint32_t slot = node.offset; slot < node.offset + node.itemCount; slot++)
+                {
+                    const Item& item = items[slot];
+                    if (!math::IntersectRayAABB(origin, inverseDirection, item.boundsMin, item.boundsMax, closest, entry))
+                        continue;
+                    const float distance = intersectItem(item.index, closest);
+                    if (distance >= 0.0f && distance <= closest)
+                    {
+                        closest = distance;
+                        hitItem = item.index;
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+
+            float leftEntry = 0.0f, rightEntry = 0.0f;
+            const bool leftHit = math::IntersectRayAABB(origin, inverseDirection, NodeMin(nodes[index + 1]),
+                                                        NodeMax(nodes[index + 1]), closest, leftEntry);
+            const bool rightHit = math::IntersectRayAABB(origin, inverseDirection, NodeMin(nodes[node.offset]),
+                                                         NodeMax(nodes[node.offset]), closest, rightEntry);
+            if (leftHit && rightHit && leftEntry > rightEntry)
+            {
+                stack.emplace_back(index + 1, leftEntry);
+                stack.emplace_back(node.offset, rightEntry);
+                continue;
+            }
+            if (rightHit)
+                stack.emplace_back(node.offset, rightEntry);
+            if (leftHit)
+                stack.emplace_back(index + 1, leftEntry);
+        }
+        if (hit)
+            hitDistance = closest;
+        return hit;
+    }
+}
@@ -55,6 +55,12 @@ void Camera::UpdateAspectRatio(float aspect)
     }
 }
 
+glm::mat4 Camera::GetJitteredPerspective(const glm::vec2& jitter) const
+{
+    // moves the clip space position by jitter * w, so every point moves by jitter after the perspective divide
+    return glm::translate(glm::mat4(1.0f), glm::vec3(jitter, 0.0f)) * matrices.perspective;
+}
+
 void Camera::SetPosition(glm::vec3 position)
 {
     this->position = position;
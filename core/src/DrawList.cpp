@@ -0,0 +1,76 @@
+﻿#include <DrawList.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace vks
+{
+    namespace
+    {
+        constexpr uint32_t DIGIT_COUNT = 64 / DrawList::DIGIT_BITS;
+
+        // the bits of a non negative float increase with its value, negative depths clamp to the camera
+        uint32_t DepthBits(float depth)
+        {
+            depth = std::max(depth, 0.0f);
+            uint32_t bits;
+            std::memcpy(&bits, &depth, sizeof(bits));
+            return bits;
+        }
+
+        uint32_t Digit(uint64_t key, uint32_t digit)
+        {
+            return static_cast<uint32_t>(key >> (digit * DrawList::DIGIT_BITS)) & (DrawList::BUCKET_COUNT - 1);
+        }
+    }
+
+    uint64_t DrawList::OpaqueKey(uint32_t pipeline, uint32_t material, float depth)
+    {
+        return (static_cast<uint64_t>(pipeline & 0xffu) << 56) | (static_cast<uint64_t>(material & 0xffffffu) << 32) |
+               DepthBits(depth);
+    }
+
+    uint64_t DrawList::BlendedKey(float depth)
+    {
+        return (static_cast<uint64_t>(0xffu) << 56) | (~DepthBits(depth));
+    }
+
+    void DrawList::Sort()
+    {
+        sortedDigitCount = 0;
+        const size_t count = draws.size();
+        if (count < 2)
+            return;
+        scratch.resize(count);
+
+        // the digits every key shares need no pass
+        uint64_t differingBits = 0;
+        for (size_t i = 1; i < count; i++)
+            differingBits |= draws[i].key ^ draws[0].key;
+
+        std::array<uint32_t, BUCKET_COUNT> offsets;
+        for (uint32_t digit = 0; digit < DIGIT_COUNT; digit++)
+        {
+            if (Digit(differingBits, digit) == 0)
+                continue;
+
+            offsets.fill(0);
+            for (size_t i = 0; i < count; i++)
+                offsets[Digit(draws[i].key, digit)]++;
+
+            // exclusive prefix sum, the scatter walks the draws in order so equal digits keep their order
+            uint32_t offset = 0;
+            for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++)
+            {
+                const uint32_t bucketCount = offsets[bucket];
+                offsets[bucket] = offset;
+                offset += bucketCount;
+            }
+
+            for (size_t i = 0; i < count; i++)
+                scratch[offsets[Digit(draws[i].key, digit)]++] = draws[i];
+            draws.swap(scratch);
+            sortedDigitCount++;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+﻿#include <FrameBenchmark.h>
+#include <cstdarg>
+#include <cstdio>
+
+namespace vks
+{
+    void FrameBenchmark::Start(uint32_t stepCount, Callbacks callbacks, uint32_t warmupFrames)
+    {
+        this->callbacks = std::move(callbacks);
+        this->stepCount = stepCount;
+        this->warmupFrames = warmupFrames;
+        running = stepCount > 0;
+        step = 0;
+        frame = 0;
+        reports.clear();
+    }
+
+    void FrameBenchmark::Update()
+    {
+        if (!running)
+            return;
+        if (frame == 0 && !callbacks.apply(step))
+            return;
+
+        // a step that prepares its measurement waits for the frame recorded after the preparation
+        const uint32_t measureFrame = callbacks.prepareMeasure ? warmupFrames + 1 : warmupFrames;
+        if (++frame == warmupFrames && callbacks.prepareMeasure)
+            callbacks.prepareMeasure(step);
+        if (frame < measureFrame)
+            return;
+
+        reports.push_back(callbacks.measure(step));
+        frame = 0;
+        if (++step == stepCount)
+        {
+            running = false;
+            step = 0;
+            if (callbacks.finish)
+                callbacks.finish();
+        }
+    }
+
+    std::string FormatReport(const char* format, ...)
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        return buffer;
+    }
+}
@@ -0,0 +1,81 @@
+﻿#include <LightCluster.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace vks
+{
+    float LightClusterGrid::SliceScale() const
+    {
+        return static_cast<float>(sliceCount) / std::log(farPlane / nearPlane);
+    }
+
+    float LightClusterGrid::SliceBias() const
+    {
+        return static_cast<float>(sliceCount) * std::log(nearPlane) / std::log(farPlane / nearPlane);
+    }
+
+    void LightClusterGrid::GetClusterBounds(const glm::mat4& invProjection, uint32_t x, uint32_t y, uint32_t z,
+                                            glm::vec3& aabbMin, glm::vec3& aabbMax) const
+    {
+        glm::vec2 ndcMin = glm::vec2(x, y) / glm::vec2(tileCountX, tileCountY) * 2.0f - 1.0f;
+        glm::vec2 ndcMax = glm::vec2(x + 1, y + 1) / glm::vec2(tileCountX, tileCountY) * 2.0f - 1.0f;
+
+        float sliceNear = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(z) / sliceCount);
+        float sliceFar = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(z + 1) / sliceCount);
+
+        const glm::vec2 corners[4] = {
+            ndcMin, glm::vec2(ndcMax.x, ndcMin.y), glm::vec2(ndcMin.x, ndcMax.y), ndcMax
+        };
+
+        aabbMin = glm::vec3(FLT_MAX);
+        aabbMax = glm::vec3(-FLT_MAX);
+        for (const glm::vec2& corner : corners)
+        {
+            // point on the near plane (depth 0), then scale the view ray to the slice depths
+            glm::vec4 p = invProjection * glm::vec4(corner, 0.0f, 1.0f);
+            glm::vec3 ray = glm::vec3(p) / p.w;
+            ray /= -ray.z;
+            aabbMin = glm::min(aabbMin, glm::min(ray * sliceNear, ray * sliceFar));
+            aabbMax = glm::max(aabbMax, glm::max(ray * sliceNear, ray * sliceFar));
+        }
+    }
+
+    float ComputeLightRange(const glm::vec3& color, float cutoff)
+    {
+        float peak = std::max(color.r, std::max(color.g, color.b));
+        return std::sqrt(std::max(peak, 0.0f) / cutoff);
+    }
+
+    void BinLightsToClusters(const LightClusterGrid& grid, const glm::mat4& invProjection,
+                             const std::vector<ClusterLight>& lights, uint32_t maxLightsPerCluster,
+                             std::vector<uint32_t>& clusterLightCounts, std::vector<uint32_t>& clusterLightIndices)
+    {
+        clusterLightCounts.assign(grid.ClusterCount(), 0);
+        clusterLightIndices.assign(grid.ClusterCount() * maxLightsPerCluster, 0);
+
+        for (uint32_t z = 0; z < grid.sliceCount; z++)
+        {
+            for (uint32_t y = 0; y < grid.tileCountY; y++)
+            {
+                for (uint32_t x = 0; x < grid.tileCountX; x++)
+                {
+                    glm::vec3 aabbMin, aabbMax;
+                    grid.GetClusterBounds(invProjection, x, y, z, aabbMin, aabbMax);
+
+                    uint32_t clusterIndex = grid.ClusterIndex(x, y, z);
+                    uint32_t& count = clusterLightCounts[clusterIndex];
+                    for (uint32_t i = 0; i < lights.size() && count < maxLightsPerCluster; i++)
+                    {
+                        // sphere/AABB overlap
+                        glm::vec3 center = glm::vec3(lights[i].positionRange);
+                        float range = lights[i].positionRange.w;
+                        glm::vec3 d = glm::clamp(center, aabbMin, aabbMax) - center;
+                        if (glm::dot(d, d) <= range * range)
+                            clusterLightIndices[clusterIndex * maxLightsPerCluster + count++] = i;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -1,6 +1,15 @@
 ﻿#pragma once
 #include <MathUtils.h>
 #include <glm/ext/scalar_constants.hpp>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MATH_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MATH_SIMD_SSE
+#endif
 
 namespace math
 {
@@ -72,6 +81,219 @@ namespace math
     {
         return a + f * (b-a);
     }
+
+    float Halton(uint32_t index, uint32_t base)
+    {
+        float result = 0.0f;
+        float fraction = 1.0f;
+        while (index > 0)
+        {
+            fraction /= static_cast<float>(base);
+            result += fraction * static_cast<float>(index % base);
+            index /= base;
+        }
+        return result;
+    }
+
+    void MultiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+    {
+#if defined(MATH_SIMD_AVX) || defined(MATH_SIMD_SSE)
+        // column j of the product is the columns of a weighted by the entries of column j of b
+        const float* columnsA = &a[0][0];
+        const float* entriesB = &b[0][0];
+        const __m128 a0 = _mm_loadu_ps(columnsA);
+        const __m128 a1 = _mm_loadu_ps(columnsA + 4);
+        const __m128 a2 = _mm_loadu_ps(columnsA + 8);
+        const __m128 a3 = _mm_loadu_ps(columnsA + 12);
+        float* columnsOut = &out[0][0];
+        for (int j = 0; j < 4; j++)
+        {
+            const float* column = entriesB + 4 * j;
+            const __m128 product = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(column[0])), _mm_mul_ps(a1, _mm_set1_ps(column[1]))),
+                _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(column[2])), _mm_mul_ps(a3, _mm_set1_ps(column[3]))));
+            _mm_storeu_ps(columnsOut + 4 * j, product);
+        }
+#else
+        out = a * b;
+#endif
+    }
+
+    void TransformAABB(const glm::mat4& mat, const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+                       glm::vec3& outMin, glm::vec3& outMax)
+    {
+        glm::vec3 center = glm::vec3(mat * glm::vec4((aabbMin + aabbMax) * 0.5f, 1.0f));
+        glm::vec3 extent = (aabbMax - aabbMin) * 0.5f;
+        glm::mat3 absMat = glm::mat3(glm::abs(glm::vec3(mat[0])), glm::abs(glm::vec3(mat[1])), glm::abs(glm::vec3(mat[2])));
+        glm::vec3 newExtent = absMat * extent;
+        outMin = center - newExtent;
+        outMax = center + newExtent;
+    }
+
+    bool IntersectsSphereAABB(const glm::vec3& center, float radius, const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+    {
+        const glm::vec3 offset = glm::clamp(center, aabbMin, aabbMax) - center;
+        return glm::dot(offset, offset) <= radius * radius;
+    }
+
+    bool IntersectRayAABB(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& aabbMin,
+                          const glm::vec3& aabbMax, float maxDistance, float& entryDistance)
+    {
+        const glm::vec3 t0 = (aabbMin - origin) * inverseDirection;
+        const glm::vec3 t1 = (aabbMax - origin) * inverseDirection;
+        const glm::vec3 tNear = glm::min(t0, t1);
+        const glm::vec3 tFar = glm::max(t0, t1);
+        const float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+        entryDistance = entry;
+        return entry <= exit;
+    }
+
+    bool IntersectRayTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0,
+                              const glm::vec3& v1, const glm::vec3& v2, float& distance)
+    {
+        const glm::vec3 edge1 = v1 - v0;
+        const glm::vec3 edge2 = v2 - v0;
+        const glm::vec3 p = glm::cross(direction, edge2);
+        const float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) < 1e-12f)
+            return false;
+        const float inverseDeterminant = 1.0f / determinant;
+        const glm::vec3 s = origin - v0;
+        const float u = glm::dot(s, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        const glm::vec3 q = glm::cross(s, edge1);
+        const float v = glm::dot(direction, q) * inverseDeterminant;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        distance = glm::dot(edge2, q) * inverseDeterminant;
+        return distance >= 0.0f;
+    }
+
+    void AABBArray::Resize(size_t size)
+    {
+        count = size;
+        const size_t paddedCount = (size + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+        for (std::vector<float>* coordinates : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+            coordinates->assign(paddedCount, 0.0f);
+    }
+
+    void AABBArray::Set(size_t index, const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+    {
+        minX[index] = aabbMin.x;
+        minY[index] = aabbMin.y;
+        minZ[index] = aabbMin.z;
+        maxX[index] = aabbMax.x;
+        maxY[index] = aabbMax.y;
+        maxZ[index] = aabbMax.z;
+    }
+
+    void Frustum::Update(const glm::mat4& viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        planes[0] = rows[3] + rows[0]; // left
+        planes[1] = rows[3] - rows[0]; // right
+        planes[2] = rows[3] + rows[1]; // bottom
+        planes[3] = rows[3] - rows[1]; // top
+        planes[4] = rows[2];           // near
+        planes[5] = rows[3] - rows[2]; // far
+
+        for (glm::vec4& plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    void Frustum::Update(const glm::vec3& boxMin, const glm::vec3& boxMax)
+    {
+        planes[0] = glm::vec4(1.0f, 0.0f, 0.0f, -boxMin.x);
+        planes[1] = glm::vec4(-1.0f, 0.0f, 0.0f, boxMax.x);
+        planes[2] = glm::vec4(0.0f, 1.0f, 0.0f, -boxMin.y);
+        planes[3] = glm::vec4(0.0f, -1.0f, 0.0f, boxMax.y);
+        planes[4] = glm::vec4(0.0f, 0.0f, 1.0f, -boxMin.z);
+        planes[5] = glm::vec4(0.0f, 0.0f, -1.0f, boxMax.z);
+    }
+
+    bool Frustum::IntersectsAABB(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const
+    {
+        for (const glm::vec4& plane : planes)
+        {
+            // corner furthest along the plane normal
+            glm::vec3 positive(plane.x >= 0.0f ? aabbMax.x : aabbMin.x,
+                               plane.y >= 0.0f ? aabbMax.y : aabbMin.y,
+                               plane.z >= 0.0f ? aabbMax.z : aabbMin.z);
+            if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    void Frustum::IntersectsAABBs(const AABBArray& boxes, uint8_t* visible) const
+    {
+        // the sign of a plane's normal picks the coordinate array of the furthest corner for every box at once
+        const float* cornerX[6];
+        const float* cornerY[6];
+        const float* cornerZ[6];
+        for (int p = 0; p < 6; p++)
+        {
+            cornerX[p] = planes[p].x >= 0.0f ? boxes.maxX.data() : boxes.minX.data();
+            cornerY[p] = planes[p].y >= 0.0f ? boxes.maxY.data() : boxes.minY.data();
+            cornerZ[p] = planes[p].z >= 0.0f ? boxes.maxZ.data() : boxes.minZ.data();
+        }
+
+        const size_t count = boxes.Size();
+        for (size_t first = 0; first < count; first += AABBArray::BATCH_SIZE)
+        {
+            // one bit per box of the batch, set while the box is on the inner side of every plane
+            uint32_t mask = 0;
+#if defined(MATH_SIMD_AVX)
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 distance = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].x), _mm256_loadu_ps(cornerX[p] + first)),
+                                  _mm256_mul_ps(_mm256_set1_ps(planes[p].y), _mm256_loadu_ps(cornerY[p] + first))),
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].z), _mm256_loadu_ps(cornerZ[p] + first)),
+                                  _mm256_set1_ps(planes[p].w)));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+            }
+            mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+#elif defined(MATH_SIMD_SSE)
+            for (size_t half = 0; half < AABBArray::BATCH_SIZE; half += 4)
+            {
+                const size_t offset = first + half;
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int p = 0; p < 6; p++)
+                {
+                    __m128 distance = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].x), _mm_loadu_ps(cornerX[p] + offset)),
+                                   _mm_mul_ps(_mm_set1_ps(planes[p].y), _mm_loadu_ps(cornerY[p] + offset))),
+                        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].z), _mm_loadu_ps(cornerZ[p] + offset)),
+                                   _mm_set1_ps(planes[p].w)));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+                }
+                mask |= static_cast<uint32_t>(_mm_movemask_ps(inside)) << half;
+            }
+#else
+            for (size_t lane = 0; lane < AABBArray::BATCH_SIZE; lane++)
+            {
+                bool inside = true;
+                for (int p = 0; p < 6 && inside; p++)
+                {
+                    const size_t i = first + lane;
+                    inside = planes[p].x * cornerX[p][i] + planes[p].y * cornerY[p][i] +
+                             planes[p].z * cornerZ[p][i] + planes[p].w >= 0.0f;
+                }
+                mask |= static_cast<uint32_t>(inside) << lane;
+            }
+#endif
+            const size_t batchCount = std::min(count - first, AABBArray::BATCH_SIZE);
+            for (size_t lane = 0; lane < batchCount; lane++)
+                visible[first + lane] = static_cast<uint8_t>((mask >> lane) & 1u);
+        }
+    }
 }
 
 
@@ -0,0 +1,296 @@
+﻿#include <ShadowAtlas.h>
+#include <MathUtils.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace vks
+{
+    namespace
+    {
+        // projected radius in pixels from which a light gets a large or a medium tile
+        constexpr float largeTileRadius = 256.0f;
+        constexpr float mediumTileRadius = 96.0f;
+
+        uint32_t SizeClassOf(float screenRadius)
+        {
+            if (screenRadius >= largeTileRadius)
+                return 0;
+            return screenRadius >= mediumTileRadius ? 1 : 2;
+        }
+
+        bool LightChanged(const ShadowAtlasLight& a, const ShadowAtlasLight& b)
+        {
+            return glm::any(glm::greaterThan(glm::abs(a.position - b.position), glm::vec3(1e-4f))) ||
+                glm::any(glm::greaterThan(glm::abs(a.direction - b.direction), glm::vec3(1e-4f))) ||
+                std::abs(a.range - b.range) > 1e-4f || std::abs(a.outerConeAngle - b.outerConeAngle) > 1e-4f;
+        }
+    }
+
+    ShadowAtlas::ShadowAtlas(uint32_t atlasSize) : atlasSize(atlasSize)
+    {
+        // top half large tiles, then a quarter each of medium and small tiles
+        sizeClasses[0] = {atlasSize / 8, 0, 8, 0, 32};
+        sizeClasses[1] = {atlasSize / 16, atlasSize / 2, 16, 32, 64};
+        sizeClasses[2] = {atlasSize / 32, atlasSize / 4 * 3, 32, 96, 256};
+
+        tiles.resize(MAX_TILE_COUNT);
+        tileStates.resize(MAX_TILE_COUNT);
+        for (const SizeClass& sizeClass : sizeClasses)
+        {
+            for (uint32_t i = 0; i < sizeClass.tileCount; i++)
+            {
+                float x = static_cast<float>(i % sizeClass.columns * sizeClass.tileSize);
+                float y = static_cast<float>(sizeClass.originY + i / sizeClass.columns * sizeClass.tileSize);
+                tiles[sizeClass.firstTile + i].viewProjection = glm::mat4(1.0f);
+                tiles[sizeClass.firstTile + i].atlasRect = glm::vec4(x, y, sizeClass.tileSize, sizeClass.tileSize) /
+                    static_cast<float>(atlasSize);
+                tiles[sizeClass.firstTile + i].params = glm::vec4(0.0f);
+            }
+        }
+    }
+
+    void ShadowAtlas::Reset()
+    {
+        for (uint32_t i = 0; i < lightStates.size(); i++)
+            Free(i);
+        lightStates.clear();
+        tileUpdates.clear();
+        lightUpdates.clear();
+        statistics = {};
+    }
+
+    bool ShadowAtlas::Allocate(uint32_t lightIndex, uint32_t sizeClass, uint32_t tileCount)
+    {
+        // first fit, the tiles of a point light are consecutive so the shaders can add the cube face
+        const SizeClass& pool = sizeClasses[sizeClass];
+        uint32_t runLength = 0;
+        for (uint32_t tile = pool.firstTile; tile < pool.firstTile + pool.tileCount; tile++)
+        {
+            runLength = tileStates[tile].owner < 0 ? runLength + 1 : 0;
+            if (runLength < tileCount)
+                continue;
+
+            LightState& state = lightStates[lightIndex];
+            state.sizeClass = static_cast<int32_t>(sizeClass);
+            state.firstTile = tile + 1 - tileCount;
+            state.tileCount = tileCount;
+            for (uint32_t i = state.firstTile; i <= tile; i++)
+            {
+                tileStates[i].owner = static_cast<int32_t>(lightIndex);
+                tileStates[i].rendered = false;
+                tileStates[i].dirty = true;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void ShadowAtlas::Free(uint32_t lightIndex)
+    {
+        LightState& state = lightStates[lightIndex];
+        if (state.sizeClass < 0)
+            return;
+        for (uint32_t i = state.firstTile; i < state.firstTile + state.tileCount; i++)
+            tileStates[i] = TileState{};
+        state.sizeClass = -1;
+        state.tileCount = 0;
+    }
+
+    void ShadowAtlas::UpdateTile(uint32_t tile)
+    {
+        TileState& tileState = tileStates[tile];
+        const LightState& state = lightStates[tileState.owner];
+        const ShadowAtlasLight& light = state.light;
+        const float tileSize = static_cast<float>(sizeClasses[state.sizeClass].tileSize);
+        const float nearPlane = std::max(light.range * 0.01f, 0.01f);
+
+        glm::mat4 view, projection;
+        float tanHalfFov = 1.0f;
+        if (light.spot)
+        {
+            float halfFov = std::clamp(light.outerConeAngle, 0.01f, 1.48f);
+            tanHalfFov = std::tan(halfFov);
+            glm::vec3 up = std::abs(light.direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            view = glm::lookAt(light.position, light.position + light.direction, up);
+            projection = glm::perspective(2.0f * halfFov, 1.0f, nearPlane, light.range);
+        }
+        else
+        {
+            // +x, -x, +y, -y, +z, -z, lighting.frag picks the face from the major axis
+            const glm::vec3 faceDirections[6] = {
+                {1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+                {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}
+            };
+            const glm::vec3 faceUps[6] = {
+                {0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f},
+                {0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}
+            };
+            uint32_t face = tile - state.firstTile;
+            view = glm::lookAt(light.position, light.position + faceDirections[face], faceUps[face]);
+            projection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, light.range);
+        }
+
+        tiles[tile].viewProjection = projection * view;
+        tiles[tile].params = glm::vec4(2.0f * tanHalfFov / tileSize, 0.0f, 0.0f, 0.0f);
+        tileState.rendered = true;
+        tileState.dirty = false;
+        tileState.lastUpdateFrame = frameIndex;
+
+        const SizeClass& pool = sizeClasses[state.sizeClass];
+        uint32_t localIndex = tile - pool.firstTile;
+        tileUpdates.push_back({tile, localIndex % pool.columns * pool.tileSize,
+                               pool.originY + localIndex / pool.columns * pool.tileSize, pool.tileSize});
+    }
+
+    void ShadowAtlas::UpdateLight(uint32_t lightIndex)
+    {
+        const LightState& state = lightStates[lightIndex];
+        lightUpdates.push_back({lightIndex, static_cast<uint32_t>(tileUpdates.size()), state.tileCount});
+        for (uint32_t tile = state.firstTile; tile < state.firstTile + state.tileCount; tile++)
+            UpdateTile(tile);
+    }
+
+    void ShadowAtlas::Update(const std::vector<ShadowAtlasLight>& lights, const glm::mat4& view,
+                             const glm::mat4& projection, float viewportHeight, uint32_t updateBudget)
+    {
+        frameIndex++;
+        tileUpdates.clear();
+        lightUpdates.clear();
+        statistics = {};
+
+        for (uint32_t i = static_cast<uint32_t>(lights.size()); i < lightStates.size(); i++)
+            Free(i);
+        lightStates.resize(lights.size());
+
+        // rank the lights that can reach a visible pixel by their projected radius
+        math::Frustum frustum;
+        frustum.Update(projection * view);
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < lights.size(); i++)
+        {
+            const ShadowAtlasLight& light = lights[i];
+            LightState& state = lightStates[i];
+            glm::vec3 extent(light.range);
+            if (!light.castsShadow || light.range <= 0.0f ||
+                !frustum.IntersectsAABB(light.position - extent, light.position + extent))
+            {
+                Free(i);
+                continue;
+            }
+
+            float distance = glm::length(glm::vec3(view * glm::vec4(light.position, 1.0f)));
+            state.screenRadius = distance <= light.range
+                                     ? viewportHeight
+                                     : light.range / distance * std::abs(projection[1][1]) * viewportHeight * 0.5f;
+            candidates.push_back(i);
+
+            uint32_t tileCount = light.spot ? 1 : 6;
+            if (state.sizeClass >= 0 && state.tileCount != tileCount)
+                Free(i);
+            if (state.sizeClass >= 0 && LightChanged(state.light, light))
+            {
+                for (uint32_t tile = state.firstTile; tile < state.firstTile + state.tileCount; tile++)
+                    tileStates[tile].dirty = true;
+            }
+            state.light = light;
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+        {
+            return lightStates[a].screenRadius > lightStates[b].screenRadius;
+        });
+        statistics.candidateLightCount = static_cast<uint32_t>(candidates.size());
+
+        // tiles are kept unless the light left its size range by a margin, reallocation means rendering again
+        for (uint32_t lightIndex : candidates)
+        {
+            LightState& state = lightStates[lightIndex];
+            if (state.sizeClass < 0)
+                continue;
+            uint32_t smallest = SizeClassOf(state.screenRadius / 1.2f);
+            uint32_t largest = SizeClassOf(state.screenRadius * 1.2f);
+            if (static_cast<uint32_t>(state.sizeClass) < largest || static_cast<uint32_t>(state.sizeClass) > smallest)
+                Free(lightIndex);
+        }
+
+        // most important first, fall back to smaller tiles and evict less important lights when the atlas is full
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            uint32_t lightIndex = candidates[c];
+            LightState& state = lightStates[lightIndex];
+            if (state.sizeClass >= 0)
+                continue;
+
+            uint32_t tileCount = state.light.spot ? 1 : 6;
+            auto tryAllocate = [&]()
+            {
+                for (uint32_t sizeClass = SizeClassOf(state.screenRadius); sizeClass < SIZE_CLASS_COUNT; sizeClass++)
+                {
+                    if (Allocate(lightIndex, sizeClass, tileCount))
+                        return true;
+                }
+                return false;
+            };
+            bool allocated = tryAllocate();
+            for (size_t victim = candidates.size(); !allocated && victim-- > c + 1;)
+            {
+                if (lightStates[candidates[victim]].sizeClass < 0)
+                    continue;
+                Free(candidates[victim]);
+                allocated = tryAllocate();
+            }
+        }
+
+        // new and changed lights first, then round-robin over the least recently rendered lights
+        std::vector<uint32_t> dirtyLights, otherLights;
+        for (uint32_t lightIndex : candidates)
+        {
+            const LightState& state = lightStates[lightIndex];
+            if (state.sizeClass < 0)
+                continue;
+            statistics.allocatedTileCount += state.tileCount;
+            bool dirty = false;
+            for (uint32_t tile = state.firstTile; tile < state.firstTile + state.tileCount; tile++)
+                dirty = dirty || tileStates[tile].dirty;
+            (dirty ? dirtyLights : otherLights).push_back(lightIndex);
+        }
+        std::stable_sort(otherLights.begin(), otherLights.end(), [this](uint32_t a, uint32_t b)
+        {
+            return tileStates[lightStates[a].firstTile].lastUpdateFrame <
+                tileStates[lightStates[b].firstTile].lastUpdateFrame;
+        });
+        // a light that does not fit the remaining budget waits, unless nothing has been scheduled yet
+        auto schedule = [&](const std::vector<uint32_t>& scheduledLights)
+        {
+            for (uint32_t lightIndex : scheduledLights)
+            {
+                uint32_t tileCount = lightStates[lightIndex].tileCount;
+                if (updateBudget == 0 || (!tileUpdates.empty() && tileUpdates.size() + tileCount > updateBudget))
+                    return false;
+                UpdateLight(lightIndex);
+            }
+            return true;
+        };
+        if (schedule(dirtyLights))
+            schedule(otherLights);
+
+        statistics.updatedTileCount = static_cast<uint32_t>(tileUpdates.size());
+        for (uint32_t tile = 0; tile < MAX_TILE_COUNT; tile++)
+            statistics.pendingTileCount += tileStates[tile].dirty ? 1 : 0;
+        for (uint32_t i = 0; i < lightStates.size(); i++)
+            statistics.shadowedLightCount += GetFirstTile(i) >= 0 ? 1 : 0;
+    }
+
+    int32_t ShadowAtlas::GetFirstTile(uint32_t lightIndex) const
+    {
+        if (lightIndex >= lightStates.size() || lightStates[lightIndex].sizeClass < 0)
+            return -1;
+        const LightState& state = lightStates[lightIndex];
+        for (uint32_t tile = state.firstTile; tile < state.firstTile + state.tileCount; tile++)
+        {
+            if (!tileStates[tile].rendered)
+                return -1;
+        }
+        return static_cast<int32_t>(state.firstTile);
+    }
+}
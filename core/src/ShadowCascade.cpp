@@ -0,0 +1,122 @@
+﻿#include <ShadowCascade.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace vks
+{
+    void ComputeCascadeSplits(float nearPlane, float farPlane, uint32_t cascadeCount, float lambda,
+                              std::vector<float>& splitDepths)
+    {
+        splitDepths.resize(cascadeCount);
+        for (uint32_t i = 0; i < cascadeCount; i++)
+        {
+            float p = static_cast<float>(i + 1) / static_cast<float>(cascadeCount);
+            float logSplit = nearPlane * std::pow(farPlane / nearPlane, p);
+            float uniformSplit = nearPlane + (farPlane - nearPlane) * p;
+            splitDepths[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+        }
+    }
+
+    void FitShadowCascades(const glm::mat4& invViewProjection, float nearPlane, float farPlane,
+                           const std::vector<float>& splitDepths, const glm::vec3& lightDirection,
+                           const glm::vec3& sceneMin, const glm::vec3& sceneMax, uint32_t resolution, bool stable,
+                           uint32_t snapTexels, std::vector<ShadowCascade>& cascades)
+    {
+        // rotation only light view, texel snapping needs a light space that does not follow the camera
+        glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+
+        // camera frustum edges from the near to the far plane
+        glm::vec3 nearCorners[4], farCorners[4];
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            glm::vec2 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f);
+            glm::vec4 nearCorner = invViewProjection * glm::vec4(ndc, 0.0f, 1.0f);
+            glm::vec4 farCorner = invViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+            nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+            farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+        }
+
+        glm::vec3 sceneLightMin(FLT_MAX), sceneLightMax(-FLT_MAX);
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            glm::vec3 corner((i & 1) ? sceneMax.x : sceneMin.x, (i & 2) ? sceneMax.y : sceneMin.y,
+                             (i & 4) ? sceneMax.z : sceneMin.z);
+            glm::vec3 p = glm::vec3(lightView * glm::vec4(corner, 1.0f));
+            sceneLightMin = glm::min(sceneLightMin, p);
+            sceneLightMax = glm::max(sceneLightMax, p);
+        }
+
+        cascades.resize(splitDepths.size());
+        float splitNear = nearPlane;
+        for (size_t c = 0; c < splitDepths.size(); c++)
+        {
+            float splitFar = splitDepths[c];
+            // view depth is linear along each frustum edge
+            float t0 = (splitNear - nearPlane) / (farPlane - nearPlane);
+            float t1 = (splitFar - nearPlane) / (farPlane - nearPlane);
+
+            glm::vec3 corners[8];
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                corners[i] = glm::mix(nearCorners[i], farCorners[i], t0);
+                corners[i + 4] = glm::mix(nearCorners[i], farCorners[i], t1);
+            }
+
+            glm::vec3 lightMin(FLT_MAX), lightMax(-FLT_MAX);
+            glm::vec2 texelSize;
+            if (stable)
+            {
+                glm::vec3 center(0.0f);
+                for (const glm::vec3& corner : corners)
+                    center += corner / 8.0f;
+                float radius = 0.0f;
+                for (const glm::vec3& corner : corners)
+                    radius = std::max(radius, glm::distance(corner, center));
+                radius = std::ceil(radius * 16.0f) / 16.0f;
+
+                // the window is one snap step wider than the sphere so flooring its origin never uncovers the split
+                const float steps = static_cast<float>(std::min(std::max(snapTexels, 1u), resolution / 2));
+                const float size = 2.0f * radius * static_cast<float>(resolution) / (static_cast<float>(resolution) - steps);
+                texelSize = glm::vec2(size / static_cast<float>(resolution));
+                const float snap = steps * texelSize.x;
+
+                // move the fixed size window, depth included, in whole snap steps only
+                glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+                lightMin = glm::floor((lightCenter - glm::vec3(radius)) / snap) * snap;
+                lightMax = lightMin + glm::vec3(size);
+            }
+            else
+            {
+                for (const glm::vec3& corner : corners)
+                {
+                    glm::vec3 p = glm::vec3(lightView * glm::vec4(corner, 1.0f));
+                    lightMin = glm::min(lightMin, p);
+                    lightMax = glm::max(lightMax, p);
+                }
+                texelSize = (glm::vec2(lightMax) - glm::vec2(lightMin)) / static_cast<float>(resolution);
+
+                glm::vec2 snappedMin = glm::floor(glm::vec2(lightMin) / texelSize) * texelSize;
+                glm::vec2 snappedMax = glm::ceil(glm::vec2(lightMax) / texelSize) * texelSize;
+                lightMin = glm::vec3(snappedMin, lightMin.z);
+                lightMax = glm::vec3(snappedMax, lightMax.z);
+            }
+
+            // the light looks down -z, pull the near plane back to the scene's casters and
+            // clamp the far plane to the scene to keep depth precision
+            float maxZ = std::max(lightMax.z, sceneLightMax.z);
+            float minZ = std::max(lightMin.z, sceneLightMin.z);
+            if (maxZ - minZ < 1e-3f)
+                minZ = maxZ - 1e-3f;
+
+            glm::mat4 lightProjection = glm::ortho(lightMin.x, lightMax.x, lightMin.y, lightMax.y, -maxZ, -minZ);
+
+            cascades[c].viewProjection = lightProjection * lightView;
+            cascades[c].splitDepth = splitFar;
+            cascades[c].texelSize = std::max(texelSize.x, texelSize.y);
+            splitNear = splitFar;
+        }
+    }
+}
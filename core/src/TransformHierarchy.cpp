@@ -0,0 +1,100 @@
+﻿#include <TransformHierarchy.h>
+#include <MathUtils.h>
+#include <algorithm>
+
+namespace vks
+{
+    uint32_t TransformHierarchy::Add(uint32_t parent, const glm::vec3& translation, const glm::quat& rotation,
+                                     const glm::vec3& scale, const glm::mat4& matrix)
+    {
+        const uint32_t index = Size();
+        parents.push_back(parent);
+        translations.push_back(translation);
+        rotations.push_back(rotation);
+        scales.push_back(scale);
+        matrices.push_back(matrix);
+        localMatrices.emplace_back(1.0f);
+        worldMatrices.emplace_back(1.0f);
+        flags.push_back(0);
+        MarkChanged(index);
+        return index;
+    }
+
+    void TransformHierarchy::Clear()
+    {
+        parents.clear();
+        translations.clear();
+        rotations.clear();
+        scales.clear();
+        matrices.clear();
+        localMatrices.clear();
+        worldMatrices.clear();
+        flags.clear();
+        firstChanged = 0;
+    }
+
+    void TransformHierarchy::SetTranslation(uint32_t index, const glm::vec3& translation)
+    {
+        translations[index] = translation;
+        MarkChanged(index);
+    }
+
+    void TransformHierarchy::SetRotation(uint32_t index, const glm::quat& rotation)
+    {
+        rotations[index] = rotation;
+        MarkChanged(index);
+    }
+
+    void TransformHierarchy::SetScale(uint32_t index, const glm::vec3& scale)
+    {
+        scales[index] = scale;
+        MarkChanged(index);
+    }
+
+    void TransformHierarchy::MarkChanged(uint32_t index)
+    {
+        flags[index] |= LOCAL_CHANGED | WORLD_CHANGED;
+        firstChanged = std::min(firstChanged, index);
+    }
+
+    uint32_t TransformHierarchy::Update()
+    {
+        const uint32_t count = Size();
+        uint32_t updateCount = 0;
+        for (uint32_t i = firstChanged; i < count; i++)
+        {
+            // the parent's flags are final, it precedes its children
+            const uint32_t parent = parents[i];
+            if (parent != NO_PARENT && (flags[parent] & WORLD_CHANGED))
+                flags[i] |= WORLD_CHANGED;
+            if (!flags[i])
+                continue;
+
+            if (flags[i] & LOCAL_CHANGED)
+            {
+                // translate * rotate * scale without the full products
+                const glm::mat3 rotation = glm::mat3_cast(rotations[i]);
+                const glm::mat4 trs(glm::vec4(rotation[0] * scales[i].x, 0.0f), glm::vec4(rotation[1] * scales[i].y, 0.0f),
+                                    glm::vec4(rotation[2] * scales[i].z, 0.0f), glm::vec4(translations[i], 1.0f));
+                math::MultiplyMat4(trs, matrices[i], localMatrices[i]);
+            }
+            if (parent == NO_PARENT)
+                worldMatrices[i] = localMatrices[i];
+            else
+                math::MultiplyMat4(worldMatrices[parent], localMatrices[i], worldMatrices[i]);
+            updateCount++;
+        }
+        // the flags are only cleared after the pass, the children read their parent's
+        if (firstChanged < count)
+            std::fill(flags.begin() + firstChanged, flags.end(), 0);
+        firstChanged = count;
+        return updateCount;
+    }
+
+    void TransformHierarchy::UpdateAll()
+    {
+        std::fill(flags.begin(), flags.end(), static_cast<uint8_t>(LOCAL_CHANGED | WORLD_CHANGED));
+        firstChanged = 0;
+        Update();
+    }
+}
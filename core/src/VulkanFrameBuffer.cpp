@@ -44,6 +44,9 @@ namespace vks
 
         for (auto attachment : attachments)
         {
+            if (attachment.shared)
+                continue;
+
             if(attachment.image != VK_NULL_HANDLE)
                 vkDestroyImage(vulkanDevice->logicalDevice, attachment.image, nullptr);
 
@@ -65,6 +68,7 @@ namespace vks
 		attachment.name = attachmentDescription->name;
 		attachment.binding = attachmentDescription->binding;
 		attachment.format = attachmentDescription->format;
+		attachment.usage = attachmentDescription->usage;
 
 		VkImageAspectFlags aspectMask = VK_FLAGS_NONE;
 
@@ -104,7 +108,17 @@ namespace vks
 		CheckVulkanResult(vkCreateImage(vulkanDevice->logicalDevice, &image, nullptr, &attachment.image));
 		vkGetImageMemoryRequirements(vulkanDevice->logicalDevice, attachment.image, &memReqs);
 		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		attachment.memorySize = memReqs.size;
+		// transient attachments only need memory when the implementation cannot keep them on chip,
+		// devices without lazily allocated memory back them with device local memory
+		VkBool32 lazyMemoryFound = VK_FALSE;
+		if (attachmentDescription->usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+			memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits,
+				VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemoryFound);
+		if (lazyMemoryFound)
+			attachment.lazilyAllocated = true;
+		else
+			memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 		CheckVulkanResult(vkAllocateMemory(vulkanDevice->logicalDevice, &memAlloc, nullptr, &attachment.memory));
 		CheckVulkanResult(vkBindImageMemory(vulkanDevice->logicalDevice, attachment.image, attachment.memory, 0));
 
@@ -129,6 +143,16 @@ namespace vks
 		return static_cast<uint32_t>(attachments.size() - 1);
 	}
 
+	uint32_t FrameBuffer::AddSharedAttachment(const FramebufferAttachment& sharedAttachment)
+	{
+		FramebufferAttachment attachment = sharedAttachment;
+		attachment.shared = true;
+		attachment.descriptorSet = VK_NULL_HANDLE;
+		attachments.push_back(attachment);
+
+		return static_cast<uint32_t>(attachments.size() - 1);
+	}
+
     const FramebufferAttachment& FrameBuffer::GetAttachment(const std::string &attachmentName)
     {
         auto res = std::find_if(attachments.begin(), attachments.end(),[&](const FramebufferAttachment& framebufferAttachment)
@@ -167,6 +191,8 @@ namespace vks
 
 			bool isDepthStencil = attachment.HasDepth() || attachment.HasStencil();
 			if(skipDepthStencil && isDepthStencil) continue;
+			// transient attachments only live within their render pass
+			if(!(attachment.usage & VK_IMAGE_USAGE_SAMPLED_BIT)) continue;
 
 			CheckVulkanResult(vkAllocateDescriptorSets(vulkanDevice->logicalDevice, &allocInfo, &attachment.descriptorSet));
 			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::WriteDescriptorSet(attachment.descriptorSet,
@@ -217,9 +243,18 @@ namespace vks
 		{
 			FrameBuffer* frameBuffer = GetFrameBuffer(i);
 
-			// create instanced attachment
+			// create instanced attachment, or use the one of the same frame in the shared frame buffer,
+			// or the one of the first frame when all frames share it
 			for(auto& attachmentDescription:attachmentDescriptions)
-				frameBuffer->CreateAttachment(attachmentDescription);
+			{
+				if (attachmentDescription->sharedFrameBuffer != nullptr)
+					frameBuffer->AddSharedAttachment(attachmentDescription->sharedFrameBuffer->GetFrameBuffer(i)->GetAttachment(
+						attachmentDescription->name));
+				else if (attachmentDescription->sharedAcrossFrames && i > 0)
+					frameBuffer->AddSharedAttachment(GetFrameBuffer(0)->GetAttachment(attachmentDescription->name));
+				else
+					frameBuffer->CreateAttachment(attachmentDescription);
+			}
 
 			// create attachment view
 			std::vector<VkImageView> attachmentViews(frameBuffer->attachments.size());
@@ -284,4 +319,25 @@ namespace vks
 			frameBuffers[i]->CreateAttachmentDescriptorSet(sampler, skipDepthStencil);
 	}
 
+	VkDeviceSize VulkanFrameBuffer::MemorySize() const
+	{
+		VkDeviceSize size = 0;
+		for (const FrameBuffer* frameBuffer : frameBuffers)
+			for (const FramebufferAttachment& attachment : frameBuffer->attachments)
+				if (!attachment.shared)
+					size += attachment.memorySize;
+		return size;
+	}
+
+	VkDeviceSize VulkanFrameBuffer::PerFrameMemorySize() const
+	{
+		// the first frame owns every attachment that is not shared with another frame buffer
+		VkDeviceSize size = 0;
+		if (frameBufferCount > 0)
+			for (const FramebufferAttachment& attachment : frameBuffers[0]->attachments)
+				if (!attachment.shared)
+					size += attachment.memorySize;
+		return size * frameBufferCount;
+	}
+
 }
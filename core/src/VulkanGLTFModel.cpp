@@ -8,6 +8,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <malloc.h>
+#include <array>
 
 #ifdef WIN32
 #undef min
@@ -17,7 +18,6 @@
 namespace vks {
     namespace geometry {
         VkDescriptorSetLayout descriptorSetLayoutImage = VK_NULL_HANDLE;
-        VkDescriptorSetLayout descriptorSetLayoutUbo = VK_NULL_HANDLE;
         VkMemoryPropertyFlags memoryPropertyFlags = 0;
 
         void LoadTextureFromGLTFImage(Texture *texture, tinygltf::Image &gltfImage, std::string path,
@@ -524,65 +524,18 @@ namespace vks {
             dimensions.radius = glm::distance(min, max) / 2.0f;
         }
 
-        VulkanGLTFModel::Mesh::Mesh(vks::VulkanDevice *device, glm::mat4 matrix) {
+        VulkanGLTFModel::Mesh::Mesh(vks::VulkanDevice *device) {
             this->device = device;
-            this->uniformBlock.matrix = matrix;
-            CheckVulkanResult(device->CreateBuffer(
-                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    sizeof(uniformBlock),
-                    &uniformBuffer.buffer,
-                    &uniformBuffer.memory,
-                    &uniformBlock));
-            CheckVulkanResult(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0,
-                                          &uniformBuffer.mapped));
-            uniformBuffer.descriptor = {uniformBuffer.buffer, 0, sizeof(uniformBlock)};
         };
 
         VulkanGLTFModel::Mesh::~Mesh() {
-            vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-            vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
             for (auto primitive: primitives) {
                 delete primitive;
             }
         }
 
-        glm::mat4 VulkanGLTFModel::Node::LocalMatrix() {
-            return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) *
-                   glm::scale(glm::mat4(1.0f), scale) * matrix;
-        }
-
-        glm::mat4 VulkanGLTFModel::Node::GetMatrix() {
-            glm::mat4 m = LocalMatrix();
-            VulkanGLTFModel::Node *p = parent;
-            while (p) {
-                m = p->LocalMatrix() * m;
-                p = p->parent;
-            }
-            return m;
-        }
-
-        void VulkanGLTFModel::Node::Update() {
-            if (mesh) {
-                glm::mat4 m = GetMatrix();
-                if (skin) {
-                    mesh->uniformBlock.matrix = m;
-                    // Update join matrices
-                    glm::mat4 inverseTransform = glm::inverse(m);
-                    for (size_t i = 0; i < skin->joints.size(); i++) {
-                        VulkanGLTFModel::Node *jointNode = skin->joints[i];
-                        glm::mat4 jointMat = jointNode->GetMatrix() * skin->inverseBindMatrices[i];
-                        jointMat = inverseTransform * jointMat;
-                        mesh->uniformBlock.jointMatrix[i] = jointMat;
-                    }
-                    mesh->uniformBlock.jointcount = (float) skin->joints.size();
-                    memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-                } else
-                    memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
-            }
-
-            for (auto &child: children)
-                child->Update();
+        const glm::mat4 &VulkanGLTFModel::Node::GetMatrix() const {
+            return transforms->GetWorldMatrix(transformIndex);
         }
 
         VulkanGLTFModel::Node::~Node() {
@@ -601,6 +554,9 @@ namespace vks {
             vkFreeMemory(vulkanDevice->logicalDevice, vertices.memory, nullptr);
             vkDestroyBuffer(vulkanDevice->logicalDevice, indices.buffer, nullptr);
             vkFreeMemory(vulkanDevice->logicalDevice, indices.memory, nullptr);
+            indirectDraws.recordBuffer.Destroy();
+            indirectDraws.batchBuffer.Destroy();
+            objects.buffer.Destroy();
 
 //            for (Texture image: textures)
 //                image.Destroy();
@@ -611,10 +567,6 @@ namespace vks {
             for (auto skin: skins)
                 delete skin;
 
-            if (descriptorSetLayoutUbo != VK_NULL_HANDLE) {
-                vkDestroyDescriptorSetLayout(vulkanDevice->logicalDevice, descriptorSetLayoutUbo, nullptr);
-                descriptorSetLayoutUbo = VK_NULL_HANDLE;
-            }
             if (descriptorSetLayoutImage != VK_NULL_HANDLE) {
                 vkDestroyDescriptorSetLayout(vulkanDevice->logicalDevice, descriptorSetLayoutImage, nullptr);
                 descriptorSetLayoutImage = VK_NULL_HANDLE;
@@ -726,9 +678,21 @@ namespace vks {
                 else
                     light.color = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
                 light.intensity = static_cast<float>(gltfLight.intensity);
+                light.range = static_cast<float>(gltfLight.range);
                 light.position = math::GetTranslateFromTransformMatrix(lightNode->GetMatrix());
-                if (fileLoadingFlags & FileLoadingFlags::FlipY)
+                // lights point down the node's -z axis
+                light.direction = glm::normalize(glm::mat3(lightNode->GetMatrix()) * glm::vec3(0.0f, 0.0f, -1.0f));
+                if (fileLoadingFlags & FileLoadingFlags::FlipY) {
                     light.position.y *= -1;
+                    light.direction.y *= -1;
+                }
+                if (gltfLight.type == "spot") {
+                    light.type = Light::LIGHTTYPE_SPOT;
+                    light.innerConeAngle = static_cast<float>(gltfLight.spot.innerConeAngle);
+                    light.outerConeAngle = static_cast<float>(gltfLight.spot.outerConeAngle);
+                } else if (gltfLight.type == "directional") {
+                    light.type = Light::LIGHTTYPE_DIRECTIONAL;
+                }
                 lights.push_back(light);
             }
         }
@@ -741,30 +705,31 @@ namespace vks {
             newNode->parent = parent;
             newNode->name = node.name;
             newNode->skinIndex = node.skin;
-            newNode->matrix = glm::mat4(1.0f);
 
             // Generate local node matrix
             glm::vec3 translation = glm::vec3(0.0f);
             if (node.translation.size() == 3) {
                 translation = glm::make_vec3(node.translation.data());
-                newNode->translation = translation;
             }
-            glm::mat4 rotation = glm::mat4(1.0f);
+            glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
             if (node.rotation.size() == 4) {
-                glm::quat q = glm::make_quat(node.rotation.data());
-                newNode->rotation = glm::mat4(q);
+                rotation = glm::make_quat(node.rotation.data());
             }
             glm::vec3 scale = glm::vec3(1.0f);
             if (node.scale.size() == 3) {
                 scale = glm::make_vec3(node.scale.data());
-                newNode->scale = scale;
             }
+            glm::mat4 matrix = glm::mat4(1.0f);
             if (node.matrix.size() == 16) {
-                newNode->matrix = glm::make_mat4x4(node.matrix.data());
+                matrix = glm::make_mat4x4(node.matrix.data());
                 if (globalScale != 1.0f) {
-                    newNode->matrix = glm::scale(newNode->matrix, glm::vec3(globalScale));
+                    matrix = glm::scale(matrix, glm::vec3(globalScale));
                 }
             }
+            // added before the children, so the transforms stay in topological order
+            newNode->transforms = &transforms;
+            newNode->transformIndex = transforms.Add(parent ? parent->transformIndex : TransformHierarchy::NO_PARENT,
+                                                     translation, rotation, scale, matrix);
 
             // Node with children
             if (node.children.size() > 0) {
@@ -777,7 +742,7 @@ namespace vks {
             // Node contains mesh data
             if (node.mesh > -1) {
                 const tinygltf::Mesh mesh = model.meshes[node.mesh];
-                Mesh *newMesh = new Mesh(vulkanDevice, newNode->matrix);
+                Mesh *newMesh = new Mesh(vulkanDevice);
                 newMesh->name = mesh.name;
                 for (size_t j = 0; j < mesh.primitives.size(); j++) {
                     const tinygltf::Primitive &primitive = mesh.primitives[j];
@@ -1177,6 +1142,8 @@ namespace vks {
                 const tinygltf::Node node = glTFInput.nodes[scene.nodes[i]];
                 LoadNode(nullptr, node, scene.nodes[i], glTFInput, indexBuffer, vertexBuffer, scale);
             }
+            // world matrices of the initial pose, read by the lights, bounds and pre-transformed vertices
+            transforms.Update();
              LoadAnimations(glTFInput);
              LoadSkins(glTFInput);
 
@@ -1187,11 +1154,9 @@ namespace vks {
                 if (node->skinIndex > -1) {
                     node->skin = skins[node->skinIndex];
                 }
-                // Initial pose
-                if (node->mesh) {
-                    node->Update();
-                }
             }
+            // no motion in the first frame
+            StorePreviousMatrices();
 
             // change uv to vulkan style (custom)
             for (uint32_t i = 0; i < vertexBuffer.size(); i++) {
@@ -1257,6 +1222,11 @@ namespace vks {
                     std::swap(indexBuffer[i], indexBuffer[i + 2]);
             }
 
+            vertexPositions.resize(vertexBuffer.size());
+            for (size_t i = 0; i < vertexBuffer.size(); i++)
+                vertexPositions[i] = vertexBuffer[i].pos;
+            triangleIndices = indexBuffer;
+
             struct StagingBuffer {
                 VkBuffer buffer;
                 VkDeviceMemory memory;
@@ -1322,14 +1292,16 @@ namespace vks {
             vkFreeMemory(vulkanDevice->logicalDevice, indexStaging.memory, nullptr);
 
             GetSceneDimensions();
+            UpdateWorldBounds();
+            MarkDynamicNodes();
+            dynamicBounds.clear();
+            for (uint32_t i = 0; i < boundsNodes.size(); i++) {
+                if (boundsNodes[i]->dynamic)
+                    dynamicBounds.push_back(i);
+            }
+            bvh.Build(worldBounds);
             // Setup descriptors
-            uint32_t uboCount{0};
             uint32_t imageCount{0};
-            for (auto node: linearNodes) {
-                if (node->mesh) {
-                    uboCount++;
-                }
-            }
             for (auto material: materials) {
                 if (material.baseColorTexture != nullptr) {
                     imageCount++;
@@ -1348,27 +1320,6 @@ namespace vks {
             CheckVulkanResult(
                     vkCreateDescriptorPool(vulkanDevice->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
 
-            // Descriptors for per-node uniform buffers
-            {
-                // Layout is global, so only create if it hasn't already been created before
-                if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
-                    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-                            vks::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                                                          VK_SHADER_STAGE_VERTEX_BIT, 0),
-                    };
-                    VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-                    descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-                    descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-                    descriptorLayoutCI.pBindings = setLayoutBindings.data();
-                    CheckVulkanResult(
-                            vkCreateDescriptorSetLayout(vulkanDevice->logicalDevice, &descriptorLayoutCI, nullptr,
-                                                        &descriptorSetLayoutUbo));
-                }
-                for (auto node: nodes) {
-                    PrepareNodeDescriptor(node, descriptorSetLayoutUbo);
-                }
-            }
-
             // Descriptors for per-material images
             {
                 // Layout is global, so only create if it hasn't already been created before
@@ -1427,45 +1378,269 @@ namespace vks {
         /*
             glTF rendering functions
         */
+        // alpha mode filter of the RenderFlags
+        static bool SkipMaterial(const Material &material, uint32_t renderFlags) {
+            bool skip = false;
+            if (renderFlags & RenderFlags::RenderOpaqueNodes) {
+                skip = (material.alphaMode != Material::ALPHAMODE_OPAQUE);
+            }
+            if (renderFlags & RenderFlags::RenderAlphaMaskedNodes) {
+                skip = (material.alphaMode != Material::ALPHAMODE_MASK);
+            }
+            if (renderFlags & RenderFlags::RenderAlphaBlendedNodes) {
+                skip = (material.alphaMode != Material::ALPHAMODE_BLEND);
+            }
+            return skip;
+        }
+
         // Draw a single node including child nodes (if present)
         void VulkanGLTFModel::DrawNode(Node *node, VkCommandBuffer commandBuffer, bool pushConstant, uint32_t renderFlags,
-                                  VkPipelineLayout pipelineLayout, uint32_t bindImageSet) {
-            if (node->mesh) {
-                if (node->mesh->primitives.size() > 0) {
-                    auto nodeMatrix = node->GetMatrix();
+                                  VkPipelineLayout pipelineLayout, uint32_t bindImageSet, const uint8_t* visibility) {
+            bool filtered = ((renderFlags & RenderFlags::RenderStaticNodes) && node->dynamic) ||
+                            ((renderFlags & RenderFlags::RenderDynamicNodes) && !node->dynamic);
+            // the object index is pushed per primitive instead
+            const bool pushObjectIndex = pushConstant && (renderFlags & RenderFlags::PushObjectIndex);
+            if (node->mesh && !filtered) {
+                auto nodeMatrix = node->GetMatrix();
+                if (node->mesh->primitives.size() > 0 && !pushObjectIndex) {
                     glm::mat4 idMat = glm::mat4(1.0f);
                     // Pass the final matrix to the vertex shader using push constants
                     // vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &idMat);
-                    if (pushConstant)
+                    if (pushConstant && (renderFlags & RenderFlags::PushPreviousMatrix)) {
+                        const std::array<glm::mat4, 2> matrices = {nodeMatrix, node->previousMatrix};
+                        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                                           sizeof(matrices), matrices.data());
+                    }
+                    else if (pushConstant)
                         vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
                                            sizeof(glm::mat4), &nodeMatrix);
                 }
                 for (Primitive *primitive: node->mesh->primitives) {
-                    bool skip = false;
                     const Material &material = primitive->material;
-                    if (renderFlags & RenderFlags::RenderOpaqueNodes) {
-                        skip = (material.alphaMode != Material::ALPHAMODE_OPAQUE);
-                    }
-                    if (renderFlags & RenderFlags::RenderAlphaMaskedNodes) {
-                        skip = (material.alphaMode != Material::ALPHAMODE_MASK);
-                    }
-                    if (renderFlags & RenderFlags::RenderAlphaBlendedNodes) {
-                        skip = (material.alphaMode != Material::ALPHAMODE_BLEND);
+                    bool skip = SkipMaterial(material, renderFlags);
+                    if (!skip && visibility && !visibility[primitive->boundsIndex]) {
+                        drawStatistics.culledCount++;
+                        skip = true;
                     }
                     if (!skip) {
+                        drawStatistics.drawCount++;
+                        drawStatistics.indexCount += primitive->indexCount;
                         if (renderFlags & RenderFlags::BindImages) {
                             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
                                                     bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+                            drawStatistics.descriptorBindCount++;
                         }
+                        if (pushObjectIndex)
+                            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                                               sizeof(uint32_t), &primitive->boundsIndex);
                         vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
                     }
                 }
             }
             for (auto &child: node->children) {
-                DrawNode(child, commandBuffer, pushConstant, renderFlags, pipelineLayout, bindImageSet);
+                DrawNode(child, commandBuffer, pushConstant, renderFlags, pipelineLayout, bindImageSet, visibility);
+            }
+        }
+
+        void VulkanGLTFModel::StorePreviousMatrices() {
+            for (Node *node: linearNodes) {
+                node->previousMatrix = node->GetMatrix();
+            }
+        }
+
+        void VulkanGLTFModel::UpdateWorldBounds() {
+            size_t primitiveCount = 0;
+            for (Node *node: linearNodes) {
+                if (node->mesh)
+                    primitiveCount += node->mesh->primitives.size();
+            }
+            worldBounds.Resize(primitiveCount);
+            boundsNodes.resize(primitiveCount);
+            boundsPrimitives.resize(primitiveCount);
+            uint32_t boundsIndex = 0;
+            for (Node *node: linearNodes) {
+                if (!node->mesh)
+                    continue;
+                const glm::mat4 nodeMatrix = node->GetMatrix();
+                for (Primitive *primitive: node->mesh->primitives) {
+                    glm::vec3 worldMin, worldMax;
+                    math::TransformAABB(nodeMatrix, primitive->dimensions.min, primitive->dimensions.max, worldMin, worldMax);
+                    primitive->boundsIndex = boundsIndex;
+                    boundsNodes[boundsIndex] = node;
+                    boundsPrimitives[boundsIndex] = primitive;
+                    worldBounds.Set(boundsIndex++, worldMin, worldMax);
+                }
+            }
+        }
+
+        void VulkanGLTFModel::CullPrimitives(const math::Frustum& frustum, std::vector<uint8_t>& visible) const {
+            if (bvhCulling) {
+                bvh.QueryFrustum(frustum, visible);
+                return;
+            }
+            visible.resize(worldBounds.Size());
+            frustum.IntersectsAABBs(worldBounds, visible.data());
+        }
+
+        void VulkanGLTFModel::CullPrimitives(const glm::vec3& center, float radius, std::vector<uint8_t>& visible) const {
+            bvh.QuerySphere(center, radius, visible);
+        }
+
+        void VulkanGLTFModel::CullPrimitives(const math::Frustum& frustum, const std::vector<uint8_t>& candidates,
+                                             std::vector<uint8_t>& visible) const {
+            visible.resize(worldBounds.Size());
+            for (size_t i = 0; i < worldBounds.Size(); i++) {
+                visible[i] = candidates[i] &&
+                             frustum.IntersectsAABB(glm::vec3(worldBounds.minX[i], worldBounds.minY[i], worldBounds.minZ[i]),
+                                                    glm::vec3(worldBounds.maxX[i], worldBounds.maxY[i], worldBounds.maxZ[i]))
+                                 ? 1 : 0;
+            }
+        }
+
+        bool VulkanGLTFModel::Raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const {
+            auto intersectPrimitive = [&](uint32_t boundsIndex, float maxDistance) {
+                const Primitive *primitive = boundsPrimitives[boundsIndex];
+                // an affine transform keeps the ray parameter, distances in node space compare with world space ones
+                const glm::mat4 inverseMatrix = glm::inverse(boundsNodes[boundsIndex]->GetMatrix());
+                const glm::vec3 localOrigin = glm::vec3(inverseMatrix * glm::vec4(origin, 1.0f));
+                const glm::vec3 localDirection = glm::vec3(inverseMatrix * glm::vec4(direction, 0.0f));
+                float closest = -1.0f;
+                for (uint32_t i = primitive->firstIndex; i + 2 < primitive->firstIndex + primitive->indexCount; i += 3) {
+                    float distance;
+                    if (math::IntersectRayTriangle(localOrigin, localDirection, vertexPositions[triangleIndices[i]],
+                                                   vertexPositions[triangleIndices[i + 1]],
+                                                   vertexPositions[triangleIndices[i + 2]], distance) &&
+                        distance <= maxDistance) {
+                        maxDistance = distance;
+                        closest = distance;
+                    }
+                }
+                return closest;
+            };
+            uint32_t hitIndex = 0;
+            float hitDistance = 0.0f;
+            if (!bvh.Raycast(origin, direction, std::numeric_limits<float>::max(), intersectPrimitive, hitIndex, hitDistance))
+                return false;
+            hit.node = boundsNodes[hitIndex];
+            hit.primitive = boundsPrimitives[hitIndex];
+            hit.distance = hitDistance;
+            hit.position = origin + direction * hitDistance;
+            return true;
+        }
+
+        void VulkanGLTFModel::PrepareIndirectDraws() {
+            std::vector<DrawRecord> records;
+            std::vector<uint32_t> recordMaterials;
+            std::vector<bool> recordDynamic;
+            for (Node *node: linearNodes) {
+                if (!node->mesh || node->mesh->primitives.empty())
+                    continue;
+                for (Primitive *primitive: node->mesh->primitives) {
+                    DrawRecord record{};
+                    record.boundsMin = glm::vec4(primitive->dimensions.min, 1.0f);
+                    record.boundsMax = glm::vec4(primitive->dimensions.max, 1.0f);
+                    record.firstIndex = primitive->firstIndex;
+                    record.indexCount = primitive->indexCount;
+                    record.objectIndex = primitive->boundsIndex;
+                    records.push_back(record);
+                    recordMaterials.push_back(static_cast<uint32_t>(&primitive->material - materials.data()));
+                    recordDynamic.push_back(node->dynamic);
+                }
+            }
+
+            // the camera's commands are grouped by material, the casters' by static and dynamic nodes
+            std::vector<uint32_t> materialRecordCounts(materials.size(), 0);
+            uint32_t staticCount = 0;
+            for (uint32_t i = 0; i < records.size(); i++) {
+                materialRecordCounts[recordMaterials[i]]++;
+                staticCount += recordDynamic[i] ? 0 : 1;
+            }
+            indirectDraws.batches.clear();
+            std::vector<uint32_t> materialBatches(materials.size(), 0);
+            uint32_t firstCommand = 0;
+            for (uint32_t i = 0; i < materials.size(); i++) {
+                if (materialRecordCounts[i] == 0)
+                    continue;
+                materialBatches[i] = static_cast<uint32_t>(indirectDraws.batches.size());
+                indirectDraws.batches.push_back({&materials[i], firstCommand, materialRecordCounts[i]});
+                firstCommand += materialRecordCounts[i];
+            }
+            indirectDraws.materialBatchCount = static_cast<uint32_t>(indirectDraws.batches.size());
+            indirectDraws.recordCount = static_cast<uint32_t>(records.size());
+            indirectDraws.batches.push_back({nullptr, 0, staticCount});
+            indirectDraws.batches.push_back({nullptr, staticCount, indirectDraws.recordCount - staticCount});
+            for (uint32_t i = 0; i < records.size(); i++) {
+                records[i].materialBatch = materialBatches[recordMaterials[i]];
+                records[i].casterBatch = CasterBatch(recordDynamic[i]);
+            }
+
+            std::vector<glm::uvec2> batchRanges;
+            for (const IndirectBatch &batch: indirectDraws.batches)
+                batchRanges.emplace_back(batch.firstCommand, batch.commandCount);
+
+            // records and batches never change, they are copied to device local memory once
+            auto upload = [&](vks::Buffer &buffer, void *data, VkDeviceSize size) {
+                vks::Buffer staging;
+                CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                             &staging, size, data));
+                CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, size));
+                vulkanDevice->CopyBuffer(&staging, &buffer, copyQueue);
+                staging.Destroy();
+            };
+            indirectDraws.recordBuffer.Destroy();
+            indirectDraws.batchBuffer.Destroy();
+            upload(indirectDraws.recordBuffer, records.data(), std::max<size_t>(records.size(), 1) * sizeof(DrawRecord));
+            upload(indirectDraws.batchBuffer, batchRanges.data(), batchRanges.size() * sizeof(glm::uvec2));
+        }
+
+        void VulkanGLTFModel::WriteObject(uint32_t boundsIndex, ObjectData &object) const {
+            const Node *node = boundsNodes[boundsIndex];
+            object.model = node->GetMatrix();
+            object.previousModel = node->previousMatrix;
+            // once per object instead of once per vertex
+            const glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(object.model));
+            for (int column = 0; column < 3; column++)
+                object.normalMatrix[column] = glm::vec4(normalMatrix[column], 0.0f);
+            object.materialIndex = static_cast<uint32_t>(&boundsPrimitives[boundsIndex]->material - materials.data());
+        }
+
+        void VulkanGLTFModel::PrepareObjects(uint32_t frameCount) {
+            const VkDeviceSize alignment = std::max<VkDeviceSize>(
+                    vulkanDevice->properties.limits.minStorageBufferOffsetAlignment, 16);
+            auto align = [alignment](VkDeviceSize size) { return (size + alignment - 1) / alignment * alignment; };
+            objects.frameCount = frameCount;
+            objects.frameStride = align(std::max<VkDeviceSize>(boundsPrimitives.size(), 1) * sizeof(ObjectData));
+            objects.buffer.Destroy();
+            CheckVulkanResult(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                         &objects.buffer, objects.frameStride * frameCount));
+            CheckVulkanResult(objects.buffer.Map());
+
+            // static objects are written once, UpdateObjects only rewrites the dynamic ones
+            for (uint32_t frame = 0; frame < frameCount; frame++) {
+                uint8_t *section = static_cast<uint8_t *>(objects.buffer.mapped) + frame * objects.frameStride;
+                ObjectData *frameObjects = reinterpret_cast<ObjectData *>(section);
+                for (uint32_t i = 0; i < boundsPrimitives.size(); i++)
+                    WriteObject(i, frameObjects[i]);
             }
         }
 
+        void VulkanGLTFModel::UpdateObjects(uint32_t frame) {
+            uint8_t *section = static_cast<uint8_t *>(objects.buffer.mapped) + frame * objects.frameStride;
+            ObjectData *frameObjects = reinterpret_cast<ObjectData *>(section);
+            for (uint32_t i: dynamicBounds)
+                WriteObject(i, frameObjects[i]);
+        }
+
+        VkDescriptorBufferInfo VulkanGLTFModel::ObjectDescriptor(uint32_t frame) const {
+            return {objects.buffer.buffer, frame * objects.frameStride, objects.frameStride};
+        }
+
         void VulkanGLTFModel::UpdateAnimation(uint32_t index, float time) {
             if (index > static_cast<uint32_t>(animations.size()) - 1) {
                 std::cout << "No animation with index " << index << std::endl;
@@ -1489,12 +1664,12 @@ namespace vks {
                             switch (channel.path) {
                                 case AnimationChannel::PathType::TRANSLATION: {
 //                                    glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-//                                    channel.node->translation = glm::vec3(trans);
+//                                    transforms.SetTranslation(channel.node->transformIndex, glm::vec3(trans));
                                     break;
                                 }
                                 case AnimationChannel::PathType::SCALE: {
 //                                    glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-//                                    channel.node->scale = glm::vec3(trans);
+//                                    transforms.SetScale(channel.node->transformIndex, glm::vec3(trans));
                                     break;
                                 }
                                 case AnimationChannel::PathType::ROTATION: {
@@ -1508,7 +1683,8 @@ namespace vks {
                                     q2.y = sampler.outputsVec4[i + 1].y;
                                     q2.z = sampler.outputsVec4[i + 1].z;
                                     q2.w = sampler.outputsVec4[i + 1].w;
-                                    channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
+                                    transforms.SetRotation(channel.node->transformIndex,
+                                                           glm::normalize(glm::slerp(q1, q2, u)));
                                     break;
                                 }
                             }
@@ -1518,23 +1694,148 @@ namespace vks {
                 }
             }
             if (updated) {
-                for (auto &node : nodes) {
-                    node->Update();
-                }
+                // only the animated subtrees are recomputed, UpdateObjects uploads them
+                transforms.Update();
+                UpdateWorldBounds();
+                bvh.Refit(worldBounds, dynamicBounds);
             }
         }
 
 
         // Draw the glTF scene starting at the top-level-nodes
         void VulkanGLTFModel::Draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant,
-                                   VkPipelineLayout pipelineLayout, uint32_t bindImageSet) {
+                                   VkPipelineLayout pipelineLayout, uint32_t bindImageSet, const math::Frustum* frustum) {
+            // all primitives are tested before the hierarchy is walked
+            if (frustum)
+                CullPrimitives(*frustum, primitiveVisibility);
+            DrawVisible(commandBuffer, renderFlags, pushConstant, pipelineLayout, bindImageSet,
+                        frustum ? primitiveVisibility.data() : nullptr);
+        }
+
+        void VulkanGLTFModel::Draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant,
+                                   VkPipelineLayout pipelineLayout, uint32_t bindImageSet,
+                                   const std::vector<uint8_t>& visibility) {
+            DrawVisible(commandBuffer, renderFlags, pushConstant, pipelineLayout, bindImageSet, visibility.data());
+        }
+
+        void VulkanGLTFModel::DrawVisible(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant,
+                                          VkPipelineLayout pipelineLayout, uint32_t bindImageSet,
+                                          const uint8_t* visibility) {
+            drawStatistics = {};
             if (!buffersBound) {
                 const VkDeviceSize offsets[1] = {0};
                 vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
                 vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
             }
             for (auto &node: nodes) {
-                DrawNode(node, commandBuffer, pushConstant, renderFlags, pipelineLayout, bindImageSet);
+                DrawNode(node, commandBuffer, pushConstant, renderFlags, pipelineLayout, bindImageSet, visibility);
+            }
+        }
+
+        void VulkanGLTFModel::DrawSorted(VkCommandBuffer commandBuffer, uint32_t renderFlags, bool pushConstant,
+                                         VkPipelineLayout pipelineLayout, uint32_t bindImageSet, const glm::mat4 &view,
+                                         const math::Frustum *frustum) {
+            drawStatistics = {};
+            if (frustum)
+                CullPrimitives(*frustum, primitiveVisibility);
+
+            // one key per visible primitive, the depth is the view space distance of its bounds' center
+            drawList.Clear();
+            const glm::vec3 viewDepthRow = -glm::vec3(view[0][2], view[1][2], view[2][2]);
+            for (uint32_t i = 0; i < static_cast<uint32_t>(boundsPrimitives.size()); i++) {
+                const Node *node = boundsNodes[i];
+                const Material &material = boundsPrimitives[i]->material;
+                const bool filtered = ((renderFlags & RenderFlags::RenderStaticNodes) && node->dynamic) ||
+                                      ((renderFlags & RenderFlags::RenderDynamicNodes) && !node->dynamic);
+                if (filtered || SkipMaterial(material, renderFlags))
+                    continue;
+                if (frustum && !primitiveVisibility[i]) {
+                    drawStatistics.culledCount++;
+                    continue;
+                }
+                const glm::vec3 center(worldBounds.minX[i] + worldBounds.maxX[i], worldBounds.minY[i] + worldBounds.maxY[i],
+                                       worldBounds.minZ[i] + worldBounds.maxZ[i]);
+                const float depth = glm::dot(viewDepthRow, center * 0.5f) - view[3][2];
+                if (material.alphaMode == Material::ALPHAMODE_BLEND)
+                    drawList.Add(DrawList::BlendedKey(depth), i);
+                else
+                    drawList.Add(DrawList::OpaqueKey(material.alphaMode,
+                                                     static_cast<uint32_t>(&material - materials.data()), depth), i);
+            }
+            drawList.Sort();
+
+            if (!buffersBound) {
+                const VkDeviceSize offsets[1] = {0};
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+                vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            }
+            const Node *lastNode = nullptr;
+            const Material *lastMaterial = nullptr;
+            for (const DrawList::Draw &draw: drawList.GetDraws()) {
+                Node *node = boundsNodes[draw.item];
+                const Primitive *primitive = boundsPrimitives[draw.item];
+                if (pushConstant && (renderFlags & RenderFlags::PushObjectIndex)) {
+                    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t),
+                                       &draw.item);
+                } else if (pushConstant && node != lastNode) {
+                    const std::array<glm::mat4, 2> matrices = {node->GetMatrix(), node->previousMatrix};
+                    const uint32_t size = (renderFlags & RenderFlags::PushPreviousMatrix) ? sizeof(matrices)
+                                                                                         : sizeof(glm::mat4);
+                    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, size,
+                                       matrices.data());
+                    lastNode = node;
+                }
+                if ((renderFlags & RenderFlags::BindImages) && &primitive->material != lastMaterial) {
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+                                            bindImageSet, 1, &primitive->material.descriptorSet, 0, nullptr);
+                    drawStatistics.descriptorBindCount++;
+                    lastMaterial = &primitive->material;
+                }
+                drawStatistics.drawCount++;
+                drawStatistics.indexCount += primitive->indexCount;
+                vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+            }
+        }
+
+        void VulkanGLTFModel::DrawIndirect(VkCommandBuffer commandBuffer, uint32_t renderFlags, uint32_t firstBatch,
+                                           uint32_t batchCount, VkBuffer indirectBuffer, VkDeviceSize commandOffset,
+                                           VkBuffer countBuffer, VkDeviceSize countOffset,
+                                           VkPipelineLayout pipelineLayout, uint32_t bindImageSet,
+                                           PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount,
+                                           const uint32_t *drawCounts) {
+            drawStatistics = {};
+            if (!buffersBound) {
+                const VkDeviceSize offsets[1] = {0};
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+                vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            }
+            const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+            for (uint32_t batch = firstBatch; batch < firstBatch + batchCount; batch++) {
+                const IndirectBatch &indirectBatch = indirectDraws.batches[batch];
+                if (indirectBatch.commandCount == 0)
+                    continue;
+                if (indirectBatch.material) {
+                    if (SkipMaterial(*indirectBatch.material, renderFlags))
+                        continue;
+                    if (renderFlags & RenderFlags::BindImages) {
+                        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+                                                bindImageSet, 1, &indirectBatch.material->descriptorSet, 0, nullptr);
+                        drawStatistics.descriptorBindCount++;
+                    }
+                }
+                if (drawCounts) {
+                    const uint32_t drawCount = std::min(drawCounts[batch], indirectBatch.commandCount);
+                    drawStatistics.drawCount += drawCount;
+                    drawStatistics.culledCount += indirectBatch.commandCount - drawCount;
+                }
+                const VkDeviceSize offset = commandOffset + indirectBatch.firstCommand * stride;
+                if (drawIndexedIndirectCount)
+                    drawIndexedIndirectCount(commandBuffer, indirectBuffer, offset, countBuffer,
+                                             countOffset + batch * sizeof(uint32_t), indirectBatch.commandCount,
+                                             static_cast<uint32_t>(stride));
+                else
+                    vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, offset, indirectBatch.commandCount,
+                                             static_cast<uint32_t>(stride));
             }
         }
 
@@ -1566,8 +1867,8 @@ namespace vks {
         void VulkanGLTFModel::GetNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max) {
             if (node->mesh) {
                 for (Primitive *primitive: node->mesh->primitives) {
-                    glm::vec4 locMin = glm::vec4(primitive->dimensions.min, 1.0f) * node->GetMatrix();
-                    glm::vec4 locMax = glm::vec4(primitive->dimensions.max, 1.0f) * node->GetMatrix();
+                    glm::vec3 locMin, locMax;
+                    math::TransformAABB(node->GetMatrix(), primitive->dimensions.min, primitive->dimensions.max, locMin, locMax);
                     if (locMin.x < min.x) { min.x = locMin.x; }
                     if (locMin.y < min.y) { min.y = locMin.y; }
                     if (locMin.z < min.z) { min.z = locMin.z; }
@@ -1581,28 +1882,42 @@ namespace vks {
             }
         }
 
-        void VulkanGLTFModel::PrepareNodeDescriptor(Node *node, VkDescriptorSetLayout descriptorSetLayout) {
-            if (node->mesh) {
-                VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-                descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-                descriptorSetAllocInfo.descriptorPool = descriptorPool;
-                descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-                descriptorSetAllocInfo.descriptorSetCount = 1;
-                CheckVulkanResult(vkAllocateDescriptorSets(vulkanDevice->logicalDevice, &descriptorSetAllocInfo,
-                                                           &node->mesh->uniformBuffer.descriptorSet));
-
-                VkWriteDescriptorSet writeDescriptorSet{};
-                writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-                writeDescriptorSet.descriptorCount = 1;
-                writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-                writeDescriptorSet.dstBinding = 0;
-                writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptor;
+        uint32_t VulkanGLTFModel::CountIndices(uint32_t renderFlags, const math::Frustum* frustum) const {
+            uint32_t indexCount = 0;
+            std::vector<uint8_t> visible;
+            if (frustum)
+                CullPrimitives(*frustum, visible);
+            for (Node *node: linearNodes) {
+                bool filtered = ((renderFlags & RenderFlags::RenderStaticNodes) && node->dynamic) ||
+                                ((renderFlags & RenderFlags::RenderDynamicNodes) && !node->dynamic);
+                if (!node->mesh || filtered)
+                    continue;
+                for (Primitive *primitive: node->mesh->primitives) {
+                    if (SkipMaterial(primitive->material, renderFlags))
+                        continue;
+                    if (frustum && !visible[primitive->boundsIndex])
+                        continue;
+                    indexCount += primitive->indexCount;
+                }
+            }
+            return indexCount;
+        }
 
-                vkUpdateDescriptorSets(vulkanDevice->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+        void VulkanGLTFModel::MarkDynamicNodes() {
+            for (auto &animation: animations) {
+                for (auto &channel: animation.channels) {
+                    if (channel.node)
+                        channel.node->dynamic = true;
+                }
             }
-            for (auto &child: node->children) {
-                PrepareNodeDescriptor(child, descriptorSetLayout);
+            for (auto node: linearNodes) {
+                if (node->skin)
+                    node->dynamic = true;
+                // children move with any animated ancestor
+                for (Node *p = node->parent; p && !node->dynamic; p = p->parent) {
+                    if (p->dynamic || p->skin)
+                        node->dynamic = true;
+                }
             }
         }
     };
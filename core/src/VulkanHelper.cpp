@@ -48,8 +48,13 @@ namespace vks
 		
     	const std::string GetShaderBasePath()
         {
+#ifdef SHADER_BINARY_DIR
+            // compiled by the Shaders target of the build
+            return SHADER_BINARY_DIR;
+#else
             std::string workingPath = std::filesystem::current_path().string();
         	return workingPath + "/shaders/";
+#endif
         }
 
         const std::string GetFileExtension(std::string filename)
@@ -55,6 +55,16 @@ namespace vks
             return mappedMemoryRange;
         }
 
+        /** @brief Initialize a buffer memory barrier with no buffer transfer ownership */
+        VkBufferMemoryBarrier BufferMemoryBarrier()
+        {
+            VkBufferMemoryBarrier bufferMemoryBarrier {};
+            bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            return bufferMemoryBarrier;
+        }
+
 #pragma endregion Memory
 
 #pragma region RenderPass
@@ -0,0 +1,107 @@
+﻿#include <VulkanProfiler.h>
+#include <VulkanHelper.h>
+#include <algorithm>
+
+namespace vks
+{
+    GpuProfiler::GpuProfiler(VulkanDevice* vulkanDevice, uint32_t frameCount, uint32_t maxScopeCount)
+        : vulkanDevice(vulkanDevice), maxScopeCount(maxScopeCount)
+    {
+        const VkPhysicalDeviceLimits& limits = vulkanDevice->properties.limits;
+        supported = limits.timestampComputeAndGraphics == VK_TRUE && limits.timestampPeriod > 0.0f;
+        timestampPeriod = limits.timestampPeriod;
+        if (!supported)
+            return;
+
+        frames.resize(frameCount);
+        for (FrameQueries& frame : frames)
+        {
+            VkQueryPoolCreateInfo queryPoolCI{};
+            queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolCI.queryCount = maxScopeCount * 2;
+            CheckVulkanResult(vkCreateQueryPool(vulkanDevice->logicalDevice, &queryPoolCI, nullptr, &frame.queryPool));
+        }
+    }
+
+    GpuProfiler::~GpuProfiler()
+    {
+        for (FrameQueries& frame : frames)
+        {
+            if (frame.queryPool != VK_NULL_HANDLE)
+                vkDestroyQueryPool(vulkanDevice->logicalDevice, frame.queryPool, nullptr);
+        }
+    }
+
+    void GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+    {
+        if (!supported)
+            return;
+
+        this->frameIndex = frameIndex;
+        FrameQueries& frame = frames[frameIndex];
+
+        // the frame's fence has been waited on, so the previous results are available
+        if (frame.queryCount > 0)
+        {
+            std::vector<uint64_t> timestamps(frame.queryCount);
+            VkResult result = vkGetQueryPoolResults(vulkanDevice->logicalDevice, frame.queryPool, 0, frame.queryCount,
+                                                    timestamps.size() * sizeof(uint64_t), timestamps.data(),
+                                                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            if (result == VK_SUCCESS)
+            {
+                for (const auto& scope : frame.scopes)
+                {
+                    uint64_t begin = timestamps[scope.second];
+                    uint64_t end = timestamps[scope.second + 1];
+                    float ms = end > begin ? static_cast<float>(end - begin) * timestampPeriod / 1000000.0f : 0.0f;
+                    auto it = times.find(scope.first);
+                    if (it == times.end())
+                        times[scope.first] = ms;
+                    else
+                        it->second = it->second * 0.9f + ms * 0.1f;
+                }
+            }
+        }
+
+        frame.scopes.clear();
+        frame.queryCount = 0;
+        vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, maxScopeCount * 2);
+    }
+
+    void GpuProfiler::BeginScope(VkCommandBuffer commandBuffer, const std::string& name)
+    {
+        if (!supported)
+            return;
+
+        FrameQueries& frame = frames[frameIndex];
+        if (frame.queryCount + 2 > maxScopeCount * 2 || frame.scopes.count(name) > 0)
+            return;
+
+        if (std::find(scopeNames.begin(), scopeNames.end(), name) == scopeNames.end())
+            scopeNames.push_back(name);
+
+        frame.scopes[name] = frame.queryCount;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPool, frame.queryCount);
+        frame.queryCount += 2;
+    }
+
+    void GpuProfiler::EndScope(VkCommandBuffer commandBuffer, const std::string& name)
+    {
+        if (!supported)
+            return;
+
+        FrameQueries& frame = frames[frameIndex];
+        auto it = frame.scopes.find(name);
+        if (it == frame.scopes.end())
+            return;
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPool, it->second + 1);
+    }
+
+    float GpuProfiler::GetTime(const std::string& name) const
+    {
+        auto it = times.find(name);
+        return it != times.end() ? it->second : 0.0f;
+    }
+}
@@ -0,0 +1,794 @@
+﻿#include <VulkanRenderGraph.h>
+#include <VulkanHelper.h>
+#include <VulkanInitializers.h>
+#include <VulkanUtils.h>
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace vks
+{
+    namespace
+    {
+        constexpr VkAccessFlags writeAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+            VK_ACCESS_MEMORY_WRITE_BIT;
+
+        // the stages that sample an image after the graph, e.g. the UI, and the next frame
+        constexpr VkPipelineStageFlags shaderReadStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+
+    /** @brief Collects the barriers in front of one pass into a single vkCmdPipelineBarrier */
+    class VulkanRenderGraph::BarrierBatch
+    {
+    public:
+        void AddMemoryBarrier(VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+                              VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+        {
+            srcStageMask |= srcStages;
+            dstStageMask |= dstStages;
+            memoryBarrier.srcAccessMask |= srcAccess;
+            memoryBarrier.dstAccessMask |= dstAccess;
+            empty = false;
+        }
+
+        void AddImageBarrier(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags srcStages,
+                             VkPipelineStageFlags dstStages)
+        {
+            srcStageMask |= srcStages;
+            dstStageMask |= dstStages;
+            imageBarriers.push_back(barrier);
+            empty = false;
+        }
+
+        void Record(VkCommandBuffer commandBuffer, Statistics& statistics) const
+        {
+            if (empty)
+                return;
+            // only execution dependencies when no pending write has to be made visible
+            const bool hasMemoryBarrier = memoryBarrier.srcAccessMask != 0 || memoryBarrier.dstAccessMask != 0;
+            vkCmdPipelineBarrier(commandBuffer, srcStageMask != 0 ? srcStageMask : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                 dstStageMask, 0, hasMemoryBarrier ? 1 : 0, &memoryBarrier, 0, nullptr,
+                                 static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+            statistics.barrierCount++;
+            statistics.imageBarrierCount += static_cast<uint32_t>(imageBarriers.size());
+        }
+
+    private:
+        VkPipelineStageFlags srcStageMask = 0;
+        VkPipelineStageFlags dstStageMask = 0;
+        VkMemoryBarrier memoryBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        bool empty = true;
+    };
+
+    void VulkanRenderGraph::PassBuilder::Read(RenderGraphResource resource, RenderGraphAccess access)
+    {
+        AddUse(resource, access, false);
+    }
+
+    void VulkanRenderGraph::PassBuilder::Write(RenderGraphResource resource, RenderGraphAccess access)
+    {
+        AddUse(resource, access, true);
+    }
+
+    void VulkanRenderGraph::PassBuilder::AddUse(RenderGraphResource resource, RenderGraphAccess access, bool write)
+    {
+        assert(resource < graph.resources.size());
+        const Resource& target = graph.resources[resource];
+
+        ResourceUse use;
+        use.resource = resource;
+        switch (access)
+        {
+        case RenderGraphAccess::ColorAttachment:
+            use.stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            use.accessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            use.finalLayout = target.layout;
+            use.write = true;
+            break;
+        case RenderGraphAccess::DepthAttachment:
+            use.stageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            use.accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            use.finalLayout = target.layout;
+            use.write = true;
+            break;
+        case RenderGraphAccess::ColorAttachmentLoad:
+            use.stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            use.accessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            use.layout = target.layout;
+            use.finalLayout = target.layout;
+            use.read = true;
+            use.write = true;
+            break;
+        case RenderGraphAccess::DepthAttachmentLoad:
+            use.stageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            use.accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            use.layout = target.layout;
+            use.finalLayout = target.layout;
+            use.read = true;
+            use.write = true;
+            break;
+        case RenderGraphAccess::DepthAttachmentRead:
+            use.stageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            use.accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT |
+                             VK_ACCESS_SHADER_READ_BIT;
+            use.layout = target.layout;
+            use.finalLayout = target.layout;
+            use.read = true;
+            break;
+        case RenderGraphAccess::FragmentRead:
+            use.stageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            use.accessMask = VK_ACCESS_SHADER_READ_BIT;
+            use.layout = target.layout;
+            use.finalLayout = target.layout;
+            use.read = true;
+            break;
+        case RenderGraphAccess::ComputeRead:
+            use.stageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            use.accessMask = VK_ACCESS_SHADER_READ_BIT;
+            use.layout = target.layout;
+            use.finalLayout = target.layout;
+            use.read = true;
+            break;
+        case RenderGraphAccess::IndirectRead:
+            use.stageMask = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+            use.accessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+            use.layout = target.layout;
+            use.finalLayout = target.layout;
+            use.read = true;
+            break;
+        case RenderGraphAccess::ComputeWrite:
+            use.stageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            // storage writes may read what they update, e.g. atomics
+            use.accessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            use.layout = VK_IMAGE_LAYOUT_GENERAL;
+            use.finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+            use.write = true;
+            break;
+        case RenderGraphAccess::TransferRead:
+            use.stageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            use.accessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            use.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            use.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            use.read = true;
+            break;
+        case RenderGraphAccess::TransferWrite:
+            use.stageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            use.accessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            use.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            use.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            use.write = true;
+            break;
+        }
+        assert(use.write == write);
+        if (!target.isImage)
+        {
+            use.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            use.finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+
+        // several accesses of one resource in a pass become a single use
+        std::vector<ResourceUse>& uses = graph.passes[pass].uses;
+        auto existing = std::find_if(uses.begin(), uses.end(),
+                                     [resource](const ResourceUse& other) { return other.resource == resource; });
+        if (existing == uses.end())
+        {
+            uses.push_back(use);
+            return;
+        }
+        assert(existing->layout == use.layout);
+        existing->stageMask |= use.stageMask;
+        existing->accessMask |= use.accessMask;
+        existing->read |= use.read;
+        existing->write |= use.write;
+        existing->finalLayout = use.finalLayout;
+    }
+
+    void VulkanRenderGraph::PassBuilder::SetRenderPass(VulkanRenderPass* renderPass,
+                                                       const std::vector<VkClearValue>& clearValues,
+                                                       VkExtent2D renderArea)
+    {
+        SetRenderPass(renderPass, clearValues, [renderArea]() { return renderArea; });
+    }
+
+    void VulkanRenderGraph::PassBuilder::SetRenderPass(VulkanRenderPass* renderPass,
+                                                       const std::vector<VkClearValue>& clearValues,
+                                                       std::function<VkExtent2D()> renderArea)
+    {
+        assert(renderPass->vulkanFrameBuffer != nullptr);
+        Pass& target = graph.passes[pass];
+        target.renderPass = renderPass;
+        target.clearValues = clearValues;
+        target.renderArea = std::move(renderArea);
+    }
+
+    void VulkanRenderGraph::PassBuilder::SetCondition(std::function<bool()> condition)
+    {
+        graph.passes[pass].condition = std::move(condition);
+    }
+
+    void VulkanRenderGraph::PassBuilder::SetSideEffect()
+    {
+        graph.passes[pass].sideEffect = true;
+    }
+
+    void VulkanRenderGraph::PassBuilder::SetProfileScope(const std::string& scope)
+    {
+        graph.passes[pass].profileScope = scope;
+    }
+
+    VulkanRenderGraph::VulkanRenderGraph(VulkanDevice* vulkanDevice, uint32_t frameCount)
+        : vulkanDevice(vulkanDevice), frameCount(frameCount)
+    {
+        utils::VulkanSamplerCreateInfo samplerCreateInfo{};
+        samplerCreateInfo.minFiler = VK_FILTER_LINEAR;
+        samplerCreateInfo.magFiler = VK_FILTER_LINEAR;
+        samplerCreateInfo.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler = utils::CreateSampler(vulkanDevice, samplerCreateInfo);
+    }
+
+    VulkanRenderGraph::~VulkanRenderGraph()
+    {
+        DestroyTransientImages();
+        if (sampler != VK_NULL_HANDLE)
+            vkDestroySampler(vulkanDevice->logicalDevice, sampler, nullptr);
+    }
+
+    RenderGraphResource VulkanRenderGraph::ImportImage(const std::string& name, const std::vector<VkImage>& images,
+                                                       const VkImageSubresourceRange& subresourceRange,
+                                                       VkImageLayout layout)
+    {
+        assert(!compiled);
+        assert(images.size() == 1 || images.size() == frameCount);
+        Resource resource;
+        resource.name = name;
+        resource.images = images;
+        resource.subresourceRange = subresourceRange;
+        resource.layout = layout;
+        resources.push_back(std::move(resource));
+        return static_cast<RenderGraphResource>(resources.size() - 1);
+    }
+
+    RenderGraphResource VulkanRenderGraph::ImportAttachment(const VulkanFrameBuffer* frameBuffer,
+                                                            const std::string& attachmentName)
+    {
+        std::vector<VkImage> images;
+        const FramebufferAttachment* attachment = nullptr;
+        for (uint32_t i = 0; i < frameBuffer->frameBufferCount; i++)
+        {
+            attachment = &frameBuffer->GetFrameBuffer(i)->GetAttachment(attachmentName);
+            images.push_back(attachment->image);
+        }
+        assert(attachment != nullptr);
+        return ImportImage(attachmentName, images, attachment->subresourceRange, attachment->descriptor.imageLayout);
+    }
+
+    RenderGraphResource VulkanRenderGraph::ImportBuffer(const std::string& name, VkBuffer buffer,
+                                                        VkPipelineStageFlags finalStageMask, VkAccessFlags finalAccessMask)
+    {
+        assert(!compiled);
+        Resource resource;
+        resource.name = name;
+        resource.isImage = false;
+        resource.buffer = buffer;
+        resource.finalStageMask = finalStageMask;
+        resource.finalAccessMask = finalAccessMask;
+        resources.push_back(std::move(resource));
+        return static_cast<RenderGraphResource>(resources.size() - 1);
+    }
+
+    RenderGraphResource VulkanRenderGraph::CreateImage(const std::string& name, uint32_t width, uint32_t height,
+                                                       VkFormat format, VkImageUsageFlags usage)
+    {
+        assert(!compiled);
+        Resource resource;
+        resource.name = name;
+        resource.transient = true;
+        resource.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        resource.layout = VK_IMAGE_LAYOUT_GENERAL;
+        resource.imageCI = initializers::ImageCreateInfo();
+        resource.imageCI.imageType = VK_IMAGE_TYPE_2D;
+        resource.imageCI.format = format;
+        resource.imageCI.extent = {width, height, 1};
+        resource.imageCI.mipLevels = 1;
+        resource.imageCI.arrayLayers = 1;
+        resource.imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+        resource.imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+        resource.imageCI.usage = usage;
+        resource.imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        resource.firstUse = std::numeric_limits<uint32_t>::max();
+        resources.push_back(std::move(resource));
+        return static_cast<RenderGraphResource>(resources.size() - 1);
+    }
+
+    void VulkanRenderGraph::AddOutput(RenderGraphResource resource, std::function<bool()> consumed)
+    {
+        assert(!compiled);
+        resources[resource].output = true;
+        resources[resource].consumed = std::move(consumed);
+    }
+
+    RenderGraphPass VulkanRenderGraph::AddPass(const std::string& name, const std::function<void(PassBuilder&)>& setup,
+                                               std::function<void(VkCommandBuffer)> execute)
+    {
+        assert(!compiled);
+        const RenderGraphPass pass = static_cast<RenderGraphPass>(passes.size());
+        passes.emplace_back();
+        passes.back().name = name;
+        passes.back().profileScope = name;
+        passes.back().execute = std::move(execute);
+
+        PassBuilder builder(*this, pass);
+        setup(builder);
+        return pass;
+    }
+
+    void VulkanRenderGraph::Compile()
+    {
+        assert(!compiled);
+        SortPasses();
+        CreateTransientImages();
+        states.resize(resources.size());
+        compiled = true;
+    }
+
+    void VulkanRenderGraph::SortPasses()
+    {
+        // a read depends on the last write declared before it, a write also on the reads since that write
+        std::vector<int32_t> lastWriters(resources.size(), -1);
+        std::vector<std::vector<RenderGraphPass>> readers(resources.size());
+        for (RenderGraphPass p = 0; p < passes.size(); p++)
+        {
+            Pass& pass = passes[p];
+            auto addDependency = [&pass](RenderGraphPass dependency)
+            {
+                if (std::find(pass.dependencies.begin(), pass.dependencies.end(), dependency) == pass.dependencies.end())
+                    pass.dependencies.push_back(dependency);
+            };
+            for (const ResourceUse& use : pass.uses)
+            {
+                if (lastWriters[use.resource] >= 0)
+                    addDependency(static_cast<RenderGraphPass>(lastWriters[use.resource]));
+                if (use.write)
+                {
+                    for (RenderGraphPass reader : readers[use.resource])
+                        addDependency(reader);
+                }
+            }
+            for (const ResourceUse& use : pass.uses)
+            {
+                if (use.write)
+                {
+                    lastWriters[use.resource] = static_cast<int32_t>(p);
+                    readers[use.resource].clear();
+                }
+                else
+                    readers[use.resource].push_back(p);
+            }
+        }
+
+        std::vector<uint32_t> remainingDependencies(passes.size());
+        std::vector<std::vector<RenderGraphPass>> dependents(passes.size());
+        std::vector<RenderGraphPass> ready;
+        for (RenderGraphPass p = 0; p < passes.size(); p++)
+        {
+            remainingDependencies[p] = static_cast<uint32_t>(passes[p].dependencies.size());
+            for (RenderGraphPass dependency : passes[p].dependencies)
+                dependents[dependency].push_back(p);
+            if (remainingDependencies[p] == 0)
+                ready.push_back(p);
+        }
+
+        // the scope of the previous pass is finished first, then a pass that does not wait for the previous one
+        // is preferred so the barrier in front of it overlaps independent work, otherwise declaration order
+        auto rank = [this](RenderGraphPass p)
+        {
+            if (executionOrder.empty())
+                return 2;
+            const RenderGraphPass previous = executionOrder.back();
+            if (passes[p].profileScope == passes[previous].profileScope)
+                return 0;
+            const std::vector<RenderGraphPass>& dependencies = passes[p].dependencies;
+            return std::find(dependencies.begin(), dependencies.end(), previous) == dependencies.end() ? 1 : 2;
+        };
+
+        executionOrder.clear();
+        while (!ready.empty())
+        {
+            auto next = std::min_element(ready.begin(), ready.end(), [&rank](RenderGraphPass a, RenderGraphPass b)
+            {
+                const int rankA = rank(a);
+                const int rankB = rank(b);
+                return rankA != rankB ? rankA < rankB : a < b;
+            });
+            const RenderGraphPass pass = *next;
+            ready.erase(next);
+            executionOrder.push_back(pass);
+            for (RenderGraphPass dependent : dependents[pass])
+            {
+                if (--remainingDependencies[dependent] == 0)
+                    ready.push_back(dependent);
+            }
+        }
+        // dependencies only point to passes declared earlier, so there are no cycles
+        assert(executionOrder.size() == passes.size());
+    }
+
+    void VulkanRenderGraph::CreateTransientImages()
+    {
+        VkDevice device = vulkanDevice->logicalDevice;
+
+        // lifetimes are positions in the execution order, culling in a frame can only shorten them
+        for (uint32_t i = 0; i < executionOrder.size(); i++)
+        {
+            for (const ResourceUse& use : passes[executionOrder[i]].uses)
+            {
+                Resource& resource = resources[use.resource];
+                resource.firstUse = std::min(resource.firstUse, i);
+                resource.lastUse = std::max(resource.lastUse, i);
+            }
+        }
+
+        std::vector<RenderGraphResource> transients;
+        std::vector<VkMemoryRequirements> requirements(resources.size());
+        for (RenderGraphResource r = 0; r < resources.size(); r++)
+        {
+            Resource& resource = resources[r];
+            if (!resource.transient)
+                continue;
+            if (resource.firstUse > resource.lastUse)
+            {
+                // never used, it must not share memory with anything
+                resource.firstUse = 0;
+                resource.lastUse = static_cast<uint32_t>(executionOrder.size());
+            }
+
+            resource.transientImages.resize(frameCount);
+            for (RenderGraphImage& image : resource.transientImages)
+            {
+                CheckVulkanResult(vkCreateImage(device, &resource.imageCI, nullptr, &image.image));
+                image.width = resource.imageCI.extent.width;
+                image.height = resource.imageCI.extent.height;
+                image.format = resource.imageCI.format;
+            }
+            vkGetImageMemoryRequirements(device, resource.transientImages[0].image, &requirements[r]);
+            statistics.unaliasedTransientMemorySize += requirements[r].size * frameCount;
+            transients.push_back(r);
+        }
+
+        // largest first, an image joins the first block whose images are all used in other passes
+        std::sort(transients.begin(), transients.end(), [&requirements](RenderGraphResource a, RenderGraphResource b)
+        {
+            return requirements[a].size > requirements[b].size;
+        });
+        memoryBlocks.clear();
+        for (RenderGraphResource r : transients)
+        {
+            Resource& resource = resources[r];
+            auto overlaps = [this, &resource](RenderGraphResource other)
+            {
+                return resource.firstUse <= resources[other].lastUse && resources[other].firstUse <= resource.lastUse;
+            };
+            uint32_t blockIndex = 0;
+            for (; blockIndex < memoryBlocks.size(); blockIndex++)
+            {
+                const MemoryBlock& block = memoryBlocks[blockIndex];
+                if ((block.memoryTypeBits & requirements[r].memoryTypeBits) != 0 &&
+                    std::none_of(block.resources.begin(), block.resources.end(), overlaps))
+                    break;
+            }
+            if (blockIndex == memoryBlocks.size())
+                memoryBlocks.emplace_back();
+            MemoryBlock& block = memoryBlocks[blockIndex];
+            block.size = std::max(block.size, requirements[r].size);
+            block.memoryTypeBits &= requirements[r].memoryTypeBits;
+            block.resources.push_back(r);
+            resource.memoryBlock = blockIndex;
+        }
+
+        // one allocation per block and frame, every image of the block is bound at its start
+        for (MemoryBlock& block : memoryBlocks)
+        {
+            VkMemoryAllocateInfo memAlloc = initializers::MemoryAllocateInfo();
+            memAlloc.allocationSize = block.size;
+            memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            block.memory.resize(frameCount);
+            for (VkDeviceMemory& memory : block.memory)
+                CheckVulkanResult(vkAllocateMemory(device, &memAlloc, nullptr, &memory));
+            statistics.transientMemorySize += block.size * frameCount;
+        }
+
+        for (RenderGraphResource r : transients)
+        {
+            Resource& resource = resources[r];
+            for (uint32_t frame = 0; frame < frameCount; frame++)
+            {
+                RenderGraphImage& image = resource.transientImages[frame];
+                CheckVulkanResult(vkBindImageMemory(device, image.image, memoryBlocks[resource.memoryBlock].memory[frame], 0));
+
+                VkImageViewCreateInfo imageViewCI = initializers::ImageViewCreateInfo();
+                imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+                imageViewCI.format = image.format;
+                imageViewCI.subresourceRange = resource.subresourceRange;
+                imageViewCI.image = image.image;
+                CheckVulkanResult(vkCreateImageView(device, &imageViewCI, nullptr, &image.view));
+
+                image.descriptor.sampler = sampler;
+                image.descriptor.imageView = image.view;
+                image.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            }
+        }
+    }
+
+    void VulkanRenderGraph::DestroyTransientImages()
+    {
+        VkDevice device = vulkanDevice->logicalDevice;
+        for (Resource& resource : resources)
+        {
+            for (RenderGraphImage& image : resource.transientImages)
+            {
+                if (image.view != VK_NULL_HANDLE)
+                    vkDestroyImageView(device, image.view, nullptr);
+                if (image.image != VK_NULL_HANDLE)
+                    vkDestroyImage(device, image.image, nullptr);
+            }
+            resource.transientImages.clear();
+        }
+        for (MemoryBlock& block : memoryBlocks)
+        {
+            for (VkDeviceMemory memory : block.memory)
+                vkFreeMemory(device, memory, nullptr);
+        }
+        memoryBlocks.clear();
+    }
+
+    RenderGraphImage* VulkanRenderGraph::GetImage(RenderGraphResource resource, uint32_t frameIndex)
+    {
+        assert(compiled && resources[resource].transient);
+        return &resources[resource].transientImages[frameIndex];
+    }
+
+    VkImage VulkanRenderGraph::GetVkImage(const Resource& resource, uint32_t frameIndex) const
+    {
+        if (resource.transient)
+            return resource.transientImages[frameIndex].image;
+        return resource.images.size() == 1 ? resource.images[0] : resource.images[frameIndex];
+    }
+
+    void VulkanRenderGraph::CullPasses()
+    {
+        // walks back from the consumed outputs, a pass is kept when an output or a kept pass reads what it writes
+        std::vector<bool> needed(resources.size(), false);
+        for (RenderGraphResource r = 0; r < resources.size(); r++)
+        {
+            const Resource& resource = resources[r];
+            needed[r] = resource.output && (!resource.consumed || resource.consumed());
+        }
+
+        for (auto it = executionOrder.rbegin(); it != executionOrder.rend(); ++it)
+        {
+            Pass& pass = passes[*it];
+            pass.active = !pass.condition || pass.condition();
+            if (!pass.active)
+                continue;
+
+            const bool kept = pass.sideEffect ||
+                std::any_of(pass.uses.begin(), pass.uses.end(),
+                            [&needed](const ResourceUse& use) { return use.write && needed[use.resource]; });
+            if (!kept)
+            {
+                pass.active = false;
+                statistics.culledPassCount++;
+                continue;
+            }
+            // a write that replaces the contents ends the need for the writes before it
+            for (const ResourceUse& use : pass.uses)
+            {
+                if (use.write && !use.read)
+                    needed[use.resource] = false;
+            }
+            for (const ResourceUse& use : pass.uses)
+            {
+                if (use.read)
+                    needed[use.resource] = true;
+            }
+        }
+    }
+
+    void VulkanRenderGraph::AddBarriers(const ResourceUse& use, uint32_t frameIndex, BarrierBatch& batch)
+    {
+        const Resource& resource = resources[use.resource];
+        ResourceState& state = states[use.resource];
+        // a transient image nothing has written in this frame has no contents to wait for
+        if (resource.transient && !use.write && state.layout == VK_IMAGE_LAYOUT_UNDEFINED)
+            return;
+
+        const bool transition = resource.isImage && use.layout != VK_IMAGE_LAYOUT_UNDEFINED && use.layout != state.layout;
+        if (use.write || transition)
+        {
+            // waits for the last write and for the reads since then, a layout transition has to as well
+            VkPipelineStageFlags srcStageMask = state.writeStageMask | state.readStageMask;
+            VkAccessFlags srcAccessMask = state.writeAccessMask;
+            if (resource.transient && state.layout == VK_IMAGE_LAYOUT_UNDEFINED)
+            {
+                // first use in the frame, the memory was used by the images aliasing it before
+                const MemoryBlock& block = memoryBlocks[resource.memoryBlock];
+                srcStageMask |= block.stageMask;
+                srcAccessMask |= block.accessMask;
+            }
+
+            if (transition)
+            {
+                VkImageMemoryBarrier barrier = initializers::ImageMemoryBarrier();
+                barrier.image = GetVkImage(resource, frameIndex);
+                barrier.subresourceRange = resource.subresourceRange;
+                barrier.oldLayout = state.layout;
+                barrier.newLayout = use.layout;
+                barrier.srcAccessMask = srcAccessMask;
+                barrier.dstAccessMask = use.accessMask;
+                batch.AddImageBarrier(barrier, srcStageMask, use.stageMask);
+            }
+            else if (srcStageMask != 0)
+                batch.AddMemoryBarrier(srcStageMask, srcAccessMask, use.stageMask, use.accessMask);
+
+            state.readStageMask = 0;
+            if (use.write)
+            {
+                state.writeStageMask = use.stageMask;
+                state.writeAccessMask = use.accessMask & writeAccessMask;
+                state.visibleStageMask = 0;
+                state.visibleAccessMask = 0;
+            }
+            else
+            {
+                // later reads wait for the transition, which is already visible to this one
+                state.writeStageMask = use.stageMask;
+                state.writeAccessMask = 0;
+                state.visibleStageMask = use.stageMask;
+                state.visibleAccessMask = use.accessMask;
+            }
+        }
+        else if (state.writeStageMask != 0 && ((use.stageMask & ~state.visibleStageMask) != 0 ||
+                                               (use.accessMask & ~state.visibleAccessMask) != 0))
+        {
+            // read after write, every reading stage waits once
+            batch.AddMemoryBarrier(state.writeStageMask, state.writeAccessMask, use.stageMask, use.accessMask);
+            state.visibleStageMask |= use.stageMask;
+            state.visibleAccessMask |= use.accessMask;
+        }
+
+        if (!use.write)
+            state.readStageMask |= use.stageMask;
+        if (resource.isImage && use.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED)
+            state.layout = use.finalLayout;
+        if (resource.transient)
+        {
+            MemoryBlock& block = memoryBlocks[resource.memoryBlock];
+            block.stageMask |= use.stageMask;
+            block.accessMask |= use.accessMask & writeAccessMask;
+        }
+    }
+
+    void VulkanRenderGraph::AddFinalBarriers(uint32_t frameIndex, BarrierBatch& batch)
+    {
+        for (RenderGraphResource r = 0; r < resources.size(); r++)
+        {
+            const Resource& resource = resources[r];
+            const ResourceState& state = states[r];
+            const VkPipelineStageFlags srcStageMask = state.writeStageMask | state.readStageMask;
+
+            if (!resource.isImage)
+            {
+                // e.g. host reads after the frame's fence
+                if (resource.finalStageMask != 0 && state.writeStageMask != 0)
+                    batch.AddMemoryBarrier(state.writeStageMask, state.writeAccessMask, resource.finalStageMask,
+                                           resource.finalAccessMask);
+                continue;
+            }
+            if (resource.transient)
+                continue;
+
+            if (state.layout != resource.layout)
+            {
+                // back to the resting layout the descriptors and the next frame expect
+                VkImageMemoryBarrier barrier = initializers::ImageMemoryBarrier();
+                barrier.image = GetVkImage(resource, frameIndex);
+                barrier.subresourceRange = resource.subresourceRange;
+                barrier.oldLayout = state.layout;
+                barrier.newLayout = resource.layout;
+                barrier.srcAccessMask = state.writeAccessMask;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+                batch.AddImageBarrier(barrier, srcStageMask, shaderReadStageMask);
+            }
+            else if (resource.output && state.writeStageMask != 0 &&
+                     (state.visibleStageMask & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) == 0)
+            {
+                // outputs are sampled after the graph
+                batch.AddMemoryBarrier(state.writeStageMask, state.writeAccessMask, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                       VK_ACCESS_SHADER_READ_BIT);
+            }
+        }
+    }
+
+    void VulkanRenderGraph::Execute(VkCommandBuffer commandBuffer, uint32_t frameIndex, GpuProfiler* profiler)
+    {
+        assert(compiled);
+        const VkDeviceSize transientMemorySize = statistics.transientMemorySize;
+        const VkDeviceSize unaliasedTransientMemorySize = statistics.unaliasedTransientMemorySize;
+        statistics = {};
+        statistics.transientMemorySize = transientMemorySize;
+        statistics.unaliasedTransientMemorySize = unaliasedTransientMemorySize;
+
+        for (Pass& pass : passes)
+            pass.executed = false;
+        CullPasses();
+
+        // transient images start undefined, the imported ones in their resting layout
+        for (RenderGraphResource r = 0; r < resources.size(); r++)
+        {
+            states[r] = {};
+            if (resources[r].isImage && !resources[r].transient)
+                states[r].layout = resources[r].layout;
+        }
+        for (MemoryBlock& block : memoryBlocks)
+        {
+            block.stageMask = 0;
+            block.accessMask = 0;
+        }
+
+        std::string scope;
+        for (RenderGraphPass p : executionOrder)
+        {
+            Pass& pass = passes[p];
+            if (!pass.active)
+                continue;
+
+            if (profiler != nullptr && pass.profileScope != scope)
+            {
+                if (!scope.empty())
+                    profiler->EndScope(commandBuffer, scope);
+                scope = pass.profileScope;
+                profiler->BeginScope(commandBuffer, scope);
+            }
+
+            BarrierBatch batch;
+            for (const ResourceUse& use : pass.uses)
+                AddBarriers(use, frameIndex, batch);
+            batch.Record(commandBuffer, statistics);
+
+            if (pass.renderPass != nullptr)
+            {
+                const VkExtent2D renderArea = pass.renderArea();
+                VkRenderPassBeginInfo renderPassBeginInfo = initializers::RenderPassBeginInfo();
+                renderPassBeginInfo.renderPass = pass.renderPass->renderPass;
+                renderPassBeginInfo.framebuffer = pass.renderPass->vulkanFrameBuffer->GetFrameBuffer(frameIndex)->frameBuffer;
+                renderPassBeginInfo.renderArea.offset = {0, 0};
+                renderPassBeginInfo.renderArea.extent = renderArea;
+                renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+                renderPassBeginInfo.pClearValues = pass.clearValues.data();
+                vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+                const VkViewport viewport = initializers::Viewport(static_cast<float>(renderArea.width),
+                                                                   static_cast<float>(renderArea.height), 0.0f, 1.0f);
+                const VkRect2D scissor = initializers::Rect2D(renderArea.width, renderArea.height, 0, 0);
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+            }
+            pass.execute(commandBuffer);
+            if (pass.renderPass != nullptr)
+                vkCmdEndRenderPass(commandBuffer);
+
+            pass.executed = true;
+            statistics.executedPassCount++;
+        }
+        if (profiler != nullptr && !scope.empty())
+            profiler->EndScope(commandBuffer, scope);
+
+        BarrierBatch batch;
+        AddFinalBarriers(frameIndex, batch);
+        batch.Record(commandBuffer, statistics);
+    }
+}
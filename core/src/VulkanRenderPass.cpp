@@ -51,12 +51,16 @@ namespace vks
         layerCount = attachmentCreateInfo.layerCount;
         usage = attachmentCreateInfo.usage;
         imageSampleCount = attachmentCreateInfo.imageSampleCount;
+        readOnly = attachmentCreateInfo.readOnly;
+        sharedFrameBuffer = attachmentCreateInfo.sharedFrameBuffer;
+        sharedAcrossFrames = attachmentCreateInfo.sharedAcrossFrames;
 
         // Fill attachment description
         description = {};
         description.samples = imageSampleCount;
-        description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        description.storeOp = (usage & VK_IMAGE_USAGE_SAMPLED_BIT) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.loadOp = readOnly ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        // transient attachments that are never sampled are not written back to memory
+        description.storeOp = (usage & VK_IMAGE_USAGE_SAMPLED_BIT) || readOnly ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
         description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         description.format = format;
@@ -66,6 +70,9 @@ namespace vks
             description.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
         else
             description.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        // loaded contents are in the layout the render pass that wrote them left them in
+        if (readOnly)
+            description.initialLayout = description.finalLayout;
     }
     
     VulkanSubPass::VulkanSubPass(const std::string& subPassName,
@@ -83,6 +90,12 @@ namespace vks
         for (uint32_t i = 0; i < colorAttachmentIndices.size(); i++)
         {
             uint32_t attachmentIndex = colorAttachmentIndices[i];
+            if (attachmentIndex == VK_ATTACHMENT_UNUSED)
+            {
+                colorReferences.push_back({VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED});
+                hasColor = true;
+                continue;
+            }
             if (attachmentIndex >= attachmentDescriptions.size())
                 continue;
             VulkanAttachmentDescription* attachment = attachmentDescriptions[attachmentIndex];
@@ -91,7 +104,8 @@ namespace vks
                 // Only one depth attachment allowed
                 assert(!hasDepth);
                 depthReference.attachment = attachmentIndex;
-                depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+                depthReference.layout = attachment->readOnly ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                                             : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
                 hasDepth = true;
             }
             else
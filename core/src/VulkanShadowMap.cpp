@@ -0,0 +1,348 @@
+﻿#include <VulkanShadowMap.h>
+#include <VulkanHelper.h>
+#include <VulkanInitializers.h>
+#include <VulkanUtils.h>
+#include <algorithm>
+#include <cassert>
+
+namespace vks
+{
+    namespace
+    {
+        std::unique_ptr<VulkanRenderPass> CreateDepthRenderPass(const std::string& name, VulkanDevice* vulkanDevice,
+                                                                VkFormat depthFormat, bool loadDepth)
+        {
+            auto renderPass = std::make_unique<VulkanRenderPass>(name, vulkanDevice);
+
+            AttachmentCreateInfo attachmentInfo = {};
+            attachmentInfo.name = name;
+            attachmentInfo.binding = 0;
+            attachmentInfo.layerCount = 1;
+            attachmentInfo.format = depthFormat;
+            attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+            renderPass->AddAttachment(attachmentInfo);
+            if (loadDepth)
+            {
+                VkAttachmentDescription& description = renderPass->attachmentDescriptions[0]->description;
+                description.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+                description.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+            }
+
+            renderPass->AddSubPass("shadowMap", VK_PIPELINE_BIND_POINT_GRAPHICS, std::vector<uint32_t>{0}, {});
+            renderPass->AddSubPassDependency(
+                {
+                    {
+                        VK_SUBPASS_EXTERNAL, 0,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                        VK_ACCESS_SHADER_READ_BIT,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_DEPENDENCY_BY_REGION_BIT,
+                    },
+                    {
+                        0, VK_SUBPASS_EXTERNAL,
+                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_ACCESS_SHADER_READ_BIT,
+                        VK_DEPENDENCY_BY_REGION_BIT,
+                    }
+                });
+            renderPass->Init();
+            return renderPass;
+        }
+    }
+
+    VulkanShadowMap::VulkanShadowMap(const std::string& name, VulkanDevice* vulkanDevice, VkFormat depthFormat,
+                                     VkQueue queue)
+        : name(name), vulkanDevice(vulkanDevice), depthFormat(depthFormat), queue(queue)
+    {
+        renderPass = CreateDepthRenderPass(name, vulkanDevice, depthFormat, false);
+        loadRenderPass = CreateDepthRenderPass(name + "_Load", vulkanDevice, depthFormat, true);
+
+        // raw depth fetches, e.g. for a blocker search
+        utils::VulkanSamplerCreateInfo samplerCreateInfo{};
+        samplerCreateInfo.minFiler = VK_FILTER_NEAREST;
+        samplerCreateInfo.magFiler = VK_FILTER_NEAREST;
+        samplerCreateInfo.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        sampler = utils::CreateSampler(vulkanDevice, samplerCreateInfo);
+
+        // every lookup compares the four nearest texels and filters the results, outside the map is lit
+        VkSamplerCreateInfo compareSamplerInfo = initializers::SamplerCreateInfo();
+        compareSamplerInfo.magFilter = VK_FILTER_LINEAR;
+        compareSamplerInfo.minFilter = VK_FILTER_LINEAR;
+        compareSamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        compareSamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        compareSamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        compareSamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        compareSamplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        compareSamplerInfo.compareEnable = VK_TRUE;
+        compareSamplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        compareSamplerInfo.maxAnisotropy = 1.0f;
+        compareSamplerInfo.minLod = 0.0f;
+        compareSamplerInfo.maxLod = 1.0f;
+        CheckVulkanResult(vkCreateSampler(vulkanDevice->logicalDevice, &compareSamplerInfo, nullptr, &compareSampler));
+    }
+
+    VulkanShadowMap::~VulkanShadowMap()
+    {
+        DestroyLayeredImage(shadowMap);
+        DestroyLayeredImage(cache);
+        if (sampler != VK_NULL_HANDLE)
+            vkDestroySampler(vulkanDevice->logicalDevice, sampler, nullptr);
+        if (compareSampler != VK_NULL_HANDLE)
+            vkDestroySampler(vulkanDevice->logicalDevice, compareSampler, nullptr);
+        renderPass.reset();
+        loadRenderPass.reset();
+    }
+
+    void VulkanShadowMap::DestroyLayeredImage(LayeredImage& layeredImage)
+    {
+        VkDevice device = vulkanDevice->logicalDevice;
+        for (VkFramebuffer frameBuffer : layeredImage.frameBuffers)
+            vkDestroyFramebuffer(device, frameBuffer, nullptr);
+        for (VkImageView layerView : layeredImage.layerViews)
+            vkDestroyImageView(device, layerView, nullptr);
+        if (layeredImage.arrayView != VK_NULL_HANDLE)
+            vkDestroyImageView(device, layeredImage.arrayView, nullptr);
+        if (layeredImage.image != VK_NULL_HANDLE)
+            vkDestroyImage(device, layeredImage.image, nullptr);
+        if (layeredImage.memory != VK_NULL_HANDLE)
+            vkFreeMemory(device, layeredImage.memory, nullptr);
+        layeredImage = {};
+    }
+
+    void VulkanShadowMap::CreateLayeredImage(LayeredImage& layeredImage, VkImageUsageFlags usage)
+    {
+        VkDevice device = vulkanDevice->logicalDevice;
+
+        VkImageCreateInfo imageCI = initializers::ImageCreateInfo();
+        imageCI.imageType = VK_IMAGE_TYPE_2D;
+        imageCI.format = depthFormat;
+        imageCI.extent = {resolution, resolution, 1};
+        imageCI.mipLevels = 1;
+        imageCI.arrayLayers = layerCount;
+        imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | usage;
+        CheckVulkanResult(vkCreateImage(device, &imageCI, nullptr, &layeredImage.image));
+
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements(device, layeredImage.image, &memReqs);
+        VkMemoryAllocateInfo memAlloc = initializers::MemoryAllocateInfo();
+        memAlloc.allocationSize = memReqs.size;
+        memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        CheckVulkanResult(vkAllocateMemory(device, &memAlloc, nullptr, &layeredImage.memory));
+        CheckVulkanResult(vkBindImageMemory(device, layeredImage.image, layeredImage.memory, 0));
+
+        VkImageViewCreateInfo imageViewCI = initializers::ImageViewCreateInfo();
+        imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        imageViewCI.format = depthFormat;
+        imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        imageViewCI.subresourceRange.baseMipLevel = 0;
+        imageViewCI.subresourceRange.levelCount = 1;
+        imageViewCI.subresourceRange.baseArrayLayer = 0;
+        imageViewCI.subresourceRange.layerCount = layerCount;
+        imageViewCI.image = layeredImage.image;
+        CheckVulkanResult(vkCreateImageView(device, &imageViewCI, nullptr, &layeredImage.arrayView));
+
+        layeredImage.layerViews.resize(layerCount);
+        layeredImage.frameBuffers.resize(layerCount);
+        for (uint32_t i = 0; i < layerCount; i++)
+        {
+            imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            imageViewCI.subresourceRange.baseArrayLayer = i;
+            imageViewCI.subresourceRange.layerCount = 1;
+            CheckVulkanResult(vkCreateImageView(device, &imageViewCI, nullptr, &layeredImage.layerViews[i]));
+
+            VkFramebufferCreateInfo framebufferCI = initializers::FramebufferCreateInfo();
+            framebufferCI.renderPass = renderPass->renderPass;
+            framebufferCI.attachmentCount = 1;
+            framebufferCI.pAttachments = &layeredImage.layerViews[i];
+            framebufferCI.width = resolution;
+            framebufferCI.height = resolution;
+            framebufferCI.layers = 1;
+            CheckVulkanResult(vkCreateFramebuffer(device, &framebufferCI, nullptr, &layeredImage.frameBuffers[i]));
+        }
+    }
+
+    void VulkanShadowMap::Create(uint32_t resolution, uint32_t layerCount, bool useCache)
+    {
+        DestroyLayeredImage(shadowMap);
+        DestroyLayeredImage(cache);
+        this->resolution = resolution;
+        this->layerCount = layerCount;
+
+        if (useCache)
+        {
+            CreateLayeredImage(shadowMap, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+            CreateLayeredImage(cache, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        }
+        else
+        {
+            CreateLayeredImage(shadowMap, VK_IMAGE_USAGE_SAMPLED_BIT);
+        }
+
+        // start in the layout the render passes leave behind, so the images can be sampled before the first update
+        VkCommandBuffer commandBuffer = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        for (VkImage image : {shadowMap.image, cache.image})
+        {
+            if (image == VK_NULL_HANDLE)
+                continue;
+            VkImageMemoryBarrier barrier = initializers::ImageMemoryBarrier();
+            barrier.image = image;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, layerCount};
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+        vulkanDevice->FlushCommandBuffer(commandBuffer, queue);
+
+        descriptor.sampler = sampler;
+        descriptor.imageView = shadowMap.arrayView;
+        descriptor.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        compareDescriptor = descriptor;
+        compareDescriptor.sampler = compareSampler;
+    }
+
+    void VulkanShadowMap::BeginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass pass, VkFramebuffer frameBuffer,
+                                          const VkRect2D& renderArea)
+    {
+        VkClearValue clearValue{};
+        clearValue.depthStencil = {1.0f, 0};
+
+        VkRenderPassBeginInfo renderPassBeginInfo = initializers::RenderPassBeginInfo();
+        renderPassBeginInfo.renderPass = pass;
+        renderPassBeginInfo.framebuffer = frameBuffer;
+        renderPassBeginInfo.renderArea = renderArea;
+        renderPassBeginInfo.clearValueCount = 1;
+        renderPassBeginInfo.pClearValues = &clearValue;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport = initializers::Viewport((float)renderArea.extent.width, (float)renderArea.extent.height,
+                                                     0.0f, 1.0f);
+        viewport.x = (float)renderArea.offset.x;
+        viewport.y = (float)renderArea.offset.y;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &renderArea);
+    }
+
+    void VulkanShadowMap::BeginRenderPass(VkCommandBuffer commandBuffer, uint32_t layer)
+    {
+        BeginRenderPass(commandBuffer, renderPass->renderPass, shadowMap.frameBuffers[layer],
+                        initializers::Rect2D(resolution, resolution, 0, 0));
+    }
+
+    void VulkanShadowMap::BeginCacheRenderPass(VkCommandBuffer commandBuffer, uint32_t layer)
+    {
+        assert(HasCache());
+        BeginRenderPass(commandBuffer, renderPass->renderPass, cache.frameBuffers[layer],
+                        initializers::Rect2D(resolution, resolution, 0, 0));
+    }
+
+    void VulkanShadowMap::BeginLoadRenderPass(VkCommandBuffer commandBuffer, uint32_t layer)
+    {
+        BeginRenderPass(commandBuffer, loadRenderPass->renderPass, shadowMap.frameBuffers[layer],
+                        initializers::Rect2D(resolution, resolution, 0, 0));
+    }
+
+    void VulkanShadowMap::BeginTileRenderPass(VkCommandBuffer commandBuffer, uint32_t layer, uint32_t x, uint32_t y,
+                                              uint32_t size)
+    {
+        const VkRect2D tile = initializers::Rect2D(size, size, static_cast<int32_t>(x), static_cast<int32_t>(y));
+        BeginTileRenderPass(commandBuffer, layer, &tile, 1);
+    }
+
+    void VulkanShadowMap::BeginTileRenderPass(VkCommandBuffer commandBuffer, uint32_t layer, const VkRect2D* tiles,
+                                              uint32_t tileCount)
+    {
+        assert(tileCount > 0);
+        // the render area bounds all tiles, the load pass keeps whatever lies between them
+        int32_t minX = tiles[0].offset.x, minY = tiles[0].offset.y;
+        int32_t maxX = minX + static_cast<int32_t>(tiles[0].extent.width);
+        int32_t maxY = minY + static_cast<int32_t>(tiles[0].extent.height);
+        for (uint32_t i = 1; i < tileCount; i++)
+        {
+            minX = std::min(minX, tiles[i].offset.x);
+            minY = std::min(minY, tiles[i].offset.y);
+            maxX = std::max(maxX, tiles[i].offset.x + static_cast<int32_t>(tiles[i].extent.width));
+            maxY = std::max(maxY, tiles[i].offset.y + static_cast<int32_t>(tiles[i].extent.height));
+        }
+        BeginRenderPass(commandBuffer, loadRenderPass->renderPass, shadowMap.frameBuffers[layer],
+                        initializers::Rect2D(static_cast<uint32_t>(maxX - minX), static_cast<uint32_t>(maxY - minY),
+                                             minX, minY));
+
+        std::vector<VkViewport> viewports(tileCount);
+        std::vector<VkClearRect> clearRects(tileCount);
+        for (uint32_t i = 0; i < tileCount; i++)
+        {
+            viewports[i] = initializers::Viewport((float)tiles[i].extent.width, (float)tiles[i].extent.height, 0.0f, 1.0f);
+            viewports[i].x = (float)tiles[i].offset.x;
+            viewports[i].y = (float)tiles[i].offset.y;
+            clearRects[i].rect = tiles[i];
+            clearRects[i].baseArrayLayer = 0;
+            clearRects[i].layerCount = 1;
+        }
+        vkCmdSetViewport(commandBuffer, 0, tileCount, viewports.data());
+        vkCmdSetScissor(commandBuffer, 0, tileCount, tiles);
+
+        VkClearAttachment clearAttachment{};
+        clearAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        clearAttachment.clearValue.depthStencil = {1.0f, 0};
+        vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, tileCount, clearRects.data());
+    }
+
+    void VulkanShadowMap::EndRenderPass(VkCommandBuffer commandBuffer)
+    {
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    void VulkanShadowMap::CopyCache(VkCommandBuffer commandBuffer)
+    {
+        assert(HasCache());
+        VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, layerCount};
+
+        // cache: written by BeginCacheRenderPass, shadow map: contents are replaced, wait for last frame's reads
+        VkImageMemoryBarrier barriers[2];
+        barriers[0] = initializers::ImageMemoryBarrier();
+        barriers[0].image = cache.image;
+        barriers[0].subresourceRange = subresourceRange;
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[1] = initializers::ImageMemoryBarrier();
+        barriers[1].image = shadowMap.image;
+        barriers[1].subresourceRange = subresourceRange;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].srcAccessMask = 0;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+        VkImageCopy copyRegion{};
+        copyRegion.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, layerCount};
+        copyRegion.dstSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, layerCount};
+        copyRegion.extent = {resolution, resolution, 1};
+        vkCmdCopyImage(commandBuffer, cache.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       shadowMap.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+        // both back to the render passes' final layout, BeginLoadRenderPass starts from it
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[0].dstAccessMask = 0;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, 2, barriers);
+    }
+}
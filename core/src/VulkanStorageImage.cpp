@@ -0,0 +1,109 @@
+﻿#include <VulkanStorageImage.h>
+#include <VulkanHelper.h>
+#include <VulkanInitializers.h>
+#include <VulkanUtils.h>
+
+namespace vks
+{
+    VulkanStorageImage::VulkanStorageImage(VulkanDevice* vulkanDevice, VkQueue queue)
+        : vulkanDevice(vulkanDevice), queue(queue)
+    {
+        utils::VulkanSamplerCreateInfo samplerCreateInfo{};
+        samplerCreateInfo.minFiler = VK_FILTER_LINEAR;
+        samplerCreateInfo.magFiler = VK_FILTER_LINEAR;
+        samplerCreateInfo.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler = utils::CreateSampler(vulkanDevice, samplerCreateInfo);
+    }
+
+    VulkanStorageImage::~VulkanStorageImage()
+    {
+        Destroy();
+        if (sampler != VK_NULL_HANDLE)
+            vkDestroySampler(vulkanDevice->logicalDevice, sampler, nullptr);
+    }
+
+    void VulkanStorageImage::Destroy()
+    {
+        VkDevice device = vulkanDevice->logicalDevice;
+        for (VkImageView levelView : levelViews)
+            vkDestroyImageView(device, levelView, nullptr);
+        levelViews.clear();
+        if (view != VK_NULL_HANDLE)
+            vkDestroyImageView(device, view, nullptr);
+        if (image != VK_NULL_HANDLE)
+            vkDestroyImage(device, image, nullptr);
+        if (memory != VK_NULL_HANDLE)
+            vkFreeMemory(device, memory, nullptr);
+        view = VK_NULL_HANDLE;
+        image = VK_NULL_HANDLE;
+        memory = VK_NULL_HANDLE;
+        descriptor = {};
+        width = 0;
+        height = 0;
+        levelCount = 0;
+    }
+
+    void VulkanStorageImage::Create(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage,
+                                    uint32_t levelCount)
+    {
+        Destroy();
+        this->width = width;
+        this->height = height;
+        this->levelCount = levelCount;
+        this->format = format;
+        VkDevice device = vulkanDevice->logicalDevice;
+
+        VkImageCreateInfo imageCI = initializers::ImageCreateInfo();
+        imageCI.imageType = VK_IMAGE_TYPE_2D;
+        imageCI.format = format;
+        imageCI.extent = {width, height, 1};
+        imageCI.mipLevels = levelCount;
+        imageCI.arrayLayers = 1;
+        imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | usage;
+        CheckVulkanResult(vkCreateImage(device, &imageCI, nullptr, &image));
+
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements(device, image, &memReqs);
+        VkMemoryAllocateInfo memAlloc = initializers::MemoryAllocateInfo();
+        memAlloc.allocationSize = memReqs.size;
+        memAlloc.memoryTypeIndex = vulkanDevice->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        CheckVulkanResult(vkAllocateMemory(device, &memAlloc, nullptr, &memory));
+        CheckVulkanResult(vkBindImageMemory(device, image, memory, 0));
+
+        VkImageViewCreateInfo imageViewCI = initializers::ImageViewCreateInfo();
+        imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imageViewCI.format = format;
+        imageViewCI.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+        imageViewCI.image = image;
+        CheckVulkanResult(vkCreateImageView(device, &imageViewCI, nullptr, &view));
+        // storage descriptors address a single level
+        if (levelCount > 1)
+        {
+            levelViews.resize(levelCount);
+            for (uint32_t level = 0; level < levelCount; level++)
+            {
+                VkImageViewCreateInfo levelViewCI = imageViewCI;
+                levelViewCI.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+                CheckVulkanResult(vkCreateImageView(device, &levelViewCI, nullptr, &levelViews[level]));
+            }
+        }
+
+        VkCommandBuffer commandBuffer = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        VkImageMemoryBarrier barrier = initializers::ImageMemoryBarrier();
+        barrier.image = image;
+        barrier.subresourceRange = imageViewCI.subresourceRange;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+        vulkanDevice->FlushCommandBuffer(commandBuffer, queue);
+
+        descriptor.sampler = sampler;
+        descriptor.imageView = view;
+        descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+}
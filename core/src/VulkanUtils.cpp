@@ -242,6 +242,40 @@ namespace vks {
             return (HasDepth(format) || HasStencil(format));
         }
 
+        uint32_t FormatSize(VkFormat format) {
+            switch (format) {
+                case VK_FORMAT_R8_UNORM:
+                    return 1;
+                case VK_FORMAT_R16_SFLOAT:
+                case VK_FORMAT_D16_UNORM:
+                    return 2;
+                case VK_FORMAT_R8G8B8A8_UNORM:
+                case VK_FORMAT_R8G8B8A8_SRGB:
+                case VK_FORMAT_B8G8R8A8_UNORM:
+                case VK_FORMAT_B8G8R8A8_SRGB:
+                case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+                case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+                case VK_FORMAT_R16G16_SNORM:
+                case VK_FORMAT_R16G16_SFLOAT:
+                case VK_FORMAT_R32_SFLOAT:
+                case VK_FORMAT_D32_SFLOAT:
+                case VK_FORMAT_D24_UNORM_S8_UINT:
+                case VK_FORMAT_X8_D24_UNORM_PACK32:
+                    return 4;
+                case VK_FORMAT_D16_UNORM_S8_UINT:
+                    return 3;
+                case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                    return 5;
+                case VK_FORMAT_R16G16B16A16_SFLOAT:
+                case VK_FORMAT_R32G32_SFLOAT:
+                    return 8;
+                case VK_FORMAT_R32G32B32A32_SFLOAT:
+                    return 16;
+                default:
+                    return 0;
+            }
+        }
+
         Texture2D* CreateDefaultTexture2D(VulkanDevice *vulkanDevice, VkQueue transferQueue, uint32_t width, uint32_t height,
                                               glm::vec4 clearColor) {
 
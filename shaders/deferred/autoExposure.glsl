@@ -0,0 +1,29 @@
+// bindings and push constants shared by histogram.comp and exposure.comp, one pipeline layout serves both
+
+// mirrors GlobalVars::LUMINANCE_HISTOGRAM_BIN_COUNT, one invocation per bin in both shaders
+#define BIN_COUNT 256
+
+layout (binding = 0) uniform sampler2D samplerScene;
+layout (binding = 1) buffer Histogram
+{
+	uint bins[BIN_COUNT];
+} histogram;
+layout (binding = 2) buffer Exposure
+{
+	// adapted average scene luminance, carried over from the previous frames
+	float averageLuminance;
+	float exposure;
+} exposureState;
+
+layout (push_constant) uniform PushConsts
+{
+	// log2 luminance range covered by bins 1 - 255
+	float minLogLuminance;
+	float logLuminanceRange;
+	// fraction of the way to the measured luminance covered this frame
+	float adaptation;
+	// exposure maps the average luminance to this value
+	float keyValue;
+	// rendered region of the scene in pixels
+	uvec2 renderSize;
+} pushConsts;
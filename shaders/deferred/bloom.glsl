@@ -0,0 +1,27 @@
+// bindings and push constants shared by bloomDownsample.comp and bloomUpsample.comp
+
+// downsample: the level above, upsample: the smaller upsampled level
+layout (binding = 0) uniform sampler2D samplerSource;
+// upsample: the downsampled level of the same size, added to the filtered source
+layout (binding = 1) uniform sampler2D samplerAdd;
+layout (binding = 2, rgba16f) uniform writeonly image2D outColor;
+
+layout (push_constant) uniform PushConsts
+{
+	// luminance where the first downsample starts keeping color, the knee softens the transition
+	float threshold;
+	float knee;
+	// upsample filter radius in texels of the source
+	float radius;
+	// the first downsample reads the scene and applies the threshold
+	int prefilter;
+	// fraction of every level covered by the rendered region of the scene
+	vec2 renderScale;
+} pushConsts;
+
+// keeps a source tap inside the rendered region, the rest of the source is left over from larger scales
+vec2 sourceUV(vec2 uv)
+{
+	vec2 halfTexel = 0.5 / vec2(textureSize(samplerSource, 0));
+	return clamp(uv, halfTexel, pushConsts.renderScale - halfTexel);
+}
@@ -1,11 +1,22 @@
 #version 450
 
-layout (binding = 1) uniform sampler2D samplerShadowMap;
+// mirrors GlobalVars::MAX_SHADOW_CASCADE_COUNT
+#define MAX_SHADOW_CASCADE_COUNT 4
+#define MAX_POISSON_SAMPLE_COUNT 32
 
-layout (location = 0) in vec4 inPosInLightSpace;
-layout (location = 1) in vec2 inUV;
-layout (location = 2) in vec3 inNormalInWorld;
-layout (location = 3) in vec4 inPositionInWorld;
+// filter taps, picked per quality tier, at most MAX_POISSON_SAMPLE_COUNT
+layout (constant_id = 0) const int POISSON_SAMPLE_COUNT = 16;
+// average the blockers first and widen the kernel with the receiver's distance to them (PCSS)
+layout (constant_id = 1) const bool BLOCKER_SEARCH = false;
+
+// hardware filtered comparisons for the filter, raw depth for the blocker search
+layout (binding = 1) uniform sampler2DArrayShadow samplerShadowMap;
+layout (binding = 2) uniform sampler2D samplerDepth;
+// octahedral world space normal
+layout (binding = 3) uniform sampler2D samplerNormal;
+layout (binding = 4) uniform sampler2DArray samplerShadowDepth;
+
+layout (location = 0) in vec2 inUV;
 
 layout (set = 0, binding = 0) uniform UBO
 {
@@ -13,60 +24,120 @@ layout (set = 0, binding = 0) uniform UBO
     float farPlane;
     mat4 projection;
     mat4 view;
-    mat4 lightSpace;
-    vec4 lightPosition;
+    mat4 cascadeViewProj[MAX_SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits;
+    vec4 lightDirection;
+    // x: filter radius in texels, y: penumbra texels per unit of light space depth, z: max radius in texels,
+    // w: disk rotation of this frame while the result is accumulated over time
+    vec4 filterParams;
+    // inverse camera view projection, reconstructs world positions from depth
+    mat4 invViewProjection;
 } ubo;
 
 layout (location = 0) out vec4 outColor;
 
-float textureProj(vec4 shadowCoord, vec2 off, float bias)
+// spread over the unit disk
+const vec2 poissonDisk[MAX_POISSON_SAMPLE_COUNT] = vec2[](
+    vec2(-0.613392, 0.617481), vec2(0.170019, -0.040254), vec2(-0.299417, 0.791925), vec2(0.645680, 0.493210),
+    vec2(-0.651784, 0.717887), vec2(0.421003, 0.027070), vec2(-0.817194, -0.271096), vec2(-0.705374, -0.668203),
+    vec2(0.977050, -0.108615), vec2(0.063326, 0.142369), vec2(0.203528, 0.214331), vec2(-0.667531, 0.326090),
+    vec2(-0.098422, -0.295755), vec2(-0.885922, 0.215369), vec2(0.566637, 0.605213), vec2(0.039766, -0.396100),
+    vec2(0.751946, 0.453352), vec2(0.078707, -0.715323), vec2(-0.075838, -0.529344), vec2(0.724479, -0.580798),
+    vec2(0.222999, -0.215125), vec2(-0.467574, -0.405438), vec2(-0.248268, -0.814753), vec2(0.354411, -0.887570),
+    vec2(0.175817, 0.382366), vec2(0.487472, -0.063082), vec2(-0.084078, 0.898312), vec2(0.488876, -0.783441),
+    vec2(0.470016, 0.217933), vec2(-0.696890, -0.549791), vec2(-0.149693, 0.605762), vec2(0.034211, 0.979980)
+);
+
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// rotates the disk per pixel, turns banding into noise the eye averages,
+// and per frame, so the temporal accumulation sees other taps every frame
+mat2 diskRotation()
+{
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715)))) + ubo.filterParams.w;
+    float s = sin(angle);
+    float c = cos(angle);
+    return mat2(c, s, -s, c);
+}
+
+// average light space depth of the occluders around uv, -1 without any
+float findBlockerDepth(vec2 uv, float receiverDepth, float searchRadius, mat2 rotation, uint cascade)
 {
-	float shadow = 0.0;
-    float currentDepth = shadowCoord.z;
-    vec2 uv = shadowCoord.xy * 0.5 + 0.5;
-	if (currentDepth < 1.0) 
-	{
-		float dist = texture(samplerShadowMap, uv + off).r;
-		if (dist < currentDepth - bias) 
-			shadow = 1.0;
-	}
-	return shadow;
+    float blockerSum = 0.0;
+    int blockerCount = 0;
+    for (int i = 0; i < POISSON_SAMPLE_COUNT; i++)
+    {
+        vec2 offset = rotation * poissonDisk[i] * searchRadius;
+        float depth = texture(samplerShadowDepth, vec3(uv + offset, cascade)).r;
+        if (depth < receiverDepth)
+        {
+            blockerSum += depth;
+            blockerCount++;
+        }
+    }
+    return blockerCount > 0 ? blockerSum / float(blockerCount) : -1.0;
 }
 
-float filterPCF(vec4 sc, float bias)
+// fraction of the kernel in shadow, every tap is a bilinear filtered 2x2 comparison
+float filterShadow(vec4 sc, float bias, uint cascade)
 {
-	ivec2 texDim = textureSize(samplerShadowMap, 0);
-	float scale = 1.5;
-	float dx = scale * 1.0 / float(texDim.x);
-	float dy = scale * 1.0 / float(texDim.y);
-
-	float shadowFactor = 0.0;
-	int count = 0;
-	int range = 1;
-	
-	for (int x = -range; x <= range; x++)
-	{
-		for (int y = -range; y <= range; y++)
-		{
-			shadowFactor += textureProj(sc, vec2(dx*x, dy*y), bias);
-			count++;
-		}
-	
-	}
-	return shadowFactor / count;
+    float receiverDepth = sc.z;
+    if (receiverDepth <= 0.0 || receiverDepth >= 1.0)
+        return 0.0;
+
+    vec2 texelSize = 1.0 / vec2(textureSize(samplerShadowMap, 0).xy);
+    vec2 uv = sc.xy * 0.5 + 0.5;
+    mat2 rotation = diskRotation();
+    float radius = ubo.filterParams.x;
+    if (BLOCKER_SEARCH)
+    {
+        float blockerDepth = findBlockerDepth(uv, receiverDepth - bias, ubo.filterParams.z * texelSize.x, rotation, cascade);
+        if (blockerDepth < 0.0)
+            return 0.0;
+        radius = clamp((receiverDepth - blockerDepth) * ubo.filterParams.y, radius, ubo.filterParams.z);
+    }
+
+    float lit = 0.0;
+    for (int i = 0; i < POISSON_SAMPLE_COUNT; i++)
+    {
+        vec2 offset = rotation * poissonDisk[i] * radius * texelSize;
+        lit += texture(samplerShadowMap, vec4(uv + offset, cascade, receiverDepth - bias));
+    }
+    return 1.0 - lit / float(POISSON_SAMPLE_COUNT);
 }
 
 void main()
 {
-    vec3 lightDir = normalize(inPositionInWorld - ubo.lightPosition).xyz;
-    float bias = max(0.01 * (1.0 - dot(-lightDir, inNormalInWorld)), 0.001);
-    vec4 projCoords = inPosInLightSpace / inPosInLightSpace.w;
-    // vec2 uv = projCoords.xy * 0.5 + 0.5;
-    float shadow = filterPCF(projCoords, bias) * 0.65;
-    // float closestDepth = texture(samplerShadowMap, uv).r;
-    // float currentDepth = projCoords.z;
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;  
-    // if(currentDepth > 1.0)
-        // shadow = 0.0;
+    float depth = texture(samplerDepth, inUV).r;
+    vec4 positionInWorld = ubo.invViewProjection * vec4(inUV * 2.0 - 1.0, depth, 1.0);
+    positionInWorld /= positionInWorld.w;
+    vec3 normalInWorld = octahedralDecode(texture(samplerNormal, inUV).rg);
+    // 相机空间深度, 用于选择级联
+    float viewDepth = -(ubo.view * positionInWorld).z;
+
+    uint cascadeCount = uint(ubo.lightDirection.w);
+    float shadow = 0.0;
+    // background pixels keep the cleared far depth,
+    // fragments beyond the last split are not covered by any cascade
+    if (depth < 1.0 && viewDepth <= ubo.cascadeSplits[cascadeCount - 1])
+    {
+        uint cascade = 0;
+        for (uint i = 0; i < cascadeCount - 1; i++)
+        {
+            if (viewDepth > ubo.cascadeSplits[i])
+                cascade = i + 1;
+        }
+
+        vec3 lightDir = normalize(ubo.lightDirection.xyz);
+        float bias = max(0.002 * (1.0 - dot(-lightDir, normalize(normalInWorld))), 0.0005);
+        vec4 shadowCoord = ubo.cascadeViewProj[cascade] * positionInWorld;
+        shadow = filterShadow(shadowCoord / shadowCoord.w, bias, cascade) * 0.65;
+    }
     outColor = vec4(shadow, shadow, shadow, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,31 @@
+// records of the GPU driven draws and the per object data of every draw, included after
+// #extension GL_GOOGLE_include_directive
+
+// mirrors vks::geometry::VulkanGLTFModel::DrawRecord
+struct DrawRecord
+{
+	// local space bounds
+	vec4 boundsMin;
+	vec4 boundsMax;
+	uint firstIndex;
+	uint indexCount;
+	uint objectIndex;
+	uint materialBatch;
+	uint casterBatch;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+// mirrors vks::geometry::VulkanGLTFModel::ObjectData, one per primitive
+struct ObjectData
+{
+	// world matrices in this and the last frame
+	mat4 model;
+	mat4 previousModel;
+	mat3 normalMatrix;
+	uint materialIndex;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
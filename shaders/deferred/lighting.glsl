@@ -0,0 +1,340 @@
+// clustered pbr lighting of the G-buffer, shared by the lighting pass and the lighting subpass of the merged deferred path,
+// included after #extension GL_GOOGLE_include_directive and the G-buffer bindings 0 to 4
+
+// blurred ssao, 1 when ssao is disabled
+layout (binding = 5) uniform sampler2D samplerOcclusion;
+
+layout (binding = 7) uniform samplerCube samplerIrradianceCube;
+layout (binding = 8) uniform samplerCube samplerPreFilteringCube;
+layout (binding = 9) uniform sampler2D samplerSpecularBRDFLut;
+layout (binding = 10) uniform sampler2D samplerShadowLut;
+
+layout (constant_id = 0) const uint MAX_LIGHTS_PER_CLUSTER = 128;
+
+struct Light
+{
+	// xyz: view space position, w: range
+	vec4 positionRange;
+	vec4 colorIntensity;
+	// xyz: view space spot direction
+	vec4 spotDirection;
+	// x: cone scale, y: cone offset, z: first shadow atlas tile or -1, w: tile count
+	vec4 spotShadow;
+};
+
+layout (binding = 11) uniform UBO
+{
+	vec4 viewPos;
+	mat4 viewMat;
+	// xyz: cluster grid size, w: light count
+	uvec4 clusterGrid;
+	// x: near, y: far, z: slice scale, w: slice bias
+	vec4 clusterDepth;
+	// inverse camera view projection, reconstructs world positions from depth at uvs of the targets
+	mat4 invViewProjection;
+	// xy: fraction of the targets the scene is rendered into
+	vec4 renderScale;
+} ubo;
+
+layout (std430, binding = 12) readonly buffer Lights
+{
+	Light lights[];
+};
+
+layout (std430, binding = 13) readonly buffer ClusterLightCounts
+{
+	uint clusterLightCounts[];
+};
+
+layout (std430, binding = 14) readonly buffer ClusterLightIndices
+{
+	uint clusterLightIndices[];
+};
+
+// comparison sampler, every lookup filters four depth tests
+layout (binding = 15) uniform sampler2DArrayShadow samplerShadowAtlas;
+
+struct ShadowTile
+{
+	mat4 viewProjection;
+	// xy: uv offset, zw: uv size
+	vec4 atlasRect;
+	// x: texel size at unit distance
+	vec4 params;
+};
+
+layout (std430, binding = 16) readonly buffer ShadowTiles
+{
+	ShadowTile shadowTiles[];
+};
+
+const float PI = 3.14159265359;
+
+// From http://filmicgames.com/archives/75
+vec3 Uncharted2Tonemap(vec3 x)
+{
+	float A = 0.15;
+	float B = 0.50;
+	float C = 0.10;
+	float D = 0.20;
+	float E = 0.02;
+	float F = 0.30;
+	return ((x*(A*x+C*B)+D*E)/(x*(A*x+B)+D*F))-E/F;
+}
+
+// Normal Distribution function --------------------------------------
+float D_GGX(float NH, float roughness)
+{
+	float alpha = roughness * roughness;
+	float alpha2 = alpha * alpha;
+	float denom = NH * NH * (alpha2 - 1.0) + 1.0;
+	return (alpha2)/(PI * denom*denom); 
+}
+
+// Geometric Shadowing function --------------------------------------
+float G_SchlicksmithGGX(float NL, float NV, float roughness)
+{
+	float r = (roughness + 1.0);
+	float k = (r*r) / 8.0;
+	float GL = NL / (NL * (1.0 - k) + k);
+	float GV = NV / (NV * (1.0 - k) + k);
+	return GL * GV;
+}
+
+// Fresnel function ----------------------------------------------------
+vec3 fresnelSchlickRoughness(float cosTheta, float roughness, vec3 F0)
+{
+	vec3 F = F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+	return F;    
+}
+
+// Windowed inverse square falloff, reaches zero at the light range
+float attenuationWindowed(float dist, float range)
+{
+	float ratio = dist / range;
+	float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+	return window * window / max(dist * dist, 1e-4);
+}
+
+uint clusterIndex(vec2 uv, float viewDepth)
+{
+	uvec2 tile = min(uvec2(uv * vec2(ubo.clusterGrid.xy)), ubo.clusterGrid.xy - 1);
+	float slice = log(max(viewDepth, ubo.clusterDepth.x)) * ubo.clusterDepth.z - ubo.clusterDepth.w;
+	uint z = min(uint(max(slice, 0.0)), ubo.clusterGrid.z - 1);
+	return tile.x + tile.y * ubo.clusterGrid.x + z * ubo.clusterGrid.x * ubo.clusterGrid.y;
+}
+
+// 1 where a spot or point light reaches worldPos, a 3x3 texel tent from four filtered lookups clamped to the light's atlas tile
+float localLightShadow(Light light, vec3 worldPos, vec3 worldNormal, vec3 lightToFrag)
+{
+	if (light.spotShadow.z < 0.0)
+		return 1.0;
+
+	uint tile = uint(light.spotShadow.z);
+	if (light.spotShadow.w > 1.5)
+	{
+		// cube face order +x, -x, +y, -y, +z, -z
+		vec3 a = abs(lightToFrag);
+		if (a.x >= a.y && a.x >= a.z)
+			tile += lightToFrag.x > 0.0 ? 0u : 1u;
+		else if (a.y >= a.z)
+			tile += lightToFrag.y > 0.0 ? 2u : 3u;
+		else
+			tile += lightToFrag.z > 0.0 ? 4u : 5u;
+	}
+	ShadowTile shadowTile = shadowTiles[tile];
+
+	// offset along the normal by about one shadow texel at this distance
+	float texel = shadowTile.params.x * length(lightToFrag);
+	vec4 coord = shadowTile.viewProjection * vec4(worldPos + worldNormal * texel * 1.5, 1.0);
+	coord.xyz /= coord.w;
+	if (coord.w <= 0.0 || coord.z <= 0.0 || coord.z >= 1.0)
+		return 1.0;
+
+	vec2 texelSize = 1.0 / vec2(textureSize(samplerShadowAtlas, 0).xy);
+	vec2 uv = shadowTile.atlasRect.xy + (coord.xy * 0.5 + 0.5) * shadowTile.atlasRect.zw;
+	vec2 uvMin = shadowTile.atlasRect.xy + texelSize * 0.5;
+	vec2 uvMax = shadowTile.atlasRect.xy + shadowTile.atlasRect.zw - texelSize * 0.5;
+	float lit = 0.0;
+	for (int x = 0; x < 2; x++)
+	{
+		for (int y = 0; y < 2; y++)
+		{
+			vec2 offset = (vec2(x, y) - 0.5) * texelSize;
+			lit += texture(samplerShadowAtlas, vec4(clamp(uv + offset, uvMin, uvMax), 0.0, coord.z));
+		}
+	}
+	return lit * 0.25;
+}
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+// ----------------------------------------------------------------------------
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+vec3 prefilteredReflection(vec3 R, float roughness)
+{
+	const float MAX_REFLECTION_LOD = 9.0; // todo: param/const
+	float lod = roughness * MAX_REFLECTION_LOD;
+	float lodf = floor(lod);
+	float lodc = ceil(lod);
+	vec3 a = textureLod(samplerPreFilteringCube, R, lodf).rgb;
+	vec3 b = textureLod(samplerPreFilteringCube, R, lodc).rgb;
+	return mix(a, b, lod - lodf);
+}
+
+// linear HDR radiance of the pixel at uv from its G-buffer values, albedo is in sRGB
+vec4 shadeGBuffer(vec2 uv, float depth, vec2 encodedNormal, vec3 albedoSRGB, vec3 material, vec3 emissive)
+{
+	// Get G-Buffer values
+	// lighting in view space
+	// 需要在viewspace中做光照，否则传入的viewPos本来就是有问题的，缺少相机的方向，导致N和L的计算都有问题
+	vec4 worldPosition = ubo.invViewProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	vec3 worldPos = worldPosition.xyz / worldPosition.w;
+	vec3 worldNormal = octahedralDecode(encodedNormal);
+	vec3 fragPos = (ubo.viewMat * vec4(worldPos, 1.0)).rgb;
+	mat3 mNormal = transpose(inverse(mat3(ubo.viewMat)));
+	vec3 normal = mNormal * worldNormal;
+	vec3 albedo = pow(albedoSRGB, vec3(2.2));
+	float metallic = material.b;
+	float roughness = material.g;
+	// material ao times ssao
+	float ao = material.r * texture(samplerOcclusion, uv).r;
+	float shadow = texture(samplerShadowLut, uv).r;
+
+	vec3 N = normalize(normal);
+	// in view space, viewPos is origin point
+	vec3 V = normalize(-fragPos);
+	vec3 R = reflect(-V, N);
+
+	vec3 F0 = vec3(0.04);
+	F0 = mix(F0, albedo, metallic);
+
+	// direct lighting
+	// Precalculate vectors and dot products
+	float NV = clamp(dot(N, V), 0.0, 1.0);
+
+	// Specular contribution
+	// only the lights binned into this pixel's cluster
+	vec3 Lo = vec3(0.0);
+	// the cluster grid spans the rendered region
+	uint cluster = clusterIndex(uv / ubo.renderScale.xy, -fragPos.z);
+	uint clusterLightCount = clusterLightCounts[cluster];
+	for(uint c = 0; c < clusterLightCount; c++)
+	{
+		Light light = lights[clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + c]];
+		vec3 lightPos = light.positionRange.xyz;
+		vec3 lightColor = light.colorIntensity.rgb;
+		vec3 LD = lightPos - fragPos;
+		float dist = length(LD);
+		if (dist >= light.positionRange.w) continue;
+		vec3 L = normalize(LD);
+		// spot cone, point lights have scale 0 and offset 1
+		float cone = clamp(dot(light.spotDirection.xyz, -L) * light.spotShadow.x + light.spotShadow.y, 0.0, 1.0);
+		float attenuation = attenuationWindowed(dist, light.positionRange.w) * cone * cone;
+		if (attenuation <= 0.0) continue;
+		// the view matrix is rigid, so its transpose takes the light to fragment vector back to world space
+		attenuation *= localLightShadow(light, worldPos, normalize(worldNormal), transpose(mat3(ubo.viewMat)) * -LD);
+		vec3 radiance = lightColor * attenuation;
+
+		vec3 H = normalize (V + L);
+
+		float HV = clamp(dot(H, V), 0.0, 1.0);
+		float NH = clamp(dot(N, H), 0.0, 1.0);
+		float NL = clamp(dot(N, L), 0.0, 1.0);
+		float LH = clamp(dot(L, H), 0.0, 1.0);
+
+		// BRDF
+		// D = Normal distribution (Distribution of the microfacets)
+		float D = D_GGX(NH, roughness); 
+		// G = Geometric shadowing term (Microfacets shadowing)
+		float G = G_SchlicksmithGGX(NL, NV, roughness);
+		// F = Fresnel factor (Reflectance depending on angle of incidence)
+		vec3 F = fresnelSchlick(HV, F0);
+
+		vec3 ks = F;
+        vec3 kd = vec3(1.0) - ks;
+        kd *= (1.0 - metallic);
+
+		vec3 spec = D * F * G / (4.0 * NV * NL + 1e-4);
+		Lo += (kd * albedo / PI + spec) * radiance * NL; 
+	}
+
+	// Lo *= (1.0 - shadow);
+
+	// ambient lighting
+	vec3 F = fresnelSchlickRoughness(NV, roughness, F0);
+	vec3 ks = F;
+	vec3 kd = 1.0 - ks;
+	kd *= (1.0 - metallic);	
+  
+	vec3 irradiance = texture(samplerIrradianceCube, N).rgb;
+	vec3 diffuse = irradiance * albedo;
+	// vec3 diffuse = vec3(0.0);
+
+	vec3 reflectionColor = prefilteredReflection(R, roughness).rgb; 
+	// const float MAX_REFLECTION_LOD = 7.0;
+	// vec3 reflectionColor = textureLod(samplerPreFilteringCube, R, roughness * MAX_REFLECTION_LOD).rgb;   
+	vec2 envBRDF = texture(samplerSpecularBRDFLut, vec2(NV, roughness)).rg;
+	// raw implementation
+	// vec3 specular = reflectionColor * (F * envBRDF.x + envBRDF.y);
+	// multi albedo
+	vec3 specular = reflectionColor * (F * envBRDF.x + envBRDF.y);
+	// vec3 specular = reflectionColor * (F * envBRDF.x + envBRDF.y) * albedo;
+	// 这个实现存疑，但是原来的实现没有考虑到反射的颜色和物体本身颜色的关系以及是否是金属，所以改成这样了
+	// vec3 specular = reflectionColor * (F * envBRDF.x + envBRDF.y) * albedo * metallic;
+	// vec3 specular = vec3(0.0);
+	vec3 ambient = (kd * diffuse + specular) * ao.rrr;
+    vec3 color = ambient + Lo;
+	color *= (1.0 - shadow);
+	// 自发光没有处理好，需要做一下
+	color += emissive;
+
+	// color = vec3(NV, NV, NV);
+	// color = V;
+
+	// Tone mapping
+//	color = Uncharted2Tonemap(color * 2.5);
+//	color = color * (1.0f / Uncharted2Tonemap(vec3(11.2f)));
+    // HDR tonemapping
+    // color = color / (color + vec3(1.0));
+    // gamma correct
+//    color = pow(color, vec3(1.0/2.2));
+
+    return vec4(color , 1.0);
+
+	// vec3 Lo = vec3(0.0);
+	// for(int i=0; i < LIGHT_COUNT; i++)
+	// {
+	// 	vec3 L = ubo.lights[i].position.xyz - fragPos;
+	// 	float dist = length(L);
+	// 	L = normalize(L);
+
+	// 	// Specular lighting
+	// 	vec3 R = reflect(-L, N);
+
+	// 	// Diffuse lighting
+	// 	float NdotL = max(0.0, dot(N, L));
+	// 	vec3 diff = vec3(NdotL);
+
+	// 	float NdotR = max(0.0, dot(R, V));
+	// 	vec3 spec = vec3(pow(NdotR, 16.0) * albedo.r * 2.5);
+	
+	// 	Lo += vec3(diff) * albedo.xyz * ubo.lights[i].color.rgb;
+	// }
+
+	// vec3 color = vec3(0.0);
+	// color += Lo;
+
+	// color = pow(color, vec3(0.4545));
+	// outColor = vec4(color, 1.0);
+}
\ No newline at end of file
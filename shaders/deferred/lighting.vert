@@ -5,5 +5,6 @@ layout (location = 0) out vec2 outUV;
 void main() 
 {
 	outUV = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
-	gl_Position = vec4(outUV * 2.0f - 1.0f, 0.0f, 1.0f);
+	// on the far plane, the greater depth test against the G-buffer depth rejects the sky pixels before shading
+	gl_Position = vec4(outUV * 2.0f - 1.0f, 1.0f, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// lighting subpass of the merged deferred path, the G-buffer attachments of the same render pass are read
+// at the pixel being shaded, input attachment indices follow the input references of the subpass
+layout (input_attachment_index = 0, binding = 0) uniform subpassInput inputDepth;
+// octahedral world space normal, written by the prepass so ssao and the shadow resolve can sample it
+layout (binding = 1) uniform sampler2D samplerNormal;
+
+layout (input_attachment_index = 1, binding = 2) uniform subpassInput inputAlbedo;
+// r = ao, g = roughness, b = metallic
+layout (input_attachment_index = 2, binding = 3) uniform subpassInput inputMaterial;
+layout (input_attachment_index = 3, binding = 4) uniform subpassInput inputEmissive;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outColor;
+
+#include "lighting.glsl"
+
+void main()
+{
+	outColor = shadeGBuffer(inUV, subpassLoad(inputDepth).r, texture(samplerNormal, inUV).rg, subpassLoad(inputAlbedo).rgb,
+		subpassLoad(inputMaterial).rgb, subpassLoad(inputEmissive).rgb);
+}
@@ -27,14 +27,18 @@ layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec3 inColor;
 layout (location = 3) in vec3 inWorldPos;
 layout (location = 4) in vec3 inTangent;
-
-layout (location = 0) out vec4 outPosition;
-layout (location = 1) out vec4 outNormal;
-layout (location = 2) out vec4 outAlbedo;
-layout (location = 3) out vec4 outRoughnessMetallic;
-layout (location = 4) out vec4 outEmissive;
-layout (location = 5) out vec4 outOcclusion;
-layout (location = 6) out vec4 outDepth;
+layout (location = 5) in vec4 inClipPos;
+layout (location = 6) in vec4 inPreviousClipPos;
+
+// world space positions are reconstructed from the depth buffer
+// octahedral world space normal
+layout (location = 0) out vec2 outNormal;
+layout (location = 1) out vec4 outAlbedo;
+// r = ao, g = roughness, b = metallic
+layout (location = 2) out vec4 outMaterial;
+layout (location = 3) out vec4 outEmissive;
+// uv offset from the last frame to this one, the history of uv is at uv - velocity
+layout (location = 4) out vec2 outVelocity;
 
 layout (set = 0, binding = 0) uniform UBO 
 {
@@ -42,6 +46,9 @@ layout (set = 0, binding = 0) uniform UBO
 	float farPlane;
 	mat4 projection;
 	mat4 view;
+	mat4 previousViewProjection;
+	// xy: projection jitter of this frame, zw: of the last frame, in normalized device coordinates
+	vec4 jitter;
 } ubo;
 
 // ----------------------------------------------------------------------------
@@ -66,6 +73,14 @@ vec3 getNormalFromMap()
     return normalize(TBN * tangentNormal);
 }
 
+// unit vector to the [-1, 1] square, the lower hemisphere is folded over the diagonals
+vec2 octahedralEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.z >= 0.0 ? n.xy : folded;
+}
+
 float linearDepth(float depth)
 {
 	float z = depth;
@@ -80,8 +95,6 @@ float linearDepth(float depth)
 
 void main()
 {
-    outPosition = vec4(inWorldPos, 1.0);
-
     outAlbedo = texture(samplerBaseColor, inUV);
 
     // Calculate normal in tangent space
@@ -90,22 +103,21 @@ void main()
     // vec3 B = cross(N, T);
     // mat3 TBN = mat3(T, B, N);
     // outNormal = vec4(N, 1.0);
-    outNormal = vec4(getNormalFromMap(), 1.0);
+    outNormal = octahedralEncode(getNormalFromMap());
     // outNormal = vec4(texture(samplerNormal,inUV).xyz,1.0);
     // vec3 tnorm = TBN * normalize(texture(samplerNormal, inUV).xyz * 2.0 - vec3(1.0));
     // outNormal = vec4(texture(samplerNormal, inUV).xyz, 1.0);
-    outRoughnessMetallic = vec4(0.0, texture(samplerOcclusionRoughnessMetallic, inUV).gb, 1.0);
+    vec3 occlusionRoughnessMetallic = texture(samplerOcclusionRoughnessMetallic, inUV).rgb;
     outEmissive = texture(samplerEmissive, inUV);
 
     // ao
     ivec2 occlusionSize2d = textureSize(samplerOcclusion, 0);
+    float ao = occlusionRoughnessMetallic.r;
     if(occlusionSize2d.x != 1)
-        outOcclusion = vec4(texture(samplerOcclusion, inUV).rrr, 1);
-    else
-        outOcclusion = vec4(texture(samplerOcclusionRoughnessMetallic, inUV).rrr, 1);
-
-    float depth = gl_FragCoord.z;
-//    float depth = linearDepth(gl_FragCoord.z);
-    // float depth = 1.0 - gl_FragCoord.z / gl_FragCoord.w;
-    outDepth = vec4(depth, depth, depth, 1.0);
+        ao = texture(samplerOcclusion, inUV).r;
+    outMaterial = vec4(ao, occlusionRoughnessMetallic.gb, 1.0);
+
+    // clip space to uv is ndc * 0.5 + 0.5, so the difference of the ndc only needs the scale,
+    // the jitter is left out so still surfaces have no motion
+    outVelocity = ((inClipPos.xy / inClipPos.w - ubo.jitter.xy) - (inPreviousClipPos.xy / inPreviousClipPos.w - ubo.jitter.zw)) * 0.5;
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec4 inColor;
+layout (location = 3) in vec3 inNormal;
+layout (location = 4) in vec4 inTangent;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	float nearPlane;
+	float farPlane;
+	mat4 projection;
+	mat4 view;
+	// camera of the last rendered frame, for motion vectors
+	mat4 previousViewProjection;
+	// xy: projection jitter of this frame, zw: of the last frame, in normalized device coordinates
+	vec4 jitter;
+} ubo;
+
+#include "objectData.glsl"
+
+layout (std430, set = 2, binding = 0) readonly buffer DrawRecords
+{
+	DrawRecord records[];
+};
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out vec3 outColor;
+layout (location = 3) out vec3 outWorldPos;
+layout (location = 4) out vec3 outTangent;
+layout (location = 5) out vec4 outClipPos;
+layout (location = 6) out vec4 outPreviousClipPos;
+
+// the merged deferred path draws twice, the G-buffer fill subpass tests for the depth of the prepass
+invariant gl_Position;
+
+// mrt.vert for the indirect draws of drawCulling.comp, the first instance of a command is its record
+void main() 
+{
+	ObjectData primitive = objects[records[gl_InstanceIndex].objectIndex];
+	vec4 tmpPos = vec4(inPos.xyz, 1.0);
+
+	gl_Position = ubo.projection * ubo.view * primitive.model * tmpPos;
+	// the same vertex in the last frame, interpolated per fragment for its screen space motion
+	outClipPos = gl_Position;
+	outPreviousClipPos = ubo.previousViewProjection * primitive.previousModel * tmpPos;
+	
+	outUV = inUV;
+
+	// Vertex position in world space
+	outWorldPos = vec3(primitive.model * tmpPos);
+
+	// Normal in world space, the normal matrix is computed once per object on the CPU
+	outNormal = primitive.normalMatrix * normalize(inNormal);
+	outTangent = primitive.normalMatrix * normalize(inTangent.xyz);
+	
+	// Currently just vertex color
+	outColor = inColor.xyz;
+}
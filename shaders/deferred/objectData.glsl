@@ -0,0 +1,8 @@
+// per object data of the G-buffer vertex shaders in set 2, included after #extension GL_GOOGLE_include_directive
+
+#include "drawRecord.glsl"
+
+layout (std430, set = 2, binding = 1) readonly buffer Objects
+{
+	ObjectData objects[];
+};
@@ -1,10 +0,0 @@
-#version 450
-
-layout (location = 1) out vec2 outUV;
-
-void main()
-{
-	outUV = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
-	vec4 posInClip = vec4(outUV * 2.0f - 1.0f, 1.0f, 1.0f);
-	gl_Position = posInClip;
-}
@@ -0,0 +1,27 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+
+// mirrors vks::ShadowAtlasTile
+struct ShadowTile
+{
+    mat4 viewProjection;
+    // xy: offset, zw: size, in atlas uv
+    vec4 atlasRect;
+    vec4 params;
+};
+
+layout (std430, set = 0, binding = 0) readonly buffer ShadowTiles
+{
+    ShadowTile tiles[];
+};
+
+layout(push_constant) uniform PushConsts {
+	mat4 model;
+	uint tileIndex;
+} primitive;
+
+void main()
+{
+    gl_Position = tiles[primitive.tileIndex].viewProjection * primitive.model * vec4(inPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+
+layout(push_constant) uniform PushConsts {
+	mat4 model;
+} primitive;
+
+// world space, shadowAtlasCube.geom projects into each cube face
+void main()
+{
+    gl_Position = primitive.model * vec4(inPos, 1.0);
+}
\ No newline at end of file
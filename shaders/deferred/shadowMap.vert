@@ -1,5 +1,8 @@
 #version 450
 
+// mirrors GlobalVars::MAX_SHADOW_CASCADE_COUNT
+#define MAX_SHADOW_CASCADE_COUNT 4
+
 layout (location = 0) in vec3 inPos;
 
 layout (set = 0, binding = 0) uniform UBO
@@ -8,14 +11,17 @@ layout (set = 0, binding = 0) uniform UBO
     float farPlane;
     mat4 projection;
     mat4 view;
-    mat4 lightSpace;
+    mat4 cascadeViewProj[MAX_SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits;
+    vec4 lightDirection;
 } ubo;
 
 layout(push_constant) uniform PushConsts {
 	mat4 model;
+	uint cascadeIndex;
 } primitive;
 
 void main()
 {
-    gl_Position = ubo.lightSpace * primitive.model * vec4(inPos, 1.0);
+    gl_Position = ubo.cascadeViewProj[primitive.cascadeIndex] * primitive.model * vec4(inPos, 1.0);
 }
\ No newline at end of file
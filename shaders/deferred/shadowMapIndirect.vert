@@ -0,0 +1,41 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// mirrors GlobalVars::MAX_SHADOW_CASCADE_COUNT
+#define MAX_SHADOW_CASCADE_COUNT 4
+
+layout (location = 0) in vec3 inPos;
+
+layout (set = 0, binding = 0) uniform UBO
+{
+    float nearPlane;
+    float farPlane;
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeViewProj[MAX_SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits;
+    vec4 lightDirection;
+} ubo;
+
+#include "drawRecord.glsl"
+
+layout (std430, set = 1, binding = 0) readonly buffer DrawRecords
+{
+    DrawRecord records[];
+};
+
+layout (std430, set = 1, binding = 1) readonly buffer Objects
+{
+    ObjectData objects[];
+};
+
+layout(push_constant) uniform PushConsts {
+	uint cascadeIndex;
+} cascade;
+
+// shadowMap.vert for the indirect draws of drawCulling.comp, the first instance of a command is its record
+void main()
+{
+    mat4 model = objects[records[gl_InstanceIndex].objectIndex].model;
+    gl_Position = ubo.cascadeViewProj[cascade.cascadeIndex] * model * vec4(inPos, 1.0);
+}
@@ -21,5 +21,7 @@ out gl_PerVertex
 void main() 
 {
 	outUVW = inPos;
-	gl_Position = ubo.projection * ubo.view * ubo.model * vec4(inPos.xyz, 1.0);
+	vec4 position = ubo.projection * ubo.view * ubo.model * vec4(inPos.xyz, 1.0);
+	// on the far plane, only the pixels the G-buffer left at the cleared depth pass the depth test
+	gl_Position = position.xyww;
 }
@@ -1,6 +1,7 @@
 #version 450
 
-layout (binding = 0) uniform sampler2D samplerPosition;
+layout (binding = 0) uniform sampler2D samplerDepth;
+// octahedral world space normal
 layout (binding = 1) uniform sampler2D samplerNormal;
 //layout (binding = 2) uniform sampler2D samplerDepth;
 layout (binding = 2) uniform sampler2D ssaoNoise;
@@ -13,6 +14,7 @@ layout (binding = 3) uniform UBO
 	mat4 view;
 	mat3 invViewT;
 	mat4 projection;
+	mat4 invProjection;
 	vec4 samples[SSAO_KERNEL_SIZE];	
 	float ssaoRadius;
 	float ssaoBias;
@@ -22,21 +24,35 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragColor;
 
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+// view space position of the G-buffer sample at uv
+vec3 viewPosition(vec2 uv)
+{
+	vec4 position = ubo.invProjection * vec4(uv * 2.0 - 1.0, texture(samplerDepth, uv).r, 1.0);
+	return position.xyz / position.w;
+}
+
 void main() 
 {
 	//噪声和normal的范围都是在[-1,1]，所以不需要再 * 2.0 - 1
 
 	// frag and normal shoule be in view space
 	// Get G-Buffer values
-	vec4 worldPos = texture(samplerPosition, inUV);
-	vec3 viewPos = (ubo.view * worldPos).rgb;
-	vec3 worldNormal = texture(samplerNormal, inUV).rgb;
+	vec3 viewPos = viewPosition(inUV);
+	vec3 worldNormal = octahedralDecode(texture(samplerNormal, inUV).rg);
 	vec3 normal = ubo.invViewT * worldNormal;
 	normal = normalize(normal);
 	// normal = normalize(normal * 2.0 - 1.0);
 
 	// Get a random vector using a noise lookup
-	ivec2 texDim = textureSize(samplerPosition, 0); 
+	ivec2 texDim = textureSize(samplerDepth, 0); 
 	ivec2 noiseDim = textureSize(ssaoNoise, 0);
 	const vec2 noiseUV = vec2(float(texDim.x) / float(noiseDim.x), float(texDim.y) / (noiseDim.y)) * inUV;  
 	vec3 randomVec = texture(ssaoNoise, noiseUV).xyz;
@@ -64,8 +80,7 @@ void main()
 		offset.xyz /= offset.w; 
 		offset.xyz = offset.xyz * 0.5 + 0.5;
 
-		vec4 offsetWorldPos = texture(samplerPosition, offset.xy);
-		float sampleDepthValue = (ubo.view * offsetWorldPos).z;
+		float sampleDepthValue = viewPosition(offset.xy).z;
 		// vec4 tmp = ubo.projection * ubo.view * offsetWorldPos;
 		// float debugDepthValue = tmp.z / tmp.w;
 		// float debugDepthValue = (ubo.projection * ubo.view * offsetWorldPos).z;
@@ -0,0 +1,59 @@
+#version 450
+
+// blurred low resolution ssao
+layout (binding = 0) uniform sampler2D samplerOcclusion;
+// positive linear view space depth of the low resolution texels
+layout (binding = 1) uniform sampler2D samplerLowDepth;
+// full resolution depth buffer
+layout (binding = 2) uniform sampler2D samplerDepth;
+
+// leading members of the ssao uniform block
+layout (binding = 3) uniform UBO
+{
+	mat4 view;
+	mat3 invViewT;
+	mat4 projection;
+	mat4 invProjection;
+} ubo;
+
+layout (location = 0) in vec2 inUV;
+layout (location = 0) out vec4 outColor;
+
+// low resolution texels whose depth differs by 1 / DEPTH_SHARPNESS of the pixel's depth get a weight of 1 / e
+const float DEPTH_SHARPNESS = 20.0;
+
+void main()
+{
+	vec4 position = ubo.invProjection * vec4(inUV * 2.0 - 1.0, texture(samplerDepth, inUV).r, 1.0);
+	float depth = -position.z / position.w;
+
+	// joint bilateral upsample, the bilinear weights of the four closest texels are scaled by depth similarity
+	ivec2 lowSize = textureSize(samplerLowDepth, 0);
+	vec2 lowCoord = inUV * vec2(lowSize) - 0.5;
+	ivec2 base = ivec2(floor(lowCoord));
+	vec2 f = fract(lowCoord);
+	const ivec2 offsets[4] = ivec2[](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+	float bilinearWeights[4] = float[]((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+
+	float result = 0.0;
+	float weightSum = 0.0;
+	// fallback when no texel lies on the same surface, e.g. at silhouettes thinner than a low resolution texel
+	float nearestOcclusion = 1.0;
+	float nearestDelta = 3.402823466e+38;
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 texel = clamp(base + offsets[i], ivec2(0), lowSize - 1);
+		float occlusion = texelFetch(samplerOcclusion, texel, 0).r;
+		float depthDelta = abs(texelFetch(samplerLowDepth, texel, 0).r - depth) / max(depth, 1e-4);
+		float weight = bilinearWeights[i] * exp(-depthDelta * DEPTH_SHARPNESS);
+		result += occlusion * weight;
+		weightSum += weight;
+		if (depthDelta < nearestDelta)
+		{
+			nearestDelta = depthDelta;
+			nearestOcclusion = occlusion;
+		}
+	}
+	float ao = weightSum > 1e-3 ? result / weightSum : nearestOcclusion;
+	outColor = vec4(ao, ao, ao, 1.0);
+}
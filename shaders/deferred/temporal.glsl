@@ -0,0 +1,31 @@
+// temporal accumulation shared by the screen space effects, included after #extension GL_GOOGLE_include_directive
+// a texel finds its history through the G-buffer velocity and drops it when it belongs to another surface
+
+// history depths further than this fraction from the current depth are disoccluded surfaces
+const float HISTORY_DEPTH_TOLERANCE = 0.1;
+
+// uv of the same surface point in the previous frame, velocity is the G_Velocity of uv,
+// renderScale is the fraction of the targets the scene is rendered into and the velocity spans the whole view
+vec2 reprojectUV(vec2 uv, vec2 velocity, vec2 renderScale)
+{
+	return uv - velocity * renderScale;
+}
+
+// no history for surfaces that were outside the last frame's view
+bool historyInsideScreen(vec2 historyUV, vec2 renderScale)
+{
+	return all(greaterThanEqual(historyUV, vec2(0.0))) && all(lessThanEqual(historyUV, renderScale));
+}
+
+// 1 when the history depth is close enough to belong to the same surface, both are positive linear view depths
+float historyDepthWeight(float depth, float historyDepth)
+{
+	return abs(historyDepth - depth) < HISTORY_DEPTH_TOLERANCE * max(depth, 1e-4) ? 1.0 : 0.0;
+}
+
+// exponential moving average, the history is first clamped to the range of the current neighbourhood
+// so changes the depth test cannot see, e.g. moving shadows on a static surface, do not leave ghosts
+float accumulateHistory(float current, float history, float neighbourhoodMin, float neighbourhoodMax, float historyWeight)
+{
+	return mix(current, clamp(history, neighbourhoodMin, neighbourhoodMax), historyWeight);
+}
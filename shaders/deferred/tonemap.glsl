@@ -0,0 +1,20 @@
+// filmic tone mapping of the exposed scene color, applied by the post process dispatch before grading and gamma
+
+// From http://filmicworlds.com/blog/filmic-tonemapping-operators/
+vec3 Uncharted2Tonemap(vec3 color)
+{
+	float A = 0.15;
+	float B = 0.50;
+	float C = 0.10;
+	float D = 0.20;
+	float E = 0.02;
+	float F = 0.30;
+	float W = 11.2;
+	return ((color*(A*color+C*B)+D*E)/(color*(A*color+B)+D*F))-E/F;
+}
+
+// linear color in [0, 1], the white point maps to 1
+vec3 tonemap(vec3 color)
+{
+	return Uncharted2Tonemap(color) * (1.0f / Uncharted2Tonemap(vec3(11.2f)));
+}
@@ -0,0 +1,131 @@
+﻿#include <BoundingVolumeHierarchy.h>
+#include <MathUtils.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "TestUtils.h"
+
+namespace
+{
+    struct Scene
+    {
+        std::vector<glm::vec3> boxMin, boxMax;
+        math::AABBArray boxes;
+
+        void Set(uint32_t index, const glm::vec3& min, const glm::vec3& max)
+        {
+            boxMin[index] = min;
+            boxMax[index] = max;
+            boxes.Set(index, min, max);
+        }
+    };
+
+    // boxes of varied size spread over a 100 unit cube, some overlapping
+    Scene RandomScene(tests::Random& random, uint32_t count)
+    {
+        Scene scene;
+        scene.boxMin.resize(count);
+        scene.boxMax.resize(count);
+        scene.boxes.Resize(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            glm::vec3 center(random.Range(-50.0f, 50.0f), random.Range(-50.0f, 50.0f), random.Range(-50.0f, 50.0f));
+            glm::vec3 extent(random.Range(0.1f, 4.0f), random.Range(0.1f, 4.0f), random.Range(0.1f, 4.0f));
+            scene.Set(i, center - extent, center + extent);
+        }
+        return scene;
+    }
+
+    void CheckQueries(const vks::BoundingVolumeHierarchy& bvh, const Scene& scene, tests::Random& random)
+    {
+        const uint32_t count = static_cast<uint32_t>(scene.boxMin.size());
+        std::vector<uint8_t> visible, expected(count);
+        for (uint32_t query = 0; query < 32; query++)
+        {
+            glm::vec3 center(random.Range(-60.0f, 60.0f), random.Range(-60.0f, 60.0f), random.Range(-60.0f, 60.0f));
+            glm::vec3 extent(random.Range(1.0f, 30.0f), random.Range(1.0f, 30.0f), random.Range(1.0f, 30.0f));
+
+            math::Frustum frustum;
+            frustum.Update(center - extent, center + extent);
+            bvh.QueryFrustum(frustum, visible);
+            frustum.IntersectsAABBs(scene.boxes, expected.data());
+            CHECK(visible.size() == count);
+            for (uint32_t i = 0; i < count && i < visible.size(); i++)
+                CHECK(visible[i] == expected[i]);
+
+            const float radius = extent.x;
+            bvh.QuerySphere(center, radius, visible);
+            CHECK(visible.size() == count);
+            for (uint32_t i = 0; i < count && i < visible.size(); i++)
+                CHECK((visible[i] != 0) == math::IntersectsSphereAABB(center, radius, scene.boxMin[i], scene.boxMax[i]));
+        }
+
+        for (uint32_t ray = 0; ray < 64; ray++)
+        {
+            glm::vec3 origin(random.Range(-60.0f, 60.0f), random.Range(-60.0f, 60.0f), random.Range(-60.0f, 60.0f));
+            glm::vec3 direction = glm::normalize(
+                glm::vec3(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f)));
+            const glm::vec3 inverseDirection = 1.0f / direction;
+            const float maxDistance = 200.0f;
+
+            // the boxes are the items' geometry, the hit is the entry distance of the closest box
+            auto intersectBox = [&](uint32_t item, float itemMaxDistance)
+            {
+                float entryDistance;
+                if (!math::IntersectRayAABB(origin, inverseDirection, scene.boxMin[item], scene.boxMax[item],
+                                            itemMaxDistance, entryDistance))
+                    return -1.0f;
+                return entryDistance;
+            };
+            float expectedDistance = std::numeric_limits<float>::max();
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const float distance = intersectBox(i, maxDistance);
+                if (distance >= 0.0f && distance < expectedDistance)
+                    expectedDistance = distance;
+            }
+
+            uint32_t hitItem = 0;
+            float hitDistance = 0.0f;
+            const bool hit = bvh.Raycast(origin, direction, maxDistance, intersectBox, hitItem, hitDistance);
+            CHECK(hit == (expectedDistance != std::numeric_limits<float>::max()));
+            if (hit)
+            {
+                // ties between boxes may report either item, their distance is the same
+                CHECK(std::abs(hitDistance - expectedDistance) < 1e-4f);
+                CHECK(std::abs(intersectBox(hitItem, maxDistance) - hitDistance) < 1e-4f);
+            }
+        }
+    }
+
+    void TestQueries(uint32_t count)
+    {
+        tests::Random random(count);
+        Scene scene = RandomScene(random, count);
+        vks::BoundingVolumeHierarchy bvh;
+        bvh.Build(scene.boxes);
+        CHECK(bvh.ItemCount() == count);
+        CheckQueries(bvh, scene, random);
+
+        // moved boxes keep the tree, the refit bounds must still contain them
+        std::vector<uint32_t> moved;
+        for (uint32_t i = 0; i < count; i += 7)
+        {
+            const glm::vec3 offset(random.Range(-20.0f, 20.0f), random.Range(-20.0f, 20.0f), random.Range(-20.0f, 20.0f));
+            scene.Set(i, scene.boxMin[i] + offset, scene.boxMax[i] + offset);
+            moved.push_back(i);
+        }
+        bvh.Refit(scene.boxes, moved);
+        CheckQueries(bvh, scene, random);
+    }
+}
+
+int main()
+{
+    TestQueries(1);
+    TestQueries(13);
+    // large enough for the subtrees built on separate threads
+    TestQueries(5000);
+    return tests::failureCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+﻿#include <DrawList.h>
+#include <algorithm>
+#include <vector>
+
+#include "TestUtils.h"
+
+namespace
+{
+    // the radix sort against std::stable_sort, the items are the add order so ties show up as swapped items
+    void CheckStableSort(vks::DrawList& drawList, const std::vector<uint64_t>& keys)
+    {
+        drawList.Clear();
+        std::vector<vks::DrawList::Draw> expected;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(keys.size()); i++)
+        {
+            drawList.Add(keys[i], i);
+            expected.push_back({keys[i], i});
+        }
+        std::stable_sort(expected.begin(), expected.end(),
+                         [](const vks::DrawList::Draw& a, const vks::DrawList::Draw& b) { return a.key < b.key; });
+        drawList.Sort();
+
+        const std::vector<vks::DrawList::Draw>& draws = drawList.GetDraws();
+        CHECK(draws.size() == expected.size());
+        for (size_t i = 0; i < draws.size() && i < expected.size(); i++)
+        {
+            CHECK(draws[i].key == expected[i].key);
+            CHECK(draws[i].item == expected[i].item);
+        }
+    }
+
+    void TestStability()
+    {
+        tests::Random random(1);
+        vks::DrawList drawList;
+
+        // few materials and depths, most keys appear many times
+        std::vector<uint64_t> keys;
+        for (uint32_t i = 0; i < 5000; i++)
+            keys.push_back(vks::DrawList::OpaqueKey(random.Next() % 3, random.Next() % 17,
+                                                    static_cast<float>(random.Next() % 8)));
+        CheckStableSort(drawList, keys);
+
+        // every digit varies
+        keys.clear();
+        for (uint32_t i = 0; i < 5000; i++)
+            keys.push_back((static_cast<uint64_t>(random.Next()) << 32) | (random.Next() & 0xffff00ffu));
+        CheckStableSort(drawList, keys);
+
+        // the list is reused, the scratch buffer of the larger sort must not leak into a smaller one
+        CheckStableSort(drawList, {3, 1, 2, 1, 3});
+        CheckStableSort(drawList, {});
+        CheckStableSort(drawList, {42});
+    }
+
+    void TestSkippedDigits()
+    {
+        vks::DrawList drawList;
+        for (uint32_t i = 0; i < 100; i++)
+            drawList.Add(0x1234000000000000ull, i);
+        drawList.Sort();
+        CHECK(drawList.SortedDigitCount() == 0);
+        for (uint32_t i = 0; i < 100; i++)
+            CHECK(drawList.GetDraws()[i].item == i);
+
+        // only the lowest byte differs
+        drawList.Clear();
+        for (uint32_t i = 0; i < 100; i++)
+            drawList.Add(0x1234000000000000ull | (99 - i), i);
+        drawList.Sort();
+        CHECK(drawList.SortedDigitCount() == 1);
+        for (uint32_t i = 0; i < 100; i++)
+            CHECK(drawList.GetDraws()[i].item == 99 - i);
+    }
+
+    void TestKeyOrder()
+    {
+        using vks::DrawList;
+        // pipeline, then material, then front to back
+        CHECK(DrawList::OpaqueKey(0, 5, 100.0f) < DrawList::OpaqueKey(1, 0, 0.0f));
+        CHECK(DrawList::OpaqueKey(0, 1, 100.0f) < DrawList::OpaqueKey(0, 2, 0.0f));
+        CHECK(DrawList::OpaqueKey(0, 1, 1.0f) < DrawList::OpaqueKey(0, 1, 2.0f));
+        // behind the camera sorts like on it
+        CHECK(DrawList::OpaqueKey(0, 1, -5.0f) == DrawList::OpaqueKey(0, 1, 0.0f));
+        // blended after every opaque pipeline below 0xff, back to front
+        CHECK(DrawList::OpaqueKey(0xfe, 0xffffff, 1000.0f) < DrawList::BlendedKey(1000.0f));
+        CHECK(DrawList::BlendedKey(2.0f) < DrawList::BlendedKey(1.0f));
+    }
+}
+
+int main()
+{
+    TestStability();
+    TestSkippedDigits();
+    TestKeyOrder();
+    return tests::failureCount == 0 ? 0 : 1;
+}
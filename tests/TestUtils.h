@@ -0,0 +1,40 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace tests
+{
+    inline int failureCount = 0;
+
+    // deterministic inputs, every run checks the same cases
+    class Random
+    {
+    public:
+        explicit Random(uint32_t seed) : state(seed) {}
+        uint32_t Next()
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+        float Range(float min, float max)
+        {
+            return min + (max - min) * static_cast<float>(Next() & 0xffffff) / static_cast<float>(0xffffff);
+        }
+
+    private:
+        uint32_t state;
+    };
+}
+
+// reports a failed condition and keeps going, main fails when any check did
+#define CHECK(condition)                                                                  \
+    do                                                                                    \
+    {                                                                                     \
+        if (!(condition))                                                                 \
+        {                                                                                 \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);     \
+            tests::failureCount++;                                                        \
+        }                                                                                 \
+    } while (false)
@@ -0,0 +1,123 @@
+﻿#include <TransformHierarchy.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "TestUtils.h"
+
+namespace
+{
+    // relative to the entries, deep chains of scaled transforms reach large translations
+    bool Near(const glm::mat4& a, const glm::mat4& b)
+    {
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 4; row++)
+            {
+                const float scale = std::max(1.0f, std::max(std::abs(a[column][row]), std::abs(b[column][row])));
+                if (std::abs(a[column][row] - b[column][row]) > 1e-4f * scale)
+                    return false;
+            }
+        return true;
+    }
+
+    glm::quat RandomRotation(tests::Random& random)
+    {
+        return glm::normalize(glm::quat(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f),
+                                        random.Range(-1.0f, 1.0f)));
+    }
+
+    // every world matrix is its parent's times its local matrix
+    void CheckPropagation(const vks::TransformHierarchy& hierarchy)
+    {
+        for (uint32_t i = 0; i < hierarchy.Size(); i++)
+        {
+            const uint32_t parent = hierarchy.GetParent(i);
+            const glm::mat4 expected = parent == vks::TransformHierarchy::NO_PARENT
+                                           ? hierarchy.GetLocalMatrix(i)
+                                           : hierarchy.GetWorldMatrix(parent) * hierarchy.GetLocalMatrix(i);
+            CHECK(Near(hierarchy.GetWorldMatrix(i), expected));
+        }
+    }
+
+    void TestChain()
+    {
+        const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+        vks::TransformHierarchy hierarchy;
+        const uint32_t root = hierarchy.Add(vks::TransformHierarchy::NO_PARENT, glm::vec3(1.0f, 2.0f, 3.0f), identity,
+                                            glm::vec3(2.0f));
+        const uint32_t child = hierarchy.Add(root, glm::vec3(1.0f, 0.0f, 0.0f), identity, glm::vec3(1.0f));
+        const uint32_t sibling = hierarchy.Add(root, glm::vec3(0.0f, 1.0f, 0.0f), identity, glm::vec3(1.0f));
+        const uint32_t grandchild = hierarchy.Add(child, glm::vec3(0.0f, 0.0f, 1.0f), identity, glm::vec3(1.0f));
+        CHECK(hierarchy.Update() == 4);
+
+        // the root's scale applies to the offsets below it
+        CHECK(Near(hierarchy.GetWorldMatrix(grandchild), glm::mat4(glm::vec4(2.0f, 0.0f, 0.0f, 0.0f),
+                                                                   glm::vec4(0.0f, 2.0f, 0.0f, 0.0f),
+                                                                   glm::vec4(0.0f, 0.0f, 2.0f, 0.0f),
+                                                                   glm::vec4(3.0f, 2.0f, 5.0f, 1.0f))));
+        CheckPropagation(hierarchy);
+
+        // nothing changed, nothing written
+        CHECK(hierarchy.Update() == 0);
+
+        // a leaf only updates itself, an inner node its subtree
+        hierarchy.SetTranslation(sibling, glm::vec3(0.0f, 2.0f, 0.0f));
+        CHECK(hierarchy.Update() == 1);
+        hierarchy.SetRotation(child, glm::quat(std::cos(0.5f), 0.0f, std::sin(0.5f), 0.0f));
+        CHECK(hierarchy.Update() == 2);
+        CheckPropagation(hierarchy);
+        hierarchy.SetTranslation(root, glm::vec3(-1.0f, 0.0f, 0.0f));
+        CHECK(hierarchy.Update() == 4);
+        CheckPropagation(hierarchy);
+    }
+
+    // partial updates after random changes match recomputing everything
+    void TestPartialUpdate()
+    {
+        tests::Random random(7);
+        vks::TransformHierarchy hierarchy;
+        for (uint32_t i = 0; i < 500; i++)
+        {
+            const uint32_t parent = i == 0 ? vks::TransformHierarchy::NO_PARENT : random.Next() % i;
+            hierarchy.Add(parent, glm::vec3(random.Range(-2.0f, 2.0f), random.Range(-2.0f, 2.0f), random.Range(-2.0f, 2.0f)),
+                          RandomRotation(random), glm::vec3(random.Range(0.5f, 1.5f)));
+        }
+        hierarchy.Update();
+
+        for (uint32_t frame = 0; frame < 10; frame++)
+        {
+            for (uint32_t change = 0; change < 20; change++)
+            {
+                const uint32_t index = random.Next() % hierarchy.Size();
+                switch (random.Next() % 3)
+                {
+                case 0:
+                    hierarchy.SetTranslation(index, glm::vec3(random.Range(-2.0f, 2.0f), 0.0f, random.Range(-2.0f, 2.0f)));
+                    break;
+                case 1:
+                    hierarchy.SetRotation(index, RandomRotation(random));
+                    break;
+                default:
+                    hierarchy.SetScale(index, glm::vec3(random.Range(0.5f, 1.5f), 1.0f, random.Range(0.5f, 1.5f)));
+                    break;
+                }
+            }
+            hierarchy.Update();
+            std::vector<glm::mat4> partial;
+            for (uint32_t i = 0; i < hierarchy.Size(); i++)
+                partial.push_back(hierarchy.GetWorldMatrix(i));
+
+            hierarchy.UpdateAll();
+            for (uint32_t i = 0; i < hierarchy.Size(); i++)
+                CHECK(Near(partial[i], hierarchy.GetWorldMatrix(i)));
+            CheckPropagation(hierarchy);
+        }
+    }
+}
+
+int main()
+{
+    TestChain();
+    TestPartialUpdate();
+    return tests::failureCount == 0 ? 0 : 1;
+}